@@ -0,0 +1,589 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include <pthread.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __POPCNT__
+#include <nmmintrin.h>
+#endif
+
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+
+
+typedef struct ParityTask {
+    HISTOGRAM* histogram;
+    int first_slot;
+    int last_slot;
+    const BITSET_WORD* masks;
+    int mask_count;
+    int mask_words;
+    long* sums;
+} PARITY_TASK;
+
+typedef struct MarginalTask {
+    HISTOGRAM* histogram;
+    int first_slot;
+    int last_slot;
+    const int* bits;
+    int bit_count;
+    HISTOGRAM marginal;
+    int status;
+} MARGINAL_TASK;
+
+typedef struct BootstrapTask {
+    long plus_count;
+    long shots;
+    int first_resample;
+    int last_resample;
+    unsigned long long seed;
+    double* means;
+} BOOTSTRAP_TASK;
+
+
+/**
+ * @brief Add a Z-string observable to the analysis options
+ *
+ * The string holds one Z or I per bit, the rightmost character acting on
+ * bit 0, as in Qiskit.
+ *
+ * @param options Pointer to ANALYSIS_OPTIONS to update
+ * @param text Z-string such as "ZIZ"
+ * @return 0 on success, or -1 if the string is invalid or too many
+ *         observables are set
+ */
+int add_observable(ANALYSIS_OPTIONS* options, const char* text) {
+    size_t length = strlen(text);
+    if (length == 0 || length >= ANALYSIS_OBSERVABLE_NMEMB || strspn(text, "ZIzi") != length) return -1;
+    if (options->observable_count >= ANALYSIS_MAX_OBSERVABLES) return -1;
+
+    memcpy(options->observables[options->observable_count++], text, length+1);
+
+    return 0;
+}
+
+/**
+ * @brief Parse the bits kept by a marginal
+ *
+ * @param options Pointer to ANALYSIS_OPTIONS to update
+ * @param text Comma-separated bit indices such as "0,2", in the order they
+ *        appear in the marginal outcomes, least significant first
+ * @return 0 on success, or -1 if the list is invalid
+ */
+int parse_marginal_bits(ANALYSIS_OPTIONS* options, const char* text) {
+    int bit_count = 0;
+    const char* cursor = text;
+
+    while (true) {
+        char* end = NULL;
+        long bit = strtol(cursor, &end, 10);
+        if (end == cursor || bit < 0 || bit >= ANALYSIS_MAX_BIT_INDEX || bit_count >= ANALYSIS_MAX_MARGINAL_BITS) return -1;
+
+        options->marginal_bits[bit_count++] = (int)bit;
+
+        if (*end == '\0') break;
+        if (*end != ',') return -1;
+        cursor = end+1;
+    }
+
+    options->marginal_bit_count = bit_count;
+
+    return 0;
+}
+
+/**
+ * @brief Convert a Z-string into the mask of the bits it acts on
+ *
+ * @param text Z-string, rightmost character on bit 0
+ * @param words Output pointer receiving the number of words of the mask
+ * @return Newly allocated mask (CALLER MUST FREE), or NULL on failure
+ */
+BITSET_WORD* parse_z_string(const char* text, int* words) {
+    int length = (int)strlen(text);
+
+    *words = count_bitset_words(length);
+    BITSET_WORD* mask = (BITSET_WORD*)calloc(*words, sizeof(BITSET_WORD));
+    if (!mask) {
+        fprintf(stderr, "ERROR - Allocating memory for mask failed in parse_z_string()!\n");
+        return NULL;
+    }
+
+    for (int i = 0; i < length; i++) {
+        char op = text[length-1-i];
+        if (op == 'Z' || op == 'z') mask[i / BITSET_WORD_BITS] |= 1ULL << (i % BITSET_WORD_BITS);
+    }
+
+    return mask;
+}
+
+
+/**
+ * @brief Number of set bits of a word
+ *
+ * Uses the POPCNT instruction when the build targets it.
+ *
+ * @param word Word to count
+ * @return Number of set bits
+ */
+static inline int count_word_bits(BITSET_WORD word) {
+#ifdef __POPCNT__
+    return (int)_mm_popcnt_u64(word);
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+/**
+ * @brief Parity of the bits of a sample selected by a mask
+ *
+ * The masked words are folded with XOR first, two at a time with SSE2, so
+ * that a single popcount gives the parity of the whole sample.
+ *
+ * @param sample Packed sample
+ * @param mask Packed mask
+ * @param words Number of words of both
+ * @return 1 if an odd number of selected bits is set, 0 otherwise
+ */
+static inline int get_masked_parity(const BITSET_WORD* sample, const BITSET_WORD* mask, int words) {
+    BITSET_WORD folded = 0;
+    int i = 0;
+
+#ifdef __SSE2__
+    if (words >= 2) {
+        __m128i lanes = _mm_setzero_si128();
+        for (; i+2 <= words; i += 2) {
+            __m128i masked = _mm_and_si128(_mm_loadu_si128((const __m128i*)&sample[i]), _mm_loadu_si128((const __m128i*)&mask[i]));
+            lanes = _mm_xor_si128(lanes, masked);
+        }
+
+        BITSET_WORD halves[2];
+        _mm_storeu_si128((__m128i*)halves, lanes);
+        folded = halves[0] ^ halves[1];
+    }
+#endif
+
+    for (; i < words; i++) folded ^= sample[i] & mask[i];
+
+    return count_word_bits(folded) & 1;
+}
+
+/**
+ * @brief Choose how many threads share a piece of work
+ *
+ * ANALYSIS_THREADS_ENV, when set to a positive number, caps the threads
+ * below the number of CPUs, such as 1 to run every analysis serially.
+ *
+ * @param work Size of the work in slot operations
+ * @return Number of threads, between 1 and ANALYSIS_MAX_THREADS
+ */
+static int count_analysis_threads(long work) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    long threads = work / ANALYSIS_THREAD_WORK;
+
+    char* limit = getenv(ANALYSIS_THREADS_ENV);
+    if (limit && atol(limit) > 0 && atol(limit) < cpus) cpus = atol(limit);
+
+    if (threads > cpus) threads = cpus;
+    if (threads > ANALYSIS_MAX_THREADS) threads = ANALYSIS_MAX_THREADS;
+
+    return threads > 1 ? (int)threads : 1;
+}
+
+/**
+ * @brief Run one worker per task, the first on the calling thread
+ *
+ * A task whose thread cannot be started runs on the calling thread too.
+ *
+ * @param worker Thread function taking a pointer to one task
+ * @param tasks Array of tasks
+ * @param task_size Size of one task in bytes
+ * @param task_count Number of tasks, at most ANALYSIS_MAX_THREADS
+ */
+static void run_analysis_tasks(void* (*worker)(void*), void* tasks, size_t task_size, int task_count) {
+    pthread_t threads[ANALYSIS_MAX_THREADS];
+    bool started[ANALYSIS_MAX_THREADS] = {false};
+
+    for (int i = 1; i < task_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, worker, (char*)tasks + i*task_size) == 0;
+        if (!started[i]) worker((char*)tasks + i*task_size);
+    }
+
+    worker(tasks);
+
+    for (int i = 1; i < task_count; i++) {
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+
+    return;
+}
+
+
+/**
+ * @brief Sum the signed counts of a slice of the histogram for every mask
+ *
+ * @param arg Pointer to PARITY_TASK
+ * @return NULL
+ */
+static void* sum_parities(void* arg) {
+    PARITY_TASK* task = (PARITY_TASK*)arg;
+    HISTOGRAM* histogram = task->histogram;
+
+    // Bits beyond the narrower of sample and mask are zero on one side.
+
+    int words = histogram->words < task->mask_words ? histogram->words : task->mask_words;
+
+    for (int slot = task->first_slot; slot < task->last_slot; slot++) {
+        long count = histogram->counts[slot];
+        if (count == 0) continue;
+
+        const BITSET_WORD* sample = &histogram->samples[(size_t)slot*histogram->words];
+        for (int m = 0; m < task->mask_count; m++) {
+            if (get_masked_parity(sample, &task->masks[(size_t)m*task->mask_words], words)) task->sums[m] -= count;
+            else task->sums[m] += count;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Count a slice of the histogram into a partial marginal
+ *
+ * @param arg Pointer to MARGINAL_TASK
+ * @return NULL
+ */
+static void* count_marginal(void* arg) {
+    MARGINAL_TASK* task = (MARGINAL_TASK*)arg;
+    HISTOGRAM* histogram = task->histogram;
+
+    BITSET_WORD* sample = (BITSET_WORD*)malloc(task->marginal.words*sizeof(BITSET_WORD));
+    if (!sample) {
+        task->status = -1;
+        return NULL;
+    }
+
+    for (int slot = task->first_slot; slot < task->last_slot; slot++) {
+        long count = histogram->counts[slot];
+        if (count == 0) continue;
+
+        const BITSET_WORD* source = &histogram->samples[(size_t)slot*histogram->words];
+        memset(sample, 0, task->marginal.words*sizeof(BITSET_WORD));
+        for (int k = 0; k < task->bit_count; k++) {
+            if (get_bitset_bit(source, histogram->words, task->bits[k])) sample[k / BITSET_WORD_BITS] |= 1ULL << (k % BITSET_WORD_BITS);
+        }
+
+        if (add_count_to_histogram(&task->marginal, sample, count) < 0) {
+            task->status = -1;
+            break;
+        }
+    }
+
+    free(sample);
+
+    return NULL;
+}
+
+/**
+ * @brief Draw the means of a range of bootstrap resamples
+ *
+ * The statistic of a Z-string is the mean of +1 and -1 outcomes, so a
+ * multinomial resample of the histogram reduces to a binomial draw of the
+ * +1 count. Up to ANALYSIS_EXACT_SHOTS shots are drawn one by one; beyond
+ * that the binomial is replaced by its normal approximation. Every
+ * resample draws from its own generator state, derived from the seed and
+ * its index, so the means do not depend on how the resamples are split
+ * between threads.
+ *
+ * @param arg Pointer to BOOTSTRAP_TASK
+ * @return NULL
+ */
+static void* draw_resamples(void* arg) {
+    BOOTSTRAP_TASK* task = (BOOTSTRAP_TASK*)arg;
+    double p = (double)task->plus_count / (double)task->shots;
+
+    for (int r = task->first_resample; r < task->last_resample; r++) {
+        double plus = 0.0;
+
+        // The splitmix64 finalizer spreads neighbouring indices over the whole state space.
+
+        unsigned long long state = task->seed + (unsigned long long)r * 0x9E3779B97F4A7C15ULL;
+        state = (state ^ (state >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        state = (state ^ (state >> 27)) * 0x94D049BB133111EBULL;
+        state ^= state >> 31;
+        if (!state) state = 1;
+
+        if (task->shots <= ANALYSIS_EXACT_SHOTS) {
+            // A uniform double in [0, 1) is compared against p, so that p == 0 and p == 1 draw exactly.
+
+            long hits = 0;
+            for (long shot = 0; shot < task->shots; shot++) {
+                state ^= state >> 12;
+                state ^= state << 25;
+                state ^= state >> 27;
+                if (((state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) < p) hits++;
+            }
+            plus = (double)hits;
+        } else {
+            double u[2];
+            for (int i = 0; i < 2; i++) {
+                state ^= state >> 12;
+                state ^= state << 25;
+                state ^= state >> 27;
+                u[i] = ((state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+            }
+            double normal = sqrt(-2.0 * log(u[0] > 0.0 ? u[0] : 1e-300)) * cos(2.0 * M_PI * u[1]);
+            plus = task->shots * p + normal * sqrt(task->shots * p * (1.0-p));
+            if (plus < 0.0) plus = 0.0;
+            if (plus > task->shots) plus = task->shots;
+        }
+
+        task->means[r] = (2.0*plus - task->shots) / task->shots;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Order two doubles ascending (qsort callback)
+ *
+ * @param a Pointer to the first double
+ * @param b Pointer to the second double
+ * @return Negative, zero or positive as a is below, equal to or above b
+ */
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+/**
+ * @brief Marginalize a histogram onto a subset of its bits
+ *
+ * Bit k of every marginal outcome is bit bits[k] of the original outcome.
+ * Large histograms are split into slices counted by several threads, whose
+ * partial marginals are merged at the end.
+ *
+ * @param histogram Pointer to HISTOGRAM to marginalize
+ * @param bits Indices of the kept bits
+ * @param bit_count Number of kept bits
+ * @param marginal Pointer to HISTOGRAM initialized by this function
+ *        (CALLER MUST FREE with free_histogram())
+ * @return 0 on success, or -1 on failure
+ */
+int marginalize_histogram(HISTOGRAM* histogram, const int* bits, int bit_count, HISTOGRAM* marginal) {
+    int status = -1;
+
+    int thread_count = count_analysis_threads(histogram->capacity);
+    MARGINAL_TASK tasks[ANALYSIS_MAX_THREADS];
+    memset(tasks, 0, sizeof(tasks));
+
+    int initialized = 0;
+    for (; initialized < thread_count; initialized++) {
+        MARGINAL_TASK* task = &tasks[initialized];
+        task->histogram = histogram;
+        task->first_slot = (int)((long)histogram->capacity * initialized / thread_count);
+        task->last_slot = (int)((long)histogram->capacity * (initialized+1) / thread_count);
+        task->bits = bits;
+        task->bit_count = bit_count;
+        if (initialize_histogram(&task->marginal, bit_count) < 0) {
+            fprintf(stderr, "ERROR - Initializing a partial marginal failed in marginalize_histogram()!\n");
+            goto cleanup_tasks;
+        }
+    }
+
+    run_analysis_tasks(count_marginal, tasks, sizeof(MARGINAL_TASK), thread_count);
+
+    for (int i = 0; i < thread_count; i++) {
+        if (tasks[i].status < 0 || (i > 0 && merge_histogram(&tasks[0].marginal, &tasks[i].marginal) < 0)) {
+            fprintf(stderr, "ERROR - Counting the marginal failed in marginalize_histogram()!\n");
+            goto cleanup_tasks;
+        }
+    }
+
+    *marginal = tasks[0].marginal;
+    tasks[0].marginal.samples = NULL;
+    tasks[0].marginal.counts = NULL;
+    status = 0;
+
+cleanup_tasks:
+    for (int i = 0; i < initialized; i++) free_histogram(&tasks[i].marginal);
+
+    return status;
+}
+
+/**
+ * @brief Compute the expectation values of Z-string observables
+ *
+ * The expectation of a mask is the mean over all shots of +1 for an even
+ * and -1 for an odd number of set bits under the mask. Large histograms
+ * are split into slices summed by several threads.
+ *
+ * @param histogram Pointer to HISTOGRAM of the outcomes
+ * @param masks Masks of the observables, mask_words words each
+ * @param mask_count Number of observables
+ * @param mask_words Number of words of every mask
+ * @param expectations Output array receiving mask_count values
+ * @return 0 on success, or -1 on failure
+ */
+int compute_expectations(HISTOGRAM* histogram, const BITSET_WORD* masks, int mask_count, int mask_words, double* expectations) {
+    if (histogram->shots == 0) {
+        fprintf(stderr, "ERROR - The histogram holds no shots in compute_expectations()!\n");
+        return -1;
+    }
+
+    int thread_count = count_analysis_threads((long)histogram->capacity * mask_count);
+    long* sums = (long*)calloc((size_t)thread_count*mask_count, sizeof(long));
+    if (!sums) {
+        fprintf(stderr, "ERROR - Allocating memory for sums failed in compute_expectations()!\n");
+        return -1;
+    }
+
+    PARITY_TASK tasks[ANALYSIS_MAX_THREADS];
+    for (int i = 0; i < thread_count; i++) {
+        tasks[i].histogram = histogram;
+        tasks[i].first_slot = (int)((long)histogram->capacity * i / thread_count);
+        tasks[i].last_slot = (int)((long)histogram->capacity * (i+1) / thread_count);
+        tasks[i].masks = masks;
+        tasks[i].mask_count = mask_count;
+        tasks[i].mask_words = mask_words;
+        tasks[i].sums = &sums[(size_t)i*mask_count];
+    }
+
+    run_analysis_tasks(sum_parities, tasks, sizeof(PARITY_TASK), thread_count);
+
+    for (int m = 0; m < mask_count; m++) {
+        long sum = 0;
+        for (int i = 0; i < thread_count; i++) sum += sums[(size_t)i*mask_count+m];
+        expectations[m] = (double)sum / (double)histogram->shots;
+    }
+
+    free(sums);
+
+    return 0;
+}
+
+/**
+ * @brief Compute the connected correlations of every pair of bits
+ *
+ * Entry (i, j) is <Z_i Z_j> - <Z_i><Z_j>, so that the diagonal holds the
+ * variance of each bit and uncorrelated bits give 0.
+ *
+ * @param histogram Pointer to HISTOGRAM of the outcomes
+ * @param num_bits Number of bits, at most ANALYSIS_MAX_CORRELATION_BITS
+ * @return Newly allocated row-major num_bits x num_bits matrix
+ *         (CALLER MUST FREE), or NULL on failure
+ */
+double* compute_correlation_matrix(HISTOGRAM* histogram, int num_bits) {
+    if (num_bits < 1 || num_bits > ANALYSIS_MAX_CORRELATION_BITS) {
+        fprintf(stderr, "ERROR - Correlations of %d bits are not supported in compute_correlation_matrix()!\n", num_bits);
+        return NULL;
+    }
+
+    // One mask per bit followed by one per pair, all evaluated in a single pass.
+
+    int words = count_bitset_words(num_bits);
+    int mask_count = num_bits + num_bits*(num_bits-1)/2;
+    BITSET_WORD* masks = (BITSET_WORD*)calloc((size_t)mask_count*words, sizeof(BITSET_WORD));
+    double* expectations = (double*)malloc(mask_count*sizeof(double));
+    double* matrix = (double*)malloc((size_t)num_bits*num_bits*sizeof(double));
+    if (!masks || !expectations || !matrix) {
+        fprintf(stderr, "ERROR - Allocating memory for correlations failed in compute_correlation_matrix()!\n");
+        goto cleanup_matrix;
+    }
+
+    int m = num_bits;
+    for (int i = 0; i < num_bits; i++) {
+        masks[(size_t)i*words + i/BITSET_WORD_BITS] |= 1ULL << (i % BITSET_WORD_BITS);
+        for (int j = i+1; j < num_bits; j++, m++) {
+            masks[(size_t)m*words + i/BITSET_WORD_BITS] |= 1ULL << (i % BITSET_WORD_BITS);
+            masks[(size_t)m*words + j/BITSET_WORD_BITS] |= 1ULL << (j % BITSET_WORD_BITS);
+        }
+    }
+
+    if (compute_expectations(histogram, masks, mask_count, words, expectations) < 0) goto cleanup_matrix;
+
+    m = num_bits;
+    for (int i = 0; i < num_bits; i++) {
+        matrix[(size_t)i*num_bits+i] = 1.0 - expectations[i]*expectations[i];
+        for (int j = i+1; j < num_bits; j++, m++) {
+            double correlation = expectations[m] - expectations[i]*expectations[j];
+            matrix[(size_t)i*num_bits+j] = correlation;
+            matrix[(size_t)j*num_bits+i] = correlation;
+        }
+    }
+
+    free(masks);
+    free(expectations);
+
+    return matrix;
+
+cleanup_matrix:
+    free(masks);
+    free(expectations);
+    free(matrix);
+
+    return NULL;
+}
+
+/**
+ * @brief Bootstrap a confidence interval of a Z-string expectation value
+ *
+ * The shots are resampled with replacement, the resamples being drawn by
+ * several threads, and the interval is read from the percentiles of the
+ * resampled expectations. The same seed gives the same interval whatever
+ * the number of threads.
+ *
+ * @param histogram Pointer to HISTOGRAM of the outcomes
+ * @param mask Mask of the observable
+ * @param mask_words Number of words of the mask
+ * @param resamples Number of resamples
+ * @param confidence Confidence level, such as 0.95
+ * @param seed Seed of the resampling, so that intervals are reproducible
+ * @param lower Output pointer receiving the lower bound
+ * @param upper Output pointer receiving the upper bound
+ * @return 0 on success, or -1 on failure
+ */
+int bootstrap_expectation(HISTOGRAM* histogram, const BITSET_WORD* mask, int mask_words, int resamples, double confidence, unsigned long long seed, double* lower, double* upper) {
+    double expectation = 0.0;
+    if (resamples < 1 || compute_expectations(histogram, mask, 1, mask_words, &expectation) < 0) return -1;
+
+    double* means = (double*)malloc(resamples*sizeof(double));
+    if (!means) {
+        fprintf(stderr, "ERROR - Allocating memory for resamples failed in bootstrap_expectation()!\n");
+        return -1;
+    }
+
+    long shots = histogram->shots;
+    long draws = shots <= ANALYSIS_EXACT_SHOTS ? shots : 1;
+    int thread_count = count_analysis_threads(draws * resamples);
+
+    BOOTSTRAP_TASK tasks[ANALYSIS_MAX_THREADS];
+    for (int i = 0; i < thread_count; i++) {
+        tasks[i].plus_count = lround((1.0+expectation) * shots / 2.0);
+        tasks[i].shots = shots;
+        tasks[i].first_resample = (int)((long)resamples * i / thread_count);
+        tasks[i].last_resample = (int)((long)resamples * (i+1) / thread_count);
+        tasks[i].seed = seed;
+        tasks[i].means = means;
+    }
+
+    run_analysis_tasks(draw_resamples, tasks, sizeof(BOOTSTRAP_TASK), thread_count);
+
+    qsort(means, resamples, sizeof(double), compare_doubles);
+    *lower = means[(int)floor((1.0-confidence) / 2.0 * (resamples-1))];
+    *upper = means[(int)ceil((1.0+confidence) / 2.0 * (resamples-1))];
+
+    free(means);
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef _ANALYSIS_H_
+#define _ANALYSIS_H_
+
+#define ANALYSIS_MAX_OBSERVABLES 16
+#define ANALYSIS_OBSERVABLE_NMEMB 256
+#define ANALYSIS_MAX_MARGINAL_BITS 64
+#define ANALYSIS_MAX_CORRELATION_BITS 128
+#define ANALYSIS_MAX_BIT_INDEX (1 << 16)
+#define ANALYSIS_MAX_THREADS 8
+#define ANALYSIS_THREAD_WORK (1L << 16)
+#define ANALYSIS_RESAMPLES 1000
+#define ANALYSIS_CONFIDENCE 0.95
+#define ANALYSIS_EXACT_SHOTS (1L << 16)
+#define ANALYSIS_THREADS_ENV "QUANTUMC_ANALYSIS_THREADS"
+
+typedef struct AnalysisOptions {
+    char observables[ANALYSIS_MAX_OBSERVABLES][ANALYSIS_OBSERVABLE_NMEMB];
+    int observable_count;
+    int marginal_bits[ANALYSIS_MAX_MARGINAL_BITS];
+    int marginal_bit_count;
+    bool correlations;
+    int resamples;
+} ANALYSIS_OPTIONS;
+
+int add_observable(ANALYSIS_OPTIONS* options, const char* text);
+int parse_marginal_bits(ANALYSIS_OPTIONS* options, const char* text);
+BITSET_WORD* parse_z_string(const char* text, int* words);
+
+int marginalize_histogram(HISTOGRAM* histogram, const int* bits, int bit_count, HISTOGRAM* marginal);
+int compute_expectations(HISTOGRAM* histogram, const BITSET_WORD* masks, int mask_count, int mask_words, double* expectations);
+double* compute_correlation_matrix(HISTOGRAM* histogram, int num_bits);
+int bootstrap_expectation(HISTOGRAM* histogram, const BITSET_WORD* mask, int mask_words, int resamples, double confidence, unsigned long long seed, double* lower, double* upper);
+
+#endif
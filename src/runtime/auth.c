@@ -10,27 +10,29 @@
 #include <cjson/cJSON.h>
 #include <pthread.h>
 
+#include "metrics.h"
 #include "comm.h"
+#include "cache.h"
 #include "auth.h"
 
 
 /**
  * @brief Obtain a bearer token from IBM IAM
  *
- * Calls the IAM token endpoint using the API key stored in token_data and
- * accumulates the HTTP response body.
+ * Calls the IAM token endpoint using the API key stored in the pool's token
+ * data and accumulates the HTTP response body.
  *
- * @param token_data Pointer to TOKEN_DATA containing the API key and token
+ * @param pool Pointer to CONNECTION_POOL providing the handle and API key
  * @return Newly allocated response body string on success (CALLER MUST FREE),
  *         or NULL on failure
  */
-char* get_bearer_token(TOKEN_DATA* token_data) {
+char* get_bearer_token(CONNECTION_POOL* pool) {
     char* response = NULL;
-    char* key = token_data->key;
+    char* key = pool->token_data->key;
     
-    CURL* curl = curl_easy_init();
+    CURL* curl = acquire_handle(pool);
     if (!curl) {
-        fprintf(stderr, "ERROR - cURL initialization failed in get_bearer_token()!\n");
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in get_bearer_token()!\n");
         goto terminate;
     }
 
@@ -60,17 +62,17 @@ char* get_bearer_token(TOKEN_DATA* token_data) {
         goto cleanup_payload;
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, "https://iam.cloud.ibm.com/identity/token");
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/identity/token", pool->iam_url);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT_NAME);
 
-    CURLcode response_code = curl_easy_perform(curl);
     long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    CURLcode response_code = perform_request(pool, curl, PHASE_TOKEN, false, &rb, &http_code);
     if (response_code != CURLE_OK || http_code >= 400) {
         fprintf(stderr, "ERROR - Authentication request failed in get_bearer_token()!\n");
         fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
@@ -93,7 +95,7 @@ cleanup_rb:
     free(rb.data);
 
 cleanup_curl:
-    curl_easy_cleanup(curl);
+    release_handle(pool, curl);
 
 terminate:
     return response;
@@ -112,6 +114,7 @@ void update_bearer_token(TOKEN_DATA* token_data, char* token) {
     pthread_mutex_lock(&token_data->lock);
     free(token_data->token);
     token_data->token = strdup(token);
+    token_data->token_version++;
     pthread_mutex_unlock(&token_data->lock);
 
     return;
@@ -163,35 +166,177 @@ terminate:
 }
 
 
+/**
+ * @brief Resolve the token cache file of the API key
+ *
+ * The file name is derived from a hash of the API key and the IAM URL, so
+ * that processes sharing a key share the token while different keys or
+ * token services never mix.
+ *
+ * @param pool Pointer to CONNECTION_POOL holding the API key and IAM URL
+ * @return Newly allocated path (CALLER MUST FREE), or NULL if no cache
+ *         directory is available
+ */
+static char* get_token_cache_path(CONNECTION_POOL* pool) {
+    char name[TOKEN_CACHE_NMEMB];
+    snprintf(name, TOKEN_CACHE_NMEMB, "token-%016llx.json", hash_append(hash_string(pool->token_data->key), pool->iam_url));
+
+    return get_cache_path(name);
+}
+
+/**
+ * @brief Load a bearer token from the token cache
+ *
+ * The cached token is only taken when it stays valid for longer than
+ * OFFSET_TIME, since the authenticator would refresh it right away
+ * otherwise.
+ *
+ * @param token_data Pointer to TOKEN_DATA to update
+ * @param cache_path Path of the token cache file
+ * @return Remaining lifetime in seconds, or -1 if the cache holds no usable
+ *         token
+ */
+int load_cached_token(TOKEN_DATA* token_data, char* cache_path) {
+    int expiration_time = -1;
+
+    char* cached_data = read_cache_file(cache_path);
+    if (!cached_data) goto terminate;
+
+    cJSON* cached_cjson = cJSON_Parse(cached_data);
+    if (!cached_cjson) goto cleanup_cached_data;
+
+    cJSON* token_cjson = cJSON_GetObjectItemCaseSensitive(cached_cjson, "access_token");
+    cJSON* expires_at_cjson = cJSON_GetObjectItemCaseSensitive(cached_cjson, "expires_at");
+    if (!cJSON_IsString(token_cjson) || !token_cjson->valuestring || !cJSON_IsNumber(expires_at_cjson)) goto cleanup_cached_cjson;
+
+    double remaining = difftime((time_t)expires_at_cjson->valuedouble, time(NULL));
+    if (remaining <= OFFSET_TIME) goto cleanup_cached_cjson;
+
+    update_bearer_token(token_data, token_cjson->valuestring);
+    expiration_time = (int)remaining;
+
+cleanup_cached_cjson:
+    cJSON_Delete(cached_cjson);
+
+cleanup_cached_data:
+    free(cached_data);
+
+terminate:
+    return expiration_time;
+}
+
+/**
+ * @brief Store the current bearer token in the token cache
+ *
+ * @param token_data Pointer to TOKEN_DATA holding the token
+ * @param cache_path Path of the token cache file
+ * @param expiration_time Lifetime of the token in seconds
+ */
+void store_cached_token(TOKEN_DATA* token_data, char* cache_path, int expiration_time) {
+    char* token = copy_bearer_token(token_data);
+    if (!token) goto terminate;
+
+    cJSON* cached_cjson = cJSON_CreateObject();
+    if (!cached_cjson) {
+        fprintf(stderr, "ERROR - Creating token cache JSON failed in store_cached_token()!\n");
+        goto cleanup_token;
+    }
+
+    if (!cJSON_AddStringToObject(cached_cjson, "access_token", token) ||
+        !cJSON_AddNumberToObject(cached_cjson, "expires_at", (double)(time(NULL) + expiration_time))) {
+        fprintf(stderr, "ERROR - Building token cache JSON failed in store_cached_token()!\n");
+        goto cleanup_cached_cjson;
+    }
+
+    char* cached_data = cJSON_PrintUnformatted(cached_cjson);
+    if (!cached_data) {
+        fprintf(stderr, "ERROR - Printing token cache JSON failed in store_cached_token()!\n");
+        goto cleanup_cached_cjson;
+    }
+
+    if (write_cache_file(cache_path, cached_data) < 0) {
+        fprintf(stderr, "ERROR - Writing the token cache failed in store_cached_token()!\n");
+    }
+
+    free(cached_data);
+
+cleanup_cached_cjson:
+    cJSON_Delete(cached_cjson);
+
+cleanup_token:
+    free(token);
+
+terminate:
+    return;
+}
+
+/**
+ * @brief Obtain a bearer token, from the token cache when possible
+ *
+ * Holds the token cache lock while checking the cache and fetching, so that
+ * when several processes start or refresh at once only one of them asks
+ * IAM and the others pick up its token.
+ *
+ * @param pool Pointer to CONNECTION_POOL providing the handle and API key
+ * @param cache_path Path of the token cache file, or NULL to always fetch
+ * @return Remaining lifetime of the token in seconds, or -1 on failure
+ */
+int refresh_bearer_token(CONNECTION_POOL* pool, char* cache_path) {
+    TOKEN_DATA* token_data = pool->token_data;
+    int expiration_time = -1;
+
+    int lock_fd = -1;
+    if (cache_path) {
+        lock_fd = lock_cache_file(cache_path);
+        expiration_time = load_cached_token(token_data, cache_path);
+        if (expiration_time >= 0) goto cleanup_lock;
+    }
+
+    char* response = get_bearer_token(pool);
+    if (!response) {
+        fprintf(stderr, "ERROR - Obtaining bearer token failed in refresh_bearer_token()!\n");
+        goto cleanup_lock;
+    }
+
+    expiration_time = parse_bearer_token(token_data, response);
+    if (cache_path && expiration_time > OFFSET_TIME) store_cached_token(token_data, cache_path, expiration_time);
+
+    free(response);
+
+cleanup_lock:
+    unlock_cache_file(lock_fd);
+
+    return expiration_time;
+}
+
+
 /**
  * @brief Authenticator thread that refreshes the bearer token
  *
  * Entry point for the authenticator thread. Obtains the initial bearer
- * token, signals waiting threads, and refreshes the token before expiration
- * in a loop until job termination is requested.
+ * token, from the token cache when another process left a valid one there,
+ * signals waiting threads, and refreshes the token before expiration in a
+ * loop until job termination is requested.
  *
- * @param arg Pointer to TOKEN_DATA passed to the thread
+ * @param arg Pointer to CONNECTION_POOL passed to the thread
  * @return Thread exit value (returns NULL, pthread_exit used)
  */
 void* authenticator(void* arg) {
-    TOKEN_DATA* token_data = (TOKEN_DATA*)arg;
+    CONNECTION_POOL* pool = (CONNECTION_POOL*)arg;
+    TOKEN_DATA* token_data = pool->token_data;
     long termination_status = EXIT_FAILURE;
 
-    // Obtain the first token.
+    // Obtain the first token. Without a cache directory every token is fetched.
 
-    char* response = get_bearer_token(token_data);
-    if (!response) {
-        fprintf(stderr, "ERROR - Obtaining bearer token failed in authenticator()!\n");
-        goto terminate;
-    }
+    char* cache_path = get_token_cache_path(pool);
 
-    int expiration_time = parse_bearer_token(token_data, response);
+    int expiration_time = refresh_bearer_token(pool, cache_path);
     if (expiration_time < 0) {
-        fprintf(stderr, "ERROR - Parsing bearer token failed in authenticator()!\n");
-        goto cleanup_response;
+        fprintf(stderr, "ERROR - Obtaining bearer token failed in authenticator()!\n");
+        goto cleanup_cache_path;
     } else if (expiration_time < OFFSET_TIME) {
         fprintf(stderr, "ERROR - The given expiration time (%d seconds) is less than the offset (%d seconds) in authenticator()!\n", expiration_time, OFFSET_TIME);
-        goto cleanup_response;
+        goto cleanup_cache_path;
     }
 
     // Signal that the first token was received to start sending the job.
@@ -233,14 +378,13 @@ void* authenticator(void* arg) {
             break;
         }
 
-        // Get a new token since the previous token just got expired.
+        // Get a new token since the previous token is about to expire.
+        // Another process may already have refreshed it in the token cache.
 
         if (wait_result == ETIMEDOUT) {
             pthread_mutex_unlock(&token_data->lock);
-            char* response = get_bearer_token(token_data);
-            expiration_time = parse_bearer_token(token_data, response);
+            expiration_time = refresh_bearer_token(pool, cache_path);
             pthread_mutex_lock(&token_data->lock);
-            free(response);
         }
 
         pthread_mutex_unlock(&token_data->lock);
@@ -248,10 +392,13 @@ void* authenticator(void* arg) {
 
     termination_status = EXIT_SUCCESS;
 
-cleanup_response:
-    free(response);
+cleanup_cache_path:
+    free(cache_path);
+
+    // Threads still waiting for the first token give up instead of waiting forever.
+
+    if (termination_status != EXIT_SUCCESS) signal_token_failed(token_data);
 
-terminate:
     pthread_exit((void*)termination_status);
 
     return NULL;
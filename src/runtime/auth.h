@@ -2,11 +2,16 @@
 #define _AUTH_H_
 
 #define OFFSET_TIME 300
+#define TOKEN_CACHE_NMEMB 64
 
-char* get_bearer_token(TOKEN_DATA* token_data);
+char* get_bearer_token(CONNECTION_POOL* pool);
 void update_bearer_token(TOKEN_DATA* token_data, char* token);
 int parse_bearer_token(TOKEN_DATA* token_data, char* response);
 
+int load_cached_token(TOKEN_DATA* token_data, char* cache_path);
+void store_cached_token(TOKEN_DATA* token_data, char* cache_path, int expiration_time);
+int refresh_bearer_token(CONNECTION_POOL* pool, char* cache_path);
+
 void* authenticator(void* arg);
 
 #endif
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "cache.h"
+#include "backends.h"
+#include "sender.h"
+
+
+/**
+ * @brief Create the on-disk cache of the backend list
+ *
+ * The cache file is specific to the service instance (CRN) and API URL of
+ * the pool.
+ *
+ * @param pool Pointer to CONNECTION_POOL used to refresh the list
+ * @param ttl Seconds the cached list is used without refreshing, 0 to
+ *        disable the cache, or a negative value for BACKEND_CACHE_TTL
+ * @return Pointer to newly allocated BACKEND_CACHE (CALLER MUST DESTROY),
+ *         or NULL on failure
+ */
+BACKEND_CACHE* create_backend_cache(CONNECTION_POOL* pool, int ttl) {
+    BACKEND_CACHE* cache = (BACKEND_CACHE*)calloc(1, sizeof(BACKEND_CACHE));
+    if (!cache) {
+        fprintf(stderr, "ERROR - Allocating memory for backend cache failed in create_backend_cache()!\n");
+        goto terminate;
+    }
+
+    cache->pool = pool;
+    cache->ttl = ttl < 0 ? BACKEND_CACHE_TTL : ttl;
+    pthread_mutex_init(&cache->lock, NULL);
+
+    if (cache->ttl > 0) {
+        char name[BACKEND_CACHE_NMEMB];
+        snprintf(name, BACKEND_CACHE_NMEMB, "backends-%016llx.json", hash_append(hash_string(pool->crn), pool->api_url));
+
+        // Without a cache directory every run simply fetches the list.
+
+        cache->path = get_cache_path(name);
+    }
+
+terminate:
+    return cache;
+}
+
+/**
+ * @brief Destroy the backend cache, waiting for a background refresh
+ *
+ * The refresh is told to stop first, so that it skips the properties it
+ * has not fetched yet and only the request in progress is waited for.
+ *
+ * @param cache Pointer to BACKEND_CACHE to destroy
+ */
+void destroy_backend_cache(BACKEND_CACHE* cache) {
+    if (!cache) return;
+
+    pthread_mutex_lock(&cache->lock);
+    cache->stopping = true;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (cache->refreshing) pthread_join(cache->refresh_thread, NULL);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->path);
+    free(cache);
+
+    return;
+}
+
+
+/**
+ * @brief Age of cached backend data
+ *
+ * @param cached_data JSON string read from the cache, with a fetched_at field
+ * @return Age in seconds, or -1 if the data has no valid timestamp
+ */
+static double get_cache_age(char* cached_data) {
+    double age = -1;
+
+    cJSON* cached_cjson = cJSON_Parse(cached_data);
+    if (!cached_cjson) goto terminate;
+
+    cJSON* fetched_at_cjson = cJSON_GetObjectItemCaseSensitive(cached_cjson, "fetched_at");
+    if (cJSON_IsNumber(fetched_at_cjson)) {
+        age = difftime(time(NULL), (time_t)fetched_at_cjson->valuedouble);
+    }
+
+    cJSON_Delete(cached_cjson);
+
+terminate:
+    return age;
+}
+
+/**
+ * @brief Accumulate the valid values of one named error parameter
+ *
+ * @param parameters_cjson Array of {"name", "value"} objects
+ * @param name Name of the parameter to accumulate
+ * @param sum Accumulated sum, updated in place
+ * @param count Number of accumulated values, updated in place
+ */
+static void accumulate_error(cJSON* parameters_cjson, const char* name, double* sum, int* count) {
+    for (cJSON* parameter_cjson = parameters_cjson ? parameters_cjson->child : NULL; parameter_cjson; parameter_cjson = parameter_cjson->next) {
+        cJSON* name_cjson = cJSON_GetObjectItemCaseSensitive(parameter_cjson, "name");
+        cJSON* value_cjson = cJSON_GetObjectItemCaseSensitive(parameter_cjson, "value");
+        if (!cJSON_IsString(name_cjson) || strcmp(name_cjson->valuestring, name) != 0 || !cJSON_IsNumber(value_cjson)) continue;
+
+        // An error rate of 1 marks a qubit or gate that is out of service.
+
+        if (0 <= value_cjson->valuedouble && value_cjson->valuedouble < 1) {
+            *sum += value_cjson->valuedouble;
+            (*count)++;
+        }
+    }
+
+    return;
+}
+
+/**
+ * @brief Reduce a backend properties response to its average error rates
+ *
+ * Averages the readout error over the qubits and the gate error over the
+ * two-qubit gates of the latest calibration.
+ *
+ * @param properties_data JSON string returned by the properties endpoint
+ * @return JSON string with fetched_at, two_q_error and readout_error
+ *         (CALLER MUST FREE), or NULL on failure
+ */
+char* summarize_properties_data(char* properties_data) {
+    char* summary_data = NULL;
+
+    cJSON* properties_cjson = cJSON_Parse(properties_data);
+    if (!properties_cjson) {
+        fprintf(stderr, "ERROR - Parsing backend properties JSON failed in summarize_properties_data()!\n");
+        goto terminate;
+    }
+
+    double readout_sum = 0;
+    int readout_count = 0;
+    cJSON* qubits_cjson = cJSON_GetObjectItemCaseSensitive(properties_cjson, "qubits");
+    for (cJSON* qubit_cjson = cJSON_IsArray(qubits_cjson) ? qubits_cjson->child : NULL; qubit_cjson; qubit_cjson = qubit_cjson->next) {
+        accumulate_error(qubit_cjson, "readout_error", &readout_sum, &readout_count);
+    }
+
+    double two_q_sum = 0;
+    int two_q_count = 0;
+    cJSON* gates_cjson = cJSON_GetObjectItemCaseSensitive(properties_cjson, "gates");
+    for (cJSON* gate_cjson = cJSON_IsArray(gates_cjson) ? gates_cjson->child : NULL; gate_cjson; gate_cjson = gate_cjson->next) {
+        cJSON* gate_qubits_cjson = cJSON_GetObjectItemCaseSensitive(gate_cjson, "qubits");
+        if (cJSON_GetArraySize(gate_qubits_cjson) != 2) continue;
+
+        accumulate_error(cJSON_GetObjectItemCaseSensitive(gate_cjson, "parameters"), "gate_error", &two_q_sum, &two_q_count);
+    }
+
+    cJSON* summary_cjson = cJSON_CreateObject();
+    if (!summary_cjson) {
+        fprintf(stderr, "ERROR - Creating backend properties summary failed in summarize_properties_data()!\n");
+        goto cleanup_properties_cjson;
+    }
+
+    cJSON_AddNumberToObject(summary_cjson, "fetched_at", (double)time(NULL));
+    if (two_q_count > 0) cJSON_AddNumberToObject(summary_cjson, "two_q_error", two_q_sum / two_q_count);
+    if (readout_count > 0) cJSON_AddNumberToObject(summary_cjson, "readout_error", readout_sum / readout_count);
+
+    summary_data = cJSON_PrintUnformatted(summary_cjson);
+    if (!summary_data) {
+        fprintf(stderr, "ERROR - Printing backend properties summary failed in summarize_properties_data()!\n");
+    }
+
+    cJSON_Delete(summary_cjson);
+
+cleanup_properties_cjson:
+    cJSON_Delete(properties_cjson);
+
+terminate:
+    return summary_data;
+}
+
+/**
+ * @brief Get the summarized properties of one backend, from the cache when possible
+ *
+ * Calibration changes far less often than queue lengths, so the summaries
+ * are cached per backend for BACKEND_PROPERTIES_TTL. When a refresh fails,
+ * or is left to a background refresh, an older summary is still better
+ * than none.
+ *
+ * @param cache Pointer to BACKEND_CACHE
+ * @param backend Backend name
+ * @param fetch Whether to fetch a missing or expired summary from the API
+ * @param stale Output pointer set to true when the summary is missing or
+ *        expired and was not fetched, or NULL
+ * @return Parsed summary (CALLER MUST DELETE with cJSON_Delete), or NULL if
+ *         no properties are available
+ */
+static cJSON* get_backend_properties(BACKEND_CACHE* cache, char* backend, bool fetch, bool* stale) {
+    cJSON* summary_cjson = NULL;
+
+    // The name becomes part of a URL and a file name.
+
+    if (strspn(backend, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") != strlen(backend)) goto terminate;
+
+    char name[BACKEND_CACHE_NMEMB];
+    snprintf(name, BACKEND_CACHE_NMEMB, "properties-%016llx-%s.json", hash_append(hash_string(cache->pool->crn), cache->pool->api_url), backend);
+
+    char* path = get_cache_path(name);
+    char* summary_data = path ? read_cache_file(path) : NULL;
+    double age = summary_data ? get_cache_age(summary_data) : -1;
+
+    bool expired = age < 0 || age >= BACKEND_PROPERTIES_TTL;
+    if (expired && !fetch) {
+        if (stale) *stale = true;
+    } else if (expired) {
+        char* properties_data = get_backend_properties_data(cache->pool, backend);
+        char* fresh_data = properties_data ? summarize_properties_data(properties_data) : NULL;
+
+        if (fresh_data) {
+            if (path && write_cache_file(path, fresh_data) < 0) {
+                fprintf(stderr, "ERROR - Writing the properties cache of %s failed in get_backend_properties()!\n", backend);
+            }
+            free(summary_data);
+            summary_data = fresh_data;
+        }
+
+        free(properties_data);
+    }
+
+    if (summary_data) summary_cjson = cJSON_Parse(summary_data);
+
+    free(summary_data);
+    free(path);
+
+terminate:
+    return summary_cjson;
+}
+
+/**
+ * @brief Reduce a /backends response to what backend selection needs
+ *
+ * Keeps the name, queue length, status and qubit count of every device,
+ * adds the average error rates of every online device from its cached
+ * calibration properties, and records the time the list was fetched, so
+ * that the cached copy is small and quick to parse. A device without
+ * properties is scored with the default error rates.
+ *
+ * @param cache Pointer to BACKEND_CACHE used for the properties
+ * @param backends_data JSON string returned by the /backends endpoint
+ * @param fetch_properties Whether to fetch missing or expired properties
+ *        from the API, one request per device, until the cache is
+ *        destroyed
+ * @param stale_properties Output pointer set to true when some properties
+ *        were missing or expired and not fetched, or NULL
+ * @return Compact JSON string (CALLER MUST FREE) or NULL on failure
+ */
+char* compact_backends_data(BACKEND_CACHE* cache, char* backends_data, bool fetch_properties, bool* stale_properties) {
+    char* compact_data = NULL;
+
+    cJSON* backends_data_cjson = cJSON_Parse(backends_data);
+    if (!backends_data_cjson) {
+        fprintf(stderr, "ERROR - Parsing backends data JSON failed in compact_backends_data()!\n");
+        goto terminate;
+    }
+
+    cJSON* devices_cjson = cJSON_GetObjectItemCaseSensitive(backends_data_cjson, "devices");
+    if (!cJSON_IsArray(devices_cjson)) {
+        fprintf(stderr, "ERROR - Parsing devices list failed in compact_backends_data()!\n");
+        goto cleanup_backends_data_cjson;
+    }
+
+    cJSON* compact_cjson = cJSON_CreateObject();
+    if (!compact_cjson) {
+        fprintf(stderr, "ERROR - Creating compact backends JSON failed in compact_backends_data()!\n");
+        goto cleanup_backends_data_cjson;
+    }
+
+    cJSON_AddNumberToObject(compact_cjson, "fetched_at", (double)time(NULL));
+
+    cJSON* compact_devices_cjson = cJSON_AddArrayToObject(compact_cjson, "devices");
+    if (!compact_devices_cjson) {
+        fprintf(stderr, "ERROR - Creating compact devices list failed in compact_backends_data()!\n");
+        goto cleanup_compact_cjson;
+    }
+
+    for (cJSON* device_cjson = devices_cjson->child; device_cjson; device_cjson = device_cjson->next) {
+        cJSON* name_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "name");
+        cJSON* queue_length_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "queue_length");
+
+        cJSON* compact_device_cjson = cJSON_CreateObject();
+        if (!compact_device_cjson) {
+            fprintf(stderr, "ERROR - Creating compact device JSON failed in compact_backends_data()!\n");
+            goto cleanup_compact_cjson;
+        }
+        cJSON_AddItemToArray(compact_devices_cjson, compact_device_cjson);
+
+        if (cJSON_IsString(name_cjson)) cJSON_AddStringToObject(compact_device_cjson, "name", name_cjson->valuestring);
+        if (cJSON_IsNumber(queue_length_cjson)) cJSON_AddNumberToObject(compact_device_cjson, "queue_length", queue_length_cjson->valuedouble);
+
+        // The status is either a plain string or an object with a name.
+
+        cJSON* status_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "status");
+        if (cJSON_IsObject(status_cjson)) status_cjson = cJSON_GetObjectItemCaseSensitive(status_cjson, "name");
+        if (cJSON_IsString(status_cjson)) cJSON_AddStringToObject(compact_device_cjson, "status", status_cjson->valuestring);
+
+        cJSON* qubits_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "qubits");
+        if (!cJSON_IsNumber(qubits_cjson)) qubits_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "n_qubits");
+        if (cJSON_IsNumber(qubits_cjson)) cJSON_AddNumberToObject(compact_device_cjson, "num_qubits", qubits_cjson->valuedouble);
+
+        bool online = !cJSON_IsString(status_cjson) || strcmp(status_cjson->valuestring, "online") == 0;
+        if (!online || !cJSON_IsString(name_cjson)) continue;
+
+        // A cache being destroyed leaves the remaining properties to a later refresh.
+
+        pthread_mutex_lock(&cache->lock);
+        bool fetch = fetch_properties && !cache->stopping;
+        pthread_mutex_unlock(&cache->lock);
+
+        cJSON* properties_cjson = get_backend_properties(cache, name_cjson->valuestring, fetch, stale_properties);
+        if (!properties_cjson) continue;
+
+        cJSON* two_q_error_cjson = cJSON_GetObjectItemCaseSensitive(properties_cjson, "two_q_error");
+        cJSON* readout_error_cjson = cJSON_GetObjectItemCaseSensitive(properties_cjson, "readout_error");
+        if (cJSON_IsNumber(two_q_error_cjson)) cJSON_AddNumberToObject(compact_device_cjson, "two_q_error", two_q_error_cjson->valuedouble);
+        if (cJSON_IsNumber(readout_error_cjson)) cJSON_AddNumberToObject(compact_device_cjson, "readout_error", readout_error_cjson->valuedouble);
+
+        cJSON_Delete(properties_cjson);
+    }
+
+    compact_data = cJSON_PrintUnformatted(compact_cjson);
+    if (!compact_data) {
+        fprintf(stderr, "ERROR - Printing compact backends JSON failed in compact_backends_data()!\n");
+    }
+
+cleanup_compact_cjson:
+    cJSON_Delete(compact_cjson);
+
+cleanup_backends_data_cjson:
+    cJSON_Delete(backends_data_cjson);
+
+terminate:
+    return compact_data;
+}
+
+/**
+ * @brief Fetch the backend list from the API and store it in the cache
+ *
+ * Waits for the first bearer token before issuing the request.
+ *
+ * @param cache Pointer to BACKEND_CACHE to refresh
+ * @param fetch_properties Whether to fetch missing or expired calibration
+ *        properties as well
+ * @param stale_properties Output pointer set to true when some properties
+ *        were missing or expired and not fetched, or NULL
+ * @return Compact JSON string (CALLER MUST FREE) or NULL on failure
+ */
+static char* refresh_backend_list(BACKEND_CACHE* cache, bool fetch_properties, bool* stale_properties) {
+    char* compact_data = NULL;
+
+    if (wait_for_token(cache->pool->token_data) < 0) {
+        fprintf(stderr, "ERROR - No bearer token is available in refresh_backend_list()!\n");
+        goto terminate;
+    }
+
+    char* backends_data = get_backends_data(cache->pool);
+    if (!backends_data) {
+        fprintf(stderr, "ERROR - Fetching backends data failed in refresh_backend_list()!\n");
+        goto terminate;
+    }
+
+    compact_data = compact_backends_data(cache, backends_data, fetch_properties, stale_properties);
+    if (!compact_data) {
+        fprintf(stderr, "ERROR - Compacting backends data failed in refresh_backend_list()!\n");
+        goto cleanup_backends_data;
+    }
+
+    if (cache->path && write_cache_file(cache->path, compact_data) < 0) {
+        fprintf(stderr, "ERROR - Writing the backend cache failed in refresh_backend_list()!\n");
+    }
+
+cleanup_backends_data:
+    free(backends_data);
+
+terminate:
+    return compact_data;
+}
+
+/**
+ * @brief Background thread refreshing the backend cache
+ *
+ * Fetches the calibration properties that are missing or expired as well,
+ * so that later selections score every device by its error rates.
+ *
+ * @param arg Pointer to BACKEND_CACHE to refresh
+ * @return NULL
+ */
+static void* refresh_backends(void* arg) {
+    BACKEND_CACHE* cache = (BACKEND_CACHE*)arg;
+
+    free(refresh_backend_list(cache, true, NULL));
+
+    pthread_mutex_lock(&cache->lock);
+    cache->refreshed = true;
+    pthread_mutex_unlock(&cache->lock);
+
+    return NULL;
+}
+
+/**
+ * @brief Start a background refresh of the backend cache
+ *
+ * Nothing is started while a refresh is still running. A long-running
+ * process refreshes again once the previous refresh is done.
+ *
+ * @param cache Pointer to BACKEND_CACHE to refresh
+ */
+static void start_refresh(BACKEND_CACHE* cache) {
+    pthread_mutex_lock(&cache->lock);
+
+    if (cache->refreshing && cache->refreshed) {
+        pthread_join(cache->refresh_thread, NULL);
+        cache->refreshing = false;
+    }
+
+    if (!cache->refreshing) {
+        cache->refreshed = false;
+        if (pthread_create(&cache->refresh_thread, NULL, refresh_backends, cache) == 0) cache->refreshing = true;
+    }
+
+    pthread_mutex_unlock(&cache->lock);
+
+    return;
+}
+
+/**
+ * @brief Fetch the backend list from the API and store it in the cache
+ *
+ * Only the queue lengths are waited for, so that submission can start
+ * right away. Devices whose calibration properties are not cached yet are
+ * scored with the default error rates, and a background refresh fetches
+ * their properties for later selections. Without a cache directory there
+ * is nowhere to keep them, so they are not fetched at all.
+ *
+ * @param cache Pointer to BACKEND_CACHE to refresh
+ * @return Compact JSON string (CALLER MUST FREE) or NULL on failure
+ */
+char* fetch_backends(BACKEND_CACHE* cache) {
+    bool stale_properties = false;
+
+    char* compact_data = refresh_backend_list(cache, false, &stale_properties);
+    if (!compact_data) {
+        fprintf(stderr, "ERROR - Refreshing the backend list failed in fetch_backends()!\n");
+        return NULL;
+    }
+
+    if (stale_properties && cache->path) start_refresh(cache);
+
+    return compact_data;
+}
+
+/**
+ * @brief Get the backend list, from the cache when possible
+ *
+ * A cached list younger than the TTL is used as is. A stale list younger
+ * than BACKEND_CACHE_MAX_AGE is still used, so that submission can start
+ * immediately, while a background thread refreshes the cache for later
+ * runs. Otherwise the list is fetched before returning.
+ *
+ * @param cache Pointer to BACKEND_CACHE
+ * @return Compact JSON string in the /backends format (CALLER MUST FREE),
+ *         or NULL on failure
+ */
+char* get_backends(BACKEND_CACHE* cache) {
+    if (cache->path) {
+        char* cached_data = read_cache_file(cache->path);
+        double age = cached_data ? get_cache_age(cached_data) : -1;
+
+        if (0 <= age && age < cache->ttl) return cached_data;
+
+        if (0 <= age && age < BACKEND_CACHE_MAX_AGE) {
+            start_refresh(cache);
+            return cached_data;
+        }
+
+        free(cached_data);
+    }
+
+    return fetch_backends(cache);
+}
+
+/**
+ * @brief Choose the backend to run circuits on
+ *
+ * Selects the best-scoring backend for the circuits from the cached
+ * backend list. With a fresh cache this runs while the first token is
+ * still being fetched.
+ *
+ * @param cache Pointer to BACKEND_CACHE providing the backend list
+ * @param circuits Array of circuits to run as one job
+ * @param circuit_count Number of circuits
+ * @return Name of the chosen backend (CALLER MUST FREE), or NULL on failure
+ */
+char* choose_backend(BACKEND_CACHE* cache, CIRCUIT* circuits, int circuit_count) {
+    char* backends_data = get_backends(cache);
+    if (!backends_data) {
+        fprintf(stderr, "ERROR - Fetching backends data failed in choose_backend()!\n");
+        return NULL;
+    }
+
+    char* backend = select_backend(backends_data, circuits, circuit_count);
+    if (!backend) fprintf(stderr, "ERROR - Selecting the backend device failed in choose_backend()!\n");
+
+    free(backends_data);
+
+    return backend;
+}
+
+/**
+ * @brief Choose another backend for a job that missed its deadline
+ *
+ * @param cache Pointer to BACKEND_CACHE providing the backend list
+ * @param circuits Array of circuits to run as one job
+ * @param circuit_count Number of circuits
+ * @param excluded Name of the backend the job is moved away from
+ * @param max_queue_length Longest queue the job can still wait through
+ * @return Name of the chosen backend (CALLER MUST FREE), or NULL if no
+ *         backend qualifies
+ */
+char* choose_fallback_backend(BACKEND_CACHE* cache, CIRCUIT* circuits, int circuit_count, char* excluded, int max_queue_length) {
+    char* backends_data = get_backends(cache);
+    if (!backends_data) {
+        fprintf(stderr, "ERROR - Fetching backends data failed in choose_fallback_backend()!\n");
+        return NULL;
+    }
+
+    char* backend = select_fallback_backend(backends_data, circuits, circuit_count, excluded, max_queue_length);
+
+    free(backends_data);
+
+    return backend;
+}
@@ -0,0 +1,31 @@
+#ifndef _BACKENDS_H_
+#define _BACKENDS_H_
+
+#define BACKEND_CACHE_TTL 60
+#define BACKEND_CACHE_MAX_AGE 3600
+#define BACKEND_PROPERTIES_TTL 3600
+#define BACKEND_CACHE_NMEMB 128
+
+typedef struct BackendCache {
+    CONNECTION_POOL* pool;
+    char* path;
+    int ttl;
+
+    pthread_t refresh_thread;
+    bool refreshing;
+    bool refreshed;
+    bool stopping;
+    pthread_mutex_t lock;
+} BACKEND_CACHE;
+
+BACKEND_CACHE* create_backend_cache(CONNECTION_POOL* pool, int ttl);
+void destroy_backend_cache(BACKEND_CACHE* cache);
+
+char* summarize_properties_data(char* properties_data);
+char* compact_backends_data(BACKEND_CACHE* cache, char* backends_data, bool fetch_properties, bool* stale_properties);
+char* fetch_backends(BACKEND_CACHE* cache);
+char* get_backends(BACKEND_CACHE* cache);
+char* choose_backend(BACKEND_CACHE* cache, CIRCUIT* circuits, int circuit_count);
+char* choose_fallback_backend(BACKEND_CACHE* cache, CIRCUIT* circuits, int circuit_count, char* excluded, int max_queue_length);
+
+#endif
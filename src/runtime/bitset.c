@@ -0,0 +1,227 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "bitset.h"
+
+
+/**
+ * @brief Number of words needed to hold a bit width
+ *
+ * @param num_bits Number of bits
+ * @return Number of BITSET_WORD words, at least 1
+ */
+int count_bitset_words(int num_bits) {
+    if (num_bits <= 0) return 1;
+
+    return (num_bits + BITSET_WORD_BITS-1) / BITSET_WORD_BITS;
+}
+
+/**
+ * @brief Position of the highest set bit plus one
+ *
+ * @param words Packed bits, least significant word first
+ * @param word_count Number of words
+ * @return Number of significant bits, 0 for an all-zero bitset
+ */
+int count_significant_bits(const BITSET_WORD* words, int word_count) {
+    for (int i = word_count-1; i >= 0; i--) {
+        if (words[i]) return i*BITSET_WORD_BITS + BITSET_WORD_BITS - __builtin_clzll(words[i]);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Compare two bitsets as unsigned integers
+ *
+ * @param a First bitset
+ * @param b Second bitset
+ * @param word_count Number of words of both bitsets
+ * @return Negative, zero or positive as a is smaller, equal or larger
+ */
+int compare_bitsets(const BITSET_WORD* a, const BITSET_WORD* b, int word_count) {
+    for (int i = word_count-1; i >= 0; i--) {
+        if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Read one bit of a bitset
+ *
+ * @param words Packed bits, least significant word first
+ * @param word_count Number of words
+ * @param index Bit index, 0 being the least significant bit
+ * @return Value of the bit, 0 if the index is outside the bitset
+ */
+int get_bitset_bit(const BITSET_WORD* words, int word_count, int index) {
+    if (index < 0 || index >= word_count*BITSET_WORD_BITS) return 0;
+
+    return (words[index / BITSET_WORD_BITS] >> (index % BITSET_WORD_BITS)) & 1;
+}
+
+
+/**
+ * @brief Value of one hexadecimal digit
+ *
+ * @param ch Character to decode
+ * @return Digit value, or -1 if the character is not a hexadecimal digit
+ */
+static int hex_digit_value(char ch) {
+    if ('0' <= ch && ch <= '9') return ch-'0';
+    if ('a' <= ch && ch <= 'f') return ch-'a'+10;
+    if ('A' <= ch && ch <= 'F') return ch-'A'+10;
+
+    return -1;
+}
+
+/**
+ * @brief Decode up to 16 hexadecimal digits into one word
+ *
+ * @param digits Digits, most significant first
+ * @param length Number of digits (at most BITSET_WORD_HEX_DIGITS)
+ * @param word Output pointer receiving the value
+ * @return 0 on success, or -1 on an invalid digit
+ */
+static int decode_hex_word_scalar(const char* digits, size_t length, BITSET_WORD* word) {
+    BITSET_WORD value = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        int digit = hex_digit_value(digits[i]);
+        if (digit < 0) return -1;
+        value = (value << 4) | (BITSET_WORD)digit;
+    }
+
+    *word = value;
+
+    return 0;
+}
+
+/**
+ * @brief Decode exactly 16 hexadecimal digits into one word
+ *
+ * With SSE2 the 16 digits are classified and converted in parallel and
+ * pairs of nibbles are packed into bytes; otherwise the scalar decoder is
+ * used.
+ *
+ * @param digits 16 digits, most significant first
+ * @param word Output pointer receiving the value
+ * @return 0 on success, or -1 on an invalid digit
+ */
+static int decode_hex_word(const char* digits, BITSET_WORD* word) {
+#ifdef __SSE2__
+    __m128i chars = _mm_loadu_si128((const __m128i*)digits);
+
+    __m128i digit_values = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    __m128i letter_values = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit_values, _mm_set1_epi8(9)), digit_values);
+    __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter_values, _mm_set1_epi8(5)), letter_values);
+
+    if (_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xFFFF) return -1;
+
+    __m128i nibbles = _mm_or_si128(_mm_and_si128(is_digit, digit_values),
+                                   _mm_and_si128(is_letter, _mm_add_epi8(letter_values, _mm_set1_epi8(10))));
+
+    // Each 16-bit lane holds the high nibble in its low byte and the low nibble in its high byte.
+
+    __m128i high = _mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4);
+    __m128i low = _mm_srli_epi16(nibbles, 8);
+    __m128i bytes = _mm_packus_epi16(_mm_or_si128(high, low), _mm_setzero_si128());
+
+    BITSET_WORD big_endian = 0;
+    _mm_storel_epi64((__m128i*)&big_endian, bytes);
+    *word = __builtin_bswap64(big_endian);
+
+    return 0;
+#else
+    return decode_hex_word_scalar(digits, BITSET_WORD_HEX_DIGITS, word);
+#endif
+}
+
+/**
+ * @brief Decode a hexadecimal number into a bitset
+ *
+ * The digits are consumed from the least significant end, a full word of
+ * 16 digits at a time.
+ *
+ * @param digits Digits without the 0x prefix, most significant first
+ * @param length Number of digits
+ * @param words Output bitset, least significant word first
+ * @param word_count Number of words of the output bitset
+ * @return 0 on success, or -1 on an invalid digit or if the number does not
+ *         fit into word_count words
+ */
+int decode_hex_bitset(const char* digits, size_t length, BITSET_WORD* words, int word_count) {
+    while (length > 0 && *digits == '0') {
+        digits++;
+        length--;
+    }
+
+    if (length > (size_t)word_count*BITSET_WORD_HEX_DIGITS) return -1;
+
+    memset(words, 0, word_count*sizeof(BITSET_WORD));
+
+    int word_index = 0;
+    while (length >= BITSET_WORD_HEX_DIGITS) {
+        length -= BITSET_WORD_HEX_DIGITS;
+        if (decode_hex_word(digits+length, &words[word_index++]) < 0) return -1;
+    }
+
+    if (length > 0 && decode_hex_word_scalar(digits, length, &words[word_index]) < 0) return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Format a bitset as a binary string
+ *
+ * The string is padded with leading zeros to num_bits, and is otherwise as
+ * short as the value allows.
+ *
+ * @param words Packed bits, least significant word first
+ * @param word_count Number of words
+ * @param num_bits Width of the classical register, or 0 if unknown
+ * @return Newly allocated binary string, most significant bit first
+ *         (CALLER MUST FREE), or NULL on failure
+ */
+char* format_bitset(const BITSET_WORD* words, int word_count, int num_bits) {
+    int value_bits = count_significant_bits(words, word_count);
+    if (num_bits < value_bits) num_bits = value_bits;
+    if (num_bits == 0) num_bits = 1;
+
+    char* binary_str = (char*)calloc(num_bits+1, sizeof(char));
+    if (!binary_str) {
+        fprintf(stderr, "ERROR - Memory allocation failed for binary string in format_bitset()!\n");
+        return NULL;
+    }
+
+    for (int i = num_bits-1; i >= 0; i--) {
+        binary_str[num_bits-1-i] = get_bitset_bit(words, word_count, i) ? '1' : '0';
+    }
+    binary_str[num_bits] = '\0';
+
+    return binary_str;
+}
+
+/**
+ * @brief Write a bitset to a stream as a binary string
+ *
+ * @param stream Output stream
+ * @param words Packed bits, least significant word first
+ * @param word_count Number of words
+ * @param num_bits Number of bits to write, most significant first
+ */
+void print_bitset(FILE* stream, const BITSET_WORD* words, int word_count, int num_bits) {
+    for (int i = num_bits-1; i >= 0; i--) {
+        putc(get_bitset_bit(words, word_count, i) ? '1' : '0', stream);
+    }
+
+    return;
+}
@@ -0,0 +1,18 @@
+#ifndef _BITSET_H_
+#define _BITSET_H_
+
+#define BITSET_WORD_BITS 64
+#define BITSET_WORD_HEX_DIGITS 16
+
+typedef unsigned long long BITSET_WORD;
+
+int count_bitset_words(int num_bits);
+int count_significant_bits(const BITSET_WORD* words, int word_count);
+int compare_bitsets(const BITSET_WORD* a, const BITSET_WORD* b, int word_count);
+int get_bitset_bit(const BITSET_WORD* words, int word_count, int index);
+
+int decode_hex_bitset(const char* digits, size_t length, BITSET_WORD* words, int word_count);
+char* format_bitset(const BITSET_WORD* words, int word_count, int num_bits);
+void print_bitset(FILE* stream, const BITSET_WORD* words, int word_count, int num_bits);
+
+#endif
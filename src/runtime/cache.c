@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "cache.h"
+
+
+/**
+ * @brief Continue a 64-bit FNV-1a hash with another string
+ *
+ * @param hash Hash of the preceding strings
+ * @param text String to append
+ * @return Hash of the preceding strings followed by text
+ */
+unsigned long long hash_append(unsigned long long hash, const char* text) {
+    for (const unsigned char* ch = (const unsigned char*)text; *ch; ch++) {
+        hash ^= *ch;
+        hash *= 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Hash a string with 64-bit FNV-1a
+ *
+ * Used to derive cache file names from account-specific values without
+ * writing the values themselves into the names.
+ *
+ * @param text String to hash
+ * @return Hash of the string
+ */
+unsigned long long hash_string(const char* text) {
+    return hash_append(0xcbf29ce484222325ULL, text);
+}
+
+/**
+ * @brief Create a directory and its missing parents
+ *
+ * @param path Directory path
+ * @return 0 on success, or -1 on failure
+ */
+static int make_directories(char* path) {
+    for (char* separator = strchr(path+1, '/'); separator; separator = strchr(separator+1, '/')) {
+        *separator = '\0';
+        int status = mkdir(path, 0700);
+        *separator = '/';
+        if (status != 0 && errno != EEXIST) return -1;
+    }
+
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Resolve the path of a file in the runtime cache directory
+ *
+ * The directory is QUANTUMC_CACHE_DIR if set, otherwise quantumc under
+ * XDG_CACHE_HOME or ~/.cache. It is created when missing.
+ *
+ * @param name File name inside the cache directory
+ * @return Newly allocated path (CALLER MUST FREE), or NULL if no cache
+ *         directory is available
+ */
+char* get_cache_path(const char* name) {
+    char directory[PATH_MAX];
+
+    const char* cache_dir = getenv(CACHE_DIR_ENV);
+    const char* xdg_cache_home = getenv("XDG_CACHE_HOME");
+    const char* home = getenv("HOME");
+
+    if (cache_dir && *cache_dir) snprintf(directory, PATH_MAX, "%s", cache_dir);
+    else if (xdg_cache_home && *xdg_cache_home) snprintf(directory, PATH_MAX, "%s/%s", xdg_cache_home, CACHE_DIR_NAME);
+    else if (home && *home) snprintf(directory, PATH_MAX, "%s/.cache/%s", home, CACHE_DIR_NAME);
+    else return NULL;
+
+    if (make_directories(directory) < 0) {
+        fprintf(stderr, "ERROR - Creating the cache directory %s failed in get_cache_path()!\n", directory);
+        return NULL;
+    }
+
+    char* path = (char*)calloc(PATH_MAX, sizeof(char));
+    if (!path) {
+        fprintf(stderr, "ERROR - Allocating memory for cache path failed in get_cache_path()!\n");
+        return NULL;
+    }
+    if (snprintf(path, PATH_MAX, "%s/%s", directory, name) >= PATH_MAX) {
+        fprintf(stderr, "ERROR - Cache path for %s is too long in get_cache_path()!\n", name);
+        free(path);
+        return NULL;
+    }
+
+    return path;
+}
+
+/**
+ * @brief Read a whole cache file
+ *
+ * @param path Path of the cache file
+ * @return Newly allocated file contents (CALLER MUST FREE), or NULL if the
+ *         file does not exist or cannot be read
+ */
+char* read_cache_file(const char* path) {
+    return read_cache_bytes(path, NULL);
+}
+
+/**
+ * @brief Read a whole binary cache file
+ *
+ * The contents are followed by a terminating zero byte, which is not
+ * counted in the size.
+ *
+ * @param path Path of the cache file
+ * @param size Output pointer receiving the file size, or NULL
+ * @return Newly allocated file contents (CALLER MUST FREE), or NULL if the
+ *         file does not exist or cannot be read
+ */
+char* read_cache_bytes(const char* path, size_t* size) {
+    char* data = NULL;
+
+    FILE* file = fopen(path, "r");
+    if (!file) goto terminate;
+
+    struct stat file_stat;
+    if (fstat(fileno(file), &file_stat) != 0) goto cleanup_file;
+
+    data = (char*)calloc(file_stat.st_size+1, sizeof(char));
+    if (!data) {
+        fprintf(stderr, "ERROR - Allocating memory for cache data failed in read_cache_bytes()!\n");
+        goto cleanup_file;
+    }
+
+    if (fread(data, sizeof(char), file_stat.st_size, file) != (size_t)file_stat.st_size) {
+        free(data);
+        data = NULL;
+    } else if (size) {
+        *size = file_stat.st_size;
+    }
+
+cleanup_file:
+    fclose(file);
+
+terminate:
+    return data;
+}
+
+/**
+ * @brief Replace a cache file atomically
+ *
+ * @param path Path of the cache file
+ * @param data Contents to write
+ * @return 0 on success, or -1 on failure
+ */
+int write_cache_file(const char* path, const char* data) {
+    return write_cache_bytes(path, data, strlen(data));
+}
+
+/**
+ * @brief Replace a binary cache file atomically
+ *
+ * The data is written to a temporary file next to the cache file and
+ * renamed over it, so that concurrent readers see either the old or the new
+ * contents.
+ *
+ * @param path Path of the cache file
+ * @param data Contents to write
+ * @param size Number of bytes to write
+ * @return 0 on success, or -1 on failure
+ */
+int write_cache_bytes(const char* path, const char* data, size_t size) {
+    int status = -1;
+
+    // A unique temporary file keeps concurrent writers of one process apart.
+
+    char temp_path[PATH_MAX];
+    snprintf(temp_path, PATH_MAX, "%s.XXXXXX", path);
+
+    int fd = mkstemp(temp_path);
+    FILE* file = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!file) {
+        fprintf(stderr, "ERROR - Opening %s failed in write_cache_bytes()!\n", temp_path);
+        if (fd >= 0) {
+            close(fd);
+            unlink(temp_path);
+        }
+        goto terminate;
+    }
+
+    bool written = fwrite(data, sizeof(char), size, file) == size;
+    if (fclose(file) != 0 || !written) {
+        fprintf(stderr, "ERROR - Writing %s failed in write_cache_bytes()!\n", temp_path);
+        unlink(temp_path);
+        goto terminate;
+    }
+
+    if (rename(temp_path, path) != 0) {
+        fprintf(stderr, "ERROR - Replacing %s failed in write_cache_bytes()!\n", path);
+        unlink(temp_path);
+        goto terminate;
+    }
+
+    status = 0;
+
+terminate:
+    return status;
+}
+
+/**
+ * @brief Take an exclusive lock guarding a cache file
+ *
+ * The lock is held on a separate path.lock file, so that the cache file
+ * itself can still be replaced by rename while the lock is held. Blocks
+ * until every other process has released the lock.
+ *
+ * @param path Path of the cache file
+ * @return File descriptor holding the lock, or -1 on failure
+ */
+int lock_cache_file(const char* path) {
+    char lock_path[PATH_MAX];
+    if (snprintf(lock_path, PATH_MAX, "%s.lock", path) >= PATH_MAX) {
+        fprintf(stderr, "ERROR - Lock path for %s is too long in lock_cache_file()!\n", path);
+        return -1;
+    }
+
+    int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR - Opening %s failed in lock_cache_file()!\n", lock_path);
+        return -1;
+    }
+
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno == EINTR) continue;
+        fprintf(stderr, "ERROR - Locking %s failed in lock_cache_file()!\n", lock_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Release a lock taken by lock_cache_file()
+ *
+ * @param fd File descriptor returned by lock_cache_file(), or -1
+ */
+void unlock_cache_file(int fd) {
+    if (fd < 0) return;
+
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    return;
+}
@@ -0,0 +1,19 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#define CACHE_DIR_ENV "QUANTUMC_CACHE_DIR"
+#define CACHE_DIR_NAME "quantumc"
+
+unsigned long long hash_append(unsigned long long hash, const char* text);
+unsigned long long hash_string(const char* text);
+
+char* get_cache_path(const char* name);
+char* read_cache_file(const char* path);
+char* read_cache_bytes(const char* path, size_t* size);
+int write_cache_file(const char* path, const char* data);
+int write_cache_bytes(const char* path, const char* data, size_t size);
+
+int lock_cache_file(const char* path);
+void unlock_cache_file(int fd);
+
+#endif
@@ -2,9 +2,15 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/random.h>
 
+#include <curl/curl.h>
 #include <pthread.h>
+#include <zlib.h>
 
+#include "metrics.h"
 #include "comm.h"
 
 
@@ -47,7 +53,9 @@ size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
 void initialize_token_data(TOKEN_DATA* token_data, char* key) {
     token_data->key = strdup(key);
     token_data->token = NULL;
+    token_data->token_version = 0;
     token_data->token_received_bool = false;
+    token_data->token_failed_bool = false;
     token_data->job_terminated_bool = false;
     pthread_cond_init(&token_data->token_received_cond, NULL);
     pthread_cond_init(&token_data->job_terminated_cond, NULL);
@@ -79,8 +87,8 @@ void destroy_token_data(TOKEN_DATA* token_data) {
 /**
  * @brief Signal that the initial token has been received
  *
- * Sets the token_received flag and signals the associated condition
- * variable so waiting threads can proceed.
+ * Sets the token_received flag and wakes every thread waiting on the
+ * associated condition variable.
  *
  * @param token_data Pointer to TOKEN_DATA to update
  */
@@ -88,7 +96,24 @@ void signal_token_received(TOKEN_DATA* token_data) {
     pthread_mutex_lock(&token_data->lock);
     token_data->token_received_bool = true;
     pthread_mutex_unlock(&token_data->lock);
-    pthread_cond_signal(&token_data->token_received_cond);
+    pthread_cond_broadcast(&token_data->token_received_cond);
+
+    return;
+}
+
+/**
+ * @brief Signal that the initial token could not be obtained
+ *
+ * Sets the token_failed flag and wakes every thread waiting for the first
+ * token, so that they give up instead of waiting forever.
+ *
+ * @param token_data Pointer to TOKEN_DATA to update
+ */
+void signal_token_failed(TOKEN_DATA* token_data) {
+    pthread_mutex_lock(&token_data->lock);
+    token_data->token_failed_bool = true;
+    pthread_mutex_unlock(&token_data->lock);
+    pthread_cond_broadcast(&token_data->token_received_cond);
 
     return;
 }
@@ -111,6 +136,27 @@ void signal_job_terminated(TOKEN_DATA* token_data) {
 }
 
 
+/**
+ * @brief Block until the authenticator has received the first token
+ *
+ * @param token_data Pointer to TOKEN_DATA to wait on
+ * @return 0 once the token is available, or -1 if the authenticator failed
+ *         to obtain it
+ */
+int wait_for_token(TOKEN_DATA* token_data) {
+    int status = 0;
+
+    pthread_mutex_lock(&token_data->lock);
+    while (!token_data->token_received_bool && !token_data->token_failed_bool) {
+        pthread_cond_wait(&token_data->token_received_cond, &token_data->lock);
+    }
+    if (!token_data->token_received_bool) status = -1;
+    pthread_mutex_unlock(&token_data->lock);
+
+    return status;
+}
+
+
 /**
  * @brief Return a thread-safe copy of the bearer token
  *
@@ -130,3 +176,671 @@ char* copy_bearer_token(TOKEN_DATA* token_data) {
 
     return copy;
 }
+
+
+/**
+ * @brief Read the monotonic clock
+ *
+ * @return Seconds elapsed on CLOCK_MONOTONIC, unaffected by wall clock jumps
+ */
+double get_monotonic_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+
+/**
+ * @brief Sleep for a fractional number of seconds
+ *
+ * @param seconds Time to sleep; nonpositive values return immediately
+ */
+void sleep_seconds(double seconds) {
+    if (seconds <= 0.0) return;
+
+    struct timespec duration;
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (double)duration.tv_sec) * 1e9);
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR) continue;
+
+    return;
+}
+
+
+/**
+ * @brief Lock callback for the shared cURL cache
+ *
+ * Serializes access to one category of shared data (DNS, TLS sessions or
+ * connections) between the easy handles of a connection pool.
+ *
+ * @param handle Easy handle requesting the lock (unused)
+ * @param data Category of shared data to lock
+ * @param access Requested access type (unused, all locks are exclusive)
+ * @param userp Pointer to the CONNECTION_POOL owning the share
+ */
+static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* userp) {
+    (void)handle;
+    (void)access;
+    CONNECTION_POOL* pool = userp;
+
+    pthread_mutex_lock(&pool->share_locks[data]);
+
+    return;
+}
+
+/**
+ * @brief Unlock callback for the shared cURL cache
+ *
+ * @param handle Easy handle releasing the lock (unused)
+ * @param data Category of shared data to unlock
+ * @param userp Pointer to the CONNECTION_POOL owning the share
+ */
+static void unlock_share(CURL* handle, curl_lock_data data, void* userp) {
+    (void)handle;
+    CONNECTION_POOL* pool = userp;
+
+    pthread_mutex_unlock(&pool->share_locks[data]);
+
+    return;
+}
+
+/**
+ * @brief Build the header list sent with every Qiskit Runtime API request
+ *
+ * @param token Bearer token to put in the Authorization header
+ * @param crn Service CRN string
+ * @param json_body Whether to announce a JSON request body
+ * @param compressed Whether the JSON request body is gzip compressed
+ * @return Newly allocated header list (CALLER MUST FREE with
+ *         curl_slist_free_all), or NULL on failure
+ */
+static struct curl_slist* build_api_headers(char* token, char* crn, bool json_body, bool compressed) {
+    struct curl_slist* headers = NULL;
+
+    char* token_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
+    if (!token_header) {
+        fprintf(stderr, "ERROR - Allocating memory for token header failed in build_api_headers()!\n");
+        goto terminate;
+    }
+
+    char* crn_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
+    if (!crn_header) {
+        fprintf(stderr, "ERROR - Allocating memory for CRN header failed in build_api_headers()!\n");
+        goto cleanup_token_header;
+    }
+
+    snprintf(token_header, BUFFER_NMEMB, "Authorization: Bearer %s", token);
+    snprintf(crn_header, BUFFER_NMEMB, "Service-CRN: %s", crn);
+
+    headers = curl_slist_append(headers, "Accept: application/json");
+    headers = curl_slist_append(headers, token_header);
+    headers = curl_slist_append(headers, crn_header);
+    headers = curl_slist_append(headers, "IBM-API-Version: " API_VERSION);
+    if (json_body) headers = curl_slist_append(headers, "Content-Type: application/json");
+    if (json_body && compressed) headers = curl_slist_append(headers, "Content-Encoding: gzip");
+    if (!headers) {
+        fprintf(stderr, "ERROR - Header construction failed in build_api_headers()!\n");
+        goto cleanup_crn_header;
+    }
+
+cleanup_crn_header:
+    free(crn_header);
+
+cleanup_token_header:
+    free(token_header);
+
+terminate:
+    return headers;
+}
+
+
+/**
+ * @brief Copy a base URL without its trailing slashes
+ *
+ * @param url Base URL to copy
+ * @return Newly allocated URL (CALLER MUST FREE), or NULL on failure
+ */
+static char* copy_base_url(char* url) {
+    char* copy = strdup(url);
+    if (!copy) return NULL;
+
+    size_t length = strlen(copy);
+    while (length > 0 && copy[length-1] == '/') copy[--length] = '\0';
+
+    return copy;
+}
+
+/**
+ * @brief Create a pool of reusable cURL handles bound to one service instance
+ *
+ * The pool owns a cURL share object so that DNS lookups, TLS sessions and
+ * live connections are reused by every request of the runtime, including the
+ * IAM requests of the authenticator thread.
+ *
+ * @param token_data Pointer to TOKEN_DATA providing the bearer token
+ * @param metrics Pointer to RUNTIME_METRICS recording the requests, or NULL
+ * @param crn Service CRN string to copy
+ * @param api_url Base URL of the Qiskit Runtime API, or NULL for
+ *        DEFAULT_API_URL
+ * @param iam_url Base URL of the IAM token service, or NULL for
+ *        DEFAULT_IAM_URL
+ * @return Pointer to newly allocated CONNECTION_POOL (CALLER MUST DESTROY),
+ *         or NULL on failure
+ */
+CONNECTION_POOL* create_connection_pool(TOKEN_DATA* token_data, RUNTIME_METRICS* metrics, char* crn, char* api_url, char* iam_url) {
+    CONNECTION_POOL* pool = (CONNECTION_POOL*)calloc(1, sizeof(CONNECTION_POOL));
+    if (!pool) {
+        fprintf(stderr, "ERROR - Allocating memory for connection pool failed in create_connection_pool()!\n");
+        goto terminate;
+    }
+
+    pool->crn = strdup(crn);
+    if (!pool->crn) {
+        fprintf(stderr, "ERROR - Copying the CRN failed in create_connection_pool()!\n");
+        goto cleanup_pool;
+    }
+
+    pool->api_url = copy_base_url(api_url ? api_url : DEFAULT_API_URL);
+    pool->iam_url = copy_base_url(iam_url ? iam_url : DEFAULT_IAM_URL);
+    if (!pool->api_url || !pool->iam_url) {
+        fprintf(stderr, "ERROR - Copying the service URLs failed in create_connection_pool()!\n");
+        goto cleanup_urls;
+    }
+
+    pool->share = curl_share_init();
+    if (!pool->share) {
+        fprintf(stderr, "ERROR - cURL share initialization failed in create_connection_pool()!\n");
+        goto cleanup_urls;
+    }
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_init(&pool->share_locks[i], NULL);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+
+    curl_share_setopt(pool->share, CURLSHOPT_LOCKFUNC, lock_share);
+    curl_share_setopt(pool->share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+    curl_share_setopt(pool->share, CURLSHOPT_USERDATA, pool);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    curl_share_setopt(pool->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+    pool->token_data = token_data;
+    pool->metrics = metrics;
+
+    pool->request_rate = REQUEST_RATE;
+    pool->request_burst = REQUEST_BURST;
+    pool->request_tokens = REQUEST_BURST;
+    pool->refill_time = get_monotonic_time();
+    pool->max_attempts = RETRY_MAX_ATTEMPTS;
+    pool->jitter_seed = (unsigned int)(pool->refill_time * 1e6);
+
+    goto terminate;
+
+cleanup_urls:
+    free(pool->api_url);
+    free(pool->iam_url);
+    free(pool->crn);
+
+cleanup_pool:
+    free(pool);
+    pool = NULL;
+
+terminate:
+    return pool;
+}
+
+/**
+ * @brief Destroy a connection pool and close its connections
+ *
+ * All handles must have been released back to the pool beforehand.
+ *
+ * @param pool Pointer to CONNECTION_POOL to destroy
+ */
+void destroy_connection_pool(CONNECTION_POOL* pool) {
+    for (int i = 0; i < pool->idle_count; i++) {
+        curl_easy_cleanup(pool->handles[i]);
+    }
+
+    curl_share_cleanup(pool->share);
+    curl_slist_free_all(pool->api_headers);
+    curl_slist_free_all(pool->json_headers);
+    curl_slist_free_all(pool->retired_api_headers);
+    curl_slist_free_all(pool->retired_json_headers);
+
+    for (int i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+        pthread_mutex_destroy(&pool->share_locks[i]);
+    }
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->api_url);
+    free(pool->iam_url);
+    free(pool->crn);
+    free(pool);
+
+    return;
+}
+
+/**
+ * @brief Take a configured cURL handle out of the pool
+ *
+ * Reuses an idle handle when one is available and creates a new one
+ * otherwise. The handle is attached to the pool's share and carries the
+ * common options (user agent, timeout, and every response encoding cURL can
+ * decompress, so that compressed bodies reach the write callbacks already
+ * decoded); request specific options are left to the caller.
+ *
+ * @param pool Pointer to CONNECTION_POOL to take the handle from
+ * @return cURL easy handle (CALLER MUST RELEASE), or NULL on failure
+ */
+CURL* acquire_handle(CONNECTION_POOL* pool) {
+    CURL* curl = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle_count > 0) curl = pool->handles[--pool->idle_count];
+    pthread_mutex_unlock(&pool->lock);
+
+    if (!curl) curl = curl_easy_init();
+    if (!curl) {
+        fprintf(stderr, "ERROR - cURL initialization failed in acquire_handle()!\n");
+        return NULL;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_SHARE, pool->share);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT_NAME);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+
+    return curl;
+}
+
+/**
+ * @brief Compress a request body with gzip
+ *
+ * @param data Bytes to compress
+ * @param size Number of bytes
+ * @param compressed_size Output pointer receiving the compressed size
+ * @return Newly allocated compressed body (CALLER MUST FREE), or NULL on
+ *         failure
+ */
+char* compress_request_body(const char* data, size_t size, size_t* compressed_size) {
+    char* compressed = NULL;
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (deflateInit2(&stream, COMPRESSION_LEVEL, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        fprintf(stderr, "ERROR - Initializing the compressor failed in compress_request_body()!\n");
+        goto terminate;
+    }
+
+    size_t capacity = deflateBound(&stream, size);
+    compressed = (char*)malloc(capacity);
+    if (!compressed) {
+        fprintf(stderr, "ERROR - Allocating memory for compressed body failed in compress_request_body()!\n");
+        goto cleanup_stream;
+    }
+
+    stream.next_in = (Bytef*)data;
+    stream.avail_in = size;
+    stream.next_out = (Bytef*)compressed;
+    stream.avail_out = capacity;
+
+    if (deflate(&stream, Z_FINISH) != Z_STREAM_END) {
+        fprintf(stderr, "ERROR - Compressing the request body failed in compress_request_body()!\n");
+        free(compressed);
+        compressed = NULL;
+        goto cleanup_stream;
+    }
+
+    *compressed_size = stream.total_out;
+
+cleanup_stream:
+    deflateEnd(&stream);
+
+terminate:
+    return compressed;
+}
+
+/**
+ * @brief Return a cURL handle to the pool
+ *
+ * The handle options are reset, while its connection and session caches are
+ * kept for the next request. Handles beyond POOL_SIZE are cleaned up.
+ *
+ * @param pool Pointer to CONNECTION_POOL the handle was acquired from
+ * @param curl cURL easy handle to release
+ */
+void release_handle(CONNECTION_POOL* pool, CURL* curl) {
+    if (!curl) return;
+
+    curl_easy_reset(curl);
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->idle_count < POOL_SIZE) {
+        pool->handles[pool->idle_count++] = curl;
+        curl = NULL;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (curl) curl_easy_cleanup(curl);
+
+    return;
+}
+
+/**
+ * @brief Return the header list for Qiskit Runtime API requests
+ *
+ * The authorization and CRN headers are cached in the pool and rebuilt only
+ * when the authenticator has rotated the bearer token. The previous lists
+ * are kept alive for one more rotation since requests in flight may still
+ * reference them.
+ *
+ * The JSON body headers announce gzip compression when the pool compresses
+ * request bodies.
+ *
+ * @param pool Pointer to CONNECTION_POOL holding the cached headers
+ * @param json_body Whether the request carries a JSON body
+ * @return Header list owned by the pool (DO NOT FREE), or NULL on failure
+ */
+struct curl_slist* get_api_headers(CONNECTION_POOL* pool, bool json_body) {
+    struct curl_slist* headers = NULL;
+    TOKEN_DATA* token_data = pool->token_data;
+
+    pthread_mutex_lock(&pool->lock);
+    pthread_mutex_lock(&token_data->lock);
+
+    if (!token_data->token) {
+        fprintf(stderr, "ERROR - The bearer token is not valid to build headers in get_api_headers()!\n");
+        goto unlock;
+    }
+
+    if (!pool->api_headers || pool->headers_version != token_data->token_version) {
+        struct curl_slist* api_headers = build_api_headers(token_data->token, pool->crn, false, false);
+        struct curl_slist* json_headers = build_api_headers(token_data->token, pool->crn, true, pool->compress_requests);
+        if (!api_headers || !json_headers) {
+            fprintf(stderr, "ERROR - Rebuilding the request headers failed in get_api_headers()!\n");
+            curl_slist_free_all(api_headers);
+            curl_slist_free_all(json_headers);
+            goto unlock;
+        }
+
+        curl_slist_free_all(pool->retired_api_headers);
+        curl_slist_free_all(pool->retired_json_headers);
+        pool->retired_api_headers = pool->api_headers;
+        pool->retired_json_headers = pool->json_headers;
+        pool->api_headers = api_headers;
+        pool->json_headers = json_headers;
+        pool->headers_version = token_data->token_version;
+    }
+
+    headers = json_body ? pool->json_headers : pool->api_headers;
+
+unlock:
+    pthread_mutex_unlock(&token_data->lock);
+    pthread_mutex_unlock(&pool->lock);
+
+    return headers;
+}
+
+
+/**
+ * @brief Generate a random idempotency key for a job submission
+ *
+ * The key lets a service that deduplicates submissions recognize a repeated
+ * one. Nothing guarantees that, so submissions are only repeated after
+ * failures that leave them unsent (see is_unsent_failure()).
+ *
+ * @param pool Pointer to CONNECTION_POOL providing the fallback generator
+ * @param key Output buffer of IDEMPOTENCY_KEY_NMEMB characters
+ */
+void generate_idempotency_key(CONNECTION_POOL* pool, char* key) {
+    unsigned char bytes[(IDEMPOTENCY_KEY_NMEMB-1)/2];
+
+    if (getrandom(bytes, sizeof(bytes), 0) != (ssize_t)sizeof(bytes)) {
+        pthread_mutex_lock(&pool->lock);
+        for (size_t i = 0; i < sizeof(bytes); i++) bytes[i] = (unsigned char)rand_r(&pool->jitter_seed);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    for (size_t i = 0; i < sizeof(bytes); i++) snprintf(key+2*i, 3, "%02x", bytes[i]);
+
+    return;
+}
+
+/**
+ * @brief Copy a header list and add an idempotency key to it
+ *
+ * @param headers Header list to copy, such as the one of get_api_headers()
+ * @param key Idempotency key of the request
+ * @return Newly allocated header list (CALLER MUST FREE with
+ *         curl_slist_free_all), or NULL on failure
+ */
+struct curl_slist* build_idempotent_headers(struct curl_slist* headers, char* key) {
+    struct curl_slist* copy = NULL;
+    if (!headers) goto cleanup_copy;
+
+    for (struct curl_slist* header = headers; header; header = header->next) {
+        struct curl_slist* temp = curl_slist_append(copy, header->data);
+        if (!temp) goto cleanup_copy;
+        copy = temp;
+    }
+
+    char key_header[BUFFER_NMEMB];
+    snprintf(key_header, BUFFER_NMEMB, "Idempotency-Key: %s", key);
+
+    struct curl_slist* temp = curl_slist_append(copy, key_header);
+    if (!temp) goto cleanup_copy;
+
+    return temp;
+
+cleanup_copy:
+    fprintf(stderr, "ERROR - Copying the request headers failed in build_idempotent_headers()!\n");
+    curl_slist_free_all(copy);
+
+    return NULL;
+}
+
+
+/**
+ * @brief Take a request slot from the token bucket of the pool
+ *
+ * The bucket refills at request_rate slots per second up to request_burst,
+ * which keeps the runtime under the request limits of the service. While
+ * the service asked the runtime to back off, no slot is handed out at all.
+ *
+ * @param pool Pointer to CONNECTION_POOL pacing the requests
+ * @return 0 if the request may be sent now, or the seconds to wait before
+ *         asking again
+ */
+double acquire_request_slot(CONNECTION_POOL* pool) {
+    double wait = 0.0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    double now = get_monotonic_time();
+    if (pool->paused_until > now) {
+        wait = pool->paused_until - now;
+    } else if (pool->request_rate > 0.0) {
+        pool->request_tokens += (now - pool->refill_time) * pool->request_rate;
+        if (pool->request_tokens > pool->request_burst) pool->request_tokens = pool->request_burst;
+        pool->refill_time = now;
+
+        if (pool->request_tokens >= 1.0) pool->request_tokens -= 1.0;
+        else wait = (1.0 - pool->request_tokens) / pool->request_rate;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return wait;
+}
+
+/**
+ * @brief Block until the token bucket of the pool hands out a request slot
+ *
+ * @param pool Pointer to CONNECTION_POOL pacing the requests
+ */
+void wait_for_request_slot(CONNECTION_POOL* pool) {
+    double wait;
+    while ((wait = acquire_request_slot(pool)) > 0.0) sleep_seconds(wait);
+
+    return;
+}
+
+/**
+ * @brief Hold back every request of the pool for a while
+ *
+ * Called when the service answers 429, since the limit applies to the
+ * whole service instance rather than to the request that hit it. The
+ * bucket starts empty once the pause is over.
+ *
+ * @param pool Pointer to CONNECTION_POOL pacing the requests
+ * @param seconds Time to hold the requests back
+ */
+void pause_requests(CONNECTION_POOL* pool, double seconds) {
+    pthread_mutex_lock(&pool->lock);
+
+    double until = get_monotonic_time() + seconds;
+    if (until > pool->paused_until) {
+        pool->paused_until = until;
+        pool->refill_time = until;
+        pool->request_tokens = 0.0;
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return;
+}
+
+
+/**
+ * @brief Check whether a failed request is worth sending again
+ *
+ * Rate limiting, server errors and dropped or timed out connections are
+ * transient. Any other error, such as a rejected request, fails the same
+ * way when repeated.
+ *
+ * @param response_code cURL result code of the request
+ * @param http_code HTTP status code of the response, 0 if none
+ * @return true if the request may succeed when repeated, false otherwise
+ */
+bool is_transient_failure(CURLcode response_code, long http_code) {
+    switch (response_code) {
+    case CURLE_OK:
+        break;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+    case CURLE_GOT_NOTHING:
+    case CURLE_PARTIAL_FILE:
+    case CURLE_HTTP2:
+    case CURLE_HTTP2_STREAM:
+        return true;
+    default:
+        return false;
+    }
+
+    return http_code == 429 || http_code == 500 || http_code == 502 || http_code == 503 || http_code == 504;
+}
+
+/**
+ * @brief Check whether a failed submission is safe to send again
+ *
+ * A request that never reached the service, or that the service turned
+ * away before handling it (429, 503), created no job. After any other
+ * failure, such as a timeout or a dropped connection, the job may exist
+ * already, so repeating the submission could run the circuits twice.
+ *
+ * @param response_code cURL result code of the request
+ * @param http_code HTTP status code of the response, 0 if none
+ * @return true if the submission created no job, false otherwise
+ */
+bool is_unsent_failure(CURLcode response_code, long http_code) {
+    if (response_code == CURLE_COULDNT_RESOLVE_HOST || response_code == CURLE_COULDNT_CONNECT) return true;
+
+    return response_code == CURLE_OK && (http_code == 429 || http_code == 503);
+}
+
+/**
+ * @brief Compute how long to wait before repeating a failed request
+ *
+ * A Retry-After header of the response is followed. Otherwise the delay
+ * doubles with every attempt from RETRY_BASE_DELAY, with a random half of
+ * it dropped so that concurrent requests do not retry in lockstep. Either
+ * way the delay is capped at RETRY_MAX_DELAY. A 429 response also pauses
+ * every other request of the pool for the delay.
+ *
+ * @param pool Pointer to CONNECTION_POOL the request was sent with
+ * @param curl cURL easy handle of the failed request
+ * @param http_code HTTP status code of the response, 0 if none
+ * @param attempt Number of attempts already repeated, 0 for the first
+ * @return Delay in seconds
+ */
+double get_retry_delay(CONNECTION_POOL* pool, CURL* curl, long http_code, int attempt) {
+    double delay = 0.0;
+
+    curl_off_t retry_after = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after) == CURLE_OK && retry_after > 0) {
+        delay = (double)retry_after;
+    } else {
+        delay = RETRY_BASE_DELAY;
+        for (int i = 0; i < attempt && delay < RETRY_MAX_DELAY; i++) delay *= 2.0;
+
+        pthread_mutex_lock(&pool->lock);
+        double jitter = (double)rand_r(&pool->jitter_seed) / RAND_MAX;
+        pthread_mutex_unlock(&pool->lock);
+
+        delay *= 0.5 + 0.5*jitter;
+    }
+
+    if (delay > RETRY_MAX_DELAY) delay = RETRY_MAX_DELAY;
+    if (http_code == 429) pause_requests(pool, delay);
+
+    return delay;
+}
+
+/**
+ * @brief Perform a configured request, repeating it on transient failures
+ *
+ * Every attempt waits for a request slot of the pool, starts from an empty
+ * response buffer and is recorded in the metrics. A transient failure is
+ * repeated after get_retry_delay() until max_attempts attempts were made,
+ * but a job submission only after a failure that left it unsent.
+ *
+ * @param pool Pointer to CONNECTION_POOL the handle was acquired from
+ * @param curl cURL easy handle with every request option set
+ * @param phase Phase the transfer time is recorded in, or PHASE_COUNT for
+ *        none
+ * @param submission Whether the request creates a job
+ * @param rb Pointer to RESPONSE_BUFFER the handle writes to
+ * @param http_code Output pointer receiving the HTTP status code of the
+ *        last attempt
+ * @return cURL result code of the last attempt
+ */
+CURLcode perform_request(CONNECTION_POOL* pool, CURL* curl, METRIC_PHASE phase, bool submission, RESPONSE_BUFFER* rb, long* http_code) {
+    CURLcode response_code = CURLE_OK;
+
+    for (int attempt = 0; ; attempt++) {
+        wait_for_request_slot(pool);
+
+        rb->size = 0;
+        rb->data[0] = '\0';
+
+        response_code = curl_easy_perform(curl);
+        double transfer_time = record_response(pool->metrics, curl, response_code);
+        if (phase != PHASE_COUNT) record_phase(pool->metrics, phase, transfer_time);
+
+        *http_code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, http_code);
+        bool retry = submission ? is_unsent_failure(response_code, *http_code) : is_transient_failure(response_code, *http_code);
+        if (!retry || attempt+1 >= pool->max_attempts) break;
+
+        record_failure_retry(pool->metrics);
+        sleep_seconds(get_retry_delay(pool, curl, *http_code, attempt));
+    }
+
+    return response_code;
+}
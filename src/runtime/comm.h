@@ -3,6 +3,17 @@
 
 #define BUFFER_NMEMB 2048
 #define USER_AGENT_NAME "QuantumC/dev"
+#define API_VERSION "2026-02-01"
+#define POOL_SIZE 4
+#define COMPRESSION_LEVEL 6
+#define DEFAULT_API_URL "https://quantum.cloud.ibm.com/api/v1"
+#define DEFAULT_IAM_URL "https://iam.cloud.ibm.com"
+#define RETRY_MAX_ATTEMPTS 5
+#define RETRY_BASE_DELAY 0.5
+#define RETRY_MAX_DELAY 30.0
+#define REQUEST_RATE 5.0
+#define REQUEST_BURST 10.0
+#define IDEMPOTENCY_KEY_NMEMB 33
 
 typedef struct ResponseBuffer {
     char* data;
@@ -12,8 +23,10 @@ typedef struct ResponseBuffer {
 typedef struct TokenData {
     char* key;
     char* token;
+    unsigned long token_version;
 
     bool token_received_bool;
+    bool token_failed_bool;
     bool job_terminated_bool;
 
     pthread_cond_t token_received_cond;
@@ -22,14 +35,70 @@ typedef struct TokenData {
     pthread_mutex_t lock;
 } TOKEN_DATA;
 
+typedef struct ConnectionPool {
+    TOKEN_DATA* token_data;
+    RUNTIME_METRICS* metrics;
+    char* crn;
+    char* api_url;
+    char* iam_url;
+
+    CURLSH* share;
+    pthread_mutex_t share_locks[CURL_LOCK_DATA_LAST];
+
+    CURL* handles[POOL_SIZE];
+    int idle_count;
+
+    struct curl_slist* api_headers;
+    struct curl_slist* json_headers;
+    struct curl_slist* retired_api_headers;
+    struct curl_slist* retired_json_headers;
+    unsigned long headers_version;
+    bool compress_requests;
+
+    double request_rate;
+    double request_burst;
+    double request_tokens;
+    double refill_time;
+    double paused_until;
+    int max_attempts;
+    unsigned int jitter_seed;
+
+    pthread_mutex_t lock;
+} CONNECTION_POOL;
+
 size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp);
 
 void initialize_token_data(TOKEN_DATA* token_data, char* key);
 void destroy_token_data(TOKEN_DATA* token_data);
 
 void signal_token_received(TOKEN_DATA* token_data);
+void signal_token_failed(TOKEN_DATA* token_data);
 void signal_job_terminated(TOKEN_DATA* token_data);
+int wait_for_token(TOKEN_DATA* token_data);
 
 char* copy_bearer_token(TOKEN_DATA* token_data);
 
+double get_monotonic_time(void);
+void sleep_seconds(double seconds);
+
+CONNECTION_POOL* create_connection_pool(TOKEN_DATA* token_data, RUNTIME_METRICS* metrics, char* crn, char* api_url, char* iam_url);
+void destroy_connection_pool(CONNECTION_POOL* pool);
+
+CURL* acquire_handle(CONNECTION_POOL* pool);
+void release_handle(CONNECTION_POOL* pool, CURL* curl);
+char* compress_request_body(const char* data, size_t size, size_t* compressed_size);
+
+struct curl_slist* get_api_headers(CONNECTION_POOL* pool, bool json_body);
+void generate_idempotency_key(CONNECTION_POOL* pool, char* key);
+struct curl_slist* build_idempotent_headers(struct curl_slist* headers, char* key);
+
+double acquire_request_slot(CONNECTION_POOL* pool);
+void wait_for_request_slot(CONNECTION_POOL* pool);
+void pause_requests(CONNECTION_POOL* pool, double seconds);
+
+bool is_transient_failure(CURLcode response_code, long http_code);
+bool is_unsent_failure(CURLcode response_code, long http_code);
+double get_retry_delay(CONNECTION_POOL* pool, CURL* curl, long http_code, int attempt);
+CURLcode perform_request(CONNECTION_POOL* pool, CURL* curl, METRIC_PHASE phase, bool submission, RESPONSE_BUFFER* rb, long* http_code);
+
 #endif
@@ -0,0 +1,767 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "backends.h"
+#include "session.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+#include "decoder.h"
+#include "results.h"
+#include "output.h"
+#include "options.h"
+#include "manifest.h"
+#include "runner.h"
+#include "daemon.h"
+
+
+typedef struct DaemonClient {
+    RUNTIME_DAEMON* daemon;
+    int fd;
+} DAEMON_CLIENT;
+
+typedef struct FrameStream {
+    int fd;
+    char type;
+} FRAME_STREAM;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+
+/**
+ * @brief Send a whole buffer over a socket
+ *
+ * @param fd Socket to write to
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @return 0 on success, or -1 if the connection was closed
+ */
+static int send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) return -1;
+        data += sent;
+        size -= sent;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Receive an exact number of bytes from a socket
+ *
+ * @param fd Socket to read from
+ * @param data Buffer receiving the bytes
+ * @param size Number of bytes
+ * @return 0 on success, or -1 if the connection was closed first
+ */
+static int receive_all(int fd, char* data, size_t size) {
+    while (size > 0) {
+        ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return -1;
+        data += received;
+        size -= received;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Send one frame of the daemon protocol
+ *
+ * @param fd Socket to write to
+ * @param type Frame type
+ * @param data Frame data
+ * @param length Number of data bytes
+ * @return 0 on success, or -1 if the connection was closed
+ */
+int send_frame(int fd, char type, const char* data, uint32_t length) {
+    char header[DAEMON_FRAME_HEADER_SIZE];
+    header[0] = type;
+    memcpy(header+1, &length, sizeof(uint32_t));
+
+    if (send_all(fd, header, DAEMON_FRAME_HEADER_SIZE) < 0) return -1;
+
+    return send_all(fd, data, length);
+}
+
+/**
+ * @brief Receive one frame of the daemon protocol
+ *
+ * @param fd Socket to read from
+ * @param type Output pointer receiving the frame type
+ * @param length Output pointer receiving the number of data bytes
+ * @return Newly allocated zero-terminated frame data (CALLER MUST FREE), or
+ *         NULL if the connection was closed or the frame is too large
+ */
+char* receive_frame(int fd, char* type, uint32_t* length) {
+    char header[DAEMON_FRAME_HEADER_SIZE];
+    if (receive_all(fd, header, DAEMON_FRAME_HEADER_SIZE) < 0) return NULL;
+
+    *type = header[0];
+    memcpy(length, header+1, sizeof(uint32_t));
+    if (*length > DAEMON_MAX_FRAME) {
+        fprintf(stderr, "ERROR - Frame of %u bytes exceeds the limit in receive_frame()!\n", *length);
+        return NULL;
+    }
+
+    char* data = (char*)malloc(*length+1);
+    if (!data) {
+        fprintf(stderr, "ERROR - Allocating memory for frame failed in receive_frame()!\n");
+        return NULL;
+    }
+
+    if (receive_all(fd, data, *length) < 0) {
+        free(data);
+        return NULL;
+    }
+    data[*length] = '\0';
+
+    return data;
+}
+
+/**
+ * @brief Write callback of a frame stream
+ *
+ * @param cookie Pointer to FRAME_STREAM
+ * @param data Bytes written to the stream
+ * @param size Number of bytes
+ * @return Number of bytes written, or -1 if the client went away
+ */
+static ssize_t write_frame_stream(void* cookie, const char* data, size_t size) {
+    FRAME_STREAM* frame_stream = (FRAME_STREAM*)cookie;
+
+    if (send_frame(frame_stream->fd, frame_stream->type, data, (uint32_t)size) < 0) return -1;
+
+    return (ssize_t)size;
+}
+
+/**
+ * @brief Close callback of a frame stream
+ *
+ * @param cookie Pointer to FRAME_STREAM
+ * @return 0
+ */
+static int close_frame_stream(void* cookie) {
+    free(cookie);
+
+    return 0;
+}
+
+/**
+ * @brief Open a stream whose output is sent as frames of one type
+ *
+ * Every flush of the stream becomes one frame, so output written by the
+ * runner reaches the client while the jobs are still running.
+ *
+ * @param fd Client socket
+ * @param type Frame type of the output
+ * @return Stream (CALLER MUST CLOSE), or NULL on failure
+ */
+static FILE* open_frame_stream(int fd, char type) {
+    FRAME_STREAM* frame_stream = (FRAME_STREAM*)malloc(sizeof(FRAME_STREAM));
+    if (!frame_stream) {
+        fprintf(stderr, "ERROR - Allocating memory for frame stream failed in open_frame_stream()!\n");
+        return NULL;
+    }
+    frame_stream->fd = fd;
+    frame_stream->type = type;
+
+    cookie_io_functions_t functions = {NULL, write_frame_stream, NULL, close_frame_stream};
+    FILE* stream = fopencookie(frame_stream, "w", functions);
+    if (!stream) {
+        fprintf(stderr, "ERROR - Opening the frame stream failed in open_frame_stream()!\n");
+        free(frame_stream);
+    }
+
+    return stream;
+}
+
+
+/**
+ * @brief Read the analysis options of a client request
+ *
+ * Options missing from the request keep the defaults of the daemon.
+ *
+ * @param analysis_cjson Analysis object of the request, or NULL
+ * @param analysis Pointer to ANALYSIS_OPTIONS to update
+ * @return 0 on success, or -1 if an option is invalid
+ */
+static int parse_analysis_request(cJSON* analysis_cjson, ANALYSIS_OPTIONS* analysis) {
+    if (!cJSON_IsObject(analysis_cjson)) return 0;
+
+    cJSON* expect_cjson = cJSON_GetObjectItem(analysis_cjson, "expect");
+    cJSON* marginal_cjson = cJSON_GetObjectItem(analysis_cjson, "marginal");
+    cJSON* correlations_cjson = cJSON_GetObjectItem(analysis_cjson, "correlations");
+    cJSON* resamples_cjson = cJSON_GetObjectItem(analysis_cjson, "resamples");
+
+    if (cJSON_IsArray(expect_cjson)) {
+        analysis->observable_count = 0;
+        cJSON* observable_cjson = NULL;
+        cJSON_ArrayForEach(observable_cjson, expect_cjson) {
+            if (!cJSON_IsString(observable_cjson) || add_observable(analysis, observable_cjson->valuestring) < 0) return -1;
+        }
+    }
+
+    if (cJSON_IsArray(marginal_cjson)) {
+        int bit_count = cJSON_GetArraySize(marginal_cjson);
+        if (bit_count > ANALYSIS_MAX_MARGINAL_BITS) return -1;
+
+        for (int i = 0; i < bit_count; i++) {
+            cJSON* bit_cjson = cJSON_GetArrayItem(marginal_cjson, i);
+            if (!cJSON_IsNumber(bit_cjson) || bit_cjson->valueint < 0 || bit_cjson->valueint >= ANALYSIS_MAX_BIT_INDEX) return -1;
+            analysis->marginal_bits[i] = bit_cjson->valueint;
+        }
+        analysis->marginal_bit_count = bit_count;
+    }
+
+    if (cJSON_IsBool(correlations_cjson)) analysis->correlations = cJSON_IsTrue(correlations_cjson);
+    if (cJSON_IsNumber(resamples_cjson)) analysis->resamples = resamples_cjson->valueint;
+
+    return analysis->resamples < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Build the request a client sends to the daemon
+ *
+ * @param circuits Array of circuits to run
+ * @param circuit_count Number of circuits
+ * @param options Pointer to RUNTIME_OPTIONS selecting how the circuits run
+ * @return Newly allocated JSON request (CALLER MUST FREE), or NULL on failure
+ */
+char* build_daemon_request(CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options) {
+    cJSON* root = cJSON_CreateObject();
+
+    cJSON* circuits_cjson = cJSON_AddArrayToObject(root, "circuits");
+    for (int i = 0; i < circuit_count; i++) {
+        cJSON* circuit_cjson = cJSON_CreateObject();
+        cJSON_AddStringToObject(circuit_cjson, "name", circuits[i].name);
+        cJSON_AddStringToObject(circuit_cjson, "qasm", circuits[i].qasm);
+        if (circuits[i].shots > 0) cJSON_AddNumberToObject(circuit_cjson, "shots", circuits[i].shots);
+        if (circuits[i].binding_count > 0) {
+            cJSON* values_cjson = cJSON_AddArrayToObject(circuit_cjson, "parameter_values");
+            for (int j = 0; j < circuits[i].binding_count; j++) {
+                double* row = &circuits[i].parameter_values[(size_t)j*circuits[i].parameter_count];
+                cJSON_AddItemToArray(values_cjson, cJSON_CreateDoubleArray(row, circuits[i].parameter_count));
+            }
+        }
+        cJSON_AddItemToArray(circuits_cjson, circuit_cjson);
+    }
+
+    cJSON_AddNumberToObject(root, "jobs", options->concurrent_jobs);
+    cJSON_AddNumberToObject(root, "format", options->output_format);
+    cJSON_AddNumberToObject(root, "top_k", options->top_k);
+    cJSON_AddBoolToObject(root, "probabilities", options->probabilities);
+    cJSON_AddNumberToObject(root, "cache", options->result_cache);
+    cJSON_AddNumberToObject(root, "hedge", options->hedge_count);
+    cJSON_AddNumberToObject(root, "hedge_budget", options->hedge_budget);
+    cJSON_AddNumberToObject(root, "shards", options->shard_count);
+
+    ANALYSIS_OPTIONS* analysis = &options->analysis;
+    cJSON* analysis_cjson = cJSON_AddObjectToObject(root, "analysis");
+    cJSON* expect_cjson = cJSON_AddArrayToObject(analysis_cjson, "expect");
+    for (int i = 0; i < analysis->observable_count; i++) cJSON_AddItemToArray(expect_cjson, cJSON_CreateString(analysis->observables[i]));
+    cJSON_AddItemToObject(analysis_cjson, "marginal", cJSON_CreateIntArray(analysis->marginal_bits, analysis->marginal_bit_count));
+    cJSON_AddBoolToObject(analysis_cjson, "correlations", analysis->correlations);
+    cJSON_AddNumberToObject(analysis_cjson, "resamples", analysis->resamples);
+    if (options->deadline > 0.0) {
+        cJSON_AddNumberToObject(root, "deadline", options->deadline);
+        cJSON_AddBoolToObject(root, "fallback", options->fallback);
+    }
+
+    char* request = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return request;
+}
+
+/**
+ * @brief Parse the parameter bindings of a circuit in a client request
+ *
+ * @param values_cjson Pointer to the array of binding rows, or NULL if the
+ *        circuit is not swept
+ * @param circuit Pointer to CIRCUIT receiving the bindings
+ * @return 0 on success, or -1 if the rows do not match the parameters
+ */
+static int parse_parameter_values(cJSON* values_cjson, CIRCUIT* circuit) {
+    if (!values_cjson) return 0;
+
+    int row_count = cJSON_IsArray(values_cjson) ? cJSON_GetArraySize(values_cjson) : 0;
+    if (row_count == 0 || circuit->parameter_count == 0) return -1;
+
+    circuit->parameter_values = (double*)malloc((size_t)row_count*circuit->parameter_count*sizeof(double));
+    if (!circuit->parameter_values) {
+        fprintf(stderr, "ERROR - Allocating memory for parameter values failed in parse_parameter_values()!\n");
+        return -1;
+    }
+
+    for (int i = 0; i < row_count; i++) {
+        cJSON* row_cjson = cJSON_GetArrayItem(values_cjson, i);
+        if (!cJSON_IsArray(row_cjson) || cJSON_GetArraySize(row_cjson) != circuit->parameter_count) return -1;
+
+        for (int j = 0; j < circuit->parameter_count; j++) {
+            cJSON* value_cjson = cJSON_GetArrayItem(row_cjson, j);
+            if (!cJSON_IsNumber(value_cjson)) return -1;
+            circuit->parameter_values[(size_t)i*circuit->parameter_count+j] = value_cjson->valuedouble;
+        }
+    }
+
+    circuit->binding_count = row_count;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a client request received by the daemon
+ *
+ * Options missing from the request keep the values already in options.
+ *
+ * @param request JSON request built by build_daemon_request()
+ * @param options Pointer to RUNTIME_OPTIONS updated from the request
+ * @param circuit_count Output pointer receiving the number of circuits
+ * @return Newly allocated CIRCUIT array (CALLER MUST FREE with free_circuits)
+ *         or NULL on failure
+ */
+CIRCUIT* parse_daemon_request(char* request, RUNTIME_OPTIONS* options, int* circuit_count) {
+    CIRCUIT* circuits = NULL;
+    *circuit_count = 0;
+
+    cJSON* root = cJSON_Parse(request);
+    if (!root) {
+        fprintf(stderr, "ERROR - Parsing request JSON failed in parse_daemon_request()!\n");
+        goto terminate;
+    }
+
+    cJSON* circuits_cjson = cJSON_GetObjectItem(root, "circuits");
+    int count = cJSON_IsArray(circuits_cjson) ? cJSON_GetArraySize(circuits_cjson) : 0;
+    if (count == 0) {
+        fprintf(stderr, "ERROR - The request holds no circuits in parse_daemon_request()!\n");
+        goto cleanup_root;
+    }
+
+    circuits = (CIRCUIT*)calloc(count, sizeof(CIRCUIT));
+    if (!circuits) {
+        fprintf(stderr, "ERROR - Allocating memory for circuits failed in parse_daemon_request()!\n");
+        goto cleanup_root;
+    }
+
+    for (int i = 0; i < count; i++) {
+        cJSON* circuit_cjson = cJSON_GetArrayItem(circuits_cjson, i);
+        char* name = cJSON_GetStringValue(cJSON_GetObjectItem(circuit_cjson, "name"));
+        char* qasm = cJSON_GetStringValue(cJSON_GetObjectItem(circuit_cjson, "qasm"));
+        if (!name || !qasm) {
+            fprintf(stderr, "ERROR - Circuit %d of the request is invalid in parse_daemon_request()!\n", i);
+            goto cleanup_circuits;
+        }
+
+        initialize_circuit(&circuits[i], strdup(name), strdup(qasm));
+        (*circuit_count)++;
+        if (!circuits[i].name || !circuits[i].qasm) {
+            fprintf(stderr, "ERROR - Copying circuit %d failed in parse_daemon_request()!\n", i);
+            goto cleanup_circuits;
+        }
+
+        if (parse_parameter_values(cJSON_GetObjectItem(circuit_cjson, "parameter_values"), &circuits[i]) < 0) {
+            fprintf(stderr, "ERROR - The parameter values of circuit %d are invalid in parse_daemon_request()!\n", i);
+            goto cleanup_circuits;
+        }
+
+        cJSON* shots_cjson = cJSON_GetObjectItem(circuit_cjson, "shots");
+        if (cJSON_IsNumber(shots_cjson)) circuits[i].shots = shots_cjson->valueint;
+        if (circuits[i].shots < 0) {
+            fprintf(stderr, "ERROR - The shot count of circuit %d is invalid in parse_daemon_request()!\n", i);
+            goto cleanup_circuits;
+        }
+    }
+
+    cJSON* jobs_cjson = cJSON_GetObjectItem(root, "jobs");
+    cJSON* format_cjson = cJSON_GetObjectItem(root, "format");
+    cJSON* top_k_cjson = cJSON_GetObjectItem(root, "top_k");
+    cJSON* probabilities_cjson = cJSON_GetObjectItem(root, "probabilities");
+    cJSON* cache_cjson = cJSON_GetObjectItem(root, "cache");
+    cJSON* deadline_cjson = cJSON_GetObjectItem(root, "deadline");
+    cJSON* fallback_cjson = cJSON_GetObjectItem(root, "fallback");
+    cJSON* hedge_cjson = cJSON_GetObjectItem(root, "hedge");
+    cJSON* hedge_budget_cjson = cJSON_GetObjectItem(root, "hedge_budget");
+    cJSON* shards_cjson = cJSON_GetObjectItem(root, "shards");
+
+    if (cJSON_IsNumber(jobs_cjson)) options->concurrent_jobs = jobs_cjson->valueint;
+    if (cJSON_IsNumber(format_cjson)) options->output_format = (OUTPUT_FORMAT)format_cjson->valueint;
+    if (cJSON_IsNumber(top_k_cjson)) options->top_k = top_k_cjson->valueint;
+    if (cJSON_IsBool(probabilities_cjson)) options->probabilities = cJSON_IsTrue(probabilities_cjson);
+    if (cJSON_IsNumber(cache_cjson)) options->result_cache = (RESULT_CACHE_POLICY)cache_cjson->valueint;
+    if (cJSON_IsNumber(deadline_cjson)) options->deadline = deadline_cjson->valuedouble;
+    if (cJSON_IsBool(fallback_cjson)) options->fallback = cJSON_IsTrue(fallback_cjson);
+    if (cJSON_IsNumber(hedge_cjson)) options->hedge_count = hedge_cjson->valueint;
+    if (cJSON_IsNumber(hedge_budget_cjson)) options->hedge_budget = hedge_budget_cjson->valueint;
+    if (cJSON_IsNumber(shards_cjson)) options->shard_count = shards_cjson->valueint;
+
+    if (parse_analysis_request(cJSON_GetObjectItem(root, "analysis"), &options->analysis) < 0) {
+        fprintf(stderr, "ERROR - The request holds an invalid analysis in parse_daemon_request()!\n");
+        goto cleanup_circuits;
+    }
+
+    if (options->output_format < OUTPUT_MODE || options->output_format > OUTPUT_CSV ||
+        options->result_cache < RESULT_CACHE_OFF || options->result_cache > RESULT_CACHE_REFRESH || options->top_k < 0 ||
+        !(options->deadline >= 0.0) || options->hedge_count < 1 || options->hedge_budget < -1 ||
+        options->shard_count < 1 || (options->shard_count > 1 && options->hedge_count > 1)) {
+        fprintf(stderr, "ERROR - The request holds invalid options in parse_daemon_request()!\n");
+        goto cleanup_circuits;
+    }
+
+    goto cleanup_root;
+
+cleanup_circuits:
+    free_circuits(circuits, *circuit_count);
+    circuits = NULL;
+    *circuit_count = 0;
+
+cleanup_root:
+    cJSON_Delete(root);
+
+terminate:
+    return circuits;
+}
+
+
+/**
+ * @brief Run the request of one client connection
+ *
+ * Runs the requested circuits with the shared connection pool and backend
+ * cache, streams progress and results back as frames, and ends with the
+ * exit status frame. The metrics files, if any, are updated afterwards.
+ *
+ * @param arg Pointer to DAEMON_CLIENT (freed by this function)
+ * @return NULL
+ */
+static void* serve_client(void* arg) {
+    DAEMON_CLIENT* client = (DAEMON_CLIENT*)arg;
+    RUNTIME_DAEMON* daemon = client->daemon;
+    char exit_status = EXIT_FAILURE;
+
+    char type = 0;
+    uint32_t length = 0;
+    char* request = receive_frame(client->fd, &type, &length);
+    if (!request || type != DAEMON_FRAME_REQUEST) {
+        fprintf(stderr, "ERROR - Receiving the client request failed in serve_client()!\n");
+        goto cleanup_request;
+    }
+
+    RUNTIME_OPTIONS options = *daemon->defaults;
+    int circuit_count = 0;
+    CIRCUIT* circuits = parse_daemon_request(request, &options, &circuit_count);
+    if (!circuits) {
+        fprintf(stderr, "ERROR - Parsing the client request failed in serve_client()!\n");
+        goto cleanup_request;
+    }
+
+    FILE* console = open_frame_stream(client->fd, DAEMON_FRAME_CONSOLE);
+    FILE* stream = open_frame_stream(client->fd, DAEMON_FRAME_RESULT);
+    if (!console || !stream) {
+        fprintf(stderr, "ERROR - Opening the client streams failed in serve_client()!\n");
+        goto cleanup_streams;
+    }
+
+    RESULT_WRITER* writer = create_result_writer(NULL, options.output_format, options.top_k, options.probabilities, NULL);
+    if (!writer) {
+        fprintf(stderr, "ERROR - Creating the result writer failed in serve_client()!\n");
+        goto cleanup_streams;
+    }
+    writer->stream = stream;
+    writer->console = console;
+    writer->analysis = &options.analysis;
+
+    exit_status = run_circuits(daemon->pool, daemon->backend_cache, daemon->session, circuits, circuit_count, &options, writer);
+
+    destroy_result_writer(writer);
+
+    // The exports cover every request served so far.
+
+    export_metrics(daemon->pool->metrics, options.metrics_path, options.prometheus_path);
+
+cleanup_streams:
+    if (stream) fclose(stream);
+    if (console) fclose(console);
+    free_circuits(circuits, circuit_count);
+
+cleanup_request:
+    free(request);
+
+    send_frame(client->fd, DAEMON_FRAME_EXIT, &exit_status, 1);
+    close(client->fd);
+
+    pthread_mutex_lock(&daemon->lock);
+    daemon->client_count--;
+    pthread_cond_broadcast(&daemon->idle_cond);
+    pthread_mutex_unlock(&daemon->lock);
+
+    free(client);
+
+    return NULL;
+}
+
+/**
+ * @brief Signal handler asking the daemon to stop
+ *
+ * @param signal_number Number of the received signal
+ */
+static void request_stop(int signal_number) {
+    (void)signal_number;
+    stop_requested = 1;
+
+    return;
+}
+
+/**
+ * @brief Fill the address of a Unix domain socket
+ *
+ * @param address Pointer to the address to fill
+ * @param socket_path Path of the socket
+ * @return 0 on success, or -1 if the path is too long
+ */
+static int get_socket_address(struct sockaddr_un* address, char* socket_path) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(socket_path) >= sizeof(address->sun_path)) {
+        fprintf(stderr, "ERROR - Socket path %s is too long in get_socket_address()!\n", socket_path);
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+
+    return 0;
+}
+
+/**
+ * @brief Create the listening socket of the daemon
+ *
+ * A socket file left behind by a daemon that is no longer running is
+ * replaced. The socket is only accessible to the current user.
+ *
+ * @param socket_path Path of the socket
+ * @return Listening socket, or -1 on failure
+ */
+static int listen_on_socket(char* socket_path) {
+    struct sockaddr_un address;
+    if (get_socket_address(&address, socket_path) < 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR - Creating the socket failed in listen_on_socket()!\n");
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) == 0) {
+        fprintf(stderr, "ERROR - A daemon is already listening on %s in listen_on_socket()!\n", socket_path);
+        close(fd);
+        return -1;
+    }
+    if (errno == ECONNREFUSED) unlink(socket_path);
+
+    close(fd);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR - Creating the socket failed in listen_on_socket()!\n");
+        return -1;
+    }
+
+    mode_t mask = umask(0077);
+    int bind_status = bind(fd, (struct sockaddr*)&address, sizeof(address));
+    umask(mask);
+
+    if (bind_status < 0 || listen(fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "ERROR - Listening on %s failed in listen_on_socket()!\n", socket_path);
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/**
+ * @brief Serve job requests on a Unix domain socket until stopped
+ *
+ * Keeps the authenticated connection pool and the backend cache of the
+ * calling process warm across requests. Every client is served by its own
+ * thread, so requests run concurrently. Returns after SIGINT or SIGTERM,
+ * once every running request has finished.
+ *
+ * With a session, the jobs of consecutive requests run in it, and it is
+ * closed once no request has used it for its idle timeout.
+ *
+ * @param pool Pointer to CONNECTION_POOL shared by all requests
+ * @param backend_cache Pointer to BACKEND_CACHE shared by all requests
+ * @param session Pointer to SESSION shared by all requests, or NULL
+ * @param socket_path Path of the socket to listen on
+ * @param defaults Pointer to RUNTIME_OPTIONS used where a request sets none
+ * @return 0 after a clean stop, or -1 if the daemon could not start
+ */
+int run_daemon(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, char* socket_path, RUNTIME_OPTIONS* defaults) {
+    RUNTIME_DAEMON daemon;
+    memset(&daemon, 0, sizeof(RUNTIME_DAEMON));
+    daemon.pool = pool;
+    daemon.backend_cache = backend_cache;
+    daemon.session = session;
+    daemon.defaults = defaults;
+
+    daemon.listen_fd = listen_on_socket(socket_path);
+    if (daemon.listen_fd < 0) return -1;
+
+    pthread_mutex_init(&daemon.lock, NULL);
+    pthread_cond_init(&daemon.idle_cond, NULL);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(stdout, "Listening on %s\n\n", socket_path);
+    fflush(stdout);
+
+    while (!stop_requested) {
+        expire_session(daemon.session);
+
+        struct pollfd listen_poll = {daemon.listen_fd, POLLIN, 0};
+        if (poll(&listen_poll, 1, DAEMON_POLL_MS) <= 0) continue;
+
+        int fd = accept4(daemon.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+
+        DAEMON_CLIENT* client = (DAEMON_CLIENT*)malloc(sizeof(DAEMON_CLIENT));
+        if (!client) {
+            fprintf(stderr, "ERROR - Allocating memory for client failed in run_daemon()!\n");
+            close(fd);
+            continue;
+        }
+        client->daemon = &daemon;
+        client->fd = fd;
+
+        pthread_mutex_lock(&daemon.lock);
+        daemon.client_count++;
+        pthread_mutex_unlock(&daemon.lock);
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_client, client) != 0) {
+            fprintf(stderr, "ERROR - Thread creation failed in run_daemon()!\n");
+            pthread_mutex_lock(&daemon.lock);
+            daemon.client_count--;
+            pthread_mutex_unlock(&daemon.lock);
+            close(fd);
+            free(client);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    // Stop accepting, then let the running requests finish.
+
+    close(daemon.listen_fd);
+    unlink(socket_path);
+
+    pthread_mutex_lock(&daemon.lock);
+    while (daemon.client_count > 0) pthread_cond_wait(&daemon.idle_cond, &daemon.lock);
+    pthread_mutex_unlock(&daemon.lock);
+
+    pthread_cond_destroy(&daemon.idle_cond);
+    pthread_mutex_destroy(&daemon.lock);
+
+    return 0;
+}
+
+
+/**
+ * @brief Run circuits through a running daemon
+ *
+ * Sends the circuits and options to the daemon and writes the progress and
+ * results it streams back, so that the output matches a local run.
+ *
+ * @param socket_path Path of the daemon socket
+ * @param circuits Array of circuits to run
+ * @param circuit_count Number of circuits
+ * @param options Pointer to RUNTIME_OPTIONS selecting how the circuits run
+ * @param writer Pointer to RESULT_WRITER providing the console and output
+ *        streams
+ * @return Exit status reported by the daemon, or EXIT_FAILURE on error
+ */
+int submit_to_daemon(char* socket_path, CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options, RESULT_WRITER* writer) {
+    int exit_status = EXIT_FAILURE;
+
+    struct sockaddr_un address;
+    if (get_socket_address(&address, socket_path) < 0) goto terminate;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR - Creating the socket failed in submit_to_daemon()!\n");
+        goto terminate;
+    }
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        fprintf(stderr, "ERROR - Connecting to the daemon on %s failed in submit_to_daemon()!\n", socket_path);
+        goto cleanup_socket;
+    }
+
+    char* request = build_daemon_request(circuits, circuit_count, options);
+    if (!request) {
+        fprintf(stderr, "ERROR - Building the daemon request failed in submit_to_daemon()!\n");
+        goto cleanup_socket;
+    }
+
+    if (send_frame(fd, DAEMON_FRAME_REQUEST, request, (uint32_t)strlen(request)) < 0) {
+        fprintf(stderr, "ERROR - Sending the request failed in submit_to_daemon()!\n");
+        goto cleanup_request;
+    }
+
+    while (true) {
+        char type = 0;
+        uint32_t length = 0;
+        char* data = receive_frame(fd, &type, &length);
+        if (!data) {
+            fprintf(stderr, "ERROR - The daemon closed the connection in submit_to_daemon()!\n");
+            break;
+        }
+
+        if (type == DAEMON_FRAME_CONSOLE || type == DAEMON_FRAME_RESULT) {
+            FILE* stream = type == DAEMON_FRAME_CONSOLE ? writer->console : writer->stream;
+            fwrite(data, sizeof(char), length, stream);
+            fflush(stream);
+        } else if (type == DAEMON_FRAME_EXIT && length == 1) {
+            exit_status = data[0];
+            free(data);
+            break;
+        }
+
+        free(data);
+    }
+
+cleanup_request:
+    free(request);
+
+cleanup_socket:
+    close(fd);
+
+terminate:
+    return exit_status;
+}
@@ -0,0 +1,53 @@
+#ifndef _DAEMON_H_
+#define _DAEMON_H_
+
+#define DAEMON_FRAME_REQUEST 'J'
+#define DAEMON_FRAME_CONSOLE 'C'
+#define DAEMON_FRAME_RESULT 'R'
+#define DAEMON_FRAME_EXIT 'X'
+#define DAEMON_FRAME_HEADER_SIZE 5
+#define DAEMON_MAX_FRAME (64 << 20)
+#define DAEMON_POLL_MS 1000
+
+/*
+ * Protocol on the daemon socket, all lengths in host byte order:
+ *
+ *   frame = type (1 byte), length (uint32_t), length bytes of data
+ *
+ * The client sends one DAEMON_FRAME_REQUEST frame holding a JSON object
+ *
+ *   {"circuits": [{"name": ..., "qasm": ..., "parameter_values": [[...], ...]},
+ *                 ...], "jobs": N,
+ *    "format": F, "top_k": K, "probabilities": B, "cache": P}
+ *
+ * where format and cache are OUTPUT_FORMAT and RESULT_CACHE_POLICY values
+ * and parameter_values, present only for swept circuits, holds one row of
+ * values per binding in the sorted order of the input parameters.
+ * The daemon streams DAEMON_FRAME_CONSOLE frames (progress text) and
+ * DAEMON_FRAME_RESULT frames (formatted results) while the jobs run, and
+ * ends with one DAEMON_FRAME_EXIT frame holding the exit status byte.
+ */
+
+typedef struct RuntimeDaemon {
+    CONNECTION_POOL* pool;
+    BACKEND_CACHE* backend_cache;
+    SESSION* session;
+    RUNTIME_OPTIONS* defaults;
+
+    int listen_fd;
+    int client_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t idle_cond;
+} RUNTIME_DAEMON;
+
+int send_frame(int fd, char type, const char* data, uint32_t length);
+char* receive_frame(int fd, char* type, uint32_t* length);
+
+char* build_daemon_request(CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options);
+CIRCUIT* parse_daemon_request(char* request, RUNTIME_OPTIONS* options, int* circuit_count);
+
+int run_daemon(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, char* socket_path, RUNTIME_OPTIONS* defaults);
+int submit_to_daemon(char* socket_path, CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options, RESULT_WRITER* writer);
+
+#endif
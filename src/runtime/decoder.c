@@ -0,0 +1,781 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "bitset.h"
+#include "histogram.h"
+#include "decoder.h"
+
+
+/**
+ * @brief Create a streaming decoder for a sampler job result
+ *
+ * The decoder consumes the result JSON in arbitrary chunks, as delivered by
+ * the cURL write callback, and counts the samples of every pub while the
+ * body is still downloading. Only the first DECODER_PREFIX_NMEMB bytes of
+ * the body are kept, for error reporting.
+ *
+ * @param pub_count Number of pubs submitted in the job, or of results when
+ *        pubs are swept over bindings (see set_pub_bindings())
+ * @param measured_bits Measured register width of every pub used to size
+ *        the histograms, or NULL if unknown
+ * @param keep_samples Whether every shot is also recorded in order, in
+ *        addition to the counts
+ * @return Pointer to newly allocated RESULT_DECODER (CALLER MUST DESTROY),
+ *         or NULL on failure
+ */
+RESULT_DECODER* create_result_decoder(int pub_count, int* measured_bits, bool keep_samples) {
+    RESULT_DECODER* decoder = (RESULT_DECODER*)calloc(1, sizeof(RESULT_DECODER));
+    if (!decoder) {
+        fprintf(stderr, "ERROR - Allocating memory for result decoder failed in create_result_decoder()!\n");
+        goto terminate;
+    }
+
+    decoder->pubs = (PUB_COUNTS*)calloc(pub_count, sizeof(PUB_COUNTS));
+    if (!decoder->pubs) {
+        fprintf(stderr, "ERROR - Allocating memory for pub counts failed in create_result_decoder()!\n");
+        free(decoder);
+        decoder = NULL;
+        goto terminate;
+    }
+
+    decoder->pub_count = pub_count;
+    decoder->job_pub_count = pub_count;
+    decoder->keep_samples = keep_samples;
+    decoder->state = DECODER_VALUE;
+
+    for (int i = 0; i < pub_count; i++) {
+        if (initialize_histogram(&decoder->pubs[i].histogram, measured_bits ? measured_bits[i] : 0) < 0) {
+            fprintf(stderr, "ERROR - Initializing the histogram of pub %d failed in create_result_decoder()!\n", i);
+            destroy_result_decoder(decoder);
+            decoder = NULL;
+            goto terminate;
+        }
+    }
+
+terminate:
+    return decoder;
+}
+
+/**
+ * @brief Destroy a result decoder and its counters
+ *
+ * @param decoder Pointer to RESULT_DECODER to destroy
+ */
+void destroy_result_decoder(RESULT_DECODER* decoder) {
+    if (!decoder) return;
+
+    for (int i = 0; i < decoder->pub_count; i++) {
+        free_histogram(&decoder->pubs[i].histogram);
+        free(decoder->pubs[i].samples);
+    }
+    free(decoder->pubs);
+    for (int i = 0; i < decoder->shard_count; i++) {
+        free(decoder->shards[i].job_id);
+        free(decoder->shards[i].backend);
+    }
+    free(decoder->shards);
+    free(decoder->pub_bindings);
+    free(decoder->first_slots);
+    free(decoder->sample_digits);
+    free(decoder->sample_words);
+    free(decoder);
+
+    return;
+}
+
+
+/**
+ * @brief Declare the parameter bindings of the submitted pubs
+ *
+ * A pub swept over N bindings returns its samples as N nested arrays, each
+ * of which is counted into its own result. The results of all pubs follow
+ * each other in pub order, so the decoder must have been created with one
+ * result per binding.
+ *
+ * @param decoder Pointer to RESULT_DECODER to configure
+ * @param bindings Number of bindings of every pub, 0 for an unswept pub
+ * @param job_pub_count Number of submitted pubs
+ * @return 0 on success, or -1 if the bindings do not match the results
+ */
+int set_pub_bindings(RESULT_DECODER* decoder, int* bindings, int job_pub_count) {
+    int* pub_bindings = (int*)malloc(job_pub_count*sizeof(int));
+    int* first_slots = (int*)malloc((job_pub_count+1)*sizeof(int));
+    if (!pub_bindings || !first_slots) {
+        fprintf(stderr, "ERROR - Allocating memory for bindings failed in set_pub_bindings()!\n");
+        free(pub_bindings);
+        free(first_slots);
+        return -1;
+    }
+
+    first_slots[0] = 0;
+    for (int i = 0; i < job_pub_count; i++) {
+        pub_bindings[i] = bindings[i];
+        first_slots[i+1] = first_slots[i] + (bindings[i] > 0 ? bindings[i] : 1);
+    }
+
+    if (first_slots[job_pub_count] != decoder->pub_count) {
+        fprintf(stderr, "ERROR - The bindings do not match the %d results in set_pub_bindings()!\n", decoder->pub_count);
+        free(pub_bindings);
+        free(first_slots);
+        return -1;
+    }
+
+    free(decoder->pub_bindings);
+    free(decoder->first_slots);
+    decoder->pub_bindings = pub_bindings;
+    decoder->first_slots = first_slots;
+    decoder->job_pub_count = job_pub_count;
+
+    return 0;
+}
+
+/**
+ * @brief Reset a result decoder for a new response body
+ *
+ * Keeps the allocated counters so that a retried download reuses them.
+ *
+ * @param decoder Pointer to RESULT_DECODER to reset
+ */
+void reset_result_decoder(RESULT_DECODER* decoder) {
+    for (int i = 0; i < decoder->pub_count; i++) {
+        PUB_COUNTS* pub = &decoder->pubs[i];
+        pub->register_name[0] = '\0';
+        pub->num_bits = 0;
+        pub->sample_count = 0;
+        clear_histogram(&pub->histogram);
+    }
+
+    decoder->state = DECODER_VALUE;
+    decoder->depth = 0;
+    decoder->result_count = 0;
+    decoder->parse_time = 0.0;
+    decoder->prefix_size = 0;
+    decoder->prefix[0] = '\0';
+
+    return;
+}
+
+
+/**
+ * @brief Put the decoder in the error state
+ *
+ * @param decoder Pointer to RESULT_DECODER that failed
+ * @param message Reason printed to stderr
+ */
+static void fail_decoder(RESULT_DECODER* decoder, const char* message) {
+    if (decoder->state != DECODER_ERROR) {
+        fprintf(stderr, "ERROR - %s in feed_result_decoder()!\n", message);
+    }
+    decoder->state = DECODER_ERROR;
+
+    return;
+}
+
+/**
+ * @brief Compare the object key just read with a name
+ *
+ * @param decoder Pointer to RESULT_DECODER holding the key
+ * @param name Name to compare with
+ * @return true if the key equals the name
+ */
+static bool key_is(RESULT_DECODER* decoder, const char* name) {
+    return decoder->key_length < DECODER_KEY_NMEMB && strcmp(decoder->key, name) == 0;
+}
+
+/**
+ * @brief Classify the value that starts at the current position
+ *
+ * Only the path results[i].data.<register>.{samples,num_bits} is of
+ * interest, with samples nested one level deeper for swept pubs; every
+ * other value is skipped as ROLE_OTHER.
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ * @return Role of the value
+ */
+static DECODER_ROLE child_role(RESULT_DECODER* decoder) {
+    if (decoder->depth == 0) return ROLE_ROOT;
+
+    DECODER_FRAME* parent = &decoder->stack[decoder->depth-1];
+    switch (parent->role) {
+    case ROLE_ROOT:
+        return key_is(decoder, "results") ? ROLE_RESULTS : ROLE_OTHER;
+    case ROLE_RESULTS:
+        if (parent->index+1 > decoder->result_count) decoder->result_count = parent->index+1;
+        return parent->index < decoder->job_pub_count ? ROLE_PUB : ROLE_OTHER;
+    case ROLE_PUB:
+        return key_is(decoder, "data") ? ROLE_DATA : ROLE_OTHER;
+    case ROLE_DATA:
+        return ROLE_REGISTER;
+    case ROLE_REGISTER:
+        if (!parent->selected) return ROLE_OTHER;
+        if (key_is(decoder, "samples")) return ROLE_SAMPLES;
+        if (key_is(decoder, "num_bits")) return ROLE_NUM_BITS;
+        return ROLE_OTHER;
+    case ROLE_SAMPLES:
+        if (parent->bindings == 0) return ROLE_SAMPLE;
+        return parent->index < parent->bindings ? ROLE_BINDING : ROLE_OTHER;
+    case ROLE_BINDING:
+        return ROLE_SAMPLE;
+    default:
+        return ROLE_OTHER;
+    }
+}
+
+/**
+ * @brief Decide whether a classical register of a pub is counted
+ *
+ * The register named meas is counted when present, otherwise the first
+ * register of the pub. A later meas register replaces an earlier one.
+ *
+ * @param decoder Pointer to RESULT_DECODER holding the register name as key
+ * @param slot First result of the pub
+ * @param slot_count Number of results of the pub, one per binding
+ * @return true if the register is counted
+ */
+static bool select_register(RESULT_DECODER* decoder, int slot, int slot_count) {
+    if (decoder->key_length >= DECODER_KEY_NMEMB) return false;
+
+    PUB_COUNTS* first = &decoder->pubs[slot];
+    if (first->register_name[0] && (strcmp(first->register_name, "meas") == 0 || !key_is(decoder, "meas"))) return false;
+
+    for (int i = slot; i < slot+slot_count; i++) {
+        PUB_COUNTS* pub = &decoder->pubs[i];
+        if (pub->register_name[0]) {
+            clear_histogram(&pub->histogram);
+            pub->num_bits = 0;
+            pub->sample_count = 0;
+        }
+
+        strcpy(pub->register_name, decoder->key);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Open an object or array
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ * @param type Opening character ('{' or '[')
+ */
+static void push_frame(RESULT_DECODER* decoder, char type) {
+    if (decoder->depth >= DECODER_MAX_DEPTH) {
+        fail_decoder(decoder, "The result JSON is nested too deeply");
+        return;
+    }
+
+    DECODER_ROLE role = child_role(decoder);
+    DECODER_FRAME* parent = decoder->depth > 0 ? &decoder->stack[decoder->depth-1] : NULL;
+
+    bool is_object = type == '{';
+    if ((role == ROLE_RESULTS || role == ROLE_SAMPLES || role == ROLE_BINDING) == is_object) role = ROLE_OTHER;
+    if ((role == ROLE_ROOT || role == ROLE_PUB || role == ROLE_DATA || role == ROLE_REGISTER) != is_object) role = ROLE_OTHER;
+
+    DECODER_FRAME* frame = &decoder->stack[decoder->depth++];
+    frame->type = type;
+    frame->role = role;
+    frame->index = 0;
+    frame->pub = parent ? parent->pub : -1;
+    frame->bindings = parent ? parent->bindings : 0;
+    frame->selected = false;
+
+    // Frames refer to results: the first one of their pub, or that of their binding.
+
+    if (role == ROLE_PUB) {
+        frame->pub = decoder->first_slots ? decoder->first_slots[parent->index] : parent->index;
+        frame->bindings = decoder->pub_bindings ? decoder->pub_bindings[parent->index] : 0;
+    } else if (role == ROLE_REGISTER) {
+        frame->selected = select_register(decoder, frame->pub, frame->bindings > 0 ? frame->bindings : 1);
+    } else if (role == ROLE_BINDING) {
+        frame->pub = parent->pub + parent->index;
+        frame->bindings = 0;
+    }
+
+    decoder->state = is_object ? DECODER_OBJECT_START : DECODER_ARRAY_START;
+
+    return;
+}
+
+/**
+ * @brief Move on after a complete value
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ */
+static void end_value(RESULT_DECODER* decoder) {
+    decoder->state = decoder->depth == 0 ? DECODER_DONE : DECODER_NEXT;
+
+    return;
+}
+
+/**
+ * @brief Finish a number or literal value
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ */
+static void end_literal(RESULT_DECODER* decoder) {
+    decoder->literal[decoder->literal_length] = '\0';
+
+    if (decoder->value_role == ROLE_NUM_BITS) {
+        DECODER_FRAME* parent = &decoder->stack[decoder->depth-1];
+        int slot_count = parent->bindings > 0 ? parent->bindings : 1;
+        for (int i = parent->pub; i < parent->pub+slot_count; i++) {
+            decoder->pubs[i].num_bits = atoi(decoder->literal);
+        }
+    }
+
+    end_value(decoder);
+
+    return;
+}
+
+/**
+ * @brief Append one shot to the recorded samples of a pub
+ *
+ * Every record has the width of the histogram; records written before the
+ * histogram was widened are zero-extended in place.
+ *
+ * @param pub Pointer to PUB_COUNTS of the pub
+ * @param sample Packed sample of pub->histogram.words words
+ * @return 0 on success, or -1 on failure
+ */
+static int record_sample(PUB_COUNTS* pub, const BITSET_WORD* sample) {
+    int words = pub->histogram.words;
+
+    if (pub->sample_words != words || pub->sample_count == pub->sample_capacity) {
+        long capacity = pub->sample_capacity;
+        if (pub->sample_count == capacity) capacity = capacity ? 2*capacity : DECODER_KEY_NMEMB;
+
+        BITSET_WORD* samples = (BITSET_WORD*)realloc(pub->samples, (size_t)capacity*words*sizeof(BITSET_WORD));
+        if (!samples) return -1;
+
+        if (pub->sample_words != words && pub->sample_words > 0) {
+            for (long i = pub->sample_count-1; i >= 0; i--) {
+                memmove(&samples[(size_t)i*words], &samples[(size_t)i*pub->sample_words], pub->sample_words*sizeof(BITSET_WORD));
+                memset(&samples[(size_t)i*words+pub->sample_words], 0, (words-pub->sample_words)*sizeof(BITSET_WORD));
+            }
+        }
+
+        pub->samples = samples;
+        pub->sample_capacity = capacity;
+        pub->sample_words = words;
+    }
+
+    memcpy(&pub->samples[(size_t)pub->sample_count*words], sample, words*sizeof(BITSET_WORD));
+    pub->sample_count++;
+
+    return 0;
+}
+
+/**
+ * @brief Add the counts and recorded samples of another result
+ *
+ * Both decoders must hold results of the same pubs, such as the shards of
+ * one job run on several backends. The recorded samples of the other result
+ * are appended after those of this one.
+ *
+ * @param decoder Pointer to RESULT_DECODER to update
+ * @param other Pointer to RESULT_DECODER whose result is added
+ * @return 0 on success, or -1 on failure
+ */
+int merge_result_decoder(RESULT_DECODER* decoder, RESULT_DECODER* other) {
+    if (decoder->pub_count != other->pub_count) {
+        fprintf(stderr, "ERROR - The results have %d and %d pubs in merge_result_decoder()!\n", decoder->pub_count, other->pub_count);
+        return -1;
+    }
+
+    for (int i = 0; i < decoder->pub_count; i++) {
+        PUB_COUNTS* pub = &decoder->pubs[i];
+        PUB_COUNTS* other_pub = &other->pubs[i];
+
+        if (!pub->register_name[0]) memcpy(pub->register_name, other_pub->register_name, DECODER_KEY_NMEMB);
+        if (other_pub->num_bits > pub->num_bits) pub->num_bits = other_pub->num_bits;
+
+        if (merge_histogram(&pub->histogram, &other_pub->histogram) < 0) {
+            fprintf(stderr, "ERROR - Merging the counts of pub %d failed in merge_result_decoder()!\n", i);
+            return -1;
+        }
+
+        if (!decoder->keep_samples || other_pub->sample_count == 0) continue;
+
+        // Samples of the other result are zero-extended to the merged width.
+
+        BITSET_WORD* sample = (BITSET_WORD*)calloc(pub->histogram.words, sizeof(BITSET_WORD));
+        if (!sample) {
+            fprintf(stderr, "ERROR - Allocating memory for sample failed in merge_result_decoder()!\n");
+            return -1;
+        }
+
+        for (long k = 0; k < other_pub->sample_count; k++) {
+            memcpy(sample, &other_pub->samples[(size_t)k*other_pub->sample_words], other_pub->sample_words*sizeof(BITSET_WORD));
+            if (record_sample(pub, sample) < 0) {
+                fprintf(stderr, "ERROR - Recording the samples of pub %d failed in merge_result_decoder()!\n", i);
+                free(sample);
+                return -1;
+            }
+        }
+
+        free(sample);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Record which job and backend contributed shots to a result
+ *
+ * @param decoder Pointer to RESULT_DECODER holding the merged result
+ * @param job_id Identifier of the contributing job (copied)
+ * @param backend Name of the backend the job ran on (copied)
+ * @param shots Number of shots the job contributed
+ * @return 0 on success, or -1 on failure
+ */
+int add_shard_origin(RESULT_DECODER* decoder, char* job_id, char* backend, long shots) {
+    SHARD_ORIGIN* shards = (SHARD_ORIGIN*)realloc(decoder->shards, (decoder->shard_count+1)*sizeof(SHARD_ORIGIN));
+    if (!shards) {
+        fprintf(stderr, "ERROR - Allocating memory for shard list failed in add_shard_origin()!\n");
+        return -1;
+    }
+    decoder->shards = shards;
+
+    SHARD_ORIGIN* shard = &shards[decoder->shard_count];
+    shard->job_id = strdup(job_id);
+    shard->backend = strdup(backend);
+    shard->shots = shots;
+    if (!shard->job_id || !shard->backend) {
+        fprintf(stderr, "ERROR - Allocating memory for shard failed in add_shard_origin()!\n");
+        free(shard->job_id);
+        free(shard->backend);
+        return -1;
+    }
+    decoder->shard_count++;
+
+    return 0;
+}
+
+/**
+ * @brief Decode one complete sample string and count it
+ *
+ * Samples look like "0x1f" and may be wider than one word; the histogram of
+ * the pub is widened when a sample needs more words than it holds.
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ * @param pub Pointer to PUB_COUNTS of the pub
+ * @param sample Sample string without the quotes
+ * @param length Length of the sample string
+ */
+static void count_sample(RESULT_DECODER* decoder, PUB_COUNTS* pub, const char* sample, size_t length) {
+    if (length < 3 || sample[0] != '0' || (sample[1] != 'x' && sample[1] != 'X')) {
+        fail_decoder(decoder, "A sample is not a 0x-prefixed hexadecimal number");
+        return;
+    }
+    sample += 2;
+    length -= 2;
+
+    size_t leading_zeros = 0;
+    while (leading_zeros < length && sample[leading_zeros] == '0') leading_zeros++;
+
+    size_t significant_digits = length-leading_zeros;
+    if (significant_digits > (size_t)DECODER_MAX_SAMPLE_BITS/4) {
+        fail_decoder(decoder, "A sample is too wide");
+        return;
+    }
+
+    HISTOGRAM* histogram = &pub->histogram;
+    if (widen_histogram(histogram, count_bitset_words((int)significant_digits*4)) < 0) {
+        fail_decoder(decoder, "Widening the sample counts failed");
+        return;
+    }
+
+    if (decoder->sample_word_capacity < histogram->words) {
+        BITSET_WORD* words = (BITSET_WORD*)realloc(decoder->sample_words, histogram->words*sizeof(BITSET_WORD));
+        if (!words) {
+            fail_decoder(decoder, "Allocating memory for a sample failed");
+            return;
+        }
+        decoder->sample_words = words;
+        decoder->sample_word_capacity = histogram->words;
+    }
+
+    if (decode_hex_bitset(sample+leading_zeros, significant_digits, decoder->sample_words, histogram->words) < 0) {
+        fail_decoder(decoder, "A sample contains a non-hexadecimal digit");
+        return;
+    }
+
+    if (add_to_histogram(histogram, decoder->sample_words) < 0) {
+        fail_decoder(decoder, "Allocating memory for sample counts failed");
+        return;
+    }
+
+    if (decoder->keep_samples && record_sample(pub, decoder->sample_words) < 0) {
+        fail_decoder(decoder, "Allocating memory for recorded samples failed");
+        return;
+    }
+
+    return;
+}
+
+/**
+ * @brief Consume the characters of a sample string available in a chunk
+ *
+ * A sample that lies entirely inside the chunk is decoded in place; one
+ * that is split across chunks is gathered in the decoder first.
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ * @param data Remaining part of the chunk
+ * @param length Number of bytes remaining in the chunk
+ * @return Number of bytes consumed, including the closing quote if found
+ */
+static size_t feed_sample(RESULT_DECODER* decoder, const char* data, size_t length) {
+    const char* quote = memchr(data, '"', length);
+    size_t span = quote ? (size_t)(quote-data) : length;
+
+    if (memchr(data, '\\', span)) {
+        fail_decoder(decoder, "A sample contains an escape sequence");
+        return length;
+    }
+
+    DECODER_FRAME* parent = &decoder->stack[decoder->depth-1];
+    PUB_COUNTS* pub = &decoder->pubs[parent->pub];
+
+    if (quote && decoder->sample_length == 0) {
+        count_sample(decoder, pub, data, span);
+        end_value(decoder);
+        return span+1;
+    }
+
+    if (decoder->sample_length+span > decoder->sample_capacity) {
+        size_t capacity = decoder->sample_capacity ? decoder->sample_capacity : DECODER_KEY_NMEMB;
+        while (capacity < decoder->sample_length+span) capacity *= 2;
+
+        char* digits = (char*)realloc(decoder->sample_digits, capacity);
+        if (!digits) {
+            fail_decoder(decoder, "Allocating memory for a sample failed");
+            return length;
+        }
+        decoder->sample_digits = digits;
+        decoder->sample_capacity = capacity;
+    }
+
+    memcpy(decoder->sample_digits+decoder->sample_length, data, span);
+    decoder->sample_length += span;
+
+    if (!quote) return length;
+
+    count_sample(decoder, pub, decoder->sample_digits, decoder->sample_length);
+    end_value(decoder);
+
+    return span+1;
+}
+
+/**
+ * @brief Feed a chunk of the result body to the decoder
+ *
+ * @param decoder Pointer to RESULT_DECODER
+ * @param data Chunk of the response body
+ * @param length Number of bytes in the chunk
+ * @return 0 on success, or -1 if the body is not a valid result
+ */
+int feed_result_decoder(RESULT_DECODER* decoder, const char* data, size_t length) {
+    if (decoder->prefix_size+1 < DECODER_PREFIX_NMEMB) {
+        size_t copy_size = DECODER_PREFIX_NMEMB-1-decoder->prefix_size;
+        if (copy_size > length) copy_size = length;
+        memcpy(decoder->prefix+decoder->prefix_size, data, copy_size);
+        decoder->prefix_size += copy_size;
+        decoder->prefix[decoder->prefix_size] = '\0';
+    }
+
+    size_t i = 0;
+    while (i < length && decoder->state != DECODER_ERROR) {
+        char ch = data[i];
+        DECODER_FRAME* top = decoder->depth > 0 ? &decoder->stack[decoder->depth-1] : NULL;
+
+        switch (decoder->state) {
+        case DECODER_ARRAY_START:
+            if (isspace((unsigned char)ch)) break;
+            if (ch == ']') {
+                decoder->depth--;
+                end_value(decoder);
+                break;
+            }
+            decoder->state = DECODER_VALUE;
+            continue;
+
+        case DECODER_VALUE:
+            if (isspace((unsigned char)ch)) break;
+            if (ch == '{' || ch == '[') {
+                push_frame(decoder, ch);
+            } else if (ch == '"') {
+                decoder->value_role = child_role(decoder);
+                decoder->sample_length = 0;
+                decoder->escaped = false;
+                decoder->state = DECODER_STRING;
+            } else if (isalnum((unsigned char)ch) || ch == '-') {
+                decoder->value_role = child_role(decoder);
+                decoder->literal_length = 0;
+                decoder->state = DECODER_LITERAL;
+                continue;
+            } else {
+                fail_decoder(decoder, "Unexpected character in the result JSON");
+            }
+            break;
+
+        case DECODER_OBJECT_START:
+            if (isspace((unsigned char)ch)) break;
+            if (ch == '}') {
+                decoder->depth--;
+                end_value(decoder);
+                break;
+            }
+            decoder->state = DECODER_KEY;
+            continue;
+
+        case DECODER_KEY:
+            if (isspace((unsigned char)ch)) break;
+            if (ch != '"') {
+                fail_decoder(decoder, "Expected an object key in the result JSON");
+                break;
+            }
+            decoder->key_length = 0;
+            decoder->key[0] = '\0';
+            decoder->escaped = false;
+            decoder->state = DECODER_KEY_STRING;
+            break;
+
+        case DECODER_KEY_STRING:
+            if (!decoder->escaped && ch == '"') {
+                decoder->state = DECODER_COLON;
+                break;
+            }
+            decoder->escaped = !decoder->escaped && ch == '\\';
+            if (decoder->key_length < DECODER_KEY_NMEMB-1) {
+                decoder->key[decoder->key_length++] = ch;
+                decoder->key[decoder->key_length] = '\0';
+            } else {
+                decoder->key_length = DECODER_KEY_NMEMB;
+            }
+            break;
+
+        case DECODER_COLON:
+            if (isspace((unsigned char)ch)) break;
+            if (ch != ':') {
+                fail_decoder(decoder, "Expected a colon in the result JSON");
+                break;
+            }
+            decoder->state = DECODER_VALUE;
+            break;
+
+        case DECODER_STRING:
+            if (decoder->value_role == ROLE_SAMPLE) {
+                i += feed_sample(decoder, data+i, length-i);
+                continue;
+            }
+            if (decoder->escaped) {
+                decoder->escaped = false;
+                break;
+            }
+            if (ch == '\\') {
+                decoder->escaped = true;
+                break;
+            }
+            if (ch == '"') end_value(decoder);
+            break;
+
+        case DECODER_LITERAL:
+            if (isalnum((unsigned char)ch) || ch == '-' || ch == '+' || ch == '.') {
+                if (decoder->literal_length < DECODER_LITERAL_NMEMB-1) decoder->literal[decoder->literal_length++] = ch;
+                break;
+            }
+            end_literal(decoder);
+            continue;
+
+        case DECODER_NEXT:
+            if (isspace((unsigned char)ch)) break;
+            if (ch == ',') {
+                if (top->type == '[') {
+                    top->index++;
+                    decoder->state = DECODER_VALUE;
+                } else {
+                    decoder->state = DECODER_KEY;
+                }
+            } else if ((ch == '}' && top->type == '{') || (ch == ']' && top->type == '[')) {
+                decoder->depth--;
+                end_value(decoder);
+            } else {
+                fail_decoder(decoder, "Unexpected character after a value in the result JSON");
+            }
+            break;
+
+        case DECODER_DONE:
+            if (!isspace((unsigned char)ch)) fail_decoder(decoder, "Trailing data after the result JSON");
+            break;
+
+        default:
+            break;
+        }
+
+        i++;
+    }
+
+    return decoder->state == DECODER_ERROR ? -1 : 0;
+}
+
+/**
+ * @brief Check that the whole result has been decoded
+ *
+ * @param decoder Pointer to RESULT_DECODER fed with the complete body
+ * @return 0 if every pub has samples, or -1 otherwise
+ */
+int finish_result_decoder(RESULT_DECODER* decoder) {
+    if (decoder->state == DECODER_LITERAL && decoder->depth == 0) end_literal(decoder);
+
+    if (decoder->state != DECODER_DONE) {
+        fprintf(stderr, "ERROR - The result JSON is incomplete or invalid in finish_result_decoder()!\n");
+        return -1;
+    }
+
+    if (decoder->result_count != decoder->job_pub_count) {
+        fprintf(stderr, "ERROR - The results array does not match the %d submitted pubs in finish_result_decoder()!\n", decoder->job_pub_count);
+        return -1;
+    }
+
+    for (int i = 0; i < decoder->pub_count; i++) {
+        if (decoder->pubs[i].histogram.shots == 0) {
+            fprintf(stderr, "ERROR - No samples found for result %d in finish_result_decoder()!\n", i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief libcurl write callback feeding a result decoder
+ *
+ * Decoding errors do not abort the transfer, so that the caller can still
+ * inspect the HTTP status and the body prefix of an error response. The
+ * time spent decoding is added up in parse_time, so that it can be told
+ * apart from the time spent waiting for the network.
+ *
+ * @param contents Pointer to received data
+ * @param size Size of each item
+ * @param nmemb Number of items
+ * @param userp Pointer to RESULT_DECODER
+ * @return Number of bytes consumed
+ */
+size_t decoder_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t real_size = size * nmemb;
+    RESULT_DECODER* decoder = userp;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    feed_result_decoder(decoder, (const char*)contents, real_size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    decoder->parse_time += (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+
+    return real_size;
+}
@@ -0,0 +1,111 @@
+#ifndef _DECODER_H_
+#define _DECODER_H_
+
+#define DECODER_MAX_DEPTH 32
+#define DECODER_KEY_NMEMB 64
+#define DECODER_LITERAL_NMEMB 32
+#define DECODER_PREFIX_NMEMB 4096
+#define DECODER_MAX_SAMPLE_BITS (1 << 16)
+
+typedef enum DecoderState {
+    DECODER_VALUE,
+    DECODER_OBJECT_START,
+    DECODER_ARRAY_START,
+    DECODER_KEY,
+    DECODER_KEY_STRING,
+    DECODER_COLON,
+    DECODER_STRING,
+    DECODER_LITERAL,
+    DECODER_NEXT,
+    DECODER_DONE,
+    DECODER_ERROR
+} DECODER_STATE;
+
+typedef enum DecoderRole {
+    ROLE_OTHER,
+    ROLE_ROOT,
+    ROLE_RESULTS,
+    ROLE_PUB,
+    ROLE_DATA,
+    ROLE_REGISTER,
+    ROLE_SAMPLES,
+    ROLE_BINDING,
+    ROLE_SAMPLE,
+    ROLE_NUM_BITS
+} DECODER_ROLE;
+
+typedef struct DecoderFrame {
+    char type;
+    DECODER_ROLE role;
+    int index;
+    int pub;
+    int bindings;
+    bool selected;
+} DECODER_FRAME;
+
+typedef struct PubCounts {
+    char register_name[DECODER_KEY_NMEMB];
+    int num_bits;
+    HISTOGRAM histogram;
+
+    BITSET_WORD* samples;
+    long sample_count;
+    long sample_capacity;
+    int sample_words;
+} PUB_COUNTS;
+
+typedef struct ShardOrigin {
+    char* job_id;
+    char* backend;
+    long shots;
+} SHARD_ORIGIN;
+
+typedef struct ResultDecoder {
+    DECODER_STATE state;
+    DECODER_FRAME stack[DECODER_MAX_DEPTH];
+    int depth;
+
+    char key[DECODER_KEY_NMEMB];
+    int key_length;
+    bool escaped;
+
+    DECODER_ROLE value_role;
+    char literal[DECODER_LITERAL_NMEMB];
+    int literal_length;
+
+    char* sample_digits;
+    size_t sample_length;
+    size_t sample_capacity;
+    BITSET_WORD* sample_words;
+    int sample_word_capacity;
+
+    PUB_COUNTS* pubs;
+    int pub_count;
+    int job_pub_count;
+    int* pub_bindings;
+    int* first_slots;
+    int result_count;
+    bool keep_samples;
+    double parse_time;
+
+    SHARD_ORIGIN* shards;
+    int shard_count;
+
+    char prefix[DECODER_PREFIX_NMEMB];
+    size_t prefix_size;
+} RESULT_DECODER;
+
+RESULT_DECODER* create_result_decoder(int pub_count, int* measured_bits, bool keep_samples);
+void destroy_result_decoder(RESULT_DECODER* decoder);
+int set_pub_bindings(RESULT_DECODER* decoder, int* bindings, int job_pub_count);
+void reset_result_decoder(RESULT_DECODER* decoder);
+
+int merge_result_decoder(RESULT_DECODER* decoder, RESULT_DECODER* other);
+int add_shard_origin(RESULT_DECODER* decoder, char* job_id, char* backend, long shots);
+
+int feed_result_decoder(RESULT_DECODER* decoder, const char* data, size_t length);
+int finish_result_decoder(RESULT_DECODER* decoder);
+
+size_t decoder_write_callback(void* contents, size_t size, size_t nmemb, void* userp);
+
+#endif
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "histogram.h"
+
+
+/**
+ * @brief Hash a packed sample
+ *
+ * Runs every word through the splitmix64 finalizer, so that samples
+ * differing only in their high bits still spread over the table.
+ *
+ * @param sample Packed sample
+ * @param words Number of words of the sample
+ * @return Hash of the sample
+ */
+static unsigned long long hash_sample(const BITSET_WORD* sample, int words) {
+    unsigned long long hash = 0;
+
+    for (int i = 0; i < words; i++) {
+        hash ^= sample[i];
+        hash ^= hash >> 30;
+        hash *= 0xbf58476d1ce4e5b9ULL;
+        hash ^= hash >> 27;
+        hash *= 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Find the slot of a sample, or the empty slot where it belongs
+ *
+ * @param samples Table of capacity packed samples
+ * @param counts Counts of the slots, 0 marking an empty slot
+ * @param words Number of words per sample
+ * @param capacity Number of slots in the table (a power of two)
+ * @param sample Packed sample to look up
+ * @return Index of the matching or empty slot
+ */
+static int find_slot(BITSET_WORD* samples, long* counts, int words, int capacity, const BITSET_WORD* sample) {
+    unsigned long long mask = (unsigned long long)capacity-1;
+    unsigned long long slot = hash_sample(sample, words) & mask;
+
+    while (counts[slot] != 0 && memcmp(&samples[slot*words], sample, words*sizeof(BITSET_WORD)) != 0) {
+        slot = (slot+1) & mask;
+    }
+
+    return (int)slot;
+}
+
+/**
+ * @brief Rebuild the table with a new capacity and sample width
+ *
+ * Samples are zero-extended when the width grows.
+ *
+ * @param histogram Pointer to HISTOGRAM to rebuild
+ * @param capacity New number of slots (a power of two)
+ * @param words New number of words per sample
+ * @return 0 on success, or -1 on failure
+ */
+static int rehash_histogram(HISTOGRAM* histogram, int capacity, int words) {
+    BITSET_WORD* samples = (BITSET_WORD*)calloc((size_t)capacity*words, sizeof(BITSET_WORD));
+    long* counts = (long*)calloc(capacity, sizeof(long));
+    if (!samples || !counts) {
+        fprintf(stderr, "ERROR - Allocating memory for histogram failed in rehash_histogram()!\n");
+        free(samples);
+        free(counts);
+        return -1;
+    }
+
+    BITSET_WORD* sample = (BITSET_WORD*)calloc(words, sizeof(BITSET_WORD));
+    if (!sample) {
+        fprintf(stderr, "ERROR - Allocating memory for sample failed in rehash_histogram()!\n");
+        free(samples);
+        free(counts);
+        return -1;
+    }
+
+    for (int i = 0; i < histogram->capacity; i++) {
+        if (histogram->counts[i] == 0) continue;
+
+        memcpy(sample, &histogram->samples[(size_t)i*histogram->words], histogram->words*sizeof(BITSET_WORD));
+
+        int slot = find_slot(samples, counts, words, capacity, sample);
+        memcpy(&samples[(size_t)slot*words], sample, words*sizeof(BITSET_WORD));
+        counts[slot] = histogram->counts[i];
+    }
+
+    free(sample);
+    free(histogram->samples);
+    free(histogram->counts);
+    histogram->samples = samples;
+    histogram->counts = counts;
+    histogram->capacity = capacity;
+    histogram->words = words;
+
+    return 0;
+}
+
+
+/**
+ * @brief Initialize an empty histogram of sample counts
+ *
+ * The table is an open-addressing hash table keyed on the packed sample.
+ * It is sized from the width of the measured register so that a narrow
+ * register never rehashes, and grows as needed otherwise.
+ *
+ * @param histogram Pointer to HISTOGRAM to initialize
+ * @param num_bits Width of the measured register, or 0 if unknown
+ * @return 0 on success, or -1 on failure
+ */
+int initialize_histogram(HISTOGRAM* histogram, int num_bits) {
+    int capacity = HISTOGRAM_DEFAULT_CAPACITY;
+
+    if (num_bits > 0 && num_bits < 16) {
+        capacity = HISTOGRAM_MIN_CAPACITY;
+        while (capacity < (2 << num_bits)) capacity <<= 1;
+    }
+    if (capacity > HISTOGRAM_MAX_INITIAL_CAPACITY) capacity = HISTOGRAM_MAX_INITIAL_CAPACITY;
+
+    histogram->words = count_bitset_words(num_bits);
+    histogram->samples = (BITSET_WORD*)calloc((size_t)capacity*histogram->words, sizeof(BITSET_WORD));
+    histogram->counts = (long*)calloc(capacity, sizeof(long));
+    if (!histogram->samples || !histogram->counts) {
+        fprintf(stderr, "ERROR - Allocating memory for histogram failed in initialize_histogram()!\n");
+        free_histogram(histogram);
+        return -1;
+    }
+
+    histogram->capacity = capacity;
+    histogram->unique_count = 0;
+    histogram->shots = 0;
+
+    return 0;
+}
+
+/**
+ * @brief Free the table of a histogram
+ *
+ * @param histogram Pointer to HISTOGRAM to free
+ */
+void free_histogram(HISTOGRAM* histogram) {
+    free(histogram->samples);
+    free(histogram->counts);
+    histogram->samples = NULL;
+    histogram->counts = NULL;
+    histogram->capacity = 0;
+    histogram->unique_count = 0;
+    histogram->shots = 0;
+
+    return;
+}
+
+/**
+ * @brief Remove every count from a histogram, keeping its table
+ *
+ * @param histogram Pointer to HISTOGRAM to clear
+ */
+void clear_histogram(HISTOGRAM* histogram) {
+    if (histogram->counts) memset(histogram->counts, 0, histogram->capacity*sizeof(long));
+    histogram->unique_count = 0;
+    histogram->shots = 0;
+
+    return;
+}
+
+/**
+ * @brief Make room for wider samples
+ *
+ * Samples already counted are zero-extended to the new width.
+ *
+ * @param histogram Pointer to HISTOGRAM to widen
+ * @param words New number of words per sample
+ * @return 0 on success, or -1 on failure
+ */
+int widen_histogram(HISTOGRAM* histogram, int words) {
+    if (words <= histogram->words) return 0;
+
+    return rehash_histogram(histogram, histogram->capacity, words);
+}
+
+
+/**
+ * @brief Count one sample
+ *
+ * @param histogram Pointer to HISTOGRAM to update
+ * @param sample Packed sample of histogram->words words
+ * @return 0 on success, or -1 on failure
+ */
+int add_to_histogram(HISTOGRAM* histogram, const BITSET_WORD* sample) {
+    return add_count_to_histogram(histogram, sample, 1);
+}
+
+/**
+ * @brief Count a sample several times at once
+ *
+ * @param histogram Pointer to HISTOGRAM to update
+ * @param sample Packed sample of histogram->words words
+ * @param count Number of occurrences to add (positive)
+ * @return 0 on success, or -1 on failure
+ */
+int add_count_to_histogram(HISTOGRAM* histogram, const BITSET_WORD* sample, long count) {
+    int words = histogram->words;
+    int slot = find_slot(histogram->samples, histogram->counts, words, histogram->capacity, sample);
+
+    if (histogram->counts[slot] == 0) {
+        // Keep the load factor below 0.7 so that probe sequences stay short.
+
+        if (10*(histogram->unique_count+1) > 7*histogram->capacity) {
+            if (rehash_histogram(histogram, 2*histogram->capacity, words) < 0) return -1;
+            slot = find_slot(histogram->samples, histogram->counts, words, histogram->capacity, sample);
+        }
+
+        memcpy(&histogram->samples[(size_t)slot*words], sample, words*sizeof(BITSET_WORD));
+        histogram->unique_count++;
+    }
+
+    histogram->counts[slot] += count;
+    histogram->shots += count;
+
+    return 0;
+}
+
+/**
+ * @brief Add every count of another histogram
+ *
+ * The narrower of the two widths is zero-extended, so that histograms of
+ * runs that saw different sample widths can be combined.
+ *
+ * @param histogram Pointer to HISTOGRAM to update
+ * @param other Pointer to HISTOGRAM whose counts are added
+ * @return 0 on success, or -1 on failure
+ */
+int merge_histogram(HISTOGRAM* histogram, HISTOGRAM* other) {
+    if (widen_histogram(histogram, other->words) < 0) return -1;
+
+    int words = histogram->words;
+    BITSET_WORD* sample = (BITSET_WORD*)calloc(words, sizeof(BITSET_WORD));
+    if (!sample) {
+        fprintf(stderr, "ERROR - Allocating memory for sample failed in merge_histogram()!\n");
+        return -1;
+    }
+
+    int status = 0;
+    for (int i = 0; i < other->capacity; i++) {
+        if (other->counts[i] == 0) continue;
+
+        memcpy(sample, &other->samples[(size_t)i*other->words], other->words*sizeof(BITSET_WORD));
+        if (add_count_to_histogram(histogram, sample, other->counts[i]) < 0) {
+            status = -1;
+            break;
+        }
+    }
+
+    free(sample);
+
+    return status;
+}
+
+/**
+ * @brief Look up how often a sample was observed
+ *
+ * @param histogram Pointer to HISTOGRAM to query
+ * @param sample Packed sample of histogram->words words
+ * @return Number of occurrences of the sample
+ */
+long get_histogram_count(HISTOGRAM* histogram, const BITSET_WORD* sample) {
+    if (histogram->capacity == 0) return 0;
+
+    return histogram->counts[find_slot(histogram->samples, histogram->counts, histogram->words, histogram->capacity, sample)];
+}
+
+/**
+ * @brief Find the most frequent sample
+ *
+ * Ties are broken towards the smaller value, so the answer does not depend
+ * on the layout of the table.
+ *
+ * @param histogram Pointer to HISTOGRAM to query
+ * @return Pointer to the packed sample inside the table, valid until the
+ *         histogram changes, or NULL if the histogram is empty
+ */
+BITSET_WORD* get_most_frequent(HISTOGRAM* histogram) {
+    int words = histogram->words;
+    int best = -1;
+
+    for (int i = 0; i < histogram->capacity; i++) {
+        if (histogram->counts[i] == 0) continue;
+
+        if (best < 0 || histogram->counts[i] > histogram->counts[best] ||
+            (histogram->counts[i] == histogram->counts[best] &&
+             compare_bitsets(&histogram->samples[(size_t)i*words], &histogram->samples[(size_t)best*words], words) < 0)) {
+            best = i;
+        }
+    }
+
+    if (best < 0) return NULL;
+
+    return &histogram->samples[(size_t)best*words];
+}
+
+/**
+ * @brief Order two entries by decreasing count, then increasing value
+ *
+ * @param a Pointer to first HISTOGRAM_ENTRY
+ * @param b Pointer to second HISTOGRAM_ENTRY
+ * @return Negative, zero or positive as for qsort
+ */
+static int compare_entries(const void* a, const void* b) {
+    const HISTOGRAM_ENTRY* entry_a = a;
+    const HISTOGRAM_ENTRY* entry_b = b;
+
+    if (entry_a->count != entry_b->count) return entry_a->count > entry_b->count ? -1 : 1;
+
+    return compare_bitsets(entry_a->sample, entry_b->sample, entry_a->words);
+}
+
+/**
+ * @brief Collect the full counts of a histogram
+ *
+ * The entries point into the table and stay valid until the histogram
+ * changes.
+ *
+ * @param histogram Pointer to HISTOGRAM to read
+ * @return Array of unique_count entries sorted by decreasing count
+ *         (CALLER MUST FREE), or NULL on failure
+ */
+HISTOGRAM_ENTRY* sort_histogram(HISTOGRAM* histogram) {
+    HISTOGRAM_ENTRY* sorted = (HISTOGRAM_ENTRY*)calloc(histogram->unique_count > 0 ? histogram->unique_count : 1, sizeof(HISTOGRAM_ENTRY));
+    if (!sorted) {
+        fprintf(stderr, "ERROR - Allocating memory for sorted counts failed in sort_histogram()!\n");
+        return NULL;
+    }
+
+    int sorted_count = 0;
+    for (int i = 0; i < histogram->capacity; i++) {
+        if (histogram->counts[i] == 0) continue;
+
+        sorted[sorted_count].sample = &histogram->samples[(size_t)i*histogram->words];
+        sorted[sorted_count].words = histogram->words;
+        sorted[sorted_count].count = histogram->counts[i];
+        sorted_count++;
+    }
+
+    qsort(sorted, sorted_count, sizeof(HISTOGRAM_ENTRY), compare_entries);
+
+    return sorted;
+}
@@ -0,0 +1,35 @@
+#ifndef _HISTOGRAM_H_
+#define _HISTOGRAM_H_
+
+#define HISTOGRAM_MIN_CAPACITY 16
+#define HISTOGRAM_MAX_INITIAL_CAPACITY (1 << 16)
+#define HISTOGRAM_DEFAULT_CAPACITY 1024
+
+typedef struct HistogramEntry {
+    BITSET_WORD* sample;
+    int words;
+    long count;
+} HISTOGRAM_ENTRY;
+
+typedef struct Histogram {
+    BITSET_WORD* samples;
+    long* counts;
+    int words;
+    int capacity;
+    int unique_count;
+    long shots;
+} HISTOGRAM;
+
+int initialize_histogram(HISTOGRAM* histogram, int num_bits);
+void free_histogram(HISTOGRAM* histogram);
+void clear_histogram(HISTOGRAM* histogram);
+int widen_histogram(HISTOGRAM* histogram, int words);
+
+int add_to_histogram(HISTOGRAM* histogram, const BITSET_WORD* sample);
+int add_count_to_histogram(HISTOGRAM* histogram, const BITSET_WORD* sample, long count);
+int merge_histogram(HISTOGRAM* histogram, HISTOGRAM* other);
+long get_histogram_count(HISTOGRAM* histogram, const BITSET_WORD* sample);
+BITSET_WORD* get_most_frequent(HISTOGRAM* histogram);
+HISTOGRAM_ENTRY* sort_histogram(HISTOGRAM* histogram);
+
+#endif
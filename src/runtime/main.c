@@ -1,24 +1,45 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
 #include <pthread.h>
 
+#include "metrics.h"
 #include "comm.h"
 #include "auth.h"
+#include "reader.h"
+#include "backends.h"
 #include "sender.h"
+#include "session.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+#include "decoder.h"
+#include "results.h"
 #include "receiver.h"
-#include "reader.h"
+#include "scheduler.h"
+#include "output.h"
+#include "options.h"
+#include "manifest.h"
+#include "runner.h"
+#include "daemon.h"
 
 
 /**
  * @brief Entry point for the QuantumC runtime
  *
  * Reads configuration and OpenQASM input, starts the authenticator thread,
- * submits a job to the quantum backend, and retrieves and displays the result.
+ * submits the circuits to the quantum backend, either batched into one job
+ * or as concurrent jobs, and retrieves and displays the result of every
+ * circuit. With --manifest it runs the batch a manifest lists instead.
+ * With --daemon it serves such runs for clients on a Unix domain socket,
+ * and with --socket it hands the circuits to that daemon.
  *
- * @param argc Argument count (expects exactly 2: program name and OpenQASM filename)
- * @param argv Argument vector (argv[1] must be the OpenQASM filename)
+ * @param argc Argument count
+ * @param argv Argument vector (options followed by OpenQASM files or directories)
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
  */
 int main(int argc, char** argv) {
@@ -28,69 +49,147 @@ int main(int argc, char** argv) {
 
     // Check the input.
 
-    if (argc != 2) {
-        fprintf(stderr, "ERROR - One argument for the OpenQASM filename needed in main()!\n");
+    RUNTIME_OPTIONS options;
+    if (parse_options(argc, argv, &options) < 0) {
+        print_usage(argv[0]);
         goto terminate;
     }
 
-    char* qasm_filename = argv[1];
+    // Read the specified OpenQASM files or manifest; a daemon receives them from its clients.
+
+    int circuit_count = 0;
+    CIRCUIT* circuits = NULL;
+    MANIFEST* manifest = NULL;
+    if (options.manifest_path) {
+        manifest = read_manifest(options.manifest_path, &options);
+        if (!manifest) {
+            fprintf(stderr, "ERROR - Reading the manifest failed in main()!\n");
+            goto terminate;
+        }
+
+        circuits = manifest->circuits;
+        circuit_count = manifest->entry_count;
+        fprintf(stdout, "Manifest (%s): %d circuits\n\n", options.manifest_path, circuit_count);
+    } else if (!options.daemon_path) {
+        circuits = read_circuits(options.paths, options.path_count, &circuit_count);
+        if (!circuits) {
+            fprintf(stderr, "ERROR - Reading the OpenQASM code failed in main()!\n");
+            goto terminate;
+        }
+
+        if (options.parameters_path && read_parameter_values(options.parameters_path, circuits, circuit_count) < 0) {
+            fprintf(stderr, "ERROR - Reading the parameter values failed in main()!\n");
+            goto cleanup_circuits;
+        }
+
+        for (int i = 0; i < circuit_count; i++) {
+            circuits[i].shots = options.shots;
+            fprintf(stdout, "OpenQASM Code (%s): \n%s\n", circuits[i].name, circuits[i].qasm);
+        }
+    }
+
+    // Open the result output.
+
+    RESULT_WRITER* writer = create_result_writer(options.output_path, options.output_format, options.top_k, options.probabilities, options.dump_path);
+    if (!writer) {
+        fprintf(stderr, "ERROR - Creating the result writer failed in main()!\n");
+        goto cleanup_circuits;
+    }
+    writer->analysis = &options.analysis;
+
+    // Hand the circuits to a running daemon, which is already authenticated.
+
+    if (options.socket_path) {
+        termination_status = submit_to_daemon(options.socket_path, circuits, circuit_count, &options, writer);
+        goto cleanup_writer;
+    }
+
+    // Time every phase from here on.
+
+    RUNTIME_METRICS* metrics = create_runtime_metrics();
+    if (!metrics) {
+        fprintf(stderr, "ERROR - Creating the metrics failed in main()!\n");
+        goto cleanup_writer;
+    }
 
     // Read config.json.
 
+    double start_time = get_monotonic_time();
     CONFIG* config = read_config(CONFIG_FILENAME);
+    record_phase(metrics, PHASE_CONFIG, get_monotonic_time() - start_time);
     if (!config) {
         fprintf(stderr, "ERROR - Reading the config file failed in main()!\n");
-        goto terminate;
+        goto cleanup_metrics;
     }
 
     char* key = config->key;
     char* crn = config->crn;
 
-    // Read the specified OpenQASM file.
-
-    char* qasm = read_qasm(qasm_filename);
-    if (!qasm) {
-        fprintf(stderr, "ERROR - Reading the OpenQASM code failed in main()!\n");
-        goto cleanup_config;
-    }
-
-    fprintf(stdout, "OpenQASM Code: \n%s\n", qasm);
-
     // Configure and start authentication thread.
 
     TOKEN_DATA* token_data = (TOKEN_DATA*)calloc(1, sizeof(TOKEN_DATA));
     if (!token_data) {
         fprintf(stderr, "ERROR - Allocating memory for token data failed in main()!\n");
-        goto cleanup_qasm;
+        goto cleanup_config;
     }
     initialize_token_data(token_data, key);
 
+    // Set up the connection pool shared by the authenticator and the requests.
+
+    if (curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) {
+        fprintf(stderr, "ERROR - cURL global initialization failed in main()!\n");
+        goto cleanup_token_data;
+    }
+
+    CONNECTION_POOL* pool = create_connection_pool(token_data, metrics, crn, options.api_url, options.iam_url);
+    if (!pool) {
+        fprintf(stderr, "ERROR - Creating the connection pool failed in main()!\n");
+        goto cleanup_curl_global;
+    }
+    pool->compress_requests = options.compress_requests;
+    if (options.retries >= 0) pool->max_attempts = options.retries+1;
+    if (options.request_rate >= 0.0) pool->request_rate = options.request_rate;
+
+    BACKEND_CACHE* backend_cache = create_backend_cache(pool, options.backend_ttl);
+    if (!backend_cache) {
+        fprintf(stderr, "ERROR - Creating the backend cache failed in main()!\n");
+        goto cleanup_pool;
+    }
+
+    // Jobs share a session on one backend, opened when the first job needs it.
+
+    SESSION* session = NULL;
+    if (options.session_mode != SESSION_OFF) {
+        session = create_session(pool, backend_cache, options.session_mode, options.session_idle);
+        if (!session) {
+            fprintf(stderr, "ERROR - Creating the session failed in main()!\n");
+            goto cleanup_backend_cache;
+        }
+    }
+
     pthread_t authenticator_thread;
     void* authenticator_retval;    
 
-    int create_status = pthread_create(&authenticator_thread, NULL, authenticator, (void*)token_data);
+    int create_status = pthread_create(&authenticator_thread, NULL, authenticator, (void*)pool);
     if (create_status) {
         fprintf(stderr, "ERROR - Thread creation failed in main()!\n");
-        goto cleanup_token_data;
+        goto cleanup_session;
     }
 
-    // Send a job to a quantum backend.
+    // Run the circuits on a quantum backend, or serve clients until interrupted.
 
-    char* job_id = sender(token_data, crn, qasm);
-    if (!job_id) {
-        fprintf(stderr, "ERROR - Job submission failed in main()!\n");
-        goto cleanup_token_data;
-    }
+    int run_status = EXIT_FAILURE;
+    if (options.daemon_path) run_status = run_daemon(pool, backend_cache, session, options.daemon_path, &options) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    else if (manifest) run_status = run_manifest(pool, backend_cache, session, manifest, &options, writer);
+    else run_status = run_circuits(pool, backend_cache, session, circuits, circuit_count, &options, writer);
 
-    fprintf(stdout, "Job ID: %s\n\n", job_id);
+    // Closing the session and a background refresh of the backend list may still need the token.
 
-    // Receive the job result from the quantum backend.
+    destroy_session(session);
+    session = NULL;
 
-    char* job_result = receiver(token_data, crn, job_id);
-    if (!job_result) {
-        fprintf(stderr, "ERROR - Job retrieval failed in main()!\n");
-        goto cleanup_job_id;
-    }
+    destroy_backend_cache(backend_cache);
+    backend_cache = NULL;
 
     signal_job_terminated(token_data);
 
@@ -99,33 +198,55 @@ int main(int argc, char** argv) {
     int join_status = pthread_join(authenticator_thread, &authenticator_retval);
     if (join_status) {
         fprintf(stderr, "ERROR - Thread joined with an error in main()!\n");
-        goto cleanup_job_result;
+        goto cleanup_session;
     }
 
-    fprintf(stdout, "=== Final Result ===\n\n");
-    fprintf(stdout, "%s\n", job_result);
+    // Export the metrics of failed runs as well, since they show where the time went.
+
+    if (export_metrics(metrics, options.metrics_path, options.prometheus_path) < 0) {
+        fprintf(stderr, "ERROR - Exporting the metrics failed in main()!\n");
+        goto cleanup_session;
+    }
+
+    if (run_status != EXIT_SUCCESS) {
+        fprintf(stderr, "ERROR - Running the circuits failed in main()!\n");
+        goto cleanup_session;
+    }
 
     termination_status = EXIT_SUCCESS;
 
     // Clean up.
 
-cleanup_job_result:
-    free(job_result);
+cleanup_session:
+    destroy_session(session);
+
+cleanup_backend_cache:
+    destroy_backend_cache(backend_cache);
 
-cleanup_job_id:
-    free(job_id);
+cleanup_pool:
+    destroy_connection_pool(pool);
+
+cleanup_curl_global:
+    curl_global_cleanup();
 
 cleanup_token_data:
     destroy_token_data(token_data);
 
-cleanup_qasm:
-    free(qasm);
-
 cleanup_config:
     free(key);
     free(crn);
     free(config);
 
+cleanup_metrics:
+    destroy_runtime_metrics(metrics);
+
+cleanup_writer:
+    destroy_result_writer(writer);
+
+cleanup_circuits:
+    if (manifest) destroy_manifest(manifest);
+    else free_circuits(circuits, circuit_count);
+
 terminate:
     return termination_status;
 }
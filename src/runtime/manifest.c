@@ -0,0 +1,342 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "cache.h"
+#include "reader.h"
+#include "backends.h"
+#include "session.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+#include "decoder.h"
+#include "results.h"
+#include "output.h"
+#include "options.h"
+#include "manifest.h"
+
+
+/**
+ * @brief Apply the output settings of a manifest object to an entry
+ *
+ * @param entry_cjson Manifest object holding any of output, format, top_k
+ *        and probabilities
+ * @param entry Pointer to MANIFEST_ENTRY to update
+ * @param shots Pointer to the shot count to update
+ * @return 0 on success, or -1 if a setting is invalid
+ */
+static int apply_entry_settings(cJSON* entry_cjson, MANIFEST_ENTRY* entry, int* shots) {
+    cJSON* output_cjson = cJSON_GetObjectItem(entry_cjson, "output");
+    cJSON* format_cjson = cJSON_GetObjectItem(entry_cjson, "format");
+    cJSON* top_k_cjson = cJSON_GetObjectItem(entry_cjson, "top_k");
+    cJSON* probabilities_cjson = cJSON_GetObjectItem(entry_cjson, "probabilities");
+    cJSON* shots_cjson = cJSON_GetObjectItem(entry_cjson, "shots");
+
+    if (cJSON_IsString(output_cjson)) {
+        free(entry->output_path);
+        entry->output_path = strdup(output_cjson->valuestring);
+        if (!entry->output_path) return -1;
+    }
+    if (cJSON_IsString(format_cjson) && parse_output_format(format_cjson->valuestring, &entry->output_format) < 0) return -1;
+    if (cJSON_IsNumber(top_k_cjson)) entry->top_k = top_k_cjson->valueint;
+    if (cJSON_IsBool(probabilities_cjson)) entry->probabilities = cJSON_IsTrue(probabilities_cjson);
+    if (cJSON_IsNumber(shots_cjson)) *shots = shots_cjson->valueint;
+
+    return entry->top_k < 0 || *shots < 0 ? -1 : 0;
+}
+
+/**
+ * @brief Read a manifest of circuits to run as one batch
+ *
+ * The manifest is a JSON object such as
+ *
+ *   {"max_in_flight": 4, "summary": "summary.json",
+ *    "defaults": {"shots": 1000, "format": "json", "output": "all.jsonl"},
+ *    "circuits": [{"path": "bell.qasm", "shots": 4000, "output": "bell.txt",
+ *                  "format": "counts", "top_k": 4, "probabilities": true,
+ *                  "parameters": "angles.csv", "name": "bell"}]}
+ *
+ * Every circuit starts from the command line options, then the defaults of
+ * the manifest, then its own settings; circuits without an output file
+ * write to the --output of the command line. Paths are taken as given,
+ * relative to the working directory. The --jobs option overrides
+ * max_in_flight, and without either the jobs are not limited.
+ *
+ * @param filename Path to the manifest, or STDIN_FILENAME
+ * @param options Pointer to RUNTIME_OPTIONS providing the defaults
+ * @return Pointer to newly allocated MANIFEST (CALLER MUST DESTROY), or NULL
+ *         on failure
+ */
+MANIFEST* read_manifest(char* filename, RUNTIME_OPTIONS* options) {
+    MANIFEST* manifest = NULL;
+
+    size_t size = 0;
+    char* text = read_file(filename, &size);
+    if (!text) {
+        fprintf(stderr, "ERROR - Reading %s failed in read_manifest()!\n", filename);
+        goto terminate;
+    }
+
+    cJSON* root = cJSON_Parse(text);
+    if (!cJSON_IsObject(root)) {
+        fprintf(stderr, "ERROR - Parsing the manifest %s failed in read_manifest()!\n", filename);
+        goto cleanup_root;
+    }
+
+    cJSON* circuits_cjson = cJSON_GetObjectItem(root, "circuits");
+    int count = cJSON_IsArray(circuits_cjson) ? cJSON_GetArraySize(circuits_cjson) : 0;
+    if (count == 0) {
+        fprintf(stderr, "ERROR - The manifest %s lists no circuits in read_manifest()!\n", filename);
+        goto cleanup_root;
+    }
+
+    manifest = (MANIFEST*)calloc(1, sizeof(MANIFEST));
+    if (!manifest) {
+        fprintf(stderr, "ERROR - Allocating memory for manifest failed in read_manifest()!\n");
+        goto cleanup_root;
+    }
+
+    manifest->circuits = (CIRCUIT*)calloc(count, sizeof(CIRCUIT));
+    manifest->entries = (MANIFEST_ENTRY*)calloc(count, sizeof(MANIFEST_ENTRY));
+    if (!manifest->circuits || !manifest->entries) {
+        fprintf(stderr, "ERROR - Allocating memory for manifest entries failed in read_manifest()!\n");
+        goto cleanup_manifest;
+    }
+
+    cJSON* max_in_flight_cjson = cJSON_GetObjectItem(root, "max_in_flight");
+    cJSON* summary_cjson = cJSON_GetObjectItem(root, "summary");
+    cJSON* defaults_cjson = cJSON_GetObjectItem(root, "defaults");
+
+    if (options->concurrent_jobs >= 0) manifest->max_in_flight = options->concurrent_jobs;
+    else if (cJSON_IsNumber(max_in_flight_cjson)) manifest->max_in_flight = max_in_flight_cjson->valueint;
+    if (manifest->max_in_flight < 0) {
+        fprintf(stderr, "ERROR - The manifest %s holds an invalid max_in_flight in read_manifest()!\n", filename);
+        goto cleanup_manifest;
+    }
+
+    if (cJSON_IsString(summary_cjson)) {
+        manifest->summary_path = strdup(summary_cjson->valuestring);
+        if (!manifest->summary_path) {
+            fprintf(stderr, "ERROR - Copying the summary path failed in read_manifest()!\n");
+            goto cleanup_manifest;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        cJSON* entry_cjson = cJSON_GetArrayItem(circuits_cjson, i);
+        char* path = cJSON_GetStringValue(cJSON_GetObjectItem(entry_cjson, "path"));
+        char* name = cJSON_GetStringValue(cJSON_GetObjectItem(entry_cjson, "name"));
+        char* parameters = cJSON_GetStringValue(cJSON_GetObjectItem(entry_cjson, "parameters"));
+        if (!path) {
+            fprintf(stderr, "ERROR - Circuit %d of the manifest has no path in read_manifest()!\n", i);
+            goto cleanup_manifest;
+        }
+
+        char* qasm = read_qasm(path);
+        if (!qasm) {
+            fprintf(stderr, "ERROR - Reading %s failed in read_manifest()!\n", path);
+            goto cleanup_manifest;
+        }
+
+        CIRCUIT* circuit = &manifest->circuits[i];
+        initialize_circuit(circuit, strdup(name ? name : path), qasm);
+        manifest->entry_count++;
+        if (!circuit->name) {
+            fprintf(stderr, "ERROR - Copying the name of %s failed in read_manifest()!\n", path);
+            goto cleanup_manifest;
+        }
+
+        MANIFEST_ENTRY* entry = &manifest->entries[i];
+        entry->output_format = options->output_format;
+        entry->top_k = options->top_k;
+        entry->probabilities = options->probabilities;
+        circuit->shots = options->shots;
+
+        if (apply_entry_settings(defaults_cjson, entry, &circuit->shots) < 0 ||
+            apply_entry_settings(entry_cjson, entry, &circuit->shots) < 0) {
+            fprintf(stderr, "ERROR - The settings of circuit %s are invalid in read_manifest()!\n", circuit->name);
+            goto cleanup_manifest;
+        }
+
+        if (!parameters) parameters = options->parameters_path;
+        if (parameters && read_parameter_values(parameters, circuit, 1) < 0) {
+            fprintf(stderr, "ERROR - Reading the parameter values of %s failed in read_manifest()!\n", circuit->name);
+            goto cleanup_manifest;
+        }
+    }
+
+    goto cleanup_root;
+
+cleanup_manifest:
+    destroy_manifest(manifest);
+    manifest = NULL;
+
+cleanup_root:
+    cJSON_Delete(root);
+    free(text);
+
+terminate:
+    return manifest;
+}
+
+/**
+ * @brief Destroy a manifest, its circuits and the writers it opened
+ *
+ * @param manifest Pointer to MANIFEST to destroy, or NULL
+ */
+void destroy_manifest(MANIFEST* manifest) {
+    if (!manifest) return;
+
+    for (int i = 0; manifest->entries && i < manifest->entry_count; i++) {
+        MANIFEST_ENTRY* entry = &manifest->entries[i];
+        if (entry->owns_writer) destroy_result_writer(entry->writer);
+        free(entry->output_path);
+        free(entry->job_id);
+    }
+
+    free_circuits(manifest->circuits, manifest->entry_count);
+    free(manifest->entries);
+    free(manifest->summary_path);
+    free(manifest);
+
+    return;
+}
+
+/**
+ * @brief Open the result output of every manifest entry
+ *
+ * Entries naming the same output file share one writer, so that their
+ * results are appended one after the other; entries without an output
+ * file use the default writer.
+ *
+ * @param manifest Pointer to MANIFEST whose entries are opened
+ * @param default_writer Pointer to RESULT_WRITER for entries without output
+ * @return 0 on success, or -1 on failure
+ */
+int open_manifest_writers(MANIFEST* manifest, RESULT_WRITER* default_writer) {
+    for (int i = 0; i < manifest->entry_count; i++) {
+        MANIFEST_ENTRY* entry = &manifest->entries[i];
+        if (!entry->output_path) {
+            entry->writer = default_writer;
+            continue;
+        }
+
+        for (int j = 0; j < i && !entry->writer; j++) {
+            if (manifest->entries[j].output_path && strcmp(manifest->entries[j].output_path, entry->output_path) == 0) entry->writer = manifest->entries[j].writer;
+        }
+        if (entry->writer) continue;
+
+        entry->writer = create_result_writer(entry->output_path, entry->output_format, entry->top_k, entry->probabilities, NULL);
+        if (!entry->writer) {
+            fprintf(stderr, "ERROR - Opening the output of %s failed in open_manifest_writers()!\n", manifest->circuits[i].name);
+            return -1;
+        }
+        entry->owns_writer = true;
+        entry->writer->console = default_writer->console;
+        entry->writer->analysis = default_writer->analysis;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Record the outcome of the job of one manifest entry
+ *
+ * @param manifest Pointer to MANIFEST holding the entry
+ * @param index Index of the entry
+ * @param job_id Identifier of the job (copied), or NULL if never submitted
+ * @param completed Whether the job completed
+ * @param queue_time Seconds from submission until the job finished running,
+ *        0 for a result taken from the cache
+ */
+void record_manifest_job(MANIFEST* manifest, int index, char* job_id, bool completed, double queue_time) {
+    MANIFEST_ENTRY* entry = &manifest->entries[index];
+    BATCH_SUMMARY* summary = &manifest->summary;
+
+    free(entry->job_id);
+    entry->job_id = job_id ? strdup(job_id) : NULL;
+    entry->completed = completed;
+    entry->failed = !completed;
+    entry->queue_time = queue_time;
+
+    if (completed) summary->completed_count++;
+    else summary->failed_count++;
+
+    if (queue_time > 0.0) {
+        summary->queued_count++;
+        summary->total_queue_time += queue_time;
+        if (queue_time > summary->max_queue_time) summary->max_queue_time = queue_time;
+    }
+
+    return;
+}
+
+/**
+ * @brief Report the throughput of a batch run
+ *
+ * Prints the job rate, queue times and failed circuits to the console and,
+ * when the manifest names a summary file, writes the same figures together
+ * with the outcome of every entry to it as JSON.
+ *
+ * @param manifest Pointer to MANIFEST of the finished run
+ * @param console Stream receiving the text summary
+ * @return 0 on success, or -1 if the summary file could not be written
+ */
+int write_batch_summary(MANIFEST* manifest, FILE* console) {
+    BATCH_SUMMARY* summary = &manifest->summary;
+
+    int finished_count = summary->completed_count + summary->failed_count;
+    double jobs_per_minute = summary->elapsed_time > 0.0 ? 60.0 * finished_count / summary->elapsed_time : 0.0;
+    double mean_queue_time = summary->queued_count > 0 ? summary->total_queue_time / summary->queued_count : 0.0;
+
+    fprintf(console, "=== Batch Summary ===\n\n");
+    fprintf(console, "Jobs: %d completed, %d failed of %d in %.1f s (%.1f jobs/min)\n", summary->completed_count, summary->failed_count, manifest->entry_count, summary->elapsed_time, jobs_per_minute);
+    fprintf(console, "Queue time: mean %.1f s, max %.1f s over %d submitted jobs\n", mean_queue_time, summary->max_queue_time, summary->queued_count);
+    for (int i = 0; i < manifest->entry_count; i++) {
+        if (!manifest->entries[i].completed) fprintf(console, "Failed: %s\n", manifest->circuits[i].name);
+    }
+    fprintf(console, "\n");
+    fflush(console);
+
+    if (!manifest->summary_path) return 0;
+
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "jobs", manifest->entry_count);
+    cJSON_AddNumberToObject(root, "completed", summary->completed_count);
+    cJSON_AddNumberToObject(root, "failed", summary->failed_count);
+    cJSON_AddNumberToObject(root, "elapsed_seconds", summary->elapsed_time);
+    cJSON_AddNumberToObject(root, "jobs_per_minute", jobs_per_minute);
+    cJSON_AddNumberToObject(root, "mean_queue_seconds", mean_queue_time);
+    cJSON_AddNumberToObject(root, "max_queue_seconds", summary->max_queue_time);
+
+    cJSON* circuits_cjson = cJSON_AddArrayToObject(root, "circuits");
+    for (int i = 0; i < manifest->entry_count; i++) {
+        MANIFEST_ENTRY* entry = &manifest->entries[i];
+
+        cJSON* entry_cjson = cJSON_CreateObject();
+        cJSON_AddStringToObject(entry_cjson, "name", manifest->circuits[i].name);
+        if (entry->job_id) cJSON_AddStringToObject(entry_cjson, "job_id", entry->job_id);
+        else cJSON_AddNullToObject(entry_cjson, "job_id");
+        cJSON_AddStringToObject(entry_cjson, "status", entry->completed ? "completed" : "failed");
+        cJSON_AddNumberToObject(entry_cjson, "queue_seconds", entry->queue_time);
+        if (entry->output_path) cJSON_AddStringToObject(entry_cjson, "output", entry->output_path);
+        cJSON_AddItemToArray(circuits_cjson, entry_cjson);
+    }
+
+    char* json = cJSON_Print(root);
+    cJSON_Delete(root);
+
+    int status = json ? write_cache_file(manifest->summary_path, json) : -1;
+    if (status < 0) fprintf(stderr, "ERROR - Writing the batch summary to %s failed in write_batch_summary()!\n", manifest->summary_path);
+    free(json);
+
+    return status;
+}
@@ -0,0 +1,45 @@
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+typedef struct ManifestEntry {
+    char* output_path;
+    OUTPUT_FORMAT output_format;
+    int top_k;
+    bool probabilities;
+    RESULT_WRITER* writer;
+    bool owns_writer;
+
+    char* job_id;
+    bool completed;
+    bool failed;
+    double queue_time;
+} MANIFEST_ENTRY;
+
+typedef struct BatchSummary {
+    int completed_count;
+    int failed_count;
+    int queued_count;
+    double start_time;
+    double elapsed_time;
+    double total_queue_time;
+    double max_queue_time;
+} BATCH_SUMMARY;
+
+typedef struct Manifest {
+    CIRCUIT* circuits;
+    MANIFEST_ENTRY* entries;
+    int entry_count;
+    int max_in_flight;
+    char* summary_path;
+
+    BATCH_SUMMARY summary;
+} MANIFEST;
+
+MANIFEST* read_manifest(char* filename, RUNTIME_OPTIONS* options);
+void destroy_manifest(MANIFEST* manifest);
+
+int open_manifest_writers(MANIFEST* manifest, RESULT_WRITER* default_writer);
+void record_manifest_job(MANIFEST* manifest, int index, char* job_id, bool completed, double queue_time);
+int write_batch_summary(MANIFEST* manifest, FILE* console);
+
+#endif
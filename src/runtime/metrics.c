@@ -0,0 +1,293 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "cache.h"
+
+
+static const char* PHASE_NAMES[PHASE_COUNT] = {
+    "config", "token", "backends", "payload", "session", "submit", "queue", "poll", "download", "parse"
+};
+
+
+/**
+ * @brief Create an empty set of runtime metrics
+ *
+ * @return Pointer to newly allocated RUNTIME_METRICS (CALLER MUST DESTROY),
+ *         or NULL on failure
+ */
+RUNTIME_METRICS* create_runtime_metrics(void) {
+    RUNTIME_METRICS* metrics = (RUNTIME_METRICS*)calloc(1, sizeof(RUNTIME_METRICS));
+    if (!metrics) {
+        fprintf(stderr, "ERROR - Allocating memory for metrics failed in create_runtime_metrics()!\n");
+        return NULL;
+    }
+
+    metrics->start_time = get_monotonic_time();
+    pthread_mutex_init(&metrics->lock, NULL);
+
+    return metrics;
+}
+
+/**
+ * @brief Destroy runtime metrics
+ *
+ * @param metrics Pointer to RUNTIME_METRICS to destroy, or NULL
+ */
+void destroy_runtime_metrics(RUNTIME_METRICS* metrics) {
+    if (!metrics) return;
+
+    pthread_mutex_destroy(&metrics->lock);
+    free(metrics);
+
+    return;
+}
+
+/**
+ * @brief Record the duration of one span of a runtime phase (thread-safe)
+ *
+ * @param metrics Pointer to RUNTIME_METRICS, or NULL to record nothing
+ * @param phase Phase the span belongs to
+ * @param seconds Duration of the span on the monotonic clock
+ */
+void record_phase(RUNTIME_METRICS* metrics, METRIC_PHASE phase, double seconds) {
+    if (!metrics) return;
+    if (seconds < 0.0) seconds = 0.0;
+
+    pthread_mutex_lock(&metrics->lock);
+
+    PHASE_STATS* stats = &metrics->phases[phase];
+    if (stats->count == 0 || seconds < stats->min_time) stats->min_time = seconds;
+    if (stats->count == 0 || seconds > stats->max_time) stats->max_time = seconds;
+    stats->total_time += seconds;
+    stats->count++;
+
+    pthread_mutex_unlock(&metrics->lock);
+
+    return;
+}
+
+/**
+ * @brief Count the outcome of a finished HTTP transfer (thread-safe)
+ *
+ * Transfers that failed below HTTP are counted as transport errors, all
+ * others by their status code.
+ *
+ * @param metrics Pointer to RUNTIME_METRICS, or NULL to record nothing
+ * @param curl Handle of the finished transfer
+ * @param response_code cURL result code of the transfer
+ * @return Duration of the transfer in seconds, as measured by cURL
+ */
+double record_response(RUNTIME_METRICS* metrics, CURL* curl, CURLcode response_code) {
+    long http_code = 0;
+    curl_off_t total_time = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_time);
+
+    if (!metrics) return total_time / 1e6;
+
+    pthread_mutex_lock(&metrics->lock);
+
+    if (response_code != CURLE_OK || http_code == 0) {
+        metrics->transport_errors++;
+    } else {
+        int i = 0;
+        while (i < metrics->status_count && metrics->status_counts[i].code != http_code) i++;
+
+        if (i < metrics->status_count) {
+            metrics->status_counts[i].count++;
+        } else if (i < METRICS_MAX_CODES) {
+            metrics->status_counts[i].code = http_code;
+            metrics->status_counts[i].count = 1;
+            metrics->status_count++;
+        }
+    }
+
+    pthread_mutex_unlock(&metrics->lock);
+
+    return total_time / 1e6;
+}
+
+/**
+ * @brief Count a request that is repeated because its answer was not final
+ *
+ * @param metrics Pointer to RUNTIME_METRICS, or NULL to record nothing
+ */
+void record_retry(RUNTIME_METRICS* metrics) {
+    if (!metrics) return;
+
+    pthread_mutex_lock(&metrics->lock);
+    metrics->retries++;
+    pthread_mutex_unlock(&metrics->lock);
+
+    return;
+}
+
+/**
+ * @brief Count a request that is repeated after a transient failure
+ *
+ * @param metrics Pointer to RUNTIME_METRICS, or NULL to record nothing
+ */
+void record_failure_retry(RUNTIME_METRICS* metrics) {
+    if (!metrics) return;
+
+    pthread_mutex_lock(&metrics->lock);
+    metrics->failure_retries++;
+    pthread_mutex_unlock(&metrics->lock);
+
+    return;
+}
+
+
+/**
+ * @brief Format the metrics as a JSON summary
+ *
+ * @param metrics Pointer to RUNTIME_METRICS to format
+ * @return Newly allocated JSON string (CALLER MUST FREE), or NULL on failure
+ */
+char* format_metrics_json(RUNTIME_METRICS* metrics) {
+    cJSON* root = cJSON_CreateObject();
+
+    pthread_mutex_lock(&metrics->lock);
+
+    cJSON_AddNumberToObject(root, "uptime_seconds", get_monotonic_time() - metrics->start_time);
+
+    cJSON* phases_cjson = cJSON_AddObjectToObject(root, "phases");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        PHASE_STATS* stats = &metrics->phases[i];
+
+        cJSON* phase_cjson = cJSON_AddObjectToObject(phases_cjson, PHASE_NAMES[i]);
+        cJSON_AddNumberToObject(phase_cjson, "count", stats->count);
+        cJSON_AddNumberToObject(phase_cjson, "total_seconds", stats->total_time);
+        cJSON_AddNumberToObject(phase_cjson, "mean_seconds", stats->count > 0 ? stats->total_time / stats->count : 0.0);
+        cJSON_AddNumberToObject(phase_cjson, "min_seconds", stats->min_time);
+        cJSON_AddNumberToObject(phase_cjson, "max_seconds", stats->max_time);
+    }
+
+    cJSON* http_cjson = cJSON_AddObjectToObject(root, "http");
+    cJSON* responses_cjson = cJSON_AddObjectToObject(http_cjson, "responses");
+    for (int i = 0; i < metrics->status_count; i++) {
+        char code[32];
+        snprintf(code, sizeof(code), "%ld", metrics->status_counts[i].code);
+        cJSON_AddNumberToObject(responses_cjson, code, metrics->status_counts[i].count);
+    }
+    cJSON_AddNumberToObject(http_cjson, "transport_errors", metrics->transport_errors);
+    cJSON_AddNumberToObject(http_cjson, "retries", metrics->retries);
+    cJSON_AddNumberToObject(http_cjson, "failure_retries", metrics->failure_retries);
+
+    pthread_mutex_unlock(&metrics->lock);
+
+    char* json = cJSON_Print(root);
+    cJSON_Delete(root);
+
+    return json;
+}
+
+/**
+ * @brief Format the metrics in the Prometheus text exposition format
+ *
+ * The phases are exported as a summary without quantiles plus a gauge of
+ * the longest span, the HTTP outcomes as counters.
+ *
+ * @param metrics Pointer to RUNTIME_METRICS to format
+ * @return Newly allocated text (CALLER MUST FREE), or NULL on failure
+ */
+char* format_metrics_prometheus(RUNTIME_METRICS* metrics) {
+    char* text = NULL;
+    size_t size = 0;
+
+    FILE* stream = open_memstream(&text, &size);
+    if (!stream) {
+        fprintf(stderr, "ERROR - Opening the metrics buffer failed in format_metrics_prometheus()!\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&metrics->lock);
+
+    fprintf(stream, "# HELP %s_uptime_seconds Time since the runtime started.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_uptime_seconds gauge\n", METRICS_PREFIX);
+    fprintf(stream, "%s_uptime_seconds %.6f\n", METRICS_PREFIX, get_monotonic_time() - metrics->start_time);
+
+    fprintf(stream, "# HELP %s_phase_seconds Time spent in each phase of a run.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_phase_seconds summary\n", METRICS_PREFIX);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stream, "%s_phase_seconds_sum{phase=\"%s\"} %.6f\n", METRICS_PREFIX, PHASE_NAMES[i], metrics->phases[i].total_time);
+        fprintf(stream, "%s_phase_seconds_count{phase=\"%s\"} %ld\n", METRICS_PREFIX, PHASE_NAMES[i], metrics->phases[i].count);
+    }
+
+    fprintf(stream, "# HELP %s_phase_max_seconds Longest span of each phase.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_phase_max_seconds gauge\n", METRICS_PREFIX);
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(stream, "%s_phase_max_seconds{phase=\"%s\"} %.6f\n", METRICS_PREFIX, PHASE_NAMES[i], metrics->phases[i].max_time);
+    }
+
+    fprintf(stream, "# HELP %s_http_responses_total HTTP responses by status code.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_http_responses_total counter\n", METRICS_PREFIX);
+    for (int i = 0; i < metrics->status_count; i++) {
+        fprintf(stream, "%s_http_responses_total{code=\"%ld\"} %ld\n", METRICS_PREFIX, metrics->status_counts[i].code, metrics->status_counts[i].count);
+    }
+
+    fprintf(stream, "# HELP %s_http_transport_errors_total Requests that failed without an HTTP response.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_http_transport_errors_total counter\n", METRICS_PREFIX);
+    fprintf(stream, "%s_http_transport_errors_total %ld\n", METRICS_PREFIX, metrics->transport_errors);
+
+    fprintf(stream, "# HELP %s_http_retries_total Requests repeated because the answer was not final yet.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_http_retries_total counter\n", METRICS_PREFIX);
+    fprintf(stream, "%s_http_retries_total %ld\n", METRICS_PREFIX, metrics->retries);
+
+    fprintf(stream, "# HELP %s_http_failure_retries_total Requests repeated after a rate limit, a server error or a dropped connection.\n", METRICS_PREFIX);
+    fprintf(stream, "# TYPE %s_http_failure_retries_total counter\n", METRICS_PREFIX);
+    fprintf(stream, "%s_http_failure_retries_total %ld\n", METRICS_PREFIX, metrics->failure_retries);
+
+    pthread_mutex_unlock(&metrics->lock);
+
+    if (fclose(stream) != 0) {
+        fprintf(stderr, "ERROR - Formatting the metrics failed in format_metrics_prometheus()!\n");
+        free(text);
+        return NULL;
+    }
+
+    return text;
+}
+
+/**
+ * @brief Write the metrics to their export files
+ *
+ * Each file is replaced atomically, so that a collector scraping it never
+ * sees a partial export.
+ *
+ * @param metrics Pointer to RUNTIME_METRICS to export
+ * @param json_path Path of the JSON summary, or NULL
+ * @param prometheus_path Path of the Prometheus text file, or NULL
+ * @return 0 on success, or -1 if an export failed
+ */
+int export_metrics(RUNTIME_METRICS* metrics, char* json_path, char* prometheus_path) {
+    int status = 0;
+
+    if (json_path) {
+        char* json = format_metrics_json(metrics);
+        if (!json || write_cache_file(json_path, json) < 0) {
+            fprintf(stderr, "ERROR - Writing the metrics to %s failed in export_metrics()!\n", json_path);
+            status = -1;
+        }
+        free(json);
+    }
+
+    if (prometheus_path) {
+        char* text = format_metrics_prometheus(metrics);
+        if (!text || write_cache_file(prometheus_path, text) < 0) {
+            fprintf(stderr, "ERROR - Writing the metrics to %s failed in export_metrics()!\n", prometheus_path);
+            status = -1;
+        }
+        free(text);
+    }
+
+    return status;
+}
@@ -0,0 +1,58 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#define METRICS_MAX_CODES 32
+#define METRICS_PREFIX "quantumc"
+
+typedef enum MetricPhase {
+    PHASE_CONFIG,
+    PHASE_TOKEN,
+    PHASE_BACKENDS,
+    PHASE_PAYLOAD,
+    PHASE_SESSION,
+    PHASE_SUBMIT,
+    PHASE_QUEUE,
+    PHASE_POLL,
+    PHASE_DOWNLOAD,
+    PHASE_PARSE,
+    PHASE_COUNT
+} METRIC_PHASE;
+
+typedef struct PhaseStats {
+    long count;
+    double total_time;
+    double min_time;
+    double max_time;
+} PHASE_STATS;
+
+typedef struct StatusCount {
+    long code;
+    long count;
+} STATUS_COUNT;
+
+typedef struct RuntimeMetrics {
+    double start_time;
+    PHASE_STATS phases[PHASE_COUNT];
+
+    STATUS_COUNT status_counts[METRICS_MAX_CODES];
+    int status_count;
+    long transport_errors;
+    long retries;
+    long failure_retries;
+
+    pthread_mutex_t lock;
+} RUNTIME_METRICS;
+
+RUNTIME_METRICS* create_runtime_metrics(void);
+void destroy_runtime_metrics(RUNTIME_METRICS* metrics);
+
+void record_phase(RUNTIME_METRICS* metrics, METRIC_PHASE phase, double seconds);
+double record_response(RUNTIME_METRICS* metrics, CURL* curl, CURLcode response_code);
+void record_retry(RUNTIME_METRICS* metrics);
+void record_failure_retry(RUNTIME_METRICS* metrics);
+
+char* format_metrics_json(RUNTIME_METRICS* metrics);
+char* format_metrics_prometheus(RUNTIME_METRICS* metrics);
+int export_metrics(RUNTIME_METRICS* metrics, char* json_path, char* prometheus_path);
+
+#endif
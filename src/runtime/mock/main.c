@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "server.h"
+#include "mock.h"
+
+
+/**
+ * @brief Print the command line usage of the mock server
+ *
+ * @param program Name the mock server was invoked with
+ */
+static void print_usage(char* program) {
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Serves the IAM token, backends, jobs and sessions endpoints the runtime\n");
+    fprintf(stderr, "uses on 127.0.0.1. Run the runtime with --api-url\n");
+    fprintf(stderr, "http://127.0.0.1:PORT/api/v1 and --iam-url http://127.0.0.1:PORT.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -p, --port N          Port to listen on (default %d).\n", MOCK_PORT);
+    fprintf(stderr, "  -q, --queue-delay S   Seconds a job stays queued (default %.1f).\n", MOCK_QUEUE_DELAY);
+    fprintf(stderr, "  -r, --run-delay S     Seconds a job then runs (default %.1f).\n", MOCK_RUN_DELAY);
+    fprintf(stderr, "  -s, --shots N         Samples per pub that sets no shots (default %d).\n", MOCK_SHOTS);
+    fprintf(stderr, "  -b, --bits N          Width of the generated register (default %d).\n", MOCK_BITS);
+    fprintf(stderr, "  -x, --results FILE    Serve FILE as the result of every job instead of\n");
+    fprintf(stderr, "                        generated samples.\n");
+    fprintf(stderr, "  -B, --backends FILE   Serve FILE as the backend list.\n");
+    fprintf(stderr, "  -t, --token-ttl S     Lifetime of issued tokens (default %d).\n", MOCK_TOKEN_TTL);
+    fprintf(stderr, "  -l, --latency S       Delay added to every response.\n");
+    fprintf(stderr, "  -e, --error-rate P    Answer a share P of all requests with an error.\n");
+    fprintf(stderr, "  -E, --error-code N    HTTP status of injected errors (default %d).\n", MOCK_ERROR_CODE);
+    fprintf(stderr, "  -L, --lost-rate P     Answer a share P of job submissions with an error\n");
+    fprintf(stderr, "                        after creating the job.\n");
+    fprintf(stderr, "  -F, --failure-rate P  Let a share P of all jobs end as Failed.\n");
+    fprintf(stderr, "  -w, --slow-backend NAME\n");
+    fprintf(stderr, "                        Keep jobs on backend NAME queued %.0f times longer.\n", MOCK_SLOW_FACTOR);
+    fprintf(stderr, "  -u, --busy-backend NAME\n");
+    fprintf(stderr, "                        Answer the first submission to backend NAME with\n");
+    fprintf(stderr, "                        503 and Retry-After: %d.\n", MOCK_BUSY_RETRY_AFTER);
+    fprintf(stderr, "  -T, --session-ttl S   Close sessions idle for S seconds (default %.0f).\n", MOCK_SESSION_TTL);
+    fprintf(stderr, "  -v, --verbose         Log every request.\n");
+    fprintf(stderr, "  -h, --help            Show this message.\n");
+
+    return;
+}
+
+/**
+ * @brief Parse a non-negative number option argument
+ *
+ * @param text Option argument to parse
+ * @param value Output pointer receiving the parsed value
+ * @return 0 on success, or -1 if the text is not a non-negative number
+ */
+static int parse_number(char* text, double* value) {
+    char* end = NULL;
+    double parsed = strtod(text, &end);
+    if (!*text || *end || !(parsed >= 0)) return -1;
+
+    *value = parsed;
+
+    return 0;
+}
+
+/**
+ * @brief Parse the mock server command line
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param options Pointer to MOCK_OPTIONS to fill
+ * @return 0 on success, or -1 on invalid arguments
+ */
+static int parse_options(int argc, char** argv, MOCK_OPTIONS* options) {
+    static struct option long_options[] = {
+        {"port", required_argument, NULL, 'p'},
+        {"queue-delay", required_argument, NULL, 'q'},
+        {"run-delay", required_argument, NULL, 'r'},
+        {"shots", required_argument, NULL, 's'},
+        {"bits", required_argument, NULL, 'b'},
+        {"results", required_argument, NULL, 'x'},
+        {"backends", required_argument, NULL, 'B'},
+        {"token-ttl", required_argument, NULL, 't'},
+        {"latency", required_argument, NULL, 'l'},
+        {"error-rate", required_argument, NULL, 'e'},
+        {"error-code", required_argument, NULL, 'E'},
+        {"lost-rate", required_argument, NULL, 'L'},
+        {"failure-rate", required_argument, NULL, 'F'},
+        {"slow-backend", required_argument, NULL, 'w'},
+        {"busy-backend", required_argument, NULL, 'u'},
+        {"session-ttl", required_argument, NULL, 'T'},
+        {"verbose", no_argument, NULL, 'v'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(options, 0, sizeof(MOCK_OPTIONS));
+    options->port = MOCK_PORT;
+    options->queue_delay = MOCK_QUEUE_DELAY;
+    options->run_delay = MOCK_RUN_DELAY;
+    options->shots = MOCK_SHOTS;
+    options->bits = MOCK_BITS;
+    options->token_ttl = MOCK_TOKEN_TTL;
+    options->error_code = MOCK_ERROR_CODE;
+    options->session_ttl = MOCK_SESSION_TTL;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "p:q:r:s:b:x:B:t:l:e:E:L:F:w:u:T:vh", long_options, NULL)) != -1) {
+        double number = 0;
+
+        switch (option) {
+        case 'x':
+            options->results_path = optarg;
+            continue;
+        case 'B':
+            options->backends_path = optarg;
+            continue;
+        case 'w':
+            options->slow_backend = optarg;
+            continue;
+        case 'u':
+            options->busy_backend = optarg;
+            continue;
+        case 'v':
+            options->verbose = true;
+            continue;
+        case 'p': case 'q': case 'r': case 's': case 'b': case 't': case 'l': case 'e': case 'E': case 'L': case 'F': case 'T':
+            if (parse_number(optarg, &number) < 0) {
+                fprintf(stderr, "ERROR - Invalid value %s for -%c in parse_options()!\n", optarg, option);
+                return -1;
+            }
+            break;
+        default:
+            return -1;
+        }
+
+        switch (option) {
+        case 'p': options->port = (int)number; break;
+        case 'q': options->queue_delay = number; break;
+        case 'r': options->run_delay = number; break;
+        case 's': options->shots = (int)number; break;
+        case 'b': options->bits = (int)number; break;
+        case 't': options->token_ttl = (int)number; break;
+        case 'l': options->latency = number; break;
+        case 'e': options->error_rate = number; break;
+        case 'E': options->error_code = (int)number; break;
+        case 'L': options->lost_rate = number; break;
+        case 'F': options->failure_rate = number; break;
+        case 'T': options->session_ttl = number; break;
+        }
+    }
+
+    if (optind < argc) {
+        fprintf(stderr, "ERROR - Unexpected argument %s in parse_options()!\n", argv[optind]);
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int termination_status = EXIT_FAILURE;
+
+    MOCK_OPTIONS options;
+    if (parse_options(argc, argv, &options) < 0) {
+        print_usage(argv[0]);
+        goto terminate;
+    }
+
+    MOCK_SERVER* server = create_mock_server(&options);
+    if (!server) {
+        fprintf(stderr, "ERROR - Creating the mock server failed in main()!\n");
+        goto terminate;
+    }
+
+    if (run_server(options.port, handle_request, server) < 0) {
+        fprintf(stderr, "ERROR - Running the mock server failed in main()!\n");
+        goto cleanup_server;
+    }
+
+    termination_status = EXIT_SUCCESS;
+
+cleanup_server:
+    destroy_mock_server(server);
+
+terminate:
+    return termination_status;
+}
@@ -0,0 +1,902 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "server.h"
+#include "mock.h"
+
+
+static const char* DEFAULT_BACKENDS_DATA =
+    "{\"devices\":["
+    "{\"name\":\"ibm_mock_small\",\"queue_length\":1,\"qubits\":5,\"status\":{\"name\":\"online\",\"reason\":\"available\"}},"
+    "{\"name\":\"ibm_mock_large\",\"queue_length\":4,\"qubits\":127,\"status\":{\"name\":\"online\",\"reason\":\"available\"}},"
+    "{\"name\":\"ibm_mock_offline\",\"queue_length\":0,\"qubits\":127,\"status\":{\"name\":\"offline\",\"reason\":\"maintenance\"}}"
+    "]}";
+
+
+/**
+ * @brief Read the current monotonic time
+ *
+ * @return Seconds since an arbitrary fixed point
+ */
+static double get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Sleep for a fractional number of seconds
+ *
+ * @param seconds Time to sleep
+ */
+static void sleep_for(double seconds) {
+    struct timespec remaining = {(time_t)seconds, (long)((seconds - (time_t)seconds) * 1e9)};
+    while (nanosleep(&remaining, &remaining) != 0 && errno == EINTR);
+
+    return;
+}
+
+/**
+ * @brief Read a whole fixture file
+ *
+ * @param path Path of the file
+ * @return Newly allocated file contents (CALLER MUST FREE), or NULL on failure
+ */
+static char* read_fixture(char* path) {
+    char* data = NULL;
+
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "ERROR - Opening %s failed in read_fixture()!\n", path);
+        goto terminate;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    data = (char*)calloc(size+1, sizeof(char));
+    if (!data) {
+        fprintf(stderr, "ERROR - Allocating memory for fixture failed in read_fixture()!\n");
+        goto cleanup_file;
+    }
+
+    if (fread(data, sizeof(char), size, file) != (size_t)size) {
+        fprintf(stderr, "ERROR - Reading %s failed in read_fixture()!\n", path);
+        free(data);
+        data = NULL;
+    }
+
+cleanup_file:
+    fclose(file);
+
+terminate:
+    return data;
+}
+
+
+/**
+ * @brief Create the mock service state
+ *
+ * Loads the backend list and result fixtures named in the options.
+ *
+ * @param options Pointer to MOCK_OPTIONS to copy
+ * @return Pointer to newly allocated MOCK_SERVER (CALLER MUST DESTROY), or
+ *         NULL on failure
+ */
+MOCK_SERVER* create_mock_server(MOCK_OPTIONS* options) {
+    MOCK_SERVER* server = (MOCK_SERVER*)calloc(1, sizeof(MOCK_SERVER));
+    if (!server) {
+        fprintf(stderr, "ERROR - Allocating memory for mock server failed in create_mock_server()!\n");
+        goto terminate;
+    }
+
+    server->options = *options;
+    server->seed = (unsigned int)time(NULL);
+    server->start_time = get_time();
+    pthread_mutex_init(&server->lock, NULL);
+
+    server->backends_data = options->backends_path ? read_fixture(options->backends_path) : strdup(DEFAULT_BACKENDS_DATA);
+    if (!server->backends_data) {
+        fprintf(stderr, "ERROR - Loading the backend list failed in create_mock_server()!\n");
+        goto cleanup_server;
+    }
+
+    if (options->results_path) {
+        server->results_data = read_fixture(options->results_path);
+        if (!server->results_data) {
+            fprintf(stderr, "ERROR - Loading the result fixture failed in create_mock_server()!\n");
+            goto cleanup_backends_data;
+        }
+    }
+
+    goto terminate;
+
+cleanup_backends_data:
+    free(server->backends_data);
+
+cleanup_server:
+    pthread_mutex_destroy(&server->lock);
+    free(server);
+    server = NULL;
+
+terminate:
+    return server;
+}
+
+/**
+ * @brief Destroy the mock service state
+ *
+ * @param server Pointer to MOCK_SERVER to destroy
+ */
+void destroy_mock_server(MOCK_SERVER* server) {
+    pthread_mutex_destroy(&server->lock);
+    for (int i = 0; i < server->job_count; i++) {
+        free(server->jobs[i].pub_bindings);
+        free(server->jobs[i].pub_shots);
+    }
+    free(server->jobs);
+    free(server->sessions);
+    free(server->backends_data);
+    free(server->results_data);
+    free(server);
+
+    return;
+}
+
+
+/**
+ * @brief Answer with an error in the format of the Qiskit Runtime API
+ *
+ * @param response Pointer to HTTP_RESPONSE to fill
+ * @param status HTTP status code
+ * @param code API error code
+ * @param message Error message
+ */
+static void set_error(HTTP_RESPONSE* response, int status, int code, const char* message) {
+    response->status = status;
+
+    cJSON* error_cjson = cJSON_CreateObject();
+    cJSON* errors_cjson = cJSON_AddArrayToObject(error_cjson, "errors");
+    cJSON* first_error_cjson = cJSON_CreateObject();
+    cJSON_AddNumberToObject(first_error_cjson, "code", code);
+    cJSON_AddStringToObject(first_error_cjson, "message", message);
+    cJSON_AddItemToArray(errors_cjson, first_error_cjson);
+
+    response->body = cJSON_PrintUnformatted(error_cjson);
+    cJSON_Delete(error_cjson);
+
+    return;
+}
+
+/**
+ * @brief Find a job by id
+ *
+ * The caller must hold the server lock.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param job_id Job id to look for
+ * @return Pointer to MOCK_JOB, or NULL if the job does not exist
+ */
+static MOCK_JOB* find_job(MOCK_SERVER* server, const char* job_id) {
+    for (int i = 0; i < server->job_count; i++) {
+        if (strcmp(server->jobs[i].id, job_id) == 0) return &server->jobs[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Find the job created by an earlier submission with the same key
+ *
+ * The caller must hold the server lock.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param idempotency_key Idempotency key of the submission
+ * @return Pointer to MOCK_JOB, or NULL if no job was submitted with the key
+ */
+static MOCK_JOB* find_submitted_job(MOCK_SERVER* server, const char* idempotency_key) {
+    for (int i = 0; i < server->job_count; i++) {
+        if (strcmp(server->jobs[i].idempotency_key, idempotency_key) == 0) return &server->jobs[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Find a session by id
+ *
+ * The caller must hold the server lock.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param session_id Session id to look for
+ * @return Pointer to MOCK_SESSION, or NULL if the session does not exist
+ */
+static MOCK_SESSION* find_session(MOCK_SERVER* server, const char* session_id) {
+    for (int i = 0; i < server->session_count; i++) {
+        if (strcmp(server->sessions[i].id, session_id) == 0) return &server->sessions[i];
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Check whether a session still accepts jobs
+ *
+ * A session closes when it is closed explicitly or when it stayed idle,
+ * with none of its jobs running, for the configured session TTL. The
+ * caller must hold the server lock.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param session Pointer to MOCK_SESSION
+ * @return true if the session is closed, false otherwise
+ */
+static bool is_session_closed(MOCK_SERVER* server, MOCK_SESSION* session) {
+    double idle_time = get_time() - session->last_active_time;
+    if (server->options.session_ttl > 0 && idle_time > server->options.session_ttl) session->closed = true;
+
+    return session->closed;
+}
+
+/**
+ * @brief Status a job has reached by now
+ *
+ * A job is queued for its queue delay, then runs for the run delay, and
+ * then either completes or, for the configured share of jobs, fails. A
+ * cancelled job stays cancelled.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param job Pointer to MOCK_JOB
+ * @return Status string of the job
+ */
+static const char* get_job_status(MOCK_SERVER* server, MOCK_JOB* job) {
+    double elapsed = get_time() - job->submitted_time;
+
+    if (job->cancelled) return "Cancelled";
+    if (elapsed < job->queue_delay) return "Queued";
+    if (elapsed < job->queue_delay + server->options.run_delay) return "Running";
+
+    return job->failed ? "Failed" : "Completed";
+}
+
+/**
+ * @brief Number of jobs ahead of a queued job
+ *
+ * The remaining queue delay is taken as that many jobs of one run delay
+ * each.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param job Pointer to MOCK_JOB
+ * @return Queue position of the job
+ */
+static int get_queue_position(MOCK_SERVER* server, MOCK_JOB* job) {
+    double remaining = job->queue_delay - (get_time() - job->submitted_time);
+    if (remaining <= 0 || server->options.run_delay <= 0) return 0;
+
+    return (int)(remaining / server->options.run_delay);
+}
+
+
+/**
+ * @brief POST /identity/token
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void issue_token(MOCK_SERVER* server, HTTP_RESPONSE* response) {
+    pthread_mutex_lock(&server->lock);
+    unsigned long token_number = ++server->token_count;
+    pthread_mutex_unlock(&server->lock);
+
+    char token[JOB_ID_NMEMB];
+    snprintf(token, JOB_ID_NMEMB, "mock-token-%lu", token_number);
+
+    cJSON* token_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(token_cjson, "access_token", token);
+    cJSON_AddStringToObject(token_cjson, "refresh_token", "not_supported");
+    cJSON_AddStringToObject(token_cjson, "token_type", "Bearer");
+    cJSON_AddNumberToObject(token_cjson, "expires_in", server->options.token_ttl);
+    cJSON_AddNumberToObject(token_cjson, "expiration", (double)(time(NULL) + server->options.token_ttl));
+
+    response->status = 200;
+    response->body = cJSON_PrintUnformatted(token_cjson);
+    cJSON_Delete(token_cjson);
+
+    return;
+}
+
+/**
+ * @brief GET /api/v1/backends/{name}/properties
+ *
+ * Every backend gets a fixed calibration derived from its name, so that
+ * backends differ in quality but stay the same from run to run.
+ *
+ * @param backend Backend name
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void describe_properties(const char* backend, HTTP_RESPONSE* response) {
+    unsigned int name_hash = 0;
+    for (const char* ch = backend; *ch; ch++) name_hash = name_hash*31 + (unsigned char)*ch;
+
+    double gate_error = 0.004 + (name_hash % 8) * 0.001;
+    double readout_error = 0.01 + (name_hash / 8 % 8) * 0.002;
+
+    cJSON* properties_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(properties_cjson, "backend_name", backend);
+
+    cJSON* qubits_cjson = cJSON_AddArrayToObject(properties_cjson, "qubits");
+    cJSON* gates_cjson = cJSON_AddArrayToObject(properties_cjson, "gates");
+    for (int i = 0; i < 2; i++) {
+        cJSON* qubit_cjson = cJSON_CreateArray();
+        cJSON* readout_cjson = cJSON_CreateObject();
+        cJSON_AddStringToObject(readout_cjson, "name", "readout_error");
+        cJSON_AddNumberToObject(readout_cjson, "value", readout_error);
+        cJSON_AddItemToArray(qubit_cjson, readout_cjson);
+        cJSON_AddItemToArray(qubits_cjson, qubit_cjson);
+    }
+
+    cJSON* gate_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(gate_cjson, "gate", "ecr");
+    int gate_qubits[2] = {0, 1};
+    cJSON_AddItemToObject(gate_cjson, "qubits", cJSON_CreateIntArray(gate_qubits, 2));
+    cJSON* parameters_cjson = cJSON_AddArrayToObject(gate_cjson, "parameters");
+    cJSON* error_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(error_cjson, "name", "gate_error");
+    cJSON_AddNumberToObject(error_cjson, "value", gate_error);
+    cJSON_AddItemToArray(parameters_cjson, error_cjson);
+    cJSON_AddItemToArray(gates_cjson, gate_cjson);
+
+    response->status = 200;
+    response->body = cJSON_PrintUnformatted(properties_cjson);
+    cJSON_Delete(properties_cjson);
+
+    return;
+}
+
+/**
+ * @brief POST /api/v1/jobs
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param request Pointer to HTTP_REQUEST carrying the job payload
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void submit_job(MOCK_SERVER* server, HTTP_REQUEST* request, HTTP_RESPONSE* response) {
+    cJSON* payload_cjson = cJSON_Parse(request->body);
+    cJSON* backend_cjson = cJSON_GetObjectItemCaseSensitive(payload_cjson, "backend");
+    cJSON* session_id_cjson = cJSON_GetObjectItemCaseSensitive(payload_cjson, "session_id");
+    cJSON* params_cjson = cJSON_GetObjectItemCaseSensitive(payload_cjson, "params");
+    cJSON* pubs_cjson = cJSON_GetObjectItemCaseSensitive(params_cjson, "pubs");
+
+    if (!cJSON_IsString(backend_cjson) || !cJSON_IsArray(pubs_cjson) || cJSON_GetArraySize(pubs_cjson) == 0) {
+        set_error(response, 400, 400, "The job payload needs a backend and at least one pub.");
+        goto cleanup_payload_cjson;
+    }
+
+    pthread_mutex_lock(&server->lock);
+
+    // A busy backend turns away the first submission, so that the client backs off.
+
+    if (server->options.busy_backend && !server->busy_answered && strcmp(backend_cjson->valuestring, server->options.busy_backend) == 0) {
+        server->busy_answered = true;
+        pthread_mutex_unlock(&server->lock);
+        set_error(response, 503, 503, "The backend is busy.");
+        snprintf(response->headers, RESPONSE_HEADER_NMEMB, "Retry-After: %d\r\n", MOCK_BUSY_RETRY_AFTER);
+        goto cleanup_payload_cjson;
+    }
+
+    // A submission repeated with the same idempotency key gets the job of the first one.
+
+    MOCK_SESSION* session = NULL;
+    cJSON* job_cjson = NULL;
+    MOCK_JOB* job = request->idempotency_key[0] ? find_submitted_job(server, request->idempotency_key) : NULL;
+    if (job) {
+        if (job->session_id[0]) session = find_session(server, job->session_id);
+        goto respond;
+    }
+
+    if (cJSON_IsString(session_id_cjson)) {
+        session = find_session(server, session_id_cjson->valuestring);
+        int status = !session ? 404 : is_session_closed(server, session) ? 409 : strcmp(session->backend, backend_cjson->valuestring) != 0 ? 400 : 0;
+        if (status) {
+            pthread_mutex_unlock(&server->lock);
+            set_error(response, status, status, status == 404 ? "Session not found." : status == 409 ? "The session is closed." : "The job backend differs from the session backend.");
+            goto cleanup_payload_cjson;
+        }
+    }
+
+    if (server->job_count == server->job_capacity) {
+        int capacity = server->job_capacity ? 2*server->job_capacity : 16;
+        MOCK_JOB* jobs = (MOCK_JOB*)realloc(server->jobs, capacity*sizeof(MOCK_JOB));
+        if (!jobs) {
+            pthread_mutex_unlock(&server->lock);
+            set_error(response, 500, 500, "Out of memory.");
+            goto cleanup_payload_cjson;
+        }
+        server->jobs = jobs;
+        server->job_capacity = capacity;
+    }
+
+    job = &server->jobs[server->job_count++];
+    memset(job, 0, sizeof(MOCK_JOB));
+    snprintf(job->id, JOB_ID_NMEMB, "mock-job-%d", server->job_count);
+    snprintf(job->idempotency_key, REQUEST_KEY_NMEMB, "%s", request->idempotency_key);
+    snprintf(job->backend, BACKEND_NAME_NMEMB, "%s", backend_cjson->valuestring);
+    job->submitted_time = get_time();
+    job->queue_delay = server->options.queue_delay;
+    if (server->options.slow_backend && strcmp(job->backend, server->options.slow_backend) == 0) job->queue_delay *= MOCK_SLOW_FACTOR;
+    job->pub_count = cJSON_GetArraySize(pubs_cjson);
+    job->pub_bindings = (int*)calloc(job->pub_count, sizeof(int));
+    job->pub_shots = (int*)calloc(job->pub_count, sizeof(int));
+    if (!job->pub_bindings || !job->pub_shots) {
+        free(job->pub_bindings);
+        free(job->pub_shots);
+        server->job_count--;
+        pthread_mutex_unlock(&server->lock);
+        set_error(response, 500, 500, "Out of memory.");
+        goto cleanup_payload_cjson;
+    }
+
+    // A pub swept over parameter bindings holds one row of values per binding,
+    // and a pub with its own shot count overrides the one of the job.
+
+    cJSON* shots_cjson = cJSON_GetObjectItemCaseSensitive(params_cjson, "shots");
+    int job_shots = cJSON_IsNumber(shots_cjson) && shots_cjson->valueint > 0 ? shots_cjson->valueint : server->options.shots;
+
+    for (int i = 0; i < job->pub_count; i++) {
+        cJSON* pub_cjson = cJSON_GetArrayItem(pubs_cjson, i);
+        cJSON* values_cjson = cJSON_GetArrayItem(pub_cjson, 1);
+        cJSON* pub_shots_cjson = cJSON_GetArrayItem(pub_cjson, 2);
+        if (cJSON_IsArray(values_cjson)) job->pub_bindings[i] = cJSON_GetArraySize(values_cjson);
+        job->pub_shots[i] = cJSON_IsNumber(pub_shots_cjson) && pub_shots_cjson->valueint > 0 ? pub_shots_cjson->valueint : job_shots;
+    }
+    job->failed = (double)rand_r(&server->seed) / RAND_MAX < server->options.failure_rate;
+    job->seed = rand_r(&server->seed);
+
+    // The first job of a session queues for the device, which then serves
+    // the later jobs of the session without queueing again, one after the
+    // other in a dedicated session and side by side in a batch.
+
+    if (session) {
+        snprintf(job->session_id, JOB_ID_NMEMB, "%s", session->id);
+        if (session->job_count++ == 0) session->ready_time = job->submitted_time + job->queue_delay;
+
+        double start_time = session->ready_time > job->submitted_time ? session->ready_time : job->submitted_time;
+        if (session->dedicated && session->busy_until > start_time) start_time = session->busy_until;
+        job->queue_delay = start_time - job->submitted_time;
+
+        double end_time = start_time + server->options.run_delay;
+        if (end_time > session->busy_until) session->busy_until = end_time;
+        if (end_time > session->last_active_time) session->last_active_time = end_time;
+    }
+
+respond:
+    job_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(job_cjson, "id", job->id);
+    cJSON_AddStringToObject(job_cjson, "backend", job->backend);
+    if (session) cJSON_AddStringToObject(job_cjson, "session_id", job->session_id);
+
+    pthread_mutex_unlock(&server->lock);
+
+    response->status = 200;
+    response->body = cJSON_PrintUnformatted(job_cjson);
+    cJSON_Delete(job_cjson);
+
+cleanup_payload_cjson:
+    cJSON_Delete(payload_cjson);
+
+    return;
+}
+
+/**
+ * @brief GET /api/v1/jobs/{id}
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param job_id Job id from the path
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void describe_job(MOCK_SERVER* server, const char* job_id, HTTP_RESPONSE* response) {
+    pthread_mutex_lock(&server->lock);
+
+    MOCK_JOB* job = find_job(server, job_id);
+    if (!job) {
+        pthread_mutex_unlock(&server->lock);
+        set_error(response, 404, 404, "Job not found.");
+        return;
+    }
+
+    const char* status = get_job_status(server, job);
+
+    cJSON* job_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(job_cjson, "id", job->id);
+    cJSON_AddStringToObject(job_cjson, "backend", job->backend);
+    cJSON_AddStringToObject(job_cjson, "status", status);
+    if (job->session_id[0]) cJSON_AddStringToObject(job_cjson, "session_id", job->session_id);
+    cJSON* state_cjson = cJSON_AddObjectToObject(job_cjson, "state");
+    cJSON_AddStringToObject(state_cjson, "status", status);
+    if (strcmp(status, "Queued") == 0) {
+        cJSON* queue_info_cjson = cJSON_AddObjectToObject(job_cjson, "queue_info");
+        cJSON_AddNumberToObject(queue_info_cjson, "position", get_queue_position(server, job));
+    }
+
+    pthread_mutex_unlock(&server->lock);
+
+    response->status = 200;
+    response->body = cJSON_PrintUnformatted(job_cjson);
+    cJSON_Delete(job_cjson);
+
+    return;
+}
+
+/**
+ * @brief POST /api/v1/jobs/{id}/cancel
+ *
+ * Only a job that is still queued or running can be cancelled.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param job_id Job id from the path
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void cancel_job(MOCK_SERVER* server, const char* job_id, HTTP_RESPONSE* response) {
+    pthread_mutex_lock(&server->lock);
+
+    MOCK_JOB* job = find_job(server, job_id);
+    const char* status = job ? get_job_status(server, job) : NULL;
+    bool cancellable = status && (strcmp(status, "Queued") == 0 || strcmp(status, "Running") == 0);
+    if (cancellable) job->cancelled = true;
+
+    pthread_mutex_unlock(&server->lock);
+
+    if (!job) {
+        set_error(response, 404, 404, "Job not found.");
+    } else if (!cancellable) {
+        set_error(response, 409, 409, "The job has already finished.");
+    } else {
+        response->status = 204;
+    }
+
+    return;
+}
+
+/**
+ * @brief Describe a session as the sessions endpoints return it
+ *
+ * The caller must hold the server lock.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param session Pointer to MOCK_SESSION
+ * @return cJSON object of the session (CALLER MUST DELETE)
+ */
+static cJSON* describe_session_cjson(MOCK_SERVER* server, MOCK_SESSION* session) {
+    bool closed = is_session_closed(server, session);
+
+    cJSON* session_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(session_cjson, "id", session->id);
+    cJSON_AddStringToObject(session_cjson, "backend_name", session->backend);
+    cJSON_AddStringToObject(session_cjson, "mode", session->dedicated ? "dedicated" : "batch");
+    cJSON_AddStringToObject(session_cjson, "state", closed ? "closed" : "open");
+    cJSON_AddBoolToObject(session_cjson, "accepting_jobs", !closed);
+    cJSON_AddNumberToObject(session_cjson, "jobs", session->job_count);
+
+    return session_cjson;
+}
+
+/**
+ * @brief POST /api/v1/sessions
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param request Pointer to HTTP_REQUEST carrying the backend and mode
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void open_session(MOCK_SERVER* server, HTTP_REQUEST* request, HTTP_RESPONSE* response) {
+    cJSON* request_cjson = cJSON_Parse(request->body);
+    cJSON* backend_cjson = cJSON_GetObjectItemCaseSensitive(request_cjson, "backend");
+    cJSON* mode_cjson = cJSON_GetObjectItemCaseSensitive(request_cjson, "mode");
+
+    bool valid_mode = cJSON_IsString(mode_cjson) && (strcmp(mode_cjson->valuestring, "dedicated") == 0 || strcmp(mode_cjson->valuestring, "batch") == 0);
+    if (!cJSON_IsString(backend_cjson) || !valid_mode) {
+        set_error(response, 400, 400, "The session needs a backend and a mode of dedicated or batch.");
+        goto cleanup_request_cjson;
+    }
+
+    pthread_mutex_lock(&server->lock);
+
+    if (server->session_count == server->session_capacity) {
+        int capacity = server->session_capacity ? 2*server->session_capacity : 4;
+        MOCK_SESSION* sessions = (MOCK_SESSION*)realloc(server->sessions, capacity*sizeof(MOCK_SESSION));
+        if (!sessions) {
+            pthread_mutex_unlock(&server->lock);
+            set_error(response, 500, 500, "Out of memory.");
+            goto cleanup_request_cjson;
+        }
+        server->sessions = sessions;
+        server->session_capacity = capacity;
+    }
+
+    MOCK_SESSION* session = &server->sessions[server->session_count++];
+    memset(session, 0, sizeof(MOCK_SESSION));
+    snprintf(session->id, JOB_ID_NMEMB, "mock-session-%d", server->session_count);
+    snprintf(session->backend, BACKEND_NAME_NMEMB, "%s", backend_cjson->valuestring);
+    session->dedicated = strcmp(mode_cjson->valuestring, "dedicated") == 0;
+    session->last_active_time = get_time();
+
+    cJSON* session_cjson = describe_session_cjson(server, session);
+
+    pthread_mutex_unlock(&server->lock);
+
+    response->status = 200;
+    response->body = cJSON_PrintUnformatted(session_cjson);
+    cJSON_Delete(session_cjson);
+
+cleanup_request_cjson:
+    cJSON_Delete(request_cjson);
+
+    return;
+}
+
+/**
+ * @brief GET /api/v1/sessions/{id}
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param session_id Session id from the path
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void describe_session(MOCK_SERVER* server, const char* session_id, HTTP_RESPONSE* response) {
+    pthread_mutex_lock(&server->lock);
+
+    MOCK_SESSION* session = find_session(server, session_id);
+    cJSON* session_cjson = session ? describe_session_cjson(server, session) : NULL;
+
+    pthread_mutex_unlock(&server->lock);
+
+    if (!session_cjson) {
+        set_error(response, 404, 404, "Session not found.");
+        return;
+    }
+
+    response->status = 200;
+    response->body = cJSON_PrintUnformatted(session_cjson);
+    cJSON_Delete(session_cjson);
+
+    return;
+}
+
+/**
+ * @brief DELETE /api/v1/sessions/{id}/close
+ *
+ * Jobs already submitted to the session still run to completion.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param session_id Session id from the path
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void close_session(MOCK_SERVER* server, const char* session_id, HTTP_RESPONSE* response) {
+    pthread_mutex_lock(&server->lock);
+
+    MOCK_SESSION* session = find_session(server, session_id);
+    if (session) session->closed = true;
+
+    pthread_mutex_unlock(&server->lock);
+
+    if (!session) set_error(response, 404, 404, "Session not found.");
+    else response->status = 204;
+
+    return;
+}
+
+/**
+ * @brief Generate Sampler v2 results with random samples
+ *
+ * Every pub measures a register named meas of the configured width, with
+ * one nested samples array per binding for a swept pub. The samples are
+ * drawn from the job's own seed, so repeated downloads of one job return
+ * the same result.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param pub_count Number of pubs of the job
+ * @param pub_bindings Number of bindings of every pub, 0 for an unswept pub
+ * @param pub_shots Number of shots of every pub
+ * @param seed Seed of the job
+ * @return Newly allocated JSON string (CALLER MUST FREE), or NULL on failure
+ */
+static char* generate_results(MOCK_SERVER* server, int pub_count, int* pub_bindings, int* pub_shots, unsigned int seed) {
+    int bits = server->options.bits;
+    int digits = (bits+3) / 4;
+    if (digits == 0) digits = 1;
+
+    // Every sample takes at most the digits plus the quotes, 0x and a comma.
+
+    size_t capacity = 64;
+    for (int pub = 0; pub < pub_count; pub++) {
+        size_t slot_count = pub_bindings[pub] > 0 ? pub_bindings[pub] : 1;
+        capacity += slot_count * ((size_t)pub_shots[pub]*(digits+5) + 128);
+    }
+
+    char* results = (char*)malloc(capacity);
+    if (!results) {
+        fprintf(stderr, "ERROR - Allocating memory for results failed in generate_results()!\n");
+        return NULL;
+    }
+
+    char* cursor = results;
+    cursor += sprintf(cursor, "{\"results\":[");
+
+    char* sample = (char*)malloc(digits+1);
+    if (!sample) {
+        fprintf(stderr, "ERROR - Allocating memory for sample failed in generate_results()!\n");
+        free(results);
+        return NULL;
+    }
+
+    for (int pub = 0; pub < pub_count; pub++) {
+        cursor += sprintf(cursor, "%s{\"data\":{\"meas\":{\"samples\":[", pub ? "," : "");
+
+        int binding_count = pub_bindings[pub] > 0 ? pub_bindings[pub] : 1;
+        for (int binding = 0; binding < binding_count; binding++) {
+            if (pub_bindings[pub] > 0) cursor += sprintf(cursor, "%s[", binding ? "," : "");
+
+            for (int shot = 0; shot < pub_shots[pub]; shot++) {
+                for (int i = 0; i < digits; i++) {
+                    int nibble = rand_r(&seed) & 0xF;
+                    if (i == 0 && bits % 4) nibble &= (1 << (bits % 4)) - 1;
+                    sample[i] = "0123456789abcdef"[nibble];
+                }
+                sample[digits] = '\0';
+
+                // The service writes samples without leading zeros.
+
+                char* significant = sample + strspn(sample, "0");
+                if (!*significant) significant--;
+
+                cursor += sprintf(cursor, "%s\"0x%s\"", shot ? "," : "", significant);
+            }
+
+            if (pub_bindings[pub] > 0) *cursor++ = ']';
+        }
+
+        cursor += sprintf(cursor, "],\"num_bits\":%d}},\"metadata\":{\"circuit_metadata\":{}}}", bits);
+    }
+
+    sprintf(cursor, "],\"metadata\":{\"version\":2}}");
+    free(sample);
+
+    return results;
+}
+
+/**
+ * @brief GET /api/v1/jobs/{id}/results
+ *
+ * Answers with error code 1234 until the job has completed, like the real
+ * service, and then with the result fixture or generated samples.
+ *
+ * @param server Pointer to MOCK_SERVER
+ * @param job_id Job id from the path
+ * @param response Pointer to HTTP_RESPONSE to fill
+ */
+static void send_results(MOCK_SERVER* server, const char* job_id, HTTP_RESPONSE* response) {
+    pthread_mutex_lock(&server->lock);
+
+    MOCK_JOB* job = find_job(server, job_id);
+    if (!job) {
+        pthread_mutex_unlock(&server->lock);
+        set_error(response, 404, 404, "Job not found.");
+        return;
+    }
+
+    const char* status = get_job_status(server, job);
+    int pub_count = job->pub_count;
+    unsigned int seed = job->seed;
+
+    int* pub_bindings = (int*)malloc(pub_count*sizeof(int));
+    int* pub_shots = (int*)malloc(pub_count*sizeof(int));
+    if (pub_bindings) memcpy(pub_bindings, job->pub_bindings, pub_count*sizeof(int));
+    if (pub_shots) memcpy(pub_shots, job->pub_shots, pub_count*sizeof(int));
+
+    pthread_mutex_unlock(&server->lock);
+
+    if (!pub_bindings || !pub_shots) {
+        set_error(response, 500, 500, "Out of memory.");
+        goto cleanup_pub_bindings;
+    }
+
+    if (strcmp(status, "Failed") == 0 || strcmp(status, "Cancelled") == 0) {
+        set_error(response, 400, 1235, strcmp(status, "Failed") == 0 ? "Job failed." : "Job was cancelled.");
+        goto cleanup_pub_bindings;
+    }
+    if (strcmp(status, "Completed") != 0) {
+        set_error(response, 400, 1234, "Job results are not yet available.");
+        goto cleanup_pub_bindings;
+    }
+
+    response->body = server->results_data ? strdup(server->results_data) : generate_results(server, pub_count, pub_bindings, pub_shots, seed);
+    if (!response->body) {
+        set_error(response, 500, 500, "Generating the results failed.");
+        goto cleanup_pub_bindings;
+    }
+    response->status = 200;
+
+cleanup_pub_bindings:
+    free(pub_bindings);
+    free(pub_shots);
+
+    return;
+}
+
+
+/**
+ * @brief Route one request of the mock service
+ *
+ * Applies the configured latency and injected errors first, then serves
+ * the IAM token endpoint and the backends, jobs and sessions endpoints of
+ * the Qiskit Runtime API. Lost responses are injected after the job was
+ * created, the case idempotency keys protect against.
+ *
+ * @param request Pointer to HTTP_REQUEST to answer
+ * @param response Pointer to HTTP_RESPONSE to fill
+ * @param userp Pointer to MOCK_SERVER
+ */
+void handle_request(HTTP_REQUEST* request, HTTP_RESPONSE* response, void* userp) {
+    MOCK_SERVER* server = (MOCK_SERVER*)userp;
+    MOCK_OPTIONS* options = &server->options;
+
+    if (options->latency > 0) sleep_for(options->latency);
+
+    pthread_mutex_lock(&server->lock);
+    bool inject_error = (double)rand_r(&server->seed) / RAND_MAX < options->error_rate;
+    bool lose_response = (double)rand_r(&server->seed) / RAND_MAX < options->lost_rate;
+    pthread_mutex_unlock(&server->lock);
+
+    char name[REQUEST_PATH_NMEMB] = "";
+    char rest[REQUEST_PATH_NMEMB] = "";
+    bool is_get = strcmp(request->method, "GET") == 0;
+    bool is_post = strcmp(request->method, "POST") == 0;
+    bool is_delete = strcmp(request->method, "DELETE") == 0;
+
+    if (inject_error) {
+        set_error(response, options->error_code, options->error_code, "Injected error.");
+        if (options->error_code == 429) snprintf(response->headers, RESPONSE_HEADER_NMEMB, "Retry-After: 1\r\n");
+    } else if (is_post && strncmp(request->path, "/identity/token", 15) == 0) {
+        issue_token(server, response);
+    } else if (is_get && strcmp(request->path, "/api/v1/backends") == 0) {
+        response->status = 200;
+        response->body = strdup(server->backends_data);
+    } else if (is_get && sscanf(request->path, "/api/v1/backends/%2047[^/]/%2047s", name, rest) == 2 && strcmp(rest, "properties") == 0) {
+        describe_properties(name, response);
+    } else if (is_post && strcmp(request->path, "/api/v1/jobs") == 0) {
+        submit_job(server, request, response);
+
+        // The job exists, but the client only learns that the request failed.
+
+        if (lose_response && response->status == 200) {
+            free(response->body);
+            set_error(response, options->error_code, options->error_code, "Injected error after the job was created.");
+        }
+    } else if (is_get && sscanf(request->path, "/api/v1/jobs/%2047[^/]/%2047s", name, rest) == 2 && strcmp(rest, "results") == 0) {
+        send_results(server, name, response);
+    } else if (is_post && sscanf(request->path, "/api/v1/jobs/%2047[^/]/%2047s", name, rest) == 2 && strcmp(rest, "cancel") == 0) {
+        cancel_job(server, name, response);
+    } else if (is_get && sscanf(request->path, "/api/v1/jobs/%2047[^/]", name) == 1 && !strchr(request->path+13, '/')) {
+        describe_job(server, name, response);
+    } else if (is_post && strcmp(request->path, "/api/v1/sessions") == 0) {
+        open_session(server, request, response);
+    } else if (is_delete && sscanf(request->path, "/api/v1/sessions/%2047[^/]/%2047s", name, rest) == 2 && strcmp(rest, "close") == 0) {
+        close_session(server, name, response);
+    } else if (is_get && sscanf(request->path, "/api/v1/sessions/%2047[^/]", name) == 1 && !strchr(request->path+17, '/')) {
+        describe_session(server, name, response);
+    } else {
+        set_error(response, 404, 404, "Not found.");
+    }
+
+    if (options->verbose) {
+        fprintf(stderr, "%9.3f %s %s -> %d\n", get_time() - server->start_time, request->method, request->path, response->status);
+    }
+
+    return;
+}
@@ -0,0 +1,91 @@
+#ifndef _MOCK_H_
+#define _MOCK_H_
+
+#define MOCK_PORT 8765
+#define MOCK_QUEUE_DELAY 2.0
+#define MOCK_RUN_DELAY 1.0
+#define MOCK_SHOTS 1024
+#define MOCK_BITS 2
+#define MOCK_TOKEN_TTL 3600
+#define MOCK_ERROR_CODE 500
+#define MOCK_SLOW_FACTOR 10.0
+#define MOCK_BUSY_RETRY_AFTER 2
+#define MOCK_SESSION_TTL 300.0
+#define JOB_ID_NMEMB 32
+#define BACKEND_NAME_NMEMB 64
+
+typedef struct MockOptions {
+    int port;
+    double queue_delay;
+    double run_delay;
+    int shots;
+    int bits;
+    int token_ttl;
+
+    double latency;
+    double error_rate;
+    int error_code;
+    double lost_rate;
+    double failure_rate;
+    char* slow_backend;
+    char* busy_backend;
+    double session_ttl;
+
+    char* backends_path;
+    char* results_path;
+    bool verbose;
+} MOCK_OPTIONS;
+
+typedef struct MockJob {
+    char id[JOB_ID_NMEMB];
+    char backend[BACKEND_NAME_NMEMB];
+    double submitted_time;
+    double queue_delay;
+    int pub_count;
+    int* pub_bindings;
+    int* pub_shots;
+    bool failed;
+    bool cancelled;
+    unsigned int seed;
+    char session_id[JOB_ID_NMEMB];
+    char idempotency_key[REQUEST_KEY_NMEMB];
+} MOCK_JOB;
+
+typedef struct MockSession {
+    char id[JOB_ID_NMEMB];
+    char backend[BACKEND_NAME_NMEMB];
+    bool dedicated;
+    bool closed;
+    int job_count;
+    double ready_time;
+    double busy_until;
+    double last_active_time;
+} MOCK_SESSION;
+
+typedef struct MockServer {
+    MOCK_OPTIONS options;
+    char* backends_data;
+    char* results_data;
+
+    MOCK_JOB* jobs;
+    int job_count;
+    int job_capacity;
+
+    MOCK_SESSION* sessions;
+    int session_count;
+    int session_capacity;
+
+    unsigned long token_count;
+    bool busy_answered;
+    unsigned int seed;
+    double start_time;
+
+    pthread_mutex_t lock;
+} MOCK_SERVER;
+
+MOCK_SERVER* create_mock_server(MOCK_OPTIONS* options);
+void destroy_mock_server(MOCK_SERVER* server);
+
+void handle_request(HTTP_REQUEST* request, HTTP_RESPONSE* response, void* userp);
+
+#endif
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <pthread.h>
+#include <zlib.h>
+
+#include "server.h"
+
+
+typedef struct Connection {
+    int fd;
+    REQUEST_HANDLER handler;
+    void* userp;
+} CONNECTION;
+
+
+/**
+ * @brief Reason phrase of an HTTP status code
+ *
+ * @param status HTTP status code
+ * @return Reason phrase
+ */
+static const char* get_reason_phrase(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 409: return "Conflict";
+    case 429: return "Too Many Requests";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default: return "Unknown";
+    }
+}
+
+/**
+ * @brief Send a whole buffer over a socket
+ *
+ * @param fd Socket to write to
+ * @param data Bytes to send
+ * @param size Number of bytes
+ * @return 0 on success, or -1 if the connection was closed
+ */
+static int send_all(int fd, const char* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(fd, data, size, MSG_NOSIGNAL);
+        if (sent <= 0) return -1;
+        data += sent;
+        size -= sent;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Find the blank line that ends the request header
+ *
+ * @param buffer Received bytes
+ * @param size Number of received bytes
+ * @return Offset just past the blank line, or 0 if the header is incomplete
+ */
+static size_t find_header_end(const char* buffer, size_t size) {
+    for (size_t i = 3; i < size; i++) {
+        if (buffer[i-3] == '\r' && buffer[i-2] == '\n' && buffer[i-1] == '\r' && buffer[i] == '\n') return i+1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Check whether a header value lists a token
+ *
+ * @param value Header value, ending at the end of its line
+ * @param token Token to look for
+ * @return true if the token appears in the value
+ */
+static bool header_has_token(const char* value, const char* token) {
+    size_t value_length = strcspn(value, "\r\n");
+    size_t token_length = strlen(token);
+
+    for (size_t i = 0; i + token_length <= value_length; i++) {
+        if (strncasecmp(value+i, token, token_length) == 0) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Compress a response body with gzip
+ *
+ * @param data Bytes to compress
+ * @param size Number of bytes
+ * @param compressed_size Output pointer receiving the compressed size
+ * @return Newly allocated compressed body (CALLER MUST FREE), or NULL on
+ *         failure
+ */
+static char* compress_body(const char* data, size_t size, size_t* compressed_size) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (deflateInit2(&stream, Z_BEST_SPEED, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+
+    size_t capacity = deflateBound(&stream, size);
+    char* compressed = (char*)malloc(capacity);
+    if (compressed) {
+        stream.next_in = (Bytef*)data;
+        stream.avail_in = size;
+        stream.next_out = (Bytef*)compressed;
+        stream.avail_out = capacity;
+
+        if (deflate(&stream, Z_FINISH) == Z_STREAM_END) {
+            *compressed_size = stream.total_out;
+        } else {
+            free(compressed);
+            compressed = NULL;
+        }
+    }
+
+    deflateEnd(&stream);
+
+    return compressed;
+}
+
+/**
+ * @brief Decompress a gzip or zlib request body in place of the original
+ *
+ * @param request Pointer to HTTP_REQUEST whose body is replaced
+ * @return 0 on success, or -1 if the body is not valid compressed data
+ */
+static int decompress_body(HTTP_REQUEST* request) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if (inflateInit2(&stream, 15+32) != Z_OK) return -1;
+
+    size_t capacity = 4*request->body_size + 1024;
+    char* body = (char*)malloc(capacity);
+    int status = body ? Z_OK : Z_MEM_ERROR;
+
+    stream.next_in = (Bytef*)request->body;
+    stream.avail_in = request->body_size;
+
+    while (status == Z_OK) {
+        if (capacity - stream.total_out < 1024) {
+            char* temp = (char*)realloc(body, 2*capacity);
+            if (!temp) {
+                status = Z_MEM_ERROR;
+                break;
+            }
+            body = temp;
+            capacity *= 2;
+        }
+
+        stream.next_out = (Bytef*)body + stream.total_out;
+        stream.avail_out = capacity - stream.total_out - 1;
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+
+    inflateEnd(&stream);
+
+    if (status != Z_STREAM_END) {
+        free(body);
+        return -1;
+    }
+
+    body[stream.total_out] = '\0';
+    free(request->body);
+    request->body = body;
+    request->body_size = stream.total_out;
+
+    return 0;
+}
+
+/**
+ * @brief Write an HTTP response
+ *
+ * Bodies larger than COMPRESS_MIN_SIZE are sent gzip compressed when the
+ * client accepts it, like the real service.
+ *
+ * @param fd Socket to write to
+ * @param response Response to send
+ * @param accept_gzip Whether the client accepts gzip encoded bodies
+ * @return 0 on success, or -1 if the connection was closed
+ */
+static int send_response(int fd, HTTP_RESPONSE* response, bool accept_gzip) {
+    const char* body = response->body ? response->body : "";
+    size_t body_size = strlen(body);
+
+    char* compressed = NULL;
+    if (accept_gzip && body_size > COMPRESS_MIN_SIZE) {
+        size_t compressed_size = 0;
+        compressed = compress_body(body, body_size, &compressed_size);
+        if (compressed) {
+            body = compressed;
+            body_size = compressed_size;
+        }
+    }
+
+    char header[REQUEST_HEADER_NMEMB];
+    int header_size = snprintf(header, REQUEST_HEADER_NMEMB,
+                               "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n%s%s\r\n",
+                               response->status, get_reason_phrase(response->status), body_size,
+                               compressed ? "Content-Encoding: gzip\r\n" : "", response->headers);
+
+    int status = send_all(fd, header, header_size);
+    if (status == 0) status = send_all(fd, body, body_size);
+
+    free(compressed);
+
+    return status;
+}
+
+/**
+ * @brief Serve the requests of one keep-alive connection
+ *
+ * Reads requests one after another, keeping bytes that belong to the next
+ * request, answers each with the request handler, and returns once the
+ * client closes the connection or asks to.
+ *
+ * @param arg Pointer to CONNECTION (freed by this function)
+ * @return NULL
+ */
+static void* serve_connection(void* arg) {
+    CONNECTION* connection = (CONNECTION*)arg;
+
+    char* buffer = (char*)malloc(REQUEST_HEADER_NMEMB);
+    if (!buffer) {
+        fprintf(stderr, "ERROR - Allocating memory for request buffer failed in serve_connection()!\n");
+        goto cleanup_connection;
+    }
+    size_t filled = 0;
+
+    while (true) {
+        size_t header_size = 0;
+        while ((header_size = find_header_end(buffer, filled)) == 0) {
+            if (filled == REQUEST_HEADER_NMEMB) goto cleanup_buffer;
+
+            ssize_t received = recv(connection->fd, buffer+filled, REQUEST_HEADER_NMEMB-filled, 0);
+            if (received <= 0) goto cleanup_buffer;
+            filled += received;
+        }
+
+        HTTP_REQUEST request;
+        memset(&request, 0, sizeof(HTTP_REQUEST));
+
+        buffer[header_size-1] = '\0';
+        if (sscanf(buffer, "%15s %2047s", request.method, request.path) != 2) goto cleanup_buffer;
+
+        bool expect_continue = false;
+        bool close_connection = false;
+        bool accept_gzip = false;
+        bool compressed_body = false;
+        for (char* line = strstr(buffer, "\r\n"); line; line = strstr(line, "\r\n")) {
+            line += 2;
+            if (strncasecmp(line, "Content-Length:", 15) == 0) request.body_size = strtoul(line+15, NULL, 10);
+            else if (strncasecmp(line, "Idempotency-Key:", 16) == 0) sscanf(line+16, " %63[^\r\n]", request.idempotency_key);
+            else if (strncasecmp(line, "Accept-Encoding:", 16) == 0) accept_gzip = header_has_token(line+16, "gzip");
+            else if (strncasecmp(line, "Content-Encoding:", 17) == 0) compressed_body = header_has_token(line+17, "gzip") || header_has_token(line+17, "deflate");
+            else if (strncasecmp(line, "Expect:", 7) == 0 && strncasecmp(line+strspn(line+7, " ")+7, "100-continue", 12) == 0) expect_continue = true;
+            else if (strncasecmp(line, "Connection:", 11) == 0 && strncasecmp(line+strspn(line+11, " ")+11, "close", 5) == 0) close_connection = true;
+        }
+
+        request.body = (char*)malloc(request.body_size+1);
+        if (!request.body) {
+            fprintf(stderr, "ERROR - Allocating memory for request body failed in serve_connection()!\n");
+            goto cleanup_buffer;
+        }
+
+        // Part of the body may already be in the buffer, and with pipelining even the next request.
+
+        size_t buffered = filled-header_size;
+        size_t copied = buffered < request.body_size ? buffered : request.body_size;
+        memcpy(request.body, buffer+header_size, copied);
+        memmove(buffer, buffer+header_size+copied, filled-header_size-copied);
+        filled -= header_size+copied;
+
+        if (copied < request.body_size && expect_continue) {
+            const char* proceed = "HTTP/1.1 100 Continue\r\n\r\n";
+            if (send_all(connection->fd, proceed, strlen(proceed)) < 0) goto cleanup_body;
+        }
+
+        while (copied < request.body_size) {
+            ssize_t received = recv(connection->fd, request.body+copied, request.body_size-copied, 0);
+            if (received <= 0) goto cleanup_body;
+            copied += received;
+        }
+        request.body[request.body_size] = '\0';
+
+        HTTP_RESPONSE response;
+        memset(&response, 0, sizeof(HTTP_RESPONSE));
+        response.status = 500;
+
+        if (compressed_body && decompress_body(&request) < 0) {
+            response.status = 400;
+            response.body = strdup("{\"errors\":[{\"code\":400,\"message\":\"The request body could not be decompressed.\"}]}");
+        } else {
+            connection->handler(&request, &response, connection->userp);
+        }
+
+        int send_status = send_response(connection->fd, &response, accept_gzip);
+        free(response.body);
+        free(request.body);
+
+        if (send_status < 0 || close_connection) break;
+        continue;
+
+cleanup_body:
+        free(request.body);
+        break;
+    }
+
+cleanup_buffer:
+    free(buffer);
+
+cleanup_connection:
+    close(connection->fd);
+    free(connection);
+
+    return NULL;
+}
+
+/**
+ * @brief Accept connections on the loopback interface forever
+ *
+ * Every connection is served by its own detached thread, so slow clients
+ * and long responses do not hold up the others.
+ *
+ * @param port TCP port to listen on
+ * @param handler Function answering each request
+ * @param userp User pointer passed to the handler
+ * @return -1 if the server could not start (does not return otherwise)
+ */
+int run_server(int port, REQUEST_HANDLER handler, void* userp) {
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "ERROR - Creating the listening socket failed in run_server()!\n");
+        return -1;
+    }
+
+    int reuse = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+
+    if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+        fprintf(stderr, "ERROR - Listening on port %d failed in run_server()!\n", port);
+        close(listen_fd);
+        return -1;
+    }
+
+    fprintf(stderr, "Listening on http://127.0.0.1:%d\n", port);
+
+    while (true) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) continue;
+
+        // Headers and bodies are sent separately, which Nagle's algorithm would delay.
+
+        int no_delay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &no_delay, sizeof(no_delay));
+
+        CONNECTION* connection = (CONNECTION*)malloc(sizeof(CONNECTION));
+        if (!connection) {
+            fprintf(stderr, "ERROR - Allocating memory for connection failed in run_server()!\n");
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->handler = handler;
+        connection->userp = userp;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_connection, connection) != 0) {
+            fprintf(stderr, "ERROR - Thread creation failed in run_server()!\n");
+            close(fd);
+            free(connection);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    return -1;
+}
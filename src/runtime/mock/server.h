@@ -0,0 +1,29 @@
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+#define REQUEST_HEADER_NMEMB 16384
+#define REQUEST_METHOD_NMEMB 16
+#define REQUEST_PATH_NMEMB 2048
+#define REQUEST_KEY_NMEMB 64
+#define RESPONSE_HEADER_NMEMB 512
+#define COMPRESS_MIN_SIZE 1024
+
+typedef struct HttpRequest {
+    char method[REQUEST_METHOD_NMEMB];
+    char path[REQUEST_PATH_NMEMB];
+    char idempotency_key[REQUEST_KEY_NMEMB];
+    char* body;
+    size_t body_size;
+} HTTP_REQUEST;
+
+typedef struct HttpResponse {
+    int status;
+    char headers[RESPONSE_HEADER_NMEMB];
+    char* body;
+} HTTP_RESPONSE;
+
+typedef void (*REQUEST_HANDLER)(HTTP_REQUEST* request, HTTP_RESPONSE* response, void* userp);
+
+int run_server(int port, REQUEST_HANDLER handler, void* userp);
+
+#endif
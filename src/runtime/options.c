@@ -0,0 +1,439 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+
+#include <curl/curl.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "backends.h"
+#include "session.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+#include "decoder.h"
+#include "results.h"
+#include "output.h"
+#include "options.h"
+
+
+/**
+ * @brief Print the command line usage of the runtime
+ *
+ * @param program Name the runtime was invoked with
+ */
+void print_usage(char* program) {
+    fprintf(stderr, "Usage: %s [options] <file.qasm|directory|->...\n", program);
+    fprintf(stderr, "       %s --daemon SOCKET [options]\n", program);
+    fprintf(stderr, "       %s --manifest FILE [options]\n", program);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  -j, --jobs N    Submit every circuit as its own job, keeping up to N jobs\n");
+    fprintf(stderr, "                  in flight at once (0 for no limit). Without this option\n");
+    fprintf(stderr, "                  all circuits are batched into a single job.\n");
+    fprintf(stderr, "  -f, --format F  Result format: mode (most frequent outcome, default),\n");
+    fprintf(stderr, "                  counts (every outcome as text), json (one object per\n");
+    fprintf(stderr, "                  job per line) or csv (one row per outcome).\n");
+    fprintf(stderr, "  -k, --top K     List only the K most frequent outcomes of each circuit.\n");
+    fprintf(stderr, "  -p, --probabilities\n");
+    fprintf(stderr, "                  List normalized probabilities instead of counts.\n");
+    fprintf(stderr, "  -e, --expect ZSTRING\n");
+    fprintf(stderr, "                  Report the expectation value of a Z-string such as ZIZ,\n");
+    fprintf(stderr, "                  its rightmost character on bit 0. May be repeated.\n");
+    fprintf(stderr, "  -x, --marginal BITS\n");
+    fprintf(stderr, "                  Count only the comma-separated bits BITS of every\n");
+    fprintf(stderr, "                  outcome, the first one as the least significant.\n");
+    fprintf(stderr, "  -r, --correlations\n");
+    fprintf(stderr, "                  Report the correlation matrix of the measured bits.\n");
+    fprintf(stderr, "  -R, --resamples N\n");
+    fprintf(stderr, "                  Bootstrap resamples of the %.0f%% confidence intervals of\n", 100.0*ANALYSIS_CONFIDENCE);
+    fprintf(stderr, "                  expectation values (0 disables them, default %d).\n", ANALYSIS_RESAMPLES);
+    fprintf(stderr, "  -o, --output FILE\n");
+    fprintf(stderr, "                  Write the results to FILE instead of stdout.\n");
+    fprintf(stderr, "  -d, --dump FILE Dump every shot as packed binary records to FILE\n");
+    fprintf(stderr, "                  (FILE.<job id> per job with --jobs).\n");
+    fprintf(stderr, "  -t, --backend-ttl SECONDS\n");
+    fprintf(stderr, "                  Reuse the cached backend list for up to SECONDS\n");
+    fprintf(stderr, "                  (0 disables the cache, default 60).\n");
+    fprintf(stderr, "  -a, --api-url URL\n");
+    fprintf(stderr, "                  Base URL of the Qiskit Runtime API\n");
+    fprintf(stderr, "                  (default %s).\n", DEFAULT_API_URL);
+    fprintf(stderr, "  -i, --iam-url URL\n");
+    fprintf(stderr, "                  Base URL of the IAM token service\n");
+    fprintf(stderr, "                  (default %s).\n", DEFAULT_IAM_URL);
+    fprintf(stderr, "  -z, --compress  Send job payloads gzip compressed. Responses are always\n");
+    fprintf(stderr, "                  accepted compressed.\n");
+    fprintf(stderr, "  -y, --retries N Repeat a request failing with a rate limit, a server error\n");
+    fprintf(stderr, "                  or a dropped connection up to N times, with backoff\n");
+    fprintf(stderr, "                  (default %d). A job submission is only repeated when it\n", RETRY_MAX_ATTEMPTS-1);
+    fprintf(stderr, "                  was refused or never sent.\n");
+    fprintf(stderr, "  -u, --rate R    Send at most R API requests per second on average, in\n");
+    fprintf(stderr, "                  bursts of up to %.0f (0 for no limit, default %.0f).\n", REQUEST_BURST, REQUEST_RATE);
+    fprintf(stderr, "  -c, --cache POLICY\n");
+    fprintf(stderr, "                  Result cache policy: read (reuse the result of an\n");
+    fprintf(stderr, "                  identical earlier job), refresh (always submit and\n");
+    fprintf(stderr, "                  store the new result) or off (default).\n");
+    fprintf(stderr, "  -s, --shots N   Run every circuit for N shots instead of the service\n");
+    fprintf(stderr, "                  default.\n");
+    fprintf(stderr, "  -n, --shards K  Split the shots of every job across the K best backends\n");
+    fprintf(stderr, "                  and merge their counts. Needs --shots.\n");
+    fprintf(stderr, "  -T, --deadline SECONDS\n");
+    fprintf(stderr, "                  Give up on a job that is not estimated to finish within\n");
+    fprintf(stderr, "                  SECONDS of the start, judged from its queue position, and\n");
+    fprintf(stderr, "                  cancel it.\n");
+    fprintf(stderr, "  -F, --fallback  With --deadline, resubmit a cancelled job once to the least\n");
+    fprintf(stderr, "                  loaded other backend whose queue still fits the deadline.\n");
+    fprintf(stderr, "  -H, --hedge K   Submit every job to the K best backends at once, keep the\n");
+    fprintf(stderr, "                  first result and cancel the other copies.\n");
+    fprintf(stderr, "  -B, --hedge-budget N\n");
+    fprintf(stderr, "                  Submit at most N hedged copies in the whole run\n");
+    fprintf(stderr, "                  (default no limit).\n");
+    fprintf(stderr, "  -E, --session MODE\n");
+    fprintf(stderr, "                  Run the jobs in a session on one backend, so that only\n");
+    fprintf(stderr, "                  the first one waits in the queue: dedicated (jobs run\n");
+    fprintf(stderr, "                  one after the other), batch (jobs run together) or off\n");
+    fprintf(stderr, "                  (default). Cannot be combined with --hedge or --shards.\n");
+    fprintf(stderr, "  -I, --session-idle SECONDS\n");
+    fprintf(stderr, "                  Close the session after SECONDS without jobs; a later\n");
+    fprintf(stderr, "                  job opens a new one (default %d).\n", SESSION_IDLE_TIMEOUT);
+    fprintf(stderr, "  -L, --manifest FILE\n");
+    fprintf(stderr, "                  Run the circuits listed in the JSON manifest FILE, each\n");
+    fprintf(stderr, "                  as its own job with its own shots and output, and\n");
+    fprintf(stderr, "                  summarize the throughput of the batch.\n");
+    fprintf(stderr, "  -P, --parameters FILE\n");
+    fprintf(stderr, "                  Sweep the circuits declaring input parameters over the\n");
+    fprintf(stderr, "                  rows of FILE, one binding per row. An optional header\n");
+    fprintf(stderr, "                  row names the columns; otherwise they follow the\n");
+    fprintf(stderr, "                  parameter names in sorted order.\n");
+    fprintf(stderr, "  -m, --metrics FILE\n");
+    fprintf(stderr, "                  Write a JSON summary of the time spent per phase and\n");
+    fprintf(stderr, "                  of the HTTP responses to FILE.\n");
+    fprintf(stderr, "  -M, --prometheus FILE\n");
+    fprintf(stderr, "                  Write the same metrics to FILE in the Prometheus text\n");
+    fprintf(stderr, "                  format. A daemon rewrites both after every request.\n");
+    fprintf(stderr, "  -D, --daemon SOCKET\n");
+    fprintf(stderr, "                  Keep running and serve the jobs of --socket clients on\n");
+    fprintf(stderr, "                  the Unix domain socket SOCKET until interrupted, with\n");
+    fprintf(stderr, "                  the token, connections and backend list kept warm.\n");
+    fprintf(stderr, "  -S, --socket SOCKET\n");
+    fprintf(stderr, "                  Run the circuits through the daemon listening on\n");
+    fprintf(stderr, "                  SOCKET instead of connecting to the service.\n");
+    fprintf(stderr, "  -h, --help      Show this message.\n");
+
+    return;
+}
+
+/**
+ * @brief Parse a non-negative integer option argument
+ *
+ * @param text Option argument to parse
+ * @param value Output pointer receiving the parsed value
+ * @return 0 on success, or -1 if the text is not a non-negative integer
+ */
+static int parse_count(char* text, int* value) {
+    char* end = NULL;
+    long parsed = strtol(text, &end, 10);
+    if (!*text || *end || parsed < 0 || parsed > 1 << 20) return -1;
+
+    *value = (int)parsed;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a positive number of seconds option argument
+ *
+ * @param text Option argument to parse
+ * @param value Output pointer receiving the parsed value
+ * @return 0 on success, or -1 if the text is not a positive number
+ */
+static int parse_seconds(char* text, double* value) {
+    char* end = NULL;
+    double parsed = strtod(text, &end);
+    if (!*text || *end || !(parsed > 0.0)) return -1;
+
+    *value = parsed;
+
+    return 0;
+}
+
+/**
+ * @brief Parse a non-negative rate option argument
+ *
+ * @param text Option argument to parse
+ * @param value Output pointer receiving the parsed value
+ * @return 0 on success, or -1 if the text is not a non-negative number
+ */
+static int parse_rate(char* text, double* value) {
+    char* end = NULL;
+    double parsed = strtod(text, &end);
+    if (!*text || *end || !(parsed >= 0.0)) return -1;
+
+    *value = parsed;
+
+    return 0;
+}
+
+/**
+ * @brief Parse the runtime command line
+ *
+ * Fills options with the parsed flags; the remaining arguments are the
+ * OpenQASM files or directories to run, with - for standard input.
+ *
+ * @param argc Argument count
+ * @param argv Argument vector
+ * @param options Pointer to RUNTIME_OPTIONS to fill
+ * @return 0 on success, or -1 on invalid arguments
+ */
+int parse_options(int argc, char** argv, RUNTIME_OPTIONS* options) {
+    static struct option long_options[] = {
+        {"jobs", required_argument, NULL, 'j'},
+        {"format", required_argument, NULL, 'f'},
+        {"top", required_argument, NULL, 'k'},
+        {"probabilities", no_argument, NULL, 'p'},
+        {"expect", required_argument, NULL, 'e'},
+        {"marginal", required_argument, NULL, 'x'},
+        {"correlations", no_argument, NULL, 'r'},
+        {"resamples", required_argument, NULL, 'R'},
+        {"output", required_argument, NULL, 'o'},
+        {"dump", required_argument, NULL, 'd'},
+        {"backend-ttl", required_argument, NULL, 't'},
+        {"api-url", required_argument, NULL, 'a'},
+        {"iam-url", required_argument, NULL, 'i'},
+        {"compress", no_argument, NULL, 'z'},
+        {"retries", required_argument, NULL, 'y'},
+        {"rate", required_argument, NULL, 'u'},
+        {"cache", required_argument, NULL, 'c'},
+        {"shots", required_argument, NULL, 's'},
+        {"shards", required_argument, NULL, 'n'},
+        {"deadline", required_argument, NULL, 'T'},
+        {"fallback", no_argument, NULL, 'F'},
+        {"hedge", required_argument, NULL, 'H'},
+        {"hedge-budget", required_argument, NULL, 'B'},
+        {"session", required_argument, NULL, 'E'},
+        {"session-idle", required_argument, NULL, 'I'},
+        {"manifest", required_argument, NULL, 'L'},
+        {"parameters", required_argument, NULL, 'P'},
+        {"metrics", required_argument, NULL, 'm'},
+        {"prometheus", required_argument, NULL, 'M'},
+        {"daemon", required_argument, NULL, 'D'},
+        {"socket", required_argument, NULL, 'S'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    memset(options, 0, sizeof(RUNTIME_OPTIONS));
+    options->concurrent_jobs = -1;
+    options->backend_ttl = -1;
+    options->hedge_count = 1;
+    options->shard_count = 1;
+    options->hedge_budget = -1;
+    options->session_idle = -1;
+    options->retries = -1;
+    options->request_rate = -1.0;
+    options->output_format = OUTPUT_MODE;
+    options->analysis.resamples = ANALYSIS_RESAMPLES;
+
+    int option;
+    while ((option = getopt_long(argc, argv, "j:f:k:pe:x:rR:o:d:t:a:i:zy:u:c:s:n:T:FH:B:E:I:L:P:m:M:D:S:h", long_options, NULL)) != -1) {
+        switch (option) {
+        case 'j':
+            if (parse_count(optarg, &options->concurrent_jobs) < 0) {
+                fprintf(stderr, "ERROR - Invalid job count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'f':
+            if (parse_output_format(optarg, &options->output_format) < 0) {
+                fprintf(stderr, "ERROR - Unknown output format %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'k':
+            if (parse_count(optarg, &options->top_k) < 0) {
+                fprintf(stderr, "ERROR - Invalid outcome count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'p':
+            options->probabilities = true;
+            break;
+        case 'e':
+            if (add_observable(&options->analysis, optarg) < 0) {
+                fprintf(stderr, "ERROR - Invalid or too many Z-strings at %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'x':
+            if (parse_marginal_bits(&options->analysis, optarg) < 0) {
+                fprintf(stderr, "ERROR - Invalid marginal bits %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'r':
+            options->analysis.correlations = true;
+            break;
+        case 'R':
+            if (parse_count(optarg, &options->analysis.resamples) < 0) {
+                fprintf(stderr, "ERROR - Invalid resample count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'o':
+            options->output_path = optarg;
+            break;
+        case 'd':
+            options->dump_path = optarg;
+            break;
+        case 't':
+            if (parse_count(optarg, &options->backend_ttl) < 0) {
+                fprintf(stderr, "ERROR - Invalid backend cache TTL %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'a':
+            options->api_url = optarg;
+            break;
+        case 'i':
+            options->iam_url = optarg;
+            break;
+        case 'z':
+            options->compress_requests = true;
+            break;
+        case 'y':
+            if (parse_count(optarg, &options->retries) < 0) {
+                fprintf(stderr, "ERROR - Invalid retry count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'u':
+            if (parse_rate(optarg, &options->request_rate) < 0) {
+                fprintf(stderr, "ERROR - Invalid request rate %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'c':
+            if (parse_result_cache_policy(optarg, &options->result_cache) < 0) {
+                fprintf(stderr, "ERROR - Unknown result cache policy %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 's':
+            if (parse_count(optarg, &options->shots) < 0 || options->shots < 1) {
+                fprintf(stderr, "ERROR - Invalid shot count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'n':
+            if (parse_count(optarg, &options->shard_count) < 0 || options->shard_count < 1) {
+                fprintf(stderr, "ERROR - Invalid shard count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'T':
+            if (parse_seconds(optarg, &options->deadline) < 0) {
+                fprintf(stderr, "ERROR - Invalid deadline %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'F':
+            options->fallback = true;
+            break;
+        case 'H':
+            if (parse_count(optarg, &options->hedge_count) < 0 || options->hedge_count < 1) {
+                fprintf(stderr, "ERROR - Invalid hedge count %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'B':
+            if (parse_count(optarg, &options->hedge_budget) < 0) {
+                fprintf(stderr, "ERROR - Invalid hedge budget %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'E':
+            if (parse_session_mode(optarg, &options->session_mode) < 0) {
+                fprintf(stderr, "ERROR - Unknown session mode %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'I':
+            if (parse_count(optarg, &options->session_idle) < 0) {
+                fprintf(stderr, "ERROR - Invalid session idle timeout %s in parse_options()!\n", optarg);
+                return -1;
+            }
+            break;
+        case 'L':
+            options->manifest_path = optarg;
+            break;
+        case 'P':
+            options->parameters_path = optarg;
+            break;
+        case 'm':
+            options->metrics_path = optarg;
+            break;
+        case 'M':
+            options->prometheus_path = optarg;
+            break;
+        case 'D':
+            options->daemon_path = optarg;
+            break;
+        case 'S':
+            options->socket_path = optarg;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (options->fallback && options->deadline <= 0.0) {
+        fprintf(stderr, "ERROR - --fallback needs a --deadline in parse_options()!\n");
+        return -1;
+    }
+
+    if (options->shard_count > 1 && (options->shots == 0 || options->hedge_count > 1)) {
+        fprintf(stderr, "ERROR - --shards needs --shots and cannot be combined with --hedge in parse_options()!\n");
+        return -1;
+    }
+
+    if (options->session_mode != SESSION_OFF && (options->hedge_count > 1 || options->shard_count > 1)) {
+        fprintf(stderr, "ERROR - --session cannot be combined with --hedge or --shards in parse_options()!\n");
+        return -1;
+    }
+
+    if (options->daemon_path) {
+        if (optind < argc || options->socket_path || options->output_path || options->dump_path || options->parameters_path || options->manifest_path) {
+            fprintf(stderr, "ERROR - --daemon takes no files, --socket, --output, --dump, --parameters or --manifest in parse_options()!\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (options->socket_path && (options->dump_path || options->metrics_path || options->prometheus_path || options->session_mode != SESSION_OFF)) {
+        fprintf(stderr, "ERROR - --dump, --metrics, --prometheus and --session cannot be combined with --socket in parse_options()!\n");
+        return -1;
+    }
+
+    if (options->manifest_path) {
+        if (optind < argc || options->socket_path || options->dump_path) {
+            fprintf(stderr, "ERROR - --manifest takes no files, --socket or --dump in parse_options()!\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    if (optind >= argc) {
+        fprintf(stderr, "ERROR - At least one OpenQASM file or directory needed in parse_options()!\n");
+        return -1;
+    }
+
+    options->paths = argv+optind;
+    options->path_count = argc-optind;
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+typedef struct RuntimeOptions {
+    int concurrent_jobs;
+    int backend_ttl;
+    char* api_url;
+    char* iam_url;
+    bool compress_requests;
+    int retries;
+    double request_rate;
+    double deadline;
+    bool fallback;
+    int hedge_count;
+    int hedge_budget;
+    int shots;
+    int shard_count;
+    SESSION_MODE session_mode;
+    int session_idle;
+    RESULT_CACHE_POLICY result_cache;
+    char* daemon_path;
+    char* socket_path;
+    char* parameters_path;
+    char* manifest_path;
+    char* metrics_path;
+    char* prometheus_path;
+
+    OUTPUT_FORMAT output_format;
+    int top_k;
+    bool probabilities;
+    ANALYSIS_OPTIONS analysis;
+    char* output_path;
+    char* dump_path;
+
+    char** paths;
+    int path_count;
+} RUNTIME_OPTIONS;
+
+void print_usage(char* program);
+int parse_options(int argc, char** argv, RUNTIME_OPTIONS* options);
+
+#endif
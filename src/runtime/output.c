@@ -0,0 +1,529 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+
+#include "reader.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+#include "decoder.h"
+#include "output.h"
+
+
+/**
+ * @brief Parse the name of an output format
+ *
+ * @param text Format name (mode, counts, json or csv)
+ * @param format Output pointer receiving the format
+ * @return 0 on success, or -1 if the name is unknown
+ */
+int parse_output_format(char* text, OUTPUT_FORMAT* format) {
+    if (strcmp(text, "mode") == 0) *format = OUTPUT_MODE;
+    else if (strcmp(text, "counts") == 0) *format = OUTPUT_COUNTS;
+    else if (strcmp(text, "json") == 0) *format = OUTPUT_JSON;
+    else if (strcmp(text, "csv") == 0) *format = OUTPUT_CSV;
+    else return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Create a writer for job results
+ *
+ * @param output_path File the results are written to, or NULL for stdout
+ * @param format Output format
+ * @param top_k Number of most frequent outcomes listed per pub, or 0 for all
+ * @param probabilities Whether outcomes are listed with normalized
+ *        probabilities instead of counts
+ * @param dump_path File the raw samples are dumped to, or NULL for none
+ * @return Pointer to newly allocated RESULT_WRITER (CALLER MUST DESTROY),
+ *         or NULL on failure
+ */
+RESULT_WRITER* create_result_writer(char* output_path, OUTPUT_FORMAT format, int top_k, bool probabilities, char* dump_path) {
+    RESULT_WRITER* writer = (RESULT_WRITER*)calloc(1, sizeof(RESULT_WRITER));
+    if (!writer) {
+        fprintf(stderr, "ERROR - Allocating memory for result writer failed in create_result_writer()!\n");
+        goto terminate;
+    }
+
+    writer->stream = stdout;
+    writer->console = stdout;
+    if (output_path) {
+        writer->stream = fopen(output_path, "w");
+        if (!writer->stream) {
+            fprintf(stderr, "ERROR - Opening %s failed in create_result_writer()!\n", output_path);
+            free(writer);
+            writer = NULL;
+            goto terminate;
+        }
+        writer->owns_stream = true;
+    }
+
+    writer->format = format;
+    writer->top_k = top_k;
+    writer->probabilities = probabilities;
+    writer->dump_path = dump_path;
+
+terminate:
+    return writer;
+}
+
+/**
+ * @brief Destroy a result writer, closing its output file
+ *
+ * @param writer Pointer to RESULT_WRITER to destroy
+ */
+void destroy_result_writer(RESULT_WRITER* writer) {
+    if (!writer) return;
+
+    if (writer->owns_stream) fclose(writer->stream);
+    else fflush(writer->stream);
+    free(writer);
+
+    return;
+}
+
+
+/**
+ * @brief Write a string as a JSON string literal
+ *
+ * @param stream Output stream
+ * @param text String to write
+ */
+static void print_json_string(FILE* stream, const char* text) {
+    putc('"', stream);
+    for (const char* ch = text; *ch; ch++) {
+        if (*ch == '"' || *ch == '\\') fprintf(stream, "\\%c", *ch);
+        else if ((unsigned char)*ch < 0x20) fprintf(stream, "\\u%04x", (unsigned char)*ch);
+        else putc(*ch, stream);
+    }
+    putc('"', stream);
+
+    return;
+}
+
+/**
+ * @brief Write a string as a CSV field, quoting it when needed
+ *
+ * @param stream Output stream
+ * @param text String to write
+ */
+static void print_csv_field(FILE* stream, const char* text) {
+    if (!strpbrk(text, ",\"\r\n")) {
+        fputs(text, stream);
+        return;
+    }
+
+    putc('"', stream);
+    for (const char* ch = text; *ch; ch++) {
+        if (*ch == '"') putc('"', stream);
+        putc(*ch, stream);
+    }
+    putc('"', stream);
+
+    return;
+}
+
+/**
+ * @brief Width in bits used to print the outcomes of a pub
+ *
+ * The register width is used when the result reports it, otherwise the
+ * widest observed outcome, so that every outcome of a pub has the same
+ * length.
+ *
+ * @param histogram Pointer to HISTOGRAM of the outcomes
+ * @param num_bits Width of the register, or 0 if unknown
+ * @return Number of bits, at least 1
+ */
+static int get_display_width(HISTOGRAM* histogram, int num_bits) {
+    int width = num_bits;
+
+    for (int i = 0; i < histogram->capacity; i++) {
+        if (histogram->counts[i] == 0) continue;
+
+        int value_bits = count_significant_bits(&histogram->samples[(size_t)i*histogram->words], histogram->words);
+        if (value_bits > width) width = value_bits;
+    }
+
+    return width > 0 ? width : 1;
+}
+
+/**
+ * @brief Write the count or probability of one outcome
+ *
+ * @param writer Pointer to RESULT_WRITER
+ * @param entry Outcome to write
+ * @param shots Total number of shots of the pub
+ */
+static void print_value(RESULT_WRITER* writer, HISTOGRAM_ENTRY* entry, long shots) {
+    if (writer->probabilities) fprintf(writer->stream, "%.10g", (double)entry->count / (double)shots);
+    else fprintf(writer->stream, "%ld", entry->count);
+
+    return;
+}
+
+/**
+ * @brief Write the requested analysis of one pub
+ *
+ * Z-string expectation values, with bootstrap confidence intervals unless
+ * resampling is disabled, and the bit correlation matrix are added to the
+ * pub object in the JSON format and listed after the outcomes in the
+ * counts format. The mode and CSV formats keep their layout, so the
+ * analysis goes to the console there.
+ *
+ * @param writer Pointer to RESULT_WRITER
+ * @param label Label of the pub
+ * @param pub Pointer to PUB_COUNTS of the pub
+ * @return 0 on success, or -1 on failure
+ */
+static int write_pub_analysis(RESULT_WRITER* writer, char* label, PUB_COUNTS* pub) {
+    ANALYSIS_OPTIONS* analysis = writer->analysis;
+    if (!analysis || pub->histogram.shots == 0 || (analysis->observable_count == 0 && !analysis->correlations)) return 0;
+
+    bool json = writer->format == OUTPUT_JSON;
+    FILE* stream = json || writer->format == OUTPUT_COUNTS ? writer->stream : writer->console;
+    if (!json && writer->format != OUTPUT_COUNTS) fprintf(stream, "Analysis of %s:\n", label);
+
+    if (analysis->observable_count > 0 && json) fprintf(stream, ",\"expectations\":{");
+    for (int i = 0; i < analysis->observable_count; i++) {
+        int words = 0;
+        BITSET_WORD* mask = parse_z_string(analysis->observables[i], &words);
+        double value = 0.0;
+        if (!mask || compute_expectations(&pub->histogram, mask, 1, words, &value) < 0) {
+            fprintf(stderr, "ERROR - Computing <%s> of %s failed in write_pub_analysis()!\n", analysis->observables[i], label);
+            free(mask);
+            return -1;
+        }
+
+        double lower = 0.0;
+        double upper = 0.0;
+        bool has_interval = analysis->resamples > 0 && bootstrap_expectation(&pub->histogram, mask, words, analysis->resamples, ANALYSIS_CONFIDENCE, i+1, &lower, &upper) == 0;
+        free(mask);
+
+        if (json) {
+            if (i > 0) putc(',', stream);
+            print_json_string(stream, analysis->observables[i]);
+            fprintf(stream, ":{\"value\":%.10g", value);
+            if (has_interval) fprintf(stream, ",\"ci\":[%.10g,%.10g]", lower, upper);
+            putc('}', stream);
+        } else {
+            fprintf(stream, "  <%s> = %.6f", analysis->observables[i], value);
+            if (has_interval) fprintf(stream, " (%.0f%% CI %.6f to %.6f)", 100.0*ANALYSIS_CONFIDENCE, lower, upper);
+            fprintf(stream, "\n");
+        }
+    }
+    if (analysis->observable_count > 0 && json) putc('}', stream);
+
+    if (analysis->correlations) {
+        int width = get_display_width(&pub->histogram, pub->num_bits);
+        double* matrix = compute_correlation_matrix(&pub->histogram, width);
+        if (!matrix) {
+            fprintf(stderr, "ERROR - Computing the correlations of %s failed in write_pub_analysis()!\n", label);
+            return -1;
+        }
+
+        if (json) fprintf(stream, ",\"correlations\":[");
+        else fprintf(stream, "  Correlations of bits 0 to %d:\n", width-1);
+        for (int i = 0; i < width; i++) {
+            if (json) fprintf(stream, "%s[", i > 0 ? "," : "");
+            else fprintf(stream, "   ");
+            for (int j = 0; j < width; j++) {
+                if (json) fprintf(stream, "%s%.10g", j > 0 ? "," : "", matrix[(size_t)i*width+j]);
+                else fprintf(stream, " % .4f", matrix[(size_t)i*width+j]);
+            }
+            if (json) putc(']', stream);
+            else putc('\n', stream);
+        }
+        if (json) putc(']', stream);
+
+        free(matrix);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write the outcomes of one pub in the selected format
+ *
+ * @param writer Pointer to RESULT_WRITER
+ * @param job_id Job identifier
+ * @param circuit Circuit of the pub
+ * @param binding Index of the parameter binding, or -1 for an unswept pub
+ * @param pub Pointer to PUB_COUNTS of the pub
+ * @param show_name Whether the circuit name is printed in the mode format
+ * @return 0 on success, or -1 on failure
+ */
+static int write_pub_result(RESULT_WRITER* writer, char* job_id, CIRCUIT* circuit, int binding, PUB_COUNTS* pub, bool show_name) {
+    FILE* stream = writer->stream;
+
+    // The results of a swept circuit are labelled with their binding.
+
+    char label[PATH_MAX+16];
+    if (binding >= 0) snprintf(label, sizeof(label), "%s[%d]", circuit->name, binding);
+    else snprintf(label, sizeof(label), "%s", circuit->name);
+
+    // A marginal replaces the outcomes by those of the kept bits only.
+
+    HISTOGRAM* histogram = &pub->histogram;
+    HISTOGRAM marginal;
+    ANALYSIS_OPTIONS* analysis = writer->analysis;
+    bool marginalized = analysis && analysis->marginal_bit_count > 0;
+    if (marginalized) {
+        if (marginalize_histogram(&pub->histogram, analysis->marginal_bits, analysis->marginal_bit_count, &marginal) < 0) {
+            fprintf(stderr, "ERROR - Marginalizing the outcomes of %s failed in write_pub_result()!\n", circuit->name);
+            return -1;
+        }
+        histogram = &marginal;
+    }
+
+    int status = -1;
+
+    HISTOGRAM_ENTRY* entries = sort_histogram(histogram);
+    if (!entries) {
+        fprintf(stderr, "ERROR - Sorting the outcomes of %s failed in write_pub_result()!\n", circuit->name);
+        goto cleanup_marginal;
+    }
+
+    int width = marginalized ? analysis->marginal_bit_count : get_display_width(histogram, pub->num_bits);
+    int listed = histogram->unique_count;
+    if (writer->top_k > 0 && writer->top_k < listed) listed = writer->top_k;
+
+    switch (writer->format) {
+    case OUTPUT_MODE:
+        if (show_name) fprintf(stream, "%s: ", label);
+        if (listed > 0) print_bitset(stream, entries[0].sample, entries[0].words, width);
+        fprintf(stream, "\n");
+        break;
+
+    case OUTPUT_COUNTS:
+        fprintf(stream, "%s (register %s, %ld shots, %d outcomes):\n", label, pub->register_name, histogram->shots, histogram->unique_count);
+        for (int i = 0; i < listed; i++) {
+            fprintf(stream, "  ");
+            print_bitset(stream, entries[i].sample, entries[i].words, width);
+            fprintf(stream, " ");
+            print_value(writer, &entries[i], histogram->shots);
+            fprintf(stream, "\n");
+        }
+        break;
+
+    case OUTPUT_JSON:
+        fprintf(stream, "{\"name\":");
+        print_json_string(stream, circuit->name);
+        if (binding >= 0) {
+            fprintf(stream, ",\"binding\":%d,\"parameters\":{", binding);
+            for (int i = 0; i < circuit->parameter_count; i++) {
+                if (i > 0) putc(',', stream);
+                print_json_string(stream, circuit->parameter_names[i]);
+                fprintf(stream, ":%.15g", circuit->parameter_values[(size_t)binding*circuit->parameter_count+i]);
+            }
+            putc('}', stream);
+        }
+        fprintf(stream, ",\"register\":");
+        print_json_string(stream, pub->register_name);
+        if (marginalized) {
+            fprintf(stream, ",\"marginal\":[");
+            for (int i = 0; i < analysis->marginal_bit_count; i++) fprintf(stream, "%s%d", i > 0 ? "," : "", analysis->marginal_bits[i]);
+            putc(']', stream);
+        }
+        fprintf(stream, ",\"num_bits\":%d,\"shots\":%ld,\"%s\":{", width, histogram->shots, writer->probabilities ? "probabilities" : "counts");
+        for (int i = 0; i < listed; i++) {
+            fprintf(stream, i > 0 ? ",\"" : "\"");
+            print_bitset(stream, entries[i].sample, entries[i].words, width);
+            fprintf(stream, "\":");
+            print_value(writer, &entries[i], histogram->shots);
+        }
+        putc('}', stream);
+        break;
+
+    case OUTPUT_CSV:
+        for (int i = 0; i < listed; i++) {
+            print_csv_field(stream, job_id);
+            putc(',', stream);
+            print_csv_field(stream, label);
+            putc(',', stream);
+            print_csv_field(stream, pub->register_name);
+            putc(',', stream);
+            print_bitset(stream, entries[i].sample, entries[i].words, width);
+            putc(',', stream);
+            print_value(writer, &entries[i], histogram->shots);
+            fprintf(stream, "\n");
+        }
+        break;
+    }
+
+    // Expectations and correlations always refer to the full register.
+
+    status = write_pub_analysis(writer, label, pub);
+    if (writer->format == OUTPUT_JSON) putc('}', stream);
+
+    free(entries);
+
+cleanup_marginal:
+    if (marginalized) free_histogram(&marginal);
+
+    return status;
+}
+
+/**
+ * @brief Write the result of one job
+ *
+ * The mode format prints the most frequent outcome of every pub, the counts
+ * format lists the outcomes of every pub as text, the JSON format writes one
+ * JSON object per job on its own line, and the CSV format writes one row per
+ * outcome. Outcomes are ordered by decreasing count, and the results of a
+ * circuit swept over parameter bindings are labelled name[binding]. With a
+ * marginal, only the kept bits of every outcome are counted. A JSON
+ * result merged from shards lists the job, backend and shots of each. When
+ * a dump path is set, the raw samples of the job are dumped as well.
+ *
+ * @param writer Pointer to RESULT_WRITER
+ * @param job_id Job identifier
+ * @param circuits Array of circuits submitted as the pubs of the job
+ * @param decoder Pointer to RESULT_DECODER holding the result of the job
+ * @return 0 on success, or -1 on failure
+ */
+int write_job_result(RESULT_WRITER* writer, char* job_id, CIRCUIT* circuits, RESULT_DECODER* decoder) {
+    FILE* stream = writer->stream;
+
+    if (writer->format == OUTPUT_CSV && !writer->header_written) {
+        fprintf(stream, "job_id,circuit,register,outcome,%s\n", writer->probabilities ? "probability" : "count");
+        writer->header_written = true;
+    }
+
+    if (writer->format == OUTPUT_JSON) {
+        fprintf(stream, "{\"job_id\":");
+        print_json_string(stream, job_id);
+        fprintf(stream, ",\"results\":[");
+    }
+
+    // Results follow the pubs, with one result per binding of a swept circuit.
+
+    int circuit_index = 0;
+    int binding = 0;
+    for (int i = 0; i < decoder->pub_count; i++) {
+        if (writer->format == OUTPUT_JSON && i > 0) putc(',', stream);
+
+        CIRCUIT* circuit = &circuits[circuit_index];
+        if (write_pub_result(writer, job_id, circuit, circuit->binding_count > 0 ? binding : -1, &decoder->pubs[i], decoder->pub_count > 1) < 0) {
+            fprintf(stderr, "ERROR - Writing the result of %s failed in write_job_result()!\n", circuit->name);
+            return -1;
+        }
+
+        if (++binding >= circuit->binding_count) {
+            circuit_index++;
+            binding = 0;
+        }
+    }
+
+    if (writer->format == OUTPUT_JSON && decoder->shard_count > 0) {
+        fprintf(stream, "],\"shards\":[");
+        for (int i = 0; i < decoder->shard_count; i++) {
+            fprintf(stream, "%s{\"job_id\":", i ? "," : "");
+            print_json_string(stream, decoder->shards[i].job_id);
+            fprintf(stream, ",\"backend\":");
+            print_json_string(stream, decoder->shards[i].backend);
+            fprintf(stream, ",\"shots\":%ld}", decoder->shards[i].shots);
+        }
+    }
+
+    if (writer->format == OUTPUT_JSON) fprintf(stream, "]}\n");
+
+    fflush(stream);
+    if (ferror(stream)) {
+        fprintf(stderr, "ERROR - Writing the job result failed in write_job_result()!\n");
+        return -1;
+    }
+
+    if (writer->dump_path) {
+        char path[PATH_MAX];
+        if (writer->dump_per_job) snprintf(path, PATH_MAX, "%s.%s", writer->dump_path, job_id);
+        else snprintf(path, PATH_MAX, "%s", writer->dump_path);
+
+        if (dump_samples(path, decoder) < 0) {
+            fprintf(stderr, "ERROR - Dumping the samples of job %s failed in write_job_result()!\n", job_id);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Dump the recorded samples of a job as packed binary records
+ *
+ * Writes the SAMPLE_DUMP_HEADER layout described in output.h. The decoder
+ * must have been created with keep_samples set.
+ *
+ * @param path Path of the dump file
+ * @param decoder Pointer to RESULT_DECODER holding the recorded samples
+ * @return 0 on success, or -1 on failure
+ */
+int dump_samples(char* path, RESULT_DECODER* decoder) {
+    int status = -1;
+
+    if (!decoder->keep_samples) {
+        fprintf(stderr, "ERROR - The samples of the job were not recorded in dump_samples()!\n");
+        goto terminate;
+    }
+
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "ERROR - Opening %s failed in dump_samples()!\n", path);
+        goto terminate;
+    }
+
+    SAMPLE_DUMP_HEADER header;
+    memset(&header, 0, sizeof(SAMPLE_DUMP_HEADER));
+    memcpy(header.magic, SAMPLE_DUMP_MAGIC, sizeof(header.magic));
+    header.version = SAMPLE_DUMP_VERSION;
+    header.pub_count = (uint32_t)decoder->pub_count;
+
+    if (fwrite(&header, sizeof(SAMPLE_DUMP_HEADER), 1, file) != 1) {
+        fprintf(stderr, "ERROR - Writing the dump header failed in dump_samples()!\n");
+        goto cleanup_file;
+    }
+
+    uint64_t offset = sizeof(SAMPLE_DUMP_HEADER) + (uint64_t)decoder->pub_count*sizeof(SAMPLE_DUMP_PUB);
+    for (int i = 0; i < decoder->pub_count; i++) {
+        PUB_COUNTS* pub = &decoder->pubs[i];
+
+        SAMPLE_DUMP_PUB pub_header;
+        memset(&pub_header, 0, sizeof(SAMPLE_DUMP_PUB));
+        pub_header.num_bits = (uint32_t)pub->num_bits;
+        pub_header.words = (uint32_t)(pub->sample_words > 0 ? pub->sample_words : pub->histogram.words);
+        pub_header.shots = (uint64_t)pub->sample_count;
+        pub_header.offset = offset;
+
+        if (fwrite(&pub_header, sizeof(SAMPLE_DUMP_PUB), 1, file) != 1) {
+            fprintf(stderr, "ERROR - Writing the dump pub table failed in dump_samples()!\n");
+            goto cleanup_file;
+        }
+
+        offset += pub_header.shots*pub_header.words*sizeof(BITSET_WORD);
+    }
+
+    for (int i = 0; i < decoder->pub_count; i++) {
+        PUB_COUNTS* pub = &decoder->pubs[i];
+        size_t record_count = (size_t)pub->sample_count*pub->sample_words;
+
+        if (record_count > 0 && fwrite(pub->samples, sizeof(BITSET_WORD), record_count, file) != record_count) {
+            fprintf(stderr, "ERROR - Writing the samples of pub %d failed in dump_samples()!\n", i);
+            goto cleanup_file;
+        }
+    }
+
+    status = 0;
+
+cleanup_file:
+    if (fclose(file) != 0 && status == 0) {
+        fprintf(stderr, "ERROR - Closing %s failed in dump_samples()!\n", path);
+        status = -1;
+    }
+
+terminate:
+    return status;
+}
@@ -0,0 +1,61 @@
+#ifndef _OUTPUT_H_
+#define _OUTPUT_H_
+
+#define SAMPLE_DUMP_MAGIC "QCSAMPLE"
+#define SAMPLE_DUMP_VERSION 1
+
+typedef enum OutputFormat {
+    OUTPUT_MODE,
+    OUTPUT_COUNTS,
+    OUTPUT_JSON,
+    OUTPUT_CSV
+} OUTPUT_FORMAT;
+
+/*
+ * Layout of a sample dump file, all fields in host byte order:
+ *
+ *   SAMPLE_DUMP_HEADER
+ *   SAMPLE_DUMP_PUB[pub_count]
+ *   for every pub, shots records of words uint64_t each, starting at the
+ *   pub's offset (a multiple of 8), least significant word first
+ *
+ * The file can be memory-mapped and the records used in place.
+ */
+typedef struct SampleDumpHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pub_count;
+} SAMPLE_DUMP_HEADER;
+
+typedef struct SampleDumpPub {
+    uint32_t num_bits;
+    uint32_t words;
+    uint64_t shots;
+    uint64_t offset;
+} SAMPLE_DUMP_PUB;
+
+typedef struct ResultWriter {
+    FILE* stream;
+    bool owns_stream;
+    FILE* console;
+
+    OUTPUT_FORMAT format;
+    int top_k;
+    bool probabilities;
+    bool header_written;
+
+    char* dump_path;
+    bool dump_per_job;
+
+    ANALYSIS_OPTIONS* analysis;
+} RESULT_WRITER;
+
+int parse_output_format(char* text, OUTPUT_FORMAT* format);
+
+RESULT_WRITER* create_result_writer(char* output_path, OUTPUT_FORMAT format, int top_k, bool probabilities, char* dump_path);
+void destroy_result_writer(RESULT_WRITER* writer);
+
+int write_job_result(RESULT_WRITER* writer, char* job_id, CIRCUIT* circuits, RESULT_DECODER* decoder);
+int dump_samples(char* path, RESULT_DECODER* decoder);
+
+#endif
@@ -1,6 +1,15 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #include <cjson/cJSON.h>
 
@@ -8,31 +17,99 @@
 
 
 /**
- * @brief Count the number of characters in a file
+ * @brief Read a whole file, or standard input, in a single pass
  *
- * Opens the file and counts all characters until EOF.
+ * Regular files are sized with fstat() and mapped with mmap(), so that
+ * their contents are copied out exactly once. Standard input, pipes and
+ * other files without a known size are read into a growing buffer. The
+ * name STDIN_FILENAME stands for standard input.
  *
- * @param filename Path to the file to count
- * @return Number of characters on success, or -1 on failure
+ * @param filename Path to the file, or STDIN_FILENAME
+ * @param size Output pointer receiving the number of bytes read, or NULL
+ * @return Newly allocated null-terminated contents (CALLER MUST FREE), or
+ *         NULL on failure
  */
-int count_characters(char* filename) {
-    int count = -1;
+char* read_file(char* filename, size_t* size) {
+    char* data = NULL;
+    size_t length = 0;
 
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "ERROR - Opening %s failed in count_characters()!\n", filename);
+    bool is_stdin = strcmp(filename, STDIN_FILENAME) == 0;
+    int fd = is_stdin ? STDIN_FILENO : open(filename, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "ERROR - Opening %s failed in read_file()!\n", filename);
         goto terminate;
     }
 
-    count = 0;
-    for (char ch = getc(file); ch != EOF; ch = getc(file)) {
-        count++;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        fprintf(stderr, "ERROR - Accessing %s failed in read_file()!\n", filename);
+        goto cleanup_fd;
     }
 
-    fclose(file);
+    if (!is_stdin && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        length = (size_t)file_stat.st_size;
+
+        void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            fprintf(stderr, "ERROR - Mapping %s failed in read_file()!\n", filename);
+            goto cleanup_fd;
+        }
+        madvise(mapping, length, MADV_SEQUENTIAL);
+
+        data = (char*)malloc(length+1);
+        if (data) {
+            memcpy(data, mapping, length);
+            data[length] = '\0';
+        } else {
+            fprintf(stderr, "ERROR - Allocating memory for %s failed in read_file()!\n", filename);
+        }
+
+        munmap(mapping, length);
+        goto cleanup_fd;
+    }
+
+    size_t capacity = READ_CHUNK_SIZE;
+    data = (char*)malloc(capacity);
+    if (!data) {
+        fprintf(stderr, "ERROR - Allocating memory for %s failed in read_file()!\n", filename);
+        goto cleanup_fd;
+    }
+
+    while (true) {
+        if (capacity-length < READ_CHUNK_SIZE) {
+            char* temp = (char*)realloc(data, 2*capacity);
+            if (!temp) {
+                fprintf(stderr, "ERROR - Allocating memory for %s failed in read_file()!\n", filename);
+                goto cleanup_data;
+            }
+            data = temp;
+            capacity *= 2;
+        }
+
+        ssize_t count = read(fd, data+length, capacity-length-1);
+        if (count < 0 && errno == EINTR) continue;
+        if (count < 0) {
+            fprintf(stderr, "ERROR - Reading %s failed in read_file()!\n", filename);
+            goto cleanup_data;
+        }
+        if (count == 0) break;
+
+        length += (size_t)count;
+    }
+    data[length] = '\0';
+
+    goto cleanup_fd;
+
+cleanup_data:
+    free(data);
+    data = NULL;
+
+cleanup_fd:
+    if (!is_stdin) close(fd);
 
 terminate:
-    return count;
+    if (data && size) *size = length;
+    return data;
 }
 
 
@@ -48,26 +125,13 @@ terminate:
 CONFIG* read_config(char* filename) {
     CONFIG* config = NULL;
 
-    int characters = count_characters(filename);
-    if (characters <= 0) {
-        fprintf(stderr, "ERROR - Counting the number of characters failed in read_config()!\n");
-        goto terminate;
-    }
-
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "ERROR - Opening %s failed in read_config()!\n", filename);
-        goto terminate;
-    }
-
-    char* buffer = (char*)calloc(characters+1, sizeof(char));
-    if (!buffer) {
-        fprintf(stderr, "ERROR - Allocating memory for buffer failed in read_config()!\n");
-        goto cleanup_file;
+    size_t size = 0;
+    char* buffer = read_file(filename, &size);
+    if (!buffer || size == 0) {
+        fprintf(stderr, "ERROR - Reading %s failed in read_config()!\n", filename);
+        goto cleanup_buffer;
     }
 
-    fread(buffer, sizeof(char), characters, file);
-
     cJSON* config_cjson = cJSON_Parse(buffer);
     if (!config_cjson) {
         fprintf(stderr, "ERROR - Parsing configuration JSON failed in read_config()!\n");
@@ -103,10 +167,6 @@ cleanup_config_cjson:
 cleanup_buffer:
     free(buffer);
 
-cleanup_file:
-    fclose(file);
-
-terminate:
     return config;
 }
 
@@ -116,35 +176,596 @@ terminate:
  * Reads the entire contents of an OpenQASM file into a newly allocated
  * null-terminated string.
  *
- * @param filename Path to the OpenQASM file
+ * @param filename Path to the OpenQASM file, or STDIN_FILENAME
  * @return Newly allocated string (CALLER MUST FREE) or NULL on failure
  */
 char* read_qasm(char* filename) {
-    char* qasm = NULL;
+    size_t size = 0;
+    char* qasm = read_file(filename, &size);
+    if (qasm && size == 0) {
+        fprintf(stderr, "ERROR - %s is empty in read_qasm()!\n", filename);
+        free(qasm);
+        qasm = NULL;
+    }
 
-    int characters = count_characters(filename);
-    if (characters <= 0) {
-        fprintf(stderr, "ERROR - Counting the number of characters failed in read_qasm()!\n");
-        goto terminate;
+    return qasm;
+}
+
+
+/**
+ * @brief Advance to the start of the next statement
+ *
+ * Skips whitespace, line comments and the closing braces of blocks.
+ *
+ * @param cursor Position in OpenQASM source code
+ * @return Start of the next statement
+ */
+static char* skip_to_statement(char* cursor) {
+    while (isspace((unsigned char)*cursor) || *cursor == '}' || strncmp(cursor, "//", 2) == 0) {
+        if (*cursor == '/') cursor += strcspn(cursor, "\n");
+        else cursor++;
     }
 
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "ERROR - Opening %s failed in read_qasm()!\n", filename);
-        goto terminate;
+    return cursor;
+}
+
+/**
+ * @brief Check whether a statement starts with a keyword
+ *
+ * @param statement Start of the statement
+ * @param keyword Keyword to look for
+ * @return Nonzero if the statement starts with the whole keyword
+ */
+static int starts_with_keyword(char* statement, const char* keyword) {
+    size_t length = strlen(keyword);
+
+    return strncmp(statement, keyword, length) == 0 && !isalnum((unsigned char)statement[length]) && statement[length] != '_';
+}
+
+/**
+ * @brief Find the width of the classical register a circuit is measured into
+ *
+ * Scans the classical register declarations (bit[n] name; bit name; and
+ * creg name[n];). The register named meas is preferred, otherwise the first
+ * declared register is used, which matches the register the result is
+ * read from.
+ *
+ * @param qasm OpenQASM source code
+ * @return Number of bits of the register, or 0 if no register is declared
+ */
+int count_measured_bits(char* qasm) {
+    int first_width = 0;
+
+    for (char* statement = qasm; statement && *statement; statement = strchr(statement, ';')) {
+        if (*statement == ';') statement++;
+        statement = skip_to_statement(statement);
+
+        int width = 1;
+        char name[REGISTER_NAME_NMEMB] = "";
+
+        if (strncmp(statement, "bit", 3) == 0 && (statement[3] == '[' || isspace((unsigned char)statement[3]))) {
+            if (sscanf(statement, "bit [ %d ] %127[A-Za-z0-9_]", &width, name) != 2 &&
+                sscanf(statement, "bit %127[A-Za-z0-9_]", name) != 1) continue;
+        } else if (strncmp(statement, "creg", 4) == 0 && isspace((unsigned char)statement[4])) {
+            if (sscanf(statement, "creg %127[A-Za-z0-9_] [ %d ]", name, &width) != 2) continue;
+        } else {
+            continue;
+        }
+
+        if (width <= 0) continue;
+        if (strcmp(name, "meas") == 0) return width;
+        if (first_width == 0) first_width = width;
+    }
+
+    return first_width;
+}
+
+
+/**
+ * @brief Find the number of qubits a circuit needs
+ *
+ * Adds up the quantum register declarations (qubit[n] name; qubit name; and
+ * qreg name[n];). Transpiled circuits address physical qubits as $k
+ * instead, in which case the highest index used decides.
+ *
+ * @param qasm OpenQASM source code
+ * @return Number of qubits, or 0 if the circuit uses none
+ */
+int count_circuit_qubits(char* qasm) {
+    int declared_qubits = 0;
+    int physical_qubits = 0;
+
+    for (char* statement = qasm; statement && *statement; statement = strchr(statement, ';')) {
+        if (*statement == ';') statement++;
+        statement = skip_to_statement(statement);
+
+        int width = 1;
+        char name[REGISTER_NAME_NMEMB] = "";
+
+        if (starts_with_keyword(statement, "qubit")) {
+            if (sscanf(statement, "qubit [ %d ] %127[A-Za-z0-9_]", &width, name) == 2 ||
+                sscanf(statement, "qubit %127[A-Za-z0-9_]", name) == 1) {
+                if (width > 0) declared_qubits += width;
+            }
+        } else if (starts_with_keyword(statement, "qreg")) {
+            if (sscanf(statement, "qreg %127[A-Za-z0-9_] [ %d ]", name, &width) == 2 && width > 0) declared_qubits += width;
+        }
+    }
+
+    for (char* physical = strchr(qasm, '$'); physical; physical = strchr(physical+1, '$')) {
+        if (!isdigit((unsigned char)physical[1])) continue;
+
+        int index = atoi(physical+1);
+        if (index+1 > physical_qubits) physical_qubits = index+1;
+    }
+
+    return declared_qubits > physical_qubits ? declared_qubits : physical_qubits;
+}
+
+/**
+ * @brief Count the gates of a circuit that act on two or more qubits
+ *
+ * A gate call counts when it has more than one operand. Declarations,
+ * measurements, barriers, resets and delays are skipped, as are the bodies
+ * of gate and subroutine definitions, which only count where they are
+ * called.
+ *
+ * @param qasm OpenQASM source code
+ * @return Number of multi-qubit gate calls
+ */
+int count_two_qubit_gates(char* qasm) {
+    static const char* skipped_keywords[] = {
+        "OPENQASM", "include", "qubit", "qreg", "bit", "creg", "measure", "barrier", "reset", "delay", "input", "output", "const", "let"
+    };
+
+    int gate_count = 0;
+
+    char* statement = skip_to_statement(qasm);
+    while (*statement) {
+        if (starts_with_keyword(statement, "gate") || starts_with_keyword(statement, "def")) {
+            char* body = strchr(statement, '{');
+            if (!body) break;
+
+            int depth = 0;
+            for (statement = body; *statement; statement++) {
+                if (*statement == '{') depth++;
+                else if (*statement == '}' && --depth == 0) break;
+            }
+            if (*statement) statement++;
+            statement = skip_to_statement(statement);
+            continue;
+        }
+
+        char* end = strchr(statement, ';');
+        if (!end) break;
+
+        bool skipped = memchr(statement, '=', end-statement) != NULL;
+        for (size_t i = 0; !skipped && i < sizeof(skipped_keywords)/sizeof(skipped_keywords[0]); i++) {
+            skipped = starts_with_keyword(statement, skipped_keywords[i]);
+        }
+
+        // Operands are separated by commas outside of the parameter list and indices.
+
+        int operand_count = 1;
+        int depth = 0;
+        for (char* ch = statement; !skipped && ch < end; ch++) {
+            if (*ch == '(' || *ch == '[') depth++;
+            else if ((*ch == ')' || *ch == ']') && depth > 0) depth--;
+            else if (*ch == ',' && depth == 0) operand_count++;
+        }
+
+        if (!skipped && operand_count >= 2) gate_count++;
+
+        statement = skip_to_statement(end+1);
+    }
+
+    return gate_count;
+}
+
+/**
+ * @brief Compare two parameter names for qsort()
+ *
+ * @param a Pointer to the first name
+ * @param b Pointer to the second name
+ * @return Result of strcmp() on the names
+ */
+static int compare_names(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+ * @brief Read the input parameters a circuit declares
+ *
+ * Scans the input declarations (input float[64] theta; input angle phi;).
+ * The names are sorted by name, which is the order the sampler expects the
+ * values of a binding in.
+ *
+ * @param qasm OpenQASM source code
+ * @param parameter_count Output pointer receiving the number of parameters
+ * @return Newly allocated array of newly allocated names (CALLER MUST FREE
+ *         both), or NULL if the circuit declares none or on failure
+ */
+char** read_input_parameters(char* qasm, int* parameter_count) {
+    char** names = NULL;
+    *parameter_count = 0;
+
+    for (char* statement = qasm; statement && *statement; statement = strchr(statement, ';')) {
+        if (*statement == ';') statement++;
+        statement = skip_to_statement(statement);
+
+        if (!starts_with_keyword(statement, "input")) continue;
+
+        char type[REGISTER_NAME_NMEMB] = "";
+        char name[REGISTER_NAME_NMEMB] = "";
+        if (sscanf(statement, "input %127[A-Za-z] [ %*d ] %127[A-Za-z0-9_]", type, name) != 2 &&
+            sscanf(statement, "input %127[A-Za-z] %127[A-Za-z0-9_]", type, name) != 2) continue;
+
+        char** temp = (char**)realloc(names, (*parameter_count+1)*sizeof(char*));
+        if (!temp || !(temp[*parameter_count] = strdup(name))) {
+            fprintf(stderr, "ERROR - Allocating memory for parameter names failed in read_input_parameters()!\n");
+            names = temp ? temp : names;
+            goto cleanup_names;
+        }
+        names = temp;
+        (*parameter_count)++;
+    }
+
+    if (names) qsort(names, *parameter_count, sizeof(char*), compare_names);
+
+    return names;
+
+cleanup_names:
+    for (int i = 0; i < *parameter_count; i++) {
+        free(names[i]);
     }
+    free(names);
+    *parameter_count = 0;
 
-    qasm = (char*)calloc(characters+1, sizeof(char));
+    return NULL;
+}
+
+
+/**
+ * @brief Filter for OpenQASM files in a directory listing
+ *
+ * @param entry Directory entry to inspect
+ * @return Nonzero if the entry name ends with QASM_EXTENSION, 0 otherwise
+ */
+static int is_qasm_entry(const struct dirent* entry) {
+    size_t name_length = strlen(entry->d_name);
+    size_t extension_length = strlen(QASM_EXTENSION);
+
+    if (entry->d_name[0] == '.' || name_length <= extension_length) return 0;
+
+    return strcmp(entry->d_name+name_length-extension_length, QASM_EXTENSION) == 0;
+}
+
+/**
+ * @brief Initialize a circuit from its OpenQASM code
+ *
+ * Takes ownership of the name and code and derives the register width,
+ * qubit count, two-qubit gate count and input parameters from the code.
+ *
+ * @param circuit Pointer to CIRCUIT to initialize
+ * @param name Name of the circuit (freed by free_circuits)
+ * @param qasm OpenQASM source code (freed by free_circuits)
+ */
+void initialize_circuit(CIRCUIT* circuit, char* name, char* qasm) {
+    memset(circuit, 0, sizeof(CIRCUIT));
+    circuit->name = name;
+    circuit->qasm = qasm;
+    if (!qasm) return;
+
+    circuit->measured_bits = count_measured_bits(qasm);
+    circuit->qubit_count = count_circuit_qubits(qasm);
+    circuit->two_qubit_gate_count = count_two_qubit_gates(qasm);
+    circuit->parameter_names = read_input_parameters(qasm, &circuit->parameter_count);
+
+    return;
+}
+
+/**
+ * @brief Append one OpenQASM file to a circuit list
+ *
+ * @param circuits Pointer to the circuit array to grow
+ * @param circuit_count Pointer to the number of circuits in the array
+ * @param filename Path to the OpenQASM file to read
+ * @return 0 on success, or -1 on failure
+ */
+static int append_circuit(CIRCUIT** circuits, int* circuit_count, char* filename) {
+    CIRCUIT* temp = (CIRCUIT*)realloc(*circuits, (*circuit_count+1)*sizeof(CIRCUIT));
+    if (!temp) {
+        fprintf(stderr, "ERROR - Allocating memory for circuits failed in append_circuit()!\n");
+        return -1;
+    }
+    *circuits = temp;
+
+    char* qasm = read_qasm(filename);
     if (!qasm) {
-        fprintf(stderr, "ERROR - Allocating memory for QASM code failed in read_qasm()!\n");
-        goto cleanup_file;
+        fprintf(stderr, "ERROR - Reading %s failed in append_circuit()!\n", filename);
+        return -1;
     }
 
-    fread(qasm, sizeof(char), characters, file);
-    
-cleanup_file:
-    fclose(file);
+    bool is_stdin = strcmp(filename, STDIN_FILENAME) == 0;
+    initialize_circuit(&(*circuits)[*circuit_count], strdup(is_stdin ? STDIN_CIRCUIT_NAME : filename), qasm);
+    (*circuit_count)++;
+
+    return 0;
+}
+
+/**
+ * @brief Read a batch of OpenQASM circuits from files and directories
+ *
+ * Each path is either an OpenQASM file or a directory, in which case every
+ * file ending with QASM_EXTENSION inside it is read in alphabetical order.
+ * The path STDIN_FILENAME reads one circuit from standard input, so that
+ * the output of the transpiler can be piped in.
+ * The circuits keep the order of the given paths, which is also the order
+ * of the pubs in the submitted job.
+ *
+ * @param paths Array of file or directory paths
+ * @param path_count Number of paths
+ * @param circuit_count Output pointer receiving the number of circuits read
+ * @return Newly allocated CIRCUIT array (CALLER MUST FREE with free_circuits)
+ *         or NULL on failure
+ */
+CIRCUIT* read_circuits(char** paths, int path_count, int* circuit_count) {
+    CIRCUIT* circuits = NULL;
+    *circuit_count = 0;
+
+    bool stdin_read = false;
+    for (int i = 0; i < path_count; i++) {
+        if (strcmp(paths[i], STDIN_FILENAME) == 0) {
+            if (stdin_read) {
+                fprintf(stderr, "ERROR - Standard input can only be read once in read_circuits()!\n");
+                goto cleanup_circuits;
+            }
+            stdin_read = true;
+
+            if (append_circuit(&circuits, circuit_count, paths[i]) < 0) goto cleanup_circuits;
+            continue;
+        }
+
+        struct stat path_stat;
+        if (stat(paths[i], &path_stat) != 0) {
+            fprintf(stderr, "ERROR - Accessing %s failed in read_circuits()!\n", paths[i]);
+            goto cleanup_circuits;
+        }
+
+        if (!S_ISDIR(path_stat.st_mode)) {
+            if (append_circuit(&circuits, circuit_count, paths[i]) < 0) goto cleanup_circuits;
+            continue;
+        }
+
+        struct dirent** entries = NULL;
+        int entry_count = scandir(paths[i], &entries, is_qasm_entry, alphasort);
+        if (entry_count < 0) {
+            fprintf(stderr, "ERROR - Listing directory %s failed in read_circuits()!\n", paths[i]);
+            goto cleanup_circuits;
+        }
+
+        int append_status = 0;
+        for (int j = 0; j < entry_count; j++) {
+            if (append_status == 0) {
+                char filename[PATH_MAX];
+                snprintf(filename, PATH_MAX, "%s/%s", paths[i], entries[j]->d_name);
+                append_status = append_circuit(&circuits, circuit_count, filename);
+            }
+            free(entries[j]);
+        }
+        free(entries);
+
+        if (append_status < 0) goto cleanup_circuits;
+    }
+
+    if (*circuit_count == 0) {
+        fprintf(stderr, "ERROR - No OpenQASM files found in read_circuits()!\n");
+        goto cleanup_circuits;
+    }
+
+    goto terminate;
+
+cleanup_circuits:
+    free_circuits(circuits, *circuit_count);
+    circuits = NULL;
+    *circuit_count = 0;
 
 terminate:
-    return qasm;
+    return circuits;
+}
+
+/**
+ * @brief Split a line of a parameter file into fields
+ *
+ * Fields are separated by whitespace or commas; the line is modified in
+ * place.
+ *
+ * @param line Line to split
+ * @param fields Array receiving the fields
+ * @param max_fields Capacity of the fields array
+ * @return Number of fields, or -1 if the line has too many
+ */
+static int split_fields(char* line, char** fields, int max_fields) {
+    int field_count = 0;
+    char* save = NULL;
+
+    for (char* field = strtok_r(line, " \t\r,", &save); field; field = strtok_r(NULL, " \t\r,", &save)) {
+        if (field_count == max_fields) return -1;
+        fields[field_count++] = field;
+    }
+
+    return field_count;
+}
+
+/**
+ * @brief Bind the rows of a parameter file to the circuits
+ *
+ * Every circuit with input parameters gets one binding per row of the
+ * file. The values of a row are separated by whitespace or commas, and
+ * lines starting with # are comments. The first line may name the columns;
+ * the columns are then matched to the parameters by name, and otherwise
+ * they must follow the sorted parameter order of every circuit.
+ *
+ * @param filename Path to the parameter file, or STDIN_FILENAME
+ * @param circuits Array of circuits to bind
+ * @param circuit_count Number of circuits
+ * @return 0 on success, or -1 on failure
+ */
+int read_parameter_values(char* filename, CIRCUIT* circuits, int circuit_count) {
+    int status = -1;
+
+    char* text = read_file(filename, NULL);
+    if (!text) {
+        fprintf(stderr, "ERROR - Reading %s failed in read_parameter_values()!\n", filename);
+        goto terminate;
+    }
+
+    char* fields[PARAMETER_MAX_COUNT];
+    char* header[PARAMETER_MAX_COUNT];
+    int column_count = -1;
+    bool has_header = false;
+
+    double* rows = NULL;
+    int row_count = 0;
+
+    for (char* line = text; line && *line; ) {
+        char* next = strchr(line, '\n');
+        if (next) *next++ = '\0';
+
+        char* comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        int field_count = split_fields(line, fields, PARAMETER_MAX_COUNT);
+        line = next;
+        if (field_count == 0) continue;
+
+        if (field_count < 0 || (column_count >= 0 && field_count != column_count)) {
+            fprintf(stderr, "ERROR - Row %d of %s has the wrong number of values in read_parameter_values()!\n", row_count+1, filename);
+            goto cleanup_rows;
+        }
+
+        char* end = NULL;
+        strtod(fields[0], &end);
+        if (column_count < 0 && *end) {
+            memcpy(header, fields, field_count*sizeof(char*));
+            column_count = field_count;
+            has_header = true;
+            continue;
+        }
+        column_count = field_count;
+
+        double* temp = (double*)realloc(rows, (size_t)(row_count+1)*column_count*sizeof(double));
+        if (!temp) {
+            fprintf(stderr, "ERROR - Allocating memory for parameter values failed in read_parameter_values()!\n");
+            goto cleanup_rows;
+        }
+        rows = temp;
+
+        for (int i = 0; i < column_count; i++) {
+            rows[(size_t)row_count*column_count+i] = strtod(fields[i], &end);
+            if (*end) {
+                fprintf(stderr, "ERROR - %s in %s is not a number in read_parameter_values()!\n", fields[i], filename);
+                goto cleanup_rows;
+            }
+        }
+        row_count++;
+    }
+
+    if (row_count == 0) {
+        fprintf(stderr, "ERROR - %s holds no parameter values in read_parameter_values()!\n", filename);
+        goto cleanup_rows;
+    }
+
+    int bound_count = 0;
+    for (int i = 0; i < circuit_count; i++) {
+        CIRCUIT* circuit = &circuits[i];
+        if (circuit->parameter_count == 0) continue;
+
+        if (circuit->parameter_count > PARAMETER_MAX_COUNT) {
+            fprintf(stderr, "ERROR - %s declares too many parameters in read_parameter_values()!\n", circuit->name);
+            goto cleanup_rows;
+        }
+
+        int columns[PARAMETER_MAX_COUNT];
+        for (int j = 0; j < circuit->parameter_count; j++) {
+            columns[j] = has_header ? -1 : j;
+            for (int k = 0; has_header && k < column_count; k++) {
+                if (strcmp(header[k], circuit->parameter_names[j]) == 0) columns[j] = k;
+            }
+
+            if (columns[j] < 0 || columns[j] >= column_count || (!has_header && column_count != circuit->parameter_count)) {
+                fprintf(stderr, "ERROR - %s has no values for the parameters of %s in read_parameter_values()!\n", filename, circuit->name);
+                goto cleanup_rows;
+            }
+        }
+
+        circuit->parameter_values = (double*)malloc((size_t)row_count*circuit->parameter_count*sizeof(double));
+        if (!circuit->parameter_values) {
+            fprintf(stderr, "ERROR - Allocating memory for the bindings of %s failed in read_parameter_values()!\n", circuit->name);
+            goto cleanup_rows;
+        }
+
+        for (int row = 0; row < row_count; row++) {
+            for (int j = 0; j < circuit->parameter_count; j++) {
+                circuit->parameter_values[(size_t)row*circuit->parameter_count+j] = rows[(size_t)row*column_count+columns[j]];
+            }
+        }
+        circuit->binding_count = row_count;
+        bound_count++;
+    }
+
+    if (bound_count == 0) {
+        fprintf(stderr, "ERROR - No circuit declares input parameters in read_parameter_values()!\n");
+        goto cleanup_rows;
+    }
+
+    status = 0;
+
+cleanup_rows:
+    free(rows);
+    free(text);
+
+terminate:
+    return status;
+}
+
+/**
+ * @brief Count the results a job of circuits yields
+ *
+ * A circuit with bindings yields one result per binding, any other circuit
+ * a single result.
+ *
+ * @param circuits Array of circuits submitted as the pubs of a job
+ * @param circuit_count Number of circuits
+ * @return Number of results
+ */
+int count_result_slots(CIRCUIT* circuits, int circuit_count) {
+    int slot_count = 0;
+
+    for (int i = 0; i < circuit_count; i++) {
+        slot_count += circuits[i].binding_count > 0 ? circuits[i].binding_count : 1;
+    }
+
+    return slot_count;
+}
+
+/**
+ * @brief Free a circuit array returned by read_circuits()
+ *
+ * @param circuits Circuit array to free
+ * @param circuit_count Number of circuits in the array
+ */
+void free_circuits(CIRCUIT* circuits, int circuit_count) {
+    for (int i = 0; i < circuit_count; i++) {
+        free(circuits[i].name);
+        free(circuits[i].qasm);
+        for (int j = 0; j < circuits[i].parameter_count; j++) {
+            free(circuits[i].parameter_names[j]);
+        }
+        free(circuits[i].parameter_names);
+        free(circuits[i].parameter_values);
+    }
+    free(circuits);
+
+    return;
 }
@@ -2,15 +2,44 @@
 #define _READER_H_
 
 #define CONFIG_FILENAME "config.json"
+#define QASM_EXTENSION ".qasm"
+#define STDIN_FILENAME "-"
+#define STDIN_CIRCUIT_NAME "stdin"
+#define READ_CHUNK_SIZE 65536
+#define REGISTER_NAME_NMEMB 128
+#define PARAMETER_MAX_COUNT 1024
 
 typedef struct config {
     char* key;
     char* crn;
 } CONFIG;
 
-int count_characters(char* filename);
+typedef struct Circuit {
+    char* name;
+    char* qasm;
+    int measured_bits;
+    int qubit_count;
+    int two_qubit_gate_count;
+    int shots;
+
+    char** parameter_names;
+    int parameter_count;
+    double* parameter_values;
+    int binding_count;
+} CIRCUIT;
+
+char* read_file(char* filename, size_t* size);
 
 CONFIG* read_config(char* filename);
 char* read_qasm(char* filename);
+int count_measured_bits(char* qasm);
+int count_circuit_qubits(char* qasm);
+int count_two_qubit_gates(char* qasm);
+char** read_input_parameters(char* qasm, int* parameter_count);
+void initialize_circuit(CIRCUIT* circuit, char* name, char* qasm);
+CIRCUIT* read_circuits(char** paths, int path_count, int* circuit_count);
+int read_parameter_values(char* filename, CIRCUIT* circuits, int circuit_count);
+int count_result_slots(CIRCUIT* circuits, int circuit_count);
+void free_circuits(CIRCUIT* circuits, int circuit_count);
 
 #endif
@@ -3,12 +3,18 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 
 #include <curl/curl.h>
 #include <cjson/cJSON.h>
 #include <pthread.h>
 
+#include "metrics.h"
 #include "comm.h"
+#include "reader.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "decoder.h"
 #include "receiver.h"
 
 
@@ -45,7 +51,8 @@ bool check_code(char* response) {
     if (cJSON_IsNumber(code_cjson) && code_cjson->valueint == 1234) {
         is_code_1234 = true;
     } else {
-        fprintf(stderr, "ERROR - API returned error code: %d in check_code()!\n", code_cjson->valueint);
+        if (cJSON_IsNumber(code_cjson)) fprintf(stderr, "ERROR - API returned error code: %d in check_code()!\n", code_cjson->valueint);
+        else fprintf(stderr, "ERROR - API returned error code: unknown in check_code()!\n");
         cJSON* error_msg = cJSON_GetObjectItemCaseSensitive(first_error_cjson, "message");
         if (cJSON_IsString(error_msg) && error_msg->valuestring) {
             fprintf(stderr, "ERROR - Message: %s\n", error_msg->valuestring);
@@ -60,325 +67,545 @@ terminate:
 }
 
 /**
- * @brief Retrieve job result by polling the job results endpoint
+ * @brief Initialize the adaptive polling state of a job
  *
- * Polls until the job result is available (handles queued responses) and
- * returns the raw response body.
+ * @param poll_state Pointer to POLL_STATE to initialize
+ */
+void initialize_poll_state(POLL_STATE* poll_state) {
+    poll_state->last_status = STATUS_UNKNOWN;
+    poll_state->interval = 0.0;
+    poll_state->seed = (unsigned int)time(NULL) ^ (unsigned int)(size_t)poll_state;
+
+    return;
+}
+
+/**
+ * @brief Compute the delay before the next job status poll
  *
- * @param token_data Pointer to TOKEN_DATA with authentication token
- * @param crn Service CRN string
- * @param job_id Job identifier to query
- * @return JSON result string on success (CALLER MUST FREE), or NULL on error
+ * A job that just changed state is polled at the base interval of that
+ * state: quickly once it is running, since it usually finishes within
+ * seconds, and more slowly while it is queued. Repeated polls in the same
+ * state back off exponentially up to a per-state cap, and every delay is
+ * jittered so that concurrent jobs do not poll in lockstep.
+ *
+ * @param poll_state Pointer to POLL_STATE of the job
+ * @param status Status returned by the latest poll
+ * @return Delay in seconds until the next poll
  */
-char* get_job_result(TOKEN_DATA* token_data, char* crn, char* job_id) {
-    char* job_result = NULL;
+double next_poll_delay(POLL_STATE* poll_state, JOB_STATUS status) {
+    double base_time = status == STATUS_RUNNING ? POLL_RUNNING_TIME : POLL_QUEUED_TIME;
+    double max_time = status == STATUS_RUNNING ? POLL_RUNNING_MAX_TIME : POLL_MAX_TIME;
 
-    char* token = copy_bearer_token(token_data);
-    if (!token) {
-        fprintf(stderr, "ERROR - Copying bearer token failed in get_job_result()!\n");
-        goto terminate;
+    if (status != poll_state->last_status || poll_state->interval <= 0.0) {
+        poll_state->interval = base_time;
+    } else {
+        poll_state->interval *= POLL_BACKOFF_FACTOR;
+        if (poll_state->interval > max_time) poll_state->interval = max_time;
     }
+    poll_state->last_status = status;
 
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        fprintf(stderr, "ERROR - cURL initialization failed in get_job_result()!\n");
-        goto cleanup_token;
+    double jitter = 1.0 + POLL_JITTER * (2.0 * (double)rand_r(&poll_state->seed) / RAND_MAX - 1.0);
+
+    return poll_state->interval * jitter;
+}
+
+/**
+ * @brief Initialize the queue estimate of a job
+ *
+ * @param estimate Pointer to QUEUE_ESTIMATE to initialize
+ */
+void initialize_queue_estimate(QUEUE_ESTIMATE* estimate) {
+    estimate->first_position = -1;
+    estimate->first_time = 0.0;
+    estimate->slot_time = QUEUE_SLOT_TIME;
+
+    return;
+}
+
+/**
+ * @brief Estimate when a job will have finished
+ *
+ * A queued job finishes after every job ahead of it and then itself, one
+ * queue slot each. The slot time starts at QUEUE_SLOT_TIME and is replaced
+ * by the rate the queue position was seen to drain at, once it moved. A
+ * queued job without a reported position is assumed to be next. A running
+ * job is expected to finish right away.
+ *
+ * @param estimate Pointer to QUEUE_ESTIMATE of the job
+ * @param status Status returned by the latest poll
+ * @param queue_position Reported queue position, or -1 if unknown
+ * @param now Current monotonic time in seconds
+ * @return Estimated monotonic completion time in seconds
+ */
+double estimate_completion_time(QUEUE_ESTIMATE* estimate, JOB_STATUS status, int queue_position, double now) {
+    if (status != STATUS_QUEUED) return now;
+    if (queue_position < 0) queue_position = 0;
+
+    if (estimate->first_position < 0) {
+        estimate->first_position = queue_position;
+        estimate->first_time = now;
+    } else if (queue_position < estimate->first_position) {
+        estimate->slot_time = (now - estimate->first_time) / (estimate->first_position - queue_position);
     }
 
-    RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
-    if (!rb.data) {
-        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in get_job_result()!\n");
-        goto cleanup_curl;
+    return now + (queue_position + 1) * estimate->slot_time;
+}
+
+/**
+ * @brief Check whether a job can no longer finish before its deadline
+ *
+ * @param estimate Pointer to QUEUE_ESTIMATE of the job
+ * @param status Status returned by the latest poll
+ * @param queue_position Reported queue position, or -1 if unknown
+ * @param deadline Monotonic deadline in seconds, or 0 for none
+ * @return true if the deadline has passed or the estimate exceeds it
+ */
+bool misses_deadline(QUEUE_ESTIMATE* estimate, JOB_STATUS status, int queue_position, double deadline) {
+    if (deadline <= 0.0) return false;
+
+    double now = get_monotonic_time();
+
+    return now >= deadline || estimate_completion_time(estimate, status, queue_position, now) > deadline;
+}
+
+/**
+ * @brief Longest queue a job submitted now can wait through in time
+ *
+ * @param deadline Monotonic deadline in seconds
+ * @return Number of jobs that may be ahead of the job, or -1 if not even
+ *         an empty queue leaves enough time
+ */
+int deadline_queue_length(double deadline) {
+    return (int)((deadline - get_monotonic_time()) / QUEUE_SLOT_TIME) - 1;
+}
+
+/**
+ * @brief Parse the status of a job from the job details JSON
+ *
+ * Reads state.status and falls back to the top-level status field.
+ *
+ * @param response JSON response string from the job details endpoint
+ * @return Parsed JOB_STATUS, or STATUS_UNKNOWN on failure
+ */
+JOB_STATUS parse_job_status(char* response) {
+    JOB_STATUS status = STATUS_UNKNOWN;
+
+    cJSON* job_cjson = cJSON_Parse(response);
+    if (!job_cjson) {
+        fprintf(stderr, "ERROR - Parsing job details JSON failed in parse_job_status()!\n");
+        goto terminate;
     }
 
-    char* url = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!url) {
-        fprintf(stderr, "ERROR - Allocating memory for URL failed in get_job_result()!\n");
-        goto cleanup_rb;
+    cJSON* state_cjson = cJSON_GetObjectItemCaseSensitive(job_cjson, "state");
+    cJSON* status_cjson = cJSON_GetObjectItemCaseSensitive(state_cjson, "status");
+    if (!cJSON_IsString(status_cjson)) status_cjson = cJSON_GetObjectItemCaseSensitive(job_cjson, "status");
+    if (!cJSON_IsString(status_cjson) || !status_cjson->valuestring) {
+        fprintf(stderr, "ERROR - No job status found in parse_job_status()!\n");
+        goto cleanup_job_cjson;
     }
 
-    char* token_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!token_header) {
-        fprintf(stderr, "ERROR - Allocating memory for token header failed in get_job_result()!\n");
-        goto cleanup_url;
+    char* status_string = status_cjson->valuestring;
+    if (strcasecmp(status_string, "Queued") == 0) status = STATUS_QUEUED;
+    else if (strcasecmp(status_string, "Running") == 0) status = STATUS_RUNNING;
+    else if (strcasecmp(status_string, "Completed") == 0) status = STATUS_COMPLETED;
+    else if (strcasecmp(status_string, "Failed") == 0) status = STATUS_FAILED;
+    else if (strncasecmp(status_string, "Cancelled", 9) == 0) status = STATUS_CANCELLED;
+    else fprintf(stderr, "ERROR - Unknown job status %s in parse_job_status()!\n", status_string);
+
+    if (status == STATUS_FAILED || status == STATUS_CANCELLED) {
+        cJSON* reason_cjson = cJSON_GetObjectItemCaseSensitive(state_cjson, "reason");
+        if (cJSON_IsString(reason_cjson) && reason_cjson->valuestring) {
+            fprintf(stderr, "ERROR - Job %s: %s\n", status_string, reason_cjson->valuestring);
+        }
     }
 
-    char* crn_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!crn_header) {
-        fprintf(stderr, "ERROR - Allocating memory for CRN header failed in get_job_result()!\n");
-        goto cleanup_token_header;
+cleanup_job_cjson:
+    cJSON_Delete(job_cjson);
+
+terminate:
+    return status;
+}
+
+/**
+ * @brief Parse the queue position of a job from the job details JSON
+ *
+ * @param response JSON response string from the job details endpoint
+ * @return Number of jobs ahead of the job from queue_info.position, or -1
+ *         if the details do not report one
+ */
+int parse_queue_position(char* response) {
+    int queue_position = -1;
+
+    cJSON* job_cjson = cJSON_Parse(response);
+    if (!job_cjson) return -1;
+
+    cJSON* queue_info_cjson = cJSON_GetObjectItemCaseSensitive(job_cjson, "queue_info");
+    cJSON* position_cjson = cJSON_GetObjectItemCaseSensitive(queue_info_cjson, "position");
+    if (cJSON_IsNumber(position_cjson) && position_cjson->valueint >= 0) queue_position = position_cjson->valueint;
+
+    cJSON_Delete(job_cjson);
+
+    return queue_position;
+}
+
+/**
+ * @brief Query the lightweight job details endpoint for the job status
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the request
+ * @param job_id Job identifier to query
+ * @param queue_position Output pointer receiving the queue position, or -1
+ *        if unknown (may be NULL)
+ * @return Current JOB_STATUS, or STATUS_UNKNOWN on failure
+ */
+JOB_STATUS get_job_status(CONNECTION_POOL* pool, char* job_id, int* queue_position) {
+    JOB_STATUS status = STATUS_UNKNOWN;
+    if (queue_position) *queue_position = -1;
+
+    CURL* curl = acquire_handle(pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in get_job_status()!\n");
+        goto terminate;
     }
 
-    snprintf(url, BUFFER_NMEMB, "https://quantum.cloud.ibm.com/api/v1/jobs/%s/results", job_id);
-    snprintf(token_header, BUFFER_NMEMB, "Authorization: Bearer %s", token);
-    snprintf(crn_header, BUFFER_NMEMB, "Service-CRN: %s", crn);
+    RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
+    if (!rb.data) {
+        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in get_job_status()!\n");
+        goto cleanup_curl;
+    }
 
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Accept: application/json");
-    headers = curl_slist_append(headers, token_header);
-    headers = curl_slist_append(headers, crn_header);
-    headers = curl_slist_append(headers, "IBM-API-Version: 2026-02-01");
+    struct curl_slist* headers = get_api_headers(pool, false);
     if (!headers) {
-        fprintf(stderr, "ERROR - Header construction failed in get_job_result()!\n");
-        goto cleanup_crn_header;
+        fprintf(stderr, "ERROR - Header construction failed in get_job_status()!\n");
+        goto cleanup_rb;
     }
 
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/jobs/%s", pool->api_url, job_id);
+
     curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT_NAME);
 
-    while (true) {
-        CURLcode response_code = curl_easy_perform(curl);
-        long http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-        if (http_code == 400 && check_code(rb.data)) {
-            rb.data = (char*)realloc(rb.data, 1*sizeof(char));
-            rb.size = 0;
-            sleep(REFRESH_TIME);
-            continue;
-        }
-
-        if (response_code != CURLE_OK || http_code >= 400) {
-            fprintf(stderr, "ERROR - Getting job result failed in get_job_result()!\n");
-            fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
-            fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
-            goto cleanup_headers;
-        }
-        
-        break;
+    long http_code = 0;
+    CURLcode response_code = perform_request(pool, curl, PHASE_POLL, false, &rb, &http_code);
+    if (response_code != CURLE_OK || http_code >= 400) {
+        fprintf(stderr, "ERROR - Getting job status failed in get_job_status()!\n");
+        fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+        fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        goto cleanup_rb;
     }
 
-    job_result = strdup(rb.data);
-
-cleanup_headers:
-    curl_slist_free_all(headers);
-
-cleanup_crn_header:
-    free(crn_header);
-
-cleanup_token_header:
-    free(token_header);
-
-cleanup_url:
-    free(url);
+    status = parse_job_status(rb.data);
+    if (queue_position && status == STATUS_QUEUED) *queue_position = parse_queue_position(rb.data);
 
 cleanup_rb:
     free(rb.data);
 
 cleanup_curl:
-    curl_easy_cleanup(curl);
-
-cleanup_token:
-    free(token);
+    release_handle(pool, curl);
 
 terminate:
-    return job_result;
+    return status;
 }
 
 /**
- * @brief Parse job result and return most frequent sample
- *
- * Navigates the result JSON to find results[0].data.meas.samples and returns
- * the most frequent sample string.
+ * @brief Ask the service to cancel a job
  *
- * @param result Job result JSON string
- * @return Duplicated sample string (CALLER MUST FREE) or NULL on failure
+ * @param pool Pointer to CONNECTION_POOL used for the request
+ * @param job_id Job identifier to cancel
+ * @return 0 on success, or -1 on failure
  */
-char* parse_job_result(char* result) {
-    char* result_sample = NULL;
+int cancel_job(CONNECTION_POOL* pool, char* job_id) {
+    int status = -1;
 
-    cJSON* result_cjson = cJSON_Parse(result);
-    if (!result_cjson) {
-        fprintf(stderr, "ERROR - Parsing result JSON failed in parse_job_result()!\n");
+    CURL* curl = acquire_handle(pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in cancel_job()!\n");
         goto terminate;
     }
 
-    // Navigate to results[0].data.meas.samples.
-
-    cJSON* results_array = cJSON_GetObjectItemCaseSensitive(result_cjson, "results");
-    if (!results_array || !results_array->child) {
-        fprintf(stderr, "ERROR - No results array found in parse_job_result()!\n");
-        goto cleanup_result_cjson;
-    }
-
-    cJSON* first_result = results_array->child;
-    cJSON* data = cJSON_GetObjectItemCaseSensitive(first_result, "data");
-    if (!data) {
-        fprintf(stderr, "ERROR - No data field in result in parse_job_result()!\n");
-        goto cleanup_result_cjson;
-    }
-
-    cJSON* meas = cJSON_GetObjectItemCaseSensitive(data, "meas");
-    if (!meas) {
-        fprintf(stderr, "ERROR - No meas field in data in parse_job_result()!\n");
-        goto cleanup_result_cjson;
+    RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
+    if (!rb.data) {
+        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in cancel_job()!\n");
+        goto cleanup_curl;
     }
 
-    cJSON* samples_array = cJSON_GetObjectItemCaseSensitive(meas, "samples");
-    if (!samples_array || !samples_array->child) {
-        fprintf(stderr, "ERROR - No samples array found in parse_job_result()!\n");
-        goto cleanup_result_cjson;
+    struct curl_slist* headers = get_api_headers(pool, false);
+    if (!headers) {
+        fprintf(stderr, "ERROR - Header construction failed in cancel_job()!\n");
+        goto cleanup_rb;
     }
 
-    // Count frequencies of each sample.
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/jobs/%s/cancel", pool->api_url, job_id);
 
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)0);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
 
-    int max_unique_samples = 1 << 4; // This depends on the number of qubits of the circuit.
-    SAMPLE_COUNT* sample_counts = (SAMPLE_COUNT*)calloc(max_unique_samples, sizeof(SAMPLE_COUNT));
-    int unique_count = 0;
+    long http_code = 0;
+    CURLcode response_code = perform_request(pool, curl, PHASE_COUNT, false, &rb, &http_code);
+    if (response_code != CURLE_OK || http_code >= 400) {
+        fprintf(stderr, "ERROR - Cancelling job %s failed in cancel_job()!\n", job_id);
+        fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+        fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        if (rb.data && rb.size > 0) fprintf(stderr, "ERROR - Response Body: %s\n", rb.data);
+        goto cleanup_rb;
+    }
 
-    // Collect all unique samples and count.
+    status = 0;
 
-    for (cJSON* sample_item = samples_array->child; sample_item; sample_item = sample_item->next) {
-        if (!cJSON_IsString(sample_item)) continue;
+cleanup_rb:
+    free(rb.data);
 
-        const char* sample_str = sample_item->valuestring;
-        
-        // Find or add this sample to our tracking array.
+cleanup_curl:
+    release_handle(pool, curl);
 
-        int found_index = -1;
-        for (int i = 0; i < unique_count; i++) {
-            if (strcmp(sample_counts[i].sample, sample_str) == 0) {
-                found_index = i;
-                break;
-            }
-        }
+terminate:
+    return status;
+}
 
-        if (found_index >= 0) {
-            sample_counts[found_index].count++;
-        } else {
-            if (unique_count >= max_unique_samples) {
-                fprintf(stderr, "ERROR - Too many unique samples in parse_job_result()!\n");
-                goto cleanup_sample_counts;
-            }
-            sample_counts[unique_count].sample = strdup(sample_str);
-            sample_counts[unique_count].count = 1;
-            unique_count++;
-        }
+/**
+ * @brief Create a result decoder sized for the circuits of a job
+ *
+ * A circuit swept over parameter bindings gets one result per binding.
+ *
+ * @param circuits Array of circuits submitted as the pubs of the job
+ * @param circuit_count Number of circuits
+ * @param keep_samples Whether every shot is also recorded in order
+ * @return Pointer to newly allocated RESULT_DECODER (CALLER MUST DESTROY),
+ *         or NULL on failure
+ */
+RESULT_DECODER* create_job_decoder(CIRCUIT* circuits, int circuit_count, bool keep_samples) {
+    RESULT_DECODER* decoder = NULL;
+
+    int slot_count = count_result_slots(circuits, circuit_count);
+    int* measured_bits = (int*)calloc(slot_count, sizeof(int));
+    int* bindings = (int*)calloc(circuit_count, sizeof(int));
+    if (!measured_bits || !bindings) {
+        fprintf(stderr, "ERROR - Allocating memory for register widths failed in create_job_decoder()!\n");
+        goto cleanup_arrays;
     }
 
-    // Find the sample with highest frequency.
+    bool swept = false;
+    int slot = 0;
+    for (int i = 0; i < circuit_count; i++) {
+        bindings[i] = circuits[i].binding_count;
+        if (bindings[i] > 0) swept = true;
 
-    int max_count = 0;
-    char* most_frequent = NULL;
-    for (int i = 0; i < unique_count; i++) {
-        if (sample_counts[i].count > max_count) {
-            most_frequent = sample_counts[i].sample;
-            max_count = sample_counts[i].count;
+        for (int j = 0; j < (bindings[i] > 0 ? bindings[i] : 1); j++) {
+            measured_bits[slot++] = circuits[i].measured_bits;
         }
     }
 
-    result_sample = strdup(most_frequent);
-
-cleanup_sample_counts:
-    for (int i = 0; i < unique_count; i++) {
-        free(sample_counts[i].sample);
+    decoder = create_result_decoder(slot_count, measured_bits, keep_samples);
+    if (decoder && swept && set_pub_bindings(decoder, bindings, circuit_count) < 0) {
+        fprintf(stderr, "ERROR - Setting the pub bindings failed in create_job_decoder()!\n");
+        destroy_result_decoder(decoder);
+        decoder = NULL;
     }
-    free(sample_counts);
 
-cleanup_result_cjson:
-    cJSON_Delete(result_cjson);
+cleanup_arrays:
+    free(measured_bits);
+    free(bindings);
 
-terminate:
-    return result_sample;
+    return decoder;
 }
 
 /**
- * @brief Convert hex sample to binary string
+ * @brief Wait for a job to finish and decode its result
  *
- * Parses a hexadecimal sample string (e.g., "0x...") and returns a
- * newly allocated binary string representation.
+ * Polls the job status endpoint with adaptive backoff until the job has
+ * finished, then downloads the results once. The body is decoded while it
+ * arrives, so the samples are counted without buffering the whole result.
+ * A queued answer (code 1234) from the results endpoint is still handled
+ * in case the results become visible after the status, and polled for
+ * again for up to POLL_PENDING_TIMEOUT and no later than the deadline.
  *
- * @param sample Hex sample string to convert
- * @return Duplicated binary string (CALLER MUST FREE) or NULL on failure
+ * With a deadline, the job is cancelled as soon as its estimated completion
+ * time lies beyond the deadline, and no poll sleeps past the deadline.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the requests
+ * @param job_id Job identifier to query
+ * @param circuits Array of circuits submitted as the pubs of the job
+ * @param circuit_count Number of circuits
+ * @param keep_samples Whether every shot is also recorded in order
+ * @param deadline Monotonic deadline in seconds, or 0 for none
+ * @param cancelled Output pointer set to true if the job was cancelled for
+ *        missing the deadline (may be NULL)
+ * @return Pointer to RESULT_DECODER holding the sample counts
+ *         (CALLER MUST DESTROY), or NULL on error
  */
-char* convert_job_result(char* sample) {
-    char* binary_str = NULL;
+RESULT_DECODER* get_job_result(CONNECTION_POOL* pool, char* job_id, CIRCUIT* circuits, int circuit_count, bool keep_samples, double deadline, bool* cancelled) {
+    RESULT_DECODER* job_result = NULL;
+    if (cancelled) *cancelled = false;
+
+    POLL_STATE poll_state;
+    initialize_poll_state(&poll_state);
+    QUEUE_ESTIMATE estimate;
+    initialize_queue_estimate(&estimate);
+
+    double start_time = get_monotonic_time();
+    int queue_position = -1;
+    JOB_STATUS status = get_job_status(pool, job_id, &queue_position);
+    while (status == STATUS_QUEUED || status == STATUS_RUNNING) {
+        if (misses_deadline(&estimate, status, queue_position, deadline)) {
+            fprintf(stderr, "ERROR - The job %s cannot finish before the deadline in get_job_result()!\n", job_id);
+            cancel_job(pool, job_id);
+            if (cancelled) *cancelled = true;
+            goto terminate;
+        }
 
-    // Parse the hexadecimal value.
+        double delay = next_poll_delay(&poll_state, status);
+        if (deadline > 0.0 && get_monotonic_time() + delay > deadline) delay = deadline - get_monotonic_time();
+        sleep_seconds(delay);
+        status = get_job_status(pool, job_id, &queue_position);
+    }
+    record_phase(pool->metrics, PHASE_QUEUE, get_monotonic_time() - start_time);
 
-    unsigned long hex_value = 0;
-    if (sscanf(sample, "0x%lx", &hex_value) != 1) {
-        fprintf(stderr, "ERROR - Failed to parse hex sample: %s in convert_job_result()!\n", sample);
-        return NULL;
+    if (status != STATUS_COMPLETED) {
+        fprintf(stderr, "ERROR - The job %s did not complete in get_job_result()!\n", job_id);
+        goto terminate;
     }
 
-    // Determine number of bits.
+    CURL* curl = acquire_handle(pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in get_job_result()!\n");
+        goto terminate;
+    }
 
-    int num_bits = 0;
-    unsigned long temp = hex_value;
-    while (temp > 0) {
-        num_bits++;
-        temp >>= 1;
+    RESULT_DECODER* decoder = create_job_decoder(circuits, circuit_count, keep_samples);
+    if (!decoder) {
+        fprintf(stderr, "ERROR - Creating the result decoder failed in get_job_result()!\n");
+        goto cleanup_curl;
     }
-    
-    if (num_bits == 0) {
-        num_bits = 1;
+
+    char* url = (char*)calloc(BUFFER_NMEMB, sizeof(char));
+    if (!url) {
+        fprintf(stderr, "ERROR - Allocating memory for URL failed in get_job_result()!\n");
+        goto cleanup_decoder;
     }
 
-    // Allocate binary string.
+    snprintf(url, BUFFER_NMEMB, "%s/jobs/%s/results", pool->api_url, job_id);
 
-    binary_str = (char*)calloc(num_bits+1, sizeof(char));
-    if (!binary_str) {
-        fprintf(stderr, "ERROR - Memory allocation failed for binary string in convert_job_result()!\n");
-        goto terminate;
-    }
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, decoder_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, decoder);
+
+    int attempt = 0;
+    double pending_time = 0.0;
+    while (true) {
+        // The headers are looked up on every attempt since the token may rotate in between.
+
+        struct curl_slist* headers = get_api_headers(pool, false);
+        if (!headers) {
+            fprintf(stderr, "ERROR - Header construction failed in get_job_result()!\n");
+            goto cleanup_url;
+        }
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+
+        wait_for_request_slot(pool);
+        CURLcode response_code = curl_easy_perform(curl);
+        double transfer_time = record_response(pool->metrics, curl, response_code);
+        long http_code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 
-    // Convert to binary (most significant bit first).
+        // A result that is not available yet counts as one more status poll.
 
-    for (int i = num_bits-1; i >= 0; i--) {
-        binary_str[num_bits-1-i] = ((hex_value >> i) & 1) ? '1' : '0';
+        if (http_code == 400 && check_code(decoder->prefix)) {
+            record_phase(pool->metrics, PHASE_POLL, transfer_time);
+
+            double now = get_monotonic_time();
+            if (pending_time == 0.0) pending_time = now;
+            double limit = pending_time + POLL_PENDING_TIMEOUT;
+            if (deadline > 0.0 && deadline < limit) limit = deadline;
+            if (now >= limit) {
+                fprintf(stderr, "ERROR - The result of job %s did not become available in get_job_result()!\n", job_id);
+                goto cleanup_url;
+            }
+
+            double delay = next_poll_delay(&poll_state, STATUS_RUNNING);
+            if (now + delay > limit) delay = limit - now;
+
+            record_retry(pool->metrics);
+            reset_result_decoder(decoder);
+            sleep_seconds(delay);
+            continue;
+        }
+
+        if (is_transient_failure(response_code, http_code) && attempt+1 < pool->max_attempts) {
+            record_failure_retry(pool->metrics);
+            reset_result_decoder(decoder);
+            sleep_seconds(get_retry_delay(pool, curl, http_code, attempt++));
+            continue;
+        }
+
+        if (response_code != CURLE_OK || http_code >= 400) {
+            fprintf(stderr, "ERROR - Getting job result failed in get_job_result()!\n");
+            fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+            fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+            fprintf(stderr, "ERROR - Response: %s\n", decoder->prefix);
+            goto cleanup_url;
+        }
+
+        record_phase(pool->metrics, PHASE_DOWNLOAD, transfer_time - decoder->parse_time);
+        break;
+    }
+
+    start_time = get_monotonic_time();
+    int finish_status = finish_result_decoder(decoder);
+    record_phase(pool->metrics, PHASE_PARSE, decoder->parse_time + get_monotonic_time() - start_time);
+    if (finish_status < 0) {
+        fprintf(stderr, "ERROR - Decoding the job result failed in get_job_result()!\n");
+        goto cleanup_url;
     }
-    binary_str[num_bits] = '\0';
+
+    job_result = decoder;
+    decoder = NULL;
+
+cleanup_url:
+    free(url);
+
+cleanup_decoder:
+    destroy_result_decoder(decoder);
+
+cleanup_curl:
+    release_handle(pool, curl);
 
 terminate:
-    return binary_str;
+    return job_result;
 }
 
-
 /**
- * @brief Retrieve job result and return most frequent sample as bit string
+ * @brief Retrieve the full result of a job
  *
- * Retrieves the job result from the backend, extracts the most frequent
- * sample, and converts it into a binary string.
+ * Retrieves the job result from the backend and counts the samples of
+ * each pub while decoding. The counts are kept in full so that any output
+ * mode can be produced from them.
  *
- * @param token_data Pointer to TOKEN_DATA used for authentication
- * @param crn Service CRN string
+ * @param pool Pointer to CONNECTION_POOL used for the requests
  * @param job_id Job identifier to query
- * @return Duplicated bit string (CALLER MUST FREE) or NULL on failure
+ * @param circuits Array of circuits submitted as the pubs of the job
+ * @param circuit_count Number of circuits
+ * @param keep_samples Whether every shot is also recorded in order
+ * @param deadline Monotonic deadline in seconds, or 0 for none
+ * @param cancelled Output pointer set to true if the job was cancelled for
+ *        missing the deadline (may be NULL)
+ * @return Pointer to RESULT_DECODER holding the result (CALLER MUST
+ *         DESTROY), or NULL on failure
  */
-char* receiver(TOKEN_DATA* token_data, char* crn, char* job_id) {
-    char* binary_string = NULL;
-
-    char* response = get_job_result(token_data, crn, job_id);
-    if (!response) {
+RESULT_DECODER* receiver(CONNECTION_POOL* pool, char* job_id, CIRCUIT* circuits, int circuit_count, bool keep_samples, double deadline, bool* cancelled) {
+    RESULT_DECODER* decoder = get_job_result(pool, job_id, circuits, circuit_count, keep_samples, deadline, cancelled);
+    if (!decoder) {
         fprintf(stderr, "ERROR - Getting the job result from the backend failed in receiver()!\n");
-        goto terminate;
-    }
-
-    char* sample = parse_job_result(response);
-    if (!sample) {
-        fprintf(stderr, "ERROR - Result parsing failed in receiver()!\n");
-        goto cleanup_response;
-    }
-
-    binary_string = convert_job_result(sample);
-    if (!binary_string) {
-        fprintf(stderr, "ERROR - Result bit string conversion failed in receiver()!\n");
-        goto cleanup_sample;
     }
 
-cleanup_sample:
-    free(sample);
-
-cleanup_response:
-    free(response);
-
-terminate:
-    return binary_string;
+    return decoder;
 }
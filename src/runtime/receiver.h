@@ -1,18 +1,50 @@
 #ifndef _RECEIVER_H_
 #define _RECEIVER_H_
 
-#define REFRESH_TIME 10
+#define POLL_QUEUED_TIME 1.0
+#define POLL_RUNNING_TIME 0.25
+#define POLL_RUNNING_MAX_TIME 2.0
+#define POLL_MAX_TIME 30.0
+#define POLL_BACKOFF_FACTOR 1.6
+#define POLL_JITTER 0.2
+#define POLL_PENDING_TIMEOUT 60.0
+#define QUEUE_SLOT_TIME 5.0
 
-typedef struct SampleCount {
-    char* sample;
-    int count;
-} SAMPLE_COUNT;
+typedef enum JobStatus {
+    STATUS_UNKNOWN,
+    STATUS_QUEUED,
+    STATUS_RUNNING,
+    STATUS_COMPLETED,
+    STATUS_FAILED,
+    STATUS_CANCELLED
+} JOB_STATUS;
+
+typedef struct PollState {
+    JOB_STATUS last_status;
+    double interval;
+    unsigned int seed;
+} POLL_STATE;
+
+typedef struct QueueEstimate {
+    int first_position;
+    double first_time;
+    double slot_time;
+} QUEUE_ESTIMATE;
 
 bool check_code(char* response);
-char* get_job_result(TOKEN_DATA* token_data, char* crn, char* job_id);
-char* parse_job_result(char* response);
-char* convert_job_result(char* sample);
+void initialize_poll_state(POLL_STATE* poll_state);
+double next_poll_delay(POLL_STATE* poll_state, JOB_STATUS status);
+void initialize_queue_estimate(QUEUE_ESTIMATE* estimate);
+double estimate_completion_time(QUEUE_ESTIMATE* estimate, JOB_STATUS status, int queue_position, double now);
+bool misses_deadline(QUEUE_ESTIMATE* estimate, JOB_STATUS status, int queue_position, double deadline);
+int deadline_queue_length(double deadline);
+JOB_STATUS parse_job_status(char* response);
+int parse_queue_position(char* response);
+JOB_STATUS get_job_status(CONNECTION_POOL* pool, char* job_id, int* queue_position);
+int cancel_job(CONNECTION_POOL* pool, char* job_id);
+RESULT_DECODER* create_job_decoder(CIRCUIT* circuits, int circuit_count, bool keep_samples);
+RESULT_DECODER* get_job_result(CONNECTION_POOL* pool, char* job_id, CIRCUIT* circuits, int circuit_count, bool keep_samples, double deadline, bool* cancelled);
 
-char* receiver(TOKEN_DATA* token_data, char* crn, char* job_id);
+RESULT_DECODER* receiver(CONNECTION_POOL* pool, char* job_id, CIRCUIT* circuits, int circuit_count, bool keep_samples, double deadline, bool* cancelled);
 
 #endif
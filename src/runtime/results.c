@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "cache.h"
+#include "backends.h"
+#include "sender.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "decoder.h"
+#include "results.h"
+
+
+/**
+ * @brief Parse the name of a result cache policy
+ *
+ * @param name Policy name (read, refresh or off)
+ * @param policy Output pointer receiving the policy
+ * @return 0 on success, or -1 if the name is unknown
+ */
+int parse_result_cache_policy(char* name, RESULT_CACHE_POLICY* policy) {
+    if (strcmp(name, "read") == 0) *policy = RESULT_CACHE_READ;
+    else if (strcmp(name, "refresh") == 0) *policy = RESULT_CACHE_REFRESH;
+    else if (strcmp(name, "off") == 0) *policy = RESULT_CACHE_OFF;
+    else return -1;
+
+    return 0;
+}
+
+
+/**
+ * @brief Check whether a character belongs to an identifier or number
+ *
+ * @param ch Character to check
+ * @return true for letters, digits, underscores, dots and dollar signs
+ */
+static bool is_word_char(char ch) {
+    return isalnum((unsigned char)ch) || ch == '_' || ch == '.' || ch == '$';
+}
+
+/**
+ * @brief Normalize OpenQASM source code for hashing
+ *
+ * Removes comments and all whitespace that does not separate two words, so
+ * that reformatting or commenting a circuit does not change its key.
+ *
+ * @param qasm OpenQASM source code
+ * @return Newly allocated normalized code (CALLER MUST FREE), or NULL on failure
+ */
+char* normalize_qasm(char* qasm) {
+    char* normalized = (char*)malloc(strlen(qasm)+1);
+    if (!normalized) {
+        fprintf(stderr, "ERROR - Allocating memory for normalized QASM failed in normalize_qasm()!\n");
+        return NULL;
+    }
+
+    char* out = normalized;
+    bool pending_space = false;
+
+    for (char* ch = qasm; *ch; ch++) {
+        if (strncmp(ch, "//", 2) == 0) {
+            ch += strcspn(ch, "\n");
+            if (!*ch) break;
+        } else if (strncmp(ch, "/*", 2) == 0) {
+            char* end = strstr(ch+2, "*/");
+            if (!end) break;
+            ch = end+1;
+            pending_space = true;
+            continue;
+        }
+
+        if (isspace((unsigned char)*ch)) {
+            pending_space = true;
+            continue;
+        }
+
+        if (pending_space && out > normalized && is_word_char(out[-1]) && is_word_char(*ch)) *out++ = ' ';
+        pending_space = false;
+        *out++ = *ch;
+    }
+    *out = '\0';
+
+    return normalized;
+}
+
+/**
+ * @brief Compute the result cache key of a job
+ *
+ * The key hashes the payload the job would be submitted with, built from
+ * the normalized circuits, together with the API URL. It therefore covers
+ * the circuits, the backend and every submission option.
+ *
+ * @param pool Pointer to CONNECTION_POOL holding the API URL
+ * @param backend Backend the job runs on
+ * @param circuits Array of circuits of the job
+ * @param circuit_count Number of circuits
+ * @return Newly allocated key (CALLER MUST FREE), or NULL on failure
+ */
+char* get_result_key(CONNECTION_POOL* pool, char* backend, CIRCUIT* circuits, int circuit_count) {
+    char* key = NULL;
+
+    CIRCUIT* normalized = (CIRCUIT*)calloc(circuit_count, sizeof(CIRCUIT));
+    if (!normalized) {
+        fprintf(stderr, "ERROR - Allocating memory for normalized circuits failed in get_result_key()!\n");
+        goto terminate;
+    }
+
+    for (int i = 0; i < circuit_count; i++) {
+        normalized[i] = circuits[i];
+        normalized[i].qasm = normalize_qasm(circuits[i].qasm);
+        if (!normalized[i].qasm) {
+            fprintf(stderr, "ERROR - Normalizing circuit %d failed in get_result_key()!\n", i);
+            goto cleanup_normalized;
+        }
+    }
+
+    char* payload = build_payload(backend, NULL, normalized, circuit_count);
+    if (!payload) {
+        fprintf(stderr, "ERROR - Building the payload failed in get_result_key()!\n");
+        goto cleanup_normalized;
+    }
+
+    key = (char*)calloc(RESULT_CACHE_NMEMB, sizeof(char));
+    if (key) snprintf(key, RESULT_CACHE_NMEMB, "%016llx", hash_append(hash_string(pool->api_url), payload));
+    else fprintf(stderr, "ERROR - Allocating memory for result key failed in get_result_key()!\n");
+
+    free(payload);
+
+cleanup_normalized:
+    for (int i = 0; i < circuit_count; i++) {
+        free(normalized[i].qasm);
+    }
+    free(normalized);
+
+terminate:
+    return key;
+}
+
+/**
+ * @brief Resolve the cache file of a result key
+ *
+ * @param key Result cache key
+ * @return Newly allocated path (CALLER MUST FREE), or NULL if no cache
+ *         directory is available
+ */
+static char* get_result_path(char* key) {
+    char name[RESULT_CACHE_NMEMB];
+    snprintf(name, RESULT_CACHE_NMEMB, "result-%s.bin", key);
+
+    return get_cache_path(name);
+}
+
+
+/**
+ * @brief Load a cached job result
+ *
+ * The cache file holds the packed counts of every pub, so the returned
+ * decoder has histograms but no per-shot samples.
+ *
+ * @param key Result cache key
+ * @param circuit_count Number of results the job must have, one per binding
+ *        of a swept circuit
+ * @param job_id Output pointer receiving the id of the job that produced the
+ *        result (CALLER MUST FREE)
+ * @return Pointer to RESULT_DECODER holding the counts (CALLER MUST DESTROY),
+ *         or NULL if no valid result is cached
+ */
+RESULT_DECODER* load_cached_result(char* key, int circuit_count, char** job_id) {
+    RESULT_DECODER* decoder = NULL;
+
+    char* path = get_result_path(key);
+    if (!path) goto terminate;
+
+    size_t size = 0;
+    char* data = read_cache_bytes(path, &size);
+    if (!data) goto cleanup_path;
+
+    RESULT_CACHE_HEADER* header = (RESULT_CACHE_HEADER*)data;
+    if (size < sizeof(RESULT_CACHE_HEADER) || memcmp(header->magic, RESULT_CACHE_MAGIC, 8) != 0 ||
+        header->version != RESULT_CACHE_VERSION || header->pub_count != (uint32_t)circuit_count) {
+        fprintf(stderr, "ERROR - Ignoring the invalid result cache file %s in load_cached_result()!\n", path);
+        goto cleanup_data;
+    }
+
+    decoder = create_result_decoder(circuit_count, NULL, false);
+    if (!decoder) {
+        fprintf(stderr, "ERROR - Creating the result decoder failed in load_cached_result()!\n");
+        goto cleanup_data;
+    }
+
+    size_t offset = sizeof(RESULT_CACHE_HEADER);
+    for (int i = 0; i < circuit_count; i++) {
+        RESULT_CACHE_PUB pub_header;
+        if (size - offset < sizeof(RESULT_CACHE_PUB)) goto invalid_data;
+        memcpy(&pub_header, data+offset, sizeof(RESULT_CACHE_PUB));
+        offset += sizeof(RESULT_CACHE_PUB);
+
+        size_t entry_size = pub_header.words*sizeof(BITSET_WORD) + sizeof(uint64_t);
+        if (pub_header.words == 0 || pub_header.words > DECODER_MAX_SAMPLE_BITS/BITSET_WORD_BITS ||
+            pub_header.unique_count > (size - offset) / entry_size) goto invalid_data;
+
+        PUB_COUNTS* pub = &decoder->pubs[i];
+        memcpy(pub->register_name, pub_header.register_name, DECODER_KEY_NMEMB);
+        pub->register_name[DECODER_KEY_NMEMB-1] = '\0';
+        pub->num_bits = (int)pub_header.num_bits;
+        if (widen_histogram(&pub->histogram, (int)pub_header.words) < 0) goto invalid_data;
+
+        for (uint64_t j = 0; j < pub_header.unique_count; j++) {
+            BITSET_WORD sample[pub_header.words];
+            uint64_t count = 0;
+            memcpy(sample, data+offset, pub_header.words*sizeof(BITSET_WORD));
+            memcpy(&count, data+offset+pub_header.words*sizeof(BITSET_WORD), sizeof(uint64_t));
+            offset += entry_size;
+
+            if (count == 0 || add_count_to_histogram(&pub->histogram, sample, (long)count) < 0) goto invalid_data;
+        }
+    }
+
+    decoder->result_count = circuit_count;
+    decoder->state = DECODER_DONE;
+
+    *job_id = strndup(header->job_id, RESULT_CACHE_NMEMB-1);
+    if (!*job_id) {
+        fprintf(stderr, "ERROR - Copying the job ID failed in load_cached_result()!\n");
+        destroy_result_decoder(decoder);
+        decoder = NULL;
+    }
+
+    goto cleanup_data;
+
+invalid_data:
+    fprintf(stderr, "ERROR - Ignoring the corrupt result cache file %s in load_cached_result()!\n", path);
+    destroy_result_decoder(decoder);
+    decoder = NULL;
+
+cleanup_data:
+    free(data);
+
+cleanup_path:
+    free(path);
+
+terminate:
+    return decoder;
+}
+
+/**
+ * @brief Store a job result in the result cache
+ *
+ * Writes the packed counts of every pub together with the job id and the
+ * backend the job ran on.
+ *
+ * @param key Result cache key
+ * @param backend Backend the job ran on
+ * @param job_id Id of the job that produced the result
+ * @param decoder Pointer to RESULT_DECODER holding the decoded result
+ * @return 0 on success, or -1 on failure
+ */
+int store_cached_result(char* key, char* backend, char* job_id, RESULT_DECODER* decoder) {
+    int status = -1;
+
+    char* path = get_result_path(key);
+    if (!path) goto terminate;
+
+    size_t size = sizeof(RESULT_CACHE_HEADER);
+    for (int i = 0; i < decoder->pub_count; i++) {
+        HISTOGRAM* histogram = &decoder->pubs[i].histogram;
+        size += sizeof(RESULT_CACHE_PUB) + (size_t)histogram->unique_count*(histogram->words*sizeof(BITSET_WORD) + sizeof(uint64_t));
+    }
+
+    char* data = (char*)calloc(size, sizeof(char));
+    if (!data) {
+        fprintf(stderr, "ERROR - Allocating memory for the cached result failed in store_cached_result()!\n");
+        goto cleanup_path;
+    }
+
+    RESULT_CACHE_HEADER* header = (RESULT_CACHE_HEADER*)data;
+    memcpy(header->magic, RESULT_CACHE_MAGIC, 8);
+    header->version = RESULT_CACHE_VERSION;
+    header->pub_count = (uint32_t)decoder->pub_count;
+    header->created_at = (int64_t)time(NULL);
+    snprintf(header->job_id, RESULT_CACHE_NMEMB, "%s", job_id);
+    snprintf(header->backend, RESULT_CACHE_NMEMB, "%s", backend);
+
+    size_t offset = sizeof(RESULT_CACHE_HEADER);
+    for (int i = 0; i < decoder->pub_count; i++) {
+        PUB_COUNTS* pub = &decoder->pubs[i];
+        HISTOGRAM* histogram = &pub->histogram;
+
+        RESULT_CACHE_PUB pub_header;
+        memset(&pub_header, 0, sizeof(RESULT_CACHE_PUB));
+        memcpy(pub_header.register_name, pub->register_name, DECODER_KEY_NMEMB);
+        pub_header.num_bits = (uint32_t)pub->num_bits;
+        pub_header.words = (uint32_t)histogram->words;
+        pub_header.unique_count = (uint64_t)histogram->unique_count;
+        pub_header.shots = (uint64_t)histogram->shots;
+        memcpy(data+offset, &pub_header, sizeof(RESULT_CACHE_PUB));
+        offset += sizeof(RESULT_CACHE_PUB);
+
+        for (int slot = 0; slot < histogram->capacity; slot++) {
+            if (histogram->counts[slot] == 0) continue;
+
+            uint64_t count = (uint64_t)histogram->counts[slot];
+            memcpy(data+offset, &histogram->samples[(size_t)slot*histogram->words], histogram->words*sizeof(BITSET_WORD));
+            memcpy(data+offset+histogram->words*sizeof(BITSET_WORD), &count, sizeof(uint64_t));
+            offset += histogram->words*sizeof(BITSET_WORD) + sizeof(uint64_t);
+        }
+    }
+
+    status = write_cache_bytes(path, data, size);
+    if (status < 0) fprintf(stderr, "ERROR - Writing the result cache failed in store_cached_result()!\n");
+
+    free(data);
+
+cleanup_path:
+    free(path);
+
+terminate:
+    return status;
+}
@@ -0,0 +1,39 @@
+#ifndef _RESULTS_H_
+#define _RESULTS_H_
+
+#define RESULT_CACHE_MAGIC "QCRESULT"
+#define RESULT_CACHE_VERSION 1
+#define RESULT_CACHE_NMEMB 64
+
+typedef enum ResultCachePolicy {
+    RESULT_CACHE_OFF,
+    RESULT_CACHE_READ,
+    RESULT_CACHE_REFRESH
+} RESULT_CACHE_POLICY;
+
+typedef struct ResultCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pub_count;
+    int64_t created_at;
+    char job_id[RESULT_CACHE_NMEMB];
+    char backend[RESULT_CACHE_NMEMB];
+} RESULT_CACHE_HEADER;
+
+typedef struct ResultCachePub {
+    char register_name[DECODER_KEY_NMEMB];
+    uint32_t num_bits;
+    uint32_t words;
+    uint64_t unique_count;
+    uint64_t shots;
+} RESULT_CACHE_PUB;
+
+int parse_result_cache_policy(char* name, RESULT_CACHE_POLICY* policy);
+
+char* normalize_qasm(char* qasm);
+char* get_result_key(CONNECTION_POOL* pool, char* backend, CIRCUIT* circuits, int circuit_count);
+
+RESULT_DECODER* load_cached_result(char* key, int circuit_count, char** job_id);
+int store_cached_result(char* key, char* backend, char* job_id, RESULT_DECODER* decoder);
+
+#endif
@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "backends.h"
+#include "sender.h"
+#include "session.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "analysis.h"
+#include "decoder.h"
+#include "results.h"
+#include "receiver.h"
+#include "scheduler.h"
+#include "output.h"
+#include "options.h"
+#include "manifest.h"
+#include "runner.h"
+
+
+/**
+ * @brief Submit all circuits as one job and wait for its result
+ *
+ * With the read cache policy, the result of an identical earlier job is
+ * reused instead of submitting. Cached results hold counts only, so they
+ * are not reused when every shot is dumped.
+ *
+ * A job cancelled for missing the deadline is resubmitted once to the
+ * least loaded other backend when fallback is enabled.
+ *
+ * With a session, the job runs in it on the session backend; a fallback
+ * job runs outside of it.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the requests
+ * @param backend_cache Pointer to BACKEND_CACHE the backend is selected from
+ * @param session Pointer to SESSION to run the job in, or NULL
+ * @param circuits Array of circuits to submit
+ * @param circuit_count Number of circuits
+ * @param result_policy Result cache policy
+ * @param deadline Monotonic deadline in seconds, or 0 for none
+ * @param fallback Whether a job missing the deadline moves to another backend
+ * @param writer Pointer to RESULT_WRITER the result is written with
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int run_single_job(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, CIRCUIT* circuits, int circuit_count, RESULT_CACHE_POLICY result_policy, double deadline, bool fallback, RESULT_WRITER* writer) {
+    int termination_status = EXIT_FAILURE;
+
+    char* session_id = NULL;
+    char* backend = NULL;
+    if (session) {
+        session_id = enter_session(session, circuits, circuit_count, &backend);
+        if (!session_id) {
+            fprintf(stderr, "ERROR - Entering the session failed in run_single_job()!\n");
+            goto terminate;
+        }
+    } else {
+        backend = choose_backend(backend_cache, circuits, circuit_count);
+        if (!backend) {
+            fprintf(stderr, "ERROR - Choosing the backend failed in run_single_job()!\n");
+            goto terminate;
+        }
+    }
+
+    char* result_key = NULL;
+    if (result_policy != RESULT_CACHE_OFF) result_key = get_result_key(pool, backend, circuits, circuit_count);
+
+    // Reuse the result of an identical job if there is one.
+
+    char* job_id = NULL;
+    RESULT_DECODER* job_result = NULL;
+
+    if (result_key && result_policy == RESULT_CACHE_READ && !writer->dump_path) {
+        job_result = load_cached_result(result_key, count_result_slots(circuits, circuit_count), &job_id);
+        if (job_result) fprintf(writer->console, "Job ID: %s (cached)\n\n", job_id);
+    }
+
+    if (!job_result) {
+        // Send a job to a quantum backend.
+
+        job_id = sender(pool, backend, session_id, circuits, circuit_count);
+        if (!job_id) {
+            fprintf(stderr, "ERROR - Job submission failed in run_single_job()!\n");
+            goto cleanup_result_key;
+        }
+
+        if (session_id) fprintf(writer->console, "Job ID: %s (session %s on %s)\n\n", job_id, session_id, backend);
+        else fprintf(writer->console, "Job ID: %s\n\n", job_id);
+
+        // Receive the job result from the quantum backend.
+
+        bool cancelled = false;
+        job_result = receiver(pool, job_id, circuits, circuit_count, writer->dump_path != NULL, deadline, &cancelled);
+
+        if (!job_result && cancelled && fallback) {
+            int max_queue_length = deadline_queue_length(deadline);
+            char* fallback_backend = max_queue_length >= 0 ? choose_fallback_backend(backend_cache, circuits, circuit_count, backend, max_queue_length) : NULL;
+            if (!fallback_backend) {
+                fprintf(stderr, "ERROR - No backend can run the job before the deadline in run_single_job()!\n");
+                goto cleanup_job_id;
+            }
+
+            free(backend);
+            backend = fallback_backend;
+            if (result_key) {
+                free(result_key);
+                result_key = get_result_key(pool, backend, circuits, circuit_count);
+            }
+
+            free(job_id);
+            job_id = sender(pool, backend, NULL, circuits, circuit_count);
+            if (!job_id) {
+                fprintf(stderr, "ERROR - Job submission to the fallback backend failed in run_single_job()!\n");
+                goto cleanup_result_key;
+            }
+
+            fprintf(writer->console, "Job ID: %s (fallback to %s)\n\n", job_id, backend);
+
+            job_result = receiver(pool, job_id, circuits, circuit_count, writer->dump_path != NULL, deadline, NULL);
+        }
+
+        if (!job_result) {
+            fprintf(stderr, "ERROR - Job retrieval failed in run_single_job()!\n");
+            goto cleanup_job_id;
+        }
+
+        if (result_key) store_cached_result(result_key, backend, job_id, job_result);
+    }
+
+    fprintf(writer->console, "=== Final Result ===\n\n");
+    fflush(writer->console);
+
+    if (write_job_result(writer, job_id, circuits, job_result) < 0) {
+        fprintf(stderr, "ERROR - Writing the job result failed in run_single_job()!\n");
+        goto cleanup_job_result;
+    }
+
+    termination_status = EXIT_SUCCESS;
+
+cleanup_job_result:
+    destroy_result_decoder(job_result);
+
+cleanup_job_id:
+    free(job_id);
+
+cleanup_result_key:
+    free(result_key);
+    free(backend);
+    if (session_id) {
+        leave_session(session);
+        free(session_id);
+    }
+
+terminate:
+    return termination_status;
+}
+
+/**
+ * @brief Report one job of a concurrent run as soon as it finishes
+ *
+ * @param job Pointer to the finished SCHEDULED_JOB
+ * @param userp Pointer to RESULT_WRITER the result is written with
+ */
+static void report_job(SCHEDULED_JOB* job, void* userp) {
+    RESULT_WRITER* writer = userp;
+
+    if (job->state == JOB_COMPLETED) {
+        fprintf(writer->console, "=== Result of Job %s (%s) ===\n\n", job->job_id, job->circuits[0].name);
+        for (int i = 0; i < job->decoder->shard_count; i++) {
+            SHARD_ORIGIN* shard = &job->decoder->shards[i];
+            fprintf(writer->console, "Shard %d: Job %s on %s (%ld shots)\n", i, shard->job_id, shard->backend, shard->shots);
+        }
+        if (job->decoder->shard_count > 0) fprintf(writer->console, "\n");
+        fflush(writer->console);
+        if (write_job_result(writer, job->job_id, job->circuits, job->decoder) < 0) {
+            fprintf(stderr, "ERROR - Writing the result of job %s failed in report_job()!\n", job->job_id);
+        }
+        fprintf(writer->console, "\n");
+    } else {
+        fprintf(stderr, "ERROR - Job for %s failed in report_job()!\n", job->circuits[0].name);
+    }
+    fflush(writer->console);
+
+    return;
+}
+
+/**
+ * @brief Apply the run options to a scheduler
+ *
+ * @param scheduler Pointer to SCHEDULER to configure
+ * @param options Pointer to RUNTIME_OPTIONS selecting how the jobs run
+ * @param session Pointer to SESSION to run the jobs in, or NULL
+ * @param deadline Monotonic deadline in seconds, or 0 for none
+ */
+static void configure_scheduler(SCHEDULER* scheduler, RUNTIME_OPTIONS* options, SESSION* session, double deadline) {
+    scheduler->session = session;
+    scheduler->result_policy = options->result_cache;
+    scheduler->deadline = deadline;
+    scheduler->fallback = options->fallback;
+    scheduler->hedge_count = options->hedge_count;
+    scheduler->hedge_budget = options->hedge_budget;
+    scheduler->shard_count = options->shard_count;
+
+    return;
+}
+
+/**
+ * @brief Drive jobs concurrently on the scheduler
+ *
+ * Every circuit is submitted as its own job when concurrent jobs are
+ * requested; otherwise all circuits form one job, which the scheduler then
+ * only runs to hedge or shard it across backends.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the requests
+ * @param backend_cache Pointer to BACKEND_CACHE the backends are selected from
+ * @param session Pointer to SESSION to run the jobs in, or NULL
+ * @param circuits Array of circuits to run
+ * @param circuit_count Number of circuits
+ * @param options Pointer to RUNTIME_OPTIONS selecting how the circuits run
+ * @param deadline Monotonic deadline in seconds, or 0 for none
+ * @param writer Pointer to RESULT_WRITER the results are written with
+ * @return EXIT_SUCCESS if every job completed, EXIT_FAILURE otherwise
+ */
+static int run_concurrent_jobs(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options, double deadline, RESULT_WRITER* writer) {
+    int termination_status = EXIT_FAILURE;
+
+    SCHEDULER* scheduler = create_scheduler(pool, backend_cache, options->concurrent_jobs > 0 ? options->concurrent_jobs : 0, report_job, writer);
+    if (!scheduler) {
+        fprintf(stderr, "ERROR - Creating the scheduler failed in run_concurrent_jobs()!\n");
+        goto terminate;
+    }
+    configure_scheduler(scheduler, options, session, deadline);
+    scheduler->keep_samples = writer->dump_path != NULL;
+    writer->dump_per_job = true;
+
+    if (options->concurrent_jobs < 0) {
+        if (add_job(scheduler, circuits, circuit_count) < 0) {
+            fprintf(stderr, "ERROR - Adding the job failed in run_concurrent_jobs()!\n");
+            goto cleanup_scheduler;
+        }
+    }
+
+    for (int i = 0; options->concurrent_jobs >= 0 && i < circuit_count; i++) {
+        if (add_job(scheduler, &circuits[i], 1) < 0) {
+            fprintf(stderr, "ERROR - Adding the job for %s failed in run_concurrent_jobs()!\n", circuits[i].name);
+            goto cleanup_scheduler;
+        }
+    }
+
+    int failed_count = run_scheduler(scheduler);
+    if (failed_count != 0) {
+        fprintf(stderr, "ERROR - Not every job completed in run_concurrent_jobs()!\n");
+        goto cleanup_scheduler;
+    }
+
+    termination_status = EXIT_SUCCESS;
+
+cleanup_scheduler:
+    destroy_scheduler(scheduler);
+
+terminate:
+    return termination_status;
+}
+
+/**
+ * @brief Run circuits on quantum backends and write their results
+ *
+ * Batches the circuits into one job, or submits each as its own job when
+ * concurrent jobs are requested. Hedged and sharded jobs always run on the
+ * scheduler, which races their copies or merges their shards. Progress
+ * goes to the console stream of the writer and results to its output
+ * stream. The deadline of the options counts from this call.
+ *
+ * With a session, the jobs are submitted into it, except for hedged and
+ * sharded jobs, which need several backends.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the requests
+ * @param backend_cache Pointer to BACKEND_CACHE the backends are selected from
+ * @param session Pointer to SESSION to run the jobs in, or NULL
+ * @param circuits Array of circuits to run
+ * @param circuit_count Number of circuits
+ * @param options Pointer to RUNTIME_OPTIONS selecting how the circuits run
+ * @param writer Pointer to RESULT_WRITER the results are written with
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int run_circuits(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options, RESULT_WRITER* writer) {
+    double deadline = options->deadline > 0.0 ? get_monotonic_time() + options->deadline : 0.0;
+
+    if (options->hedge_count > 1 || options->shard_count > 1) session = NULL;
+
+    if (options->concurrent_jobs >= 0 || options->hedge_count > 1 || options->shard_count > 1) return run_concurrent_jobs(pool, backend_cache, session, circuits, circuit_count, options, deadline, writer);
+
+    return run_single_job(pool, backend_cache, session, circuits, circuit_count, options->result_cache, deadline, options->fallback, writer);
+}
+
+/**
+ * @brief Report one job of a manifest run to the output of its entry
+ *
+ * @param job Pointer to the finished SCHEDULED_JOB
+ * @param userp Pointer to MANIFEST the job belongs to
+ */
+static void report_manifest_job(SCHEDULED_JOB* job, void* userp) {
+    MANIFEST* manifest = userp;
+
+    // Jobs were added in manifest order, and copies and shards keep the group of their job.
+
+    MANIFEST_ENTRY* entry = &manifest->entries[job->group];
+    RESULT_WRITER* writer = entry->writer;
+    bool completed = job->state == JOB_COMPLETED;
+
+    if (completed) {
+        fprintf(writer->console, "=== Result of Job %s (%s) ===\n\n", job->job_id, job->circuits[0].name);
+        for (int i = 0; i < job->decoder->shard_count; i++) {
+            SHARD_ORIGIN* shard = &job->decoder->shards[i];
+            fprintf(writer->console, "Shard %d: Job %s on %s (%ld shots)\n", i, shard->job_id, shard->backend, shard->shots);
+        }
+        if (job->decoder->shard_count > 0) fprintf(writer->console, "\n");
+        fflush(writer->console);
+
+        writer->format = entry->output_format;
+        writer->top_k = entry->top_k;
+        writer->probabilities = entry->probabilities;
+        if (write_job_result(writer, job->job_id, job->circuits, job->decoder) < 0) {
+            fprintf(stderr, "ERROR - Writing the result of job %s failed in report_manifest_job()!\n", job->job_id);
+            completed = false;
+        }
+        fprintf(writer->console, "\n");
+    } else {
+        fprintf(stderr, "ERROR - Job for %s failed in report_manifest_job()!\n", job->circuits[0].name);
+    }
+    fflush(writer->console);
+
+    record_manifest_job(manifest, job->group, job->job_id, completed, job->queue_time);
+
+    return;
+}
+
+/**
+ * @brief Run the circuits of a manifest as a batch of concurrent jobs
+ *
+ * Every circuit is its own job, with up to max_in_flight of the manifest
+ * in flight at once, and its result goes to the output of its entry. A
+ * throughput summary closes the run.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the requests
+ * @param backend_cache Pointer to BACKEND_CACHE the backends are selected from
+ * @param session Pointer to SESSION to run the jobs in, or NULL
+ * @param manifest Pointer to MANIFEST listing the circuits
+ * @param options Pointer to RUNTIME_OPTIONS selecting how the jobs run
+ * @param writer Pointer to RESULT_WRITER of entries without an output file
+ * @return EXIT_SUCCESS if every job completed, EXIT_FAILURE otherwise
+ */
+int run_manifest(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, MANIFEST* manifest, RUNTIME_OPTIONS* options, RESULT_WRITER* writer) {
+    int termination_status = EXIT_FAILURE;
+
+    manifest->summary.start_time = get_monotonic_time();
+    double deadline = options->deadline > 0.0 ? manifest->summary.start_time + options->deadline : 0.0;
+
+    if (open_manifest_writers(manifest, writer) < 0) {
+        fprintf(stderr, "ERROR - Opening the outputs of the manifest failed in run_manifest()!\n");
+        goto terminate;
+    }
+
+    SCHEDULER* scheduler = create_scheduler(pool, backend_cache, manifest->max_in_flight, report_manifest_job, manifest);
+    if (!scheduler) {
+        fprintf(stderr, "ERROR - Creating the scheduler failed in run_manifest()!\n");
+        goto terminate;
+    }
+    configure_scheduler(scheduler, options, session, deadline);
+
+    for (int i = 0; i < manifest->entry_count; i++) {
+        if (add_job(scheduler, &manifest->circuits[i], 1) < 0) {
+            fprintf(stderr, "ERROR - Adding the job for %s failed in run_manifest()!\n", manifest->circuits[i].name);
+            goto cleanup_scheduler;
+        }
+    }
+
+    int failed_count = run_scheduler(scheduler);
+    manifest->summary.elapsed_time = get_monotonic_time() - manifest->summary.start_time;
+
+    if (failed_count < 0) {
+        fprintf(stderr, "ERROR - Running the manifest failed in run_manifest()!\n");
+        goto cleanup_scheduler;
+    }
+
+    if (write_batch_summary(manifest, writer->console) < 0) {
+        fprintf(stderr, "ERROR - Writing the batch summary failed in run_manifest()!\n");
+        goto cleanup_scheduler;
+    }
+
+    if (manifest->summary.failed_count > 0) {
+        fprintf(stderr, "ERROR - Not every job of the manifest completed in run_manifest()!\n");
+        goto cleanup_scheduler;
+    }
+
+    termination_status = EXIT_SUCCESS;
+
+cleanup_scheduler:
+    destroy_scheduler(scheduler);
+
+terminate:
+    return termination_status;
+}
@@ -0,0 +1,7 @@
+#ifndef _RUNNER_H_
+#define _RUNNER_H_
+
+int run_manifest(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, MANIFEST* manifest, RUNTIME_OPTIONS* options, RESULT_WRITER* writer);
+int run_circuits(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION* session, CIRCUIT* circuits, int circuit_count, RUNTIME_OPTIONS* options, RESULT_WRITER* writer);
+
+#endif
@@ -0,0 +1,1056 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "backends.h"
+#include "sender.h"
+#include "session.h"
+#include "bitset.h"
+#include "histogram.h"
+#include "decoder.h"
+#include "results.h"
+#include "receiver.h"
+#include "scheduler.h"
+
+
+/**
+ * @brief Create a scheduler driving many jobs on one cURL multi handle
+ *
+ * @param pool Pointer to CONNECTION_POOL providing handles and headers
+ * @param backend_cache Pointer to BACKEND_CACHE providing the backend list
+ * @param max_in_flight Maximum number of jobs submitted but not finished,
+ *        or 0 for no limit
+ * @param on_complete Callback invoked once per job when it completes or fails
+ * @param userp User pointer passed to the callback
+ * @return Pointer to newly allocated SCHEDULER (CALLER MUST DESTROY), or NULL
+ *         on failure
+ */
+SCHEDULER* create_scheduler(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, int max_in_flight, JOB_CALLBACK on_complete, void* userp) {
+    SCHEDULER* scheduler = (SCHEDULER*)calloc(1, sizeof(SCHEDULER));
+    if (!scheduler) {
+        fprintf(stderr, "ERROR - Allocating memory for scheduler failed in create_scheduler()!\n");
+        goto terminate;
+    }
+
+    scheduler->multi = curl_multi_init();
+    if (!scheduler->multi) {
+        fprintf(stderr, "ERROR - cURL multi initialization failed in create_scheduler()!\n");
+        free(scheduler);
+        scheduler = NULL;
+        goto terminate;
+    }
+
+    scheduler->pool = pool;
+    scheduler->backend_cache = backend_cache;
+    scheduler->max_in_flight = max_in_flight;
+    scheduler->hedge_count = 1;
+    scheduler->hedge_budget = -1;
+    scheduler->shard_count = 1;
+    scheduler->on_complete = on_complete;
+    scheduler->userp = userp;
+
+terminate:
+    return scheduler;
+}
+
+/**
+ * @brief Destroy a scheduler and every job it holds
+ *
+ * @param scheduler Pointer to SCHEDULER to destroy
+ */
+void destroy_scheduler(SCHEDULER* scheduler) {
+    for (int i = 0; i < scheduler->job_count; i++) {
+        SCHEDULED_JOB* job = scheduler->jobs[i];
+
+        if (job->curl) {
+            curl_multi_remove_handle(scheduler->multi, job->curl);
+            release_handle(scheduler->pool, job->curl);
+        }
+
+        free(job->backend);
+        free(job->result_key);
+        free(job->payload);
+        free(job->job_id);
+        free(job->rb.data);
+        destroy_result_decoder(job->decoder);
+        free(job->url);
+        curl_slist_free_all(job->headers);
+        if (job->owns_circuits) free(job->circuits);
+        free(job);
+    }
+
+    free(scheduler->jobs);
+    curl_multi_cleanup(scheduler->multi);
+    free(scheduler);
+
+    return;
+}
+
+/**
+ * @brief Queue a job for submission
+ *
+ * The circuits are submitted as the pubs of one job. The scheduler keeps a
+ * reference to the array, which must outlive the scheduler.
+ *
+ * @param scheduler Pointer to SCHEDULER to add the job to
+ * @param circuits Array of circuits forming the job
+ * @param circuit_count Number of circuits
+ * @return Index of the new job, or -1 on failure
+ */
+int add_job(SCHEDULER* scheduler, CIRCUIT* circuits, int circuit_count) {
+    SCHEDULED_JOB** temp = (SCHEDULED_JOB**)realloc(scheduler->jobs, (scheduler->job_count+1)*sizeof(SCHEDULED_JOB*));
+    if (!temp) {
+        fprintf(stderr, "ERROR - Allocating memory for job list failed in add_job()!\n");
+        return -1;
+    }
+    scheduler->jobs = temp;
+
+    SCHEDULED_JOB* job = (SCHEDULED_JOB*)calloc(1, sizeof(SCHEDULED_JOB));
+    if (!job) {
+        fprintf(stderr, "ERROR - Allocating memory for job failed in add_job()!\n");
+        return -1;
+    }
+
+    job->circuits = circuits;
+    job->circuit_count = circuit_count;
+    job->group = scheduler->job_count;
+    job->state = JOB_PENDING;
+
+    scheduler->jobs[scheduler->job_count] = job;
+
+    return scheduler->job_count++;
+}
+
+/**
+ * @brief Send the current request of a job on the multi handle
+ *
+ * A request finding the token bucket of the pool empty is held back, and
+ * start_due_requests() sends it once a slot is expected to be free.
+ * Submissions carry the idempotency key of the job.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the multi handle
+ * @param job Pointer to SCHEDULED_JOB issuing the request
+ * @return 0 on success, or -1 on failure
+ */
+static int send_request(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    double wait = acquire_request_slot(scheduler->pool);
+    if (wait > 0.0) {
+        job->retry_time = get_monotonic_time() + wait;
+        return 0;
+    }
+    job->retry_time = 0.0;
+
+    CURL* curl = acquire_handle(scheduler->pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in send_request()!\n");
+        return -1;
+    }
+
+    char* payload = job->request_payload;
+    struct curl_slist* headers = get_api_headers(scheduler->pool, payload && job->request_payload_size > 0);
+    if (headers && payload && payload == job->payload) {
+        curl_slist_free_all(job->headers);
+        job->headers = build_idempotent_headers(headers, job->idempotency_key);
+        headers = job->headers;
+    }
+    if (!headers) {
+        fprintf(stderr, "ERROR - Header construction failed in send_request()!\n");
+        release_handle(scheduler->pool, curl);
+        return -1;
+    }
+
+    free(job->rb.data);
+    job->rb.data = (char*)calloc(1, sizeof(char));
+    job->rb.size = 0;
+    if (!job->rb.data) {
+        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in send_request()!\n");
+        release_handle(scheduler->pool, curl);
+        return -1;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, job->url);
+    if (payload) {
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)job->request_payload_size);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    if (job->request_decoder) {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, decoder_write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, job->request_decoder);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &job->rb);
+    }
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, job);
+
+    if (curl_multi_add_handle(scheduler->multi, curl) != CURLM_OK) {
+        fprintf(stderr, "ERROR - Adding the request to the multi handle failed in send_request()!\n");
+        release_handle(scheduler->pool, curl);
+        return -1;
+    }
+
+    job->curl = curl;
+
+    return 0;
+}
+
+/**
+ * @brief Start a non-blocking request for a job on the multi handle
+ *
+ * The request is kept in the job, so that it can be sent again after a
+ * transient failure.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the multi handle
+ * @param job Pointer to SCHEDULED_JOB issuing the request
+ * @param url Request URL (copied into the job)
+ * @param payload Body to POST, which must outlive the request, or NULL for
+ *        a GET request
+ * @param payload_size Size of the body in bytes, 0 for an empty POST
+ * @param decoder Result decoder fed with the body, or NULL to buffer it
+ * @return 0 on success, or -1 on failure
+ */
+static int start_request(SCHEDULER* scheduler, SCHEDULED_JOB* job, char* url, char* payload, size_t payload_size, RESULT_DECODER* decoder) {
+    free(job->url);
+    job->url = strdup(url);
+    if (!job->url) {
+        fprintf(stderr, "ERROR - Allocating memory for request failed in start_request()!\n");
+        return -1;
+    }
+
+    job->request_payload = payload;
+    job->request_payload_size = payload_size;
+    job->request_decoder = decoder;
+    job->attempts = 0;
+
+    return send_request(scheduler, job);
+}
+
+/**
+ * @brief Check whether a job is finished
+ *
+ * @param job Pointer to SCHEDULED_JOB to check
+ * @return true if the job reached a final state, false otherwise
+ */
+static bool is_finished(SCHEDULED_JOB* job) {
+    return job->state == JOB_COMPLETED || job->state == JOB_FAILED || job->state == JOB_SUPERSEDED;
+}
+
+/**
+ * @brief Check whether another copy of a hedged job may still complete
+ *
+ * The shards of a sharded job are no copies, since each one is needed.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB whose copies are checked
+ * @return true if an unfinished copy is left, false otherwise
+ */
+static bool has_racing_copy(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    if (job->shard_count > 1) return false;
+
+    for (int i = 0; i < scheduler->job_count; i++) {
+        SCHEDULED_JOB* copy = scheduler->jobs[i];
+        if (copy != job && copy->group == job->group && !copy->superseded && !is_finished(copy)) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Give up every other job of the group of a job
+ *
+ * Called when a copy of a hedged job completed, or when a shard of a
+ * sharded job failed so that the others are of no use. Copies not
+ * submitted yet are dropped right away. Waiting copies are made due, so
+ * that start_due_requests() cancels them, and copies with a transfer in
+ * progress are cancelled once it finishes.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB that completed
+ */
+static void supersede_copies(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    for (int i = 0; i < scheduler->job_count; i++) {
+        SCHEDULED_JOB* copy = scheduler->jobs[i];
+        if (copy == job || copy->group != job->group || is_finished(copy)) continue;
+
+        copy->superseded = true;
+        if (copy->state == JOB_PENDING) copy->state = JOB_SUPERSEDED;
+        else if (copy->state == JOB_WAITING) copy->next_poll_time = 0.0;
+    }
+
+    return;
+}
+
+/**
+ * @brief Merge the shards of a sharded job once all of them completed
+ *
+ * The counts of every shard are added to the first shard, which then
+ * reports the whole job together with the job, backend and shots each
+ * shard contributed.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB of a shard that completed
+ * @return Pointer to the first shard holding the merged result, or NULL
+ *         while other shards are still running
+ */
+static SCHEDULED_JOB* merge_shards(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    SCHEDULED_JOB* first = NULL;
+    for (int i = 0; i < scheduler->job_count; i++) {
+        SCHEDULED_JOB* shard = scheduler->jobs[i];
+        if (shard->group != job->group) continue;
+        if (shard->state != JOB_COMPLETED) return NULL;
+        if (shard->shard == 0) first = shard;
+    }
+
+    // The first shard records its own shots before the others are added to it.
+
+    RESULT_DECODER* decoder = first->decoder;
+    for (int k = 0; k < job->shard_count; k++) {
+        SCHEDULED_JOB* shard = NULL;
+        for (int i = 0; i < scheduler->job_count && !shard; i++) {
+            if (scheduler->jobs[i]->group == job->group && scheduler->jobs[i]->shard == k) shard = scheduler->jobs[i];
+        }
+
+        long shots = 0;
+        for (int i = 0; i < shard->decoder->pub_count; i++) shots += shard->decoder->pubs[i].histogram.shots;
+
+        if (add_shard_origin(decoder, shard->job_id, shard->backend, shots) < 0 || (shard != first && merge_result_decoder(decoder, shard->decoder) < 0)) {
+            fprintf(stderr, "ERROR - Merging shard %d of the job for %s failed in merge_shards()!\n", k, first->circuits[0].name);
+            first->state = JOB_FAILED;
+            break;
+        }
+    }
+
+    return first;
+}
+
+/**
+ * @brief Mark a job as finished and notify the caller
+ *
+ * Of the copies of a hedged job, only the first to complete reports, or
+ * the last one if they all fail. The others end superseded. A sharded job
+ * reports once all its shards completed, or as soon as one shard fails.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB that finished
+ * @param state Final state (JOB_COMPLETED, JOB_FAILED or JOB_SUPERSEDED)
+ */
+static void finish_job(SCHEDULER* scheduler, SCHEDULED_JOB* job, JOB_STATE state) {
+    if (job->state != JOB_PENDING) scheduler->in_flight--;
+    job->state = state;
+
+    if (state == JOB_FAILED && has_racing_copy(scheduler, job)) job->state = JOB_SUPERSEDED;
+    if (job->state == JOB_SUPERSEDED) return;
+
+    if (job->shard_count > 1) {
+        if (state == JOB_FAILED) supersede_copies(scheduler, job);
+        else if (!(job = merge_shards(scheduler, job))) return;
+    } else if (state == JOB_COMPLETED) {
+        supersede_copies(scheduler, job);
+    }
+
+    if (scheduler->on_complete) scheduler->on_complete(job, scheduler->userp);
+
+    return;
+}
+
+/**
+ * @brief Schedule the next status poll of a job
+ *
+ * With a deadline, the job is polled no later than the deadline, so that
+ * a job missing it is noticed right away.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB to wait
+ * @param status Latest known status of the job
+ */
+static void wait_job(SCHEDULER* scheduler, SCHEDULED_JOB* job, JOB_STATUS status) {
+    job->state = JOB_WAITING;
+    job->next_poll_time = get_monotonic_time() + next_poll_delay(&job->poll_state, status);
+    if (scheduler->deadline > 0.0 && job->next_poll_time > scheduler->deadline) job->next_poll_time = scheduler->deadline;
+
+    return;
+}
+
+/**
+ * @brief Build the payload a job is submitted with
+ *
+ * The payload is compressed once when the pool compresses requests, and
+ * kept that way for the submission. A job moved to a fallback backend
+ * leaves the session of the run.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB with its backend selected
+ * @return 0 on success, or -1 on failure
+ */
+static int prepare_job(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    double start_time = get_monotonic_time();
+    job->payload = build_payload(job->backend, job->fell_back ? NULL : scheduler->session_id, job->circuits, job->circuit_count);
+    record_phase(scheduler->pool->metrics, PHASE_PAYLOAD, get_monotonic_time() - start_time);
+    if (!job->payload) {
+        fprintf(stderr, "ERROR - Building the payload failed in prepare_job()!\n");
+        return -1;
+    }
+    job->payload_size = strlen(job->payload);
+    generate_idempotency_key(scheduler->pool, job->idempotency_key);
+
+    if (scheduler->pool->compress_requests) {
+        char* compressed = compress_request_body(job->payload, job->payload_size, &job->payload_size);
+        free(job->payload);
+        job->payload = compressed;
+        if (!job->payload) {
+            fprintf(stderr, "ERROR - Compressing the payload failed in prepare_job()!\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Look up a cached result for a job, or prepare its submission
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB with its backend selected
+ * @return 0 if the job is ready to submit, 1 if it completed from the
+ *         result cache, or -1 if it failed
+ */
+static int plan_job(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    if (scheduler->result_policy != RESULT_CACHE_OFF) job->result_key = get_result_key(scheduler->pool, job->backend, job->circuits, job->circuit_count);
+
+    // Cached results hold counts only, so they cannot serve a dump of every shot.
+
+    if (job->result_key && scheduler->result_policy == RESULT_CACHE_READ && !scheduler->keep_samples) {
+        job->decoder = load_cached_result(job->result_key, count_result_slots(job->circuits, job->circuit_count), &job->job_id);
+        if (job->decoder) {
+            finish_job(scheduler, job, JOB_COMPLETED);
+            return 1;
+        }
+    }
+
+    if (prepare_job(scheduler, job) < 0) {
+        fprintf(stderr, "ERROR - Preparing the job for %s failed in plan_job()!\n", job->circuits[0].name);
+        finish_job(scheduler, job, JOB_FAILED);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Count the shards a job can be split into
+ *
+ * Every shard needs at least one shot of every circuit, and circuits
+ * without a shot count run the service default, which cannot be split.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB to split
+ * @return Number of shards, 1 if the job is not split
+ */
+static int count_shards(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    int shard_count = scheduler->shard_count;
+    for (int i = 0; i < job->circuit_count; i++) {
+        if (job->circuits[i].shots < shard_count) shard_count = job->circuits[i].shots;
+    }
+
+    return shard_count > 1 ? shard_count : 1;
+}
+
+/**
+ * @brief Split the shots of a job across several backends
+ *
+ * The job becomes the first shard, on its own backend, and one job is
+ * added for each other backend. Every shard runs its own copy of the
+ * circuits with an even share of their shots and belongs to the group of
+ * the job.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB to split, with backends[0] selected
+ * @param backends Names of the backends of the shards, owned by the
+ *        scheduler afterwards
+ * @param shard_count Number of shards (and backends)
+ * @return 0 on success, or -1 on failure
+ */
+static int split_job(SCHEDULER* scheduler, SCHEDULED_JOB* job, char** backends, int shard_count) {
+    CIRCUIT* original = job->circuits;
+    job->shard_count = shard_count;
+
+    for (int k = 0; k < shard_count; k++) {
+        CIRCUIT* circuits = (CIRCUIT*)malloc(job->circuit_count*sizeof(CIRCUIT));
+        if (!circuits) {
+            fprintf(stderr, "ERROR - Allocating memory for shard %d failed in split_job()!\n", k);
+            for (int i = k > 0 ? k : 1; i < shard_count; i++) free(backends[i]);
+            return -1;
+        }
+
+        memcpy(circuits, original, job->circuit_count*sizeof(CIRCUIT));
+        for (int i = 0; i < job->circuit_count; i++) {
+            circuits[i].shots = original[i].shots / shard_count + (k < original[i].shots % shard_count);
+        }
+
+        if (k == 0) {
+            job->circuits = circuits;
+            job->owns_circuits = true;
+            continue;
+        }
+
+        int index = add_job(scheduler, circuits, job->circuit_count);
+        if (index < 0) {
+            fprintf(stderr, "ERROR - Adding shard %d failed in split_job()!\n", k);
+            free(circuits);
+            for (int i = k; i < shard_count; i++) free(backends[i]);
+            return -1;
+        }
+
+        SCHEDULED_JOB* shard = scheduler->jobs[index];
+        shard->group = job->group;
+        shard->shard = k;
+        shard->shard_count = shard_count;
+        shard->owns_circuits = true;
+        shard->backend = backends[k];
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Add a hedged copy of a prepared job on another backend
+ *
+ * The copy shares the circuits and the group of the job, so that the
+ * first copy to complete supersedes the others.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB to copy
+ * @param backend Name of the backend of the copy, owned by the copy on
+ *        success
+ * @return 0 on success, or -1 on failure
+ */
+static int add_hedge(SCHEDULER* scheduler, SCHEDULED_JOB* job, char* backend) {
+    int index = add_job(scheduler, job->circuits, job->circuit_count);
+    if (index < 0) {
+        fprintf(stderr, "ERROR - Adding a hedged copy of the job failed in add_hedge()!\n");
+        return -1;
+    }
+
+    SCHEDULED_JOB* hedge = scheduler->jobs[index];
+    hedge->group = job->group;
+    hedge->backend = backend;
+    if (job->result_key) hedge->result_key = get_result_key(scheduler->pool, backend, job->circuits, job->circuit_count);
+
+    if (prepare_job(scheduler, hedge) < 0) {
+        fprintf(stderr, "ERROR - Preparing a hedged copy of the job failed in add_hedge()!\n");
+        hedge->backend = NULL;
+        hedge->state = JOB_SUPERSEDED;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Move a job cancelled for missing the deadline to another backend
+ *
+ * The job is resubmitted once, to the least loaded other backend whose
+ * queue still fits the remaining time. Without fallback, or when no
+ * backend qualifies, the job fails. A superseded copy of a hedged job, or
+ * one whose copies are still racing, is not moved.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB that was cancelled
+ */
+static void fall_back_job(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    if (job->superseded) {
+        finish_job(scheduler, job, JOB_SUPERSEDED);
+        return;
+    }
+
+    if (!scheduler->fallback || job->fell_back || has_racing_copy(scheduler, job)) {
+        finish_job(scheduler, job, JOB_FAILED);
+        return;
+    }
+
+    int max_queue_length = deadline_queue_length(scheduler->deadline);
+    char* backend = max_queue_length >= 0 ? choose_fallback_backend(scheduler->backend_cache, job->circuits, job->circuit_count, job->backend, max_queue_length) : NULL;
+    if (!backend) {
+        fprintf(stderr, "ERROR - No backend can run the job for %s before the deadline in fall_back_job()!\n", job->circuits[0].name);
+        finish_job(scheduler, job, JOB_FAILED);
+        return;
+    }
+
+    free(job->backend);
+    job->backend = backend;
+    if (job->result_key) {
+        free(job->result_key);
+        job->result_key = get_result_key(scheduler->pool, job->backend, job->circuits, job->circuit_count);
+    }
+
+    free(job->payload);
+    free(job->job_id);
+    job->payload = NULL;
+    job->job_id = NULL;
+    job->fell_back = true;
+
+    // The job keeps its in-flight slot, so it is submitted again right away.
+
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/jobs", scheduler->pool->api_url);
+    if (prepare_job(scheduler, job) < 0 || start_request(scheduler, job, url, job->payload, job->payload_size, NULL) < 0) {
+        finish_job(scheduler, job, JOB_FAILED);
+        return;
+    }
+
+    job->state = JOB_SUBMITTING;
+
+    return;
+}
+
+/**
+ * @brief Cancel a job that is no longer needed
+ *
+ * Once the cancellation finishes, fall_back_job() decides what becomes of
+ * the job.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB to cancel
+ */
+static void cancel_scheduled_job(SCHEDULER* scheduler, SCHEDULED_JOB* job) {
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/jobs/%s/cancel", scheduler->pool->api_url, job->job_id);
+    if (start_request(scheduler, job, url, "", 0, NULL) < 0) {
+        fall_back_job(scheduler, job);
+        return;
+    }
+
+    job->state = JOB_CANCELLING;
+
+    return;
+}
+
+/**
+ * @brief Handle a finished transfer of a job
+ *
+ * Advances the job state machine: a finished submission yields the job ID,
+ * a status poll either schedules the next poll with adaptive backoff,
+ * cancels a job that cannot meet the deadline or starts the result
+ * download, and a successful download completes the job. A transient
+ * failure repeats the request instead, up to the attempt limit of the pool.
+ * A result that is not available yet is polled for again, for up to
+ * POLL_PENDING_TIMEOUT and no later than the deadline.
+ *
+ * @param scheduler Pointer to SCHEDULER owning the job
+ * @param job Pointer to SCHEDULED_JOB whose transfer finished
+ * @param response_code cURL result code of the transfer
+ */
+static void handle_transfer(SCHEDULER* scheduler, SCHEDULED_JOB* job, CURLcode response_code) {
+    RUNTIME_METRICS* metrics = scheduler->pool->metrics;
+
+    long http_code = 0;
+    curl_easy_getinfo(job->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    double transfer_time = record_response(metrics, job->curl, response_code);
+
+    // A submission that may have reached the service is not repeated, since it could create a second job.
+
+    bool transient = job->state == JOB_SUBMITTING ? is_unsent_failure(response_code, http_code) : is_transient_failure(response_code, http_code);
+    bool retry = transient && job->attempts+1 < scheduler->pool->max_attempts;
+    double retry_delay = retry ? get_retry_delay(scheduler->pool, job->curl, http_code, job->attempts) : 0.0;
+
+    curl_multi_remove_handle(scheduler->multi, job->curl);
+    release_handle(scheduler->pool, job->curl);
+    job->curl = NULL;
+
+    // Result downloads are decoded while they arrive, so only the body prefix is left to inspect.
+
+    char* body = job->state == JOB_FETCHING ? job->decoder->prefix : job->rb.data;
+
+    if (job->state == JOB_SUBMITTING) record_phase(metrics, PHASE_SUBMIT, transfer_time);
+    else if (job->state == JOB_POLLING) record_phase(metrics, PHASE_POLL, transfer_time);
+
+    // A transient failure sends the same request again once the backoff is over.
+
+    if (retry) {
+        record_failure_retry(metrics);
+        if (job->request_decoder) reset_result_decoder(job->request_decoder);
+        job->attempts++;
+        job->retry_time = get_monotonic_time() + retry_delay;
+        return;
+    }
+
+    // A result that is not available yet counts as one more status poll.
+
+    if (job->state == JOB_FETCHING && http_code == 400 && check_code(body)) {
+        record_phase(metrics, PHASE_POLL, transfer_time);
+
+        double now = get_monotonic_time();
+        if (job->pending_time == 0.0) job->pending_time = now;
+        double limit = job->pending_time + POLL_PENDING_TIMEOUT;
+        if (scheduler->deadline > 0.0 && scheduler->deadline < limit) limit = scheduler->deadline;
+        if (now >= limit) {
+            fprintf(stderr, "ERROR - The result of job %s did not become available in handle_transfer()!\n", job->job_id);
+            finish_job(scheduler, job, JOB_FAILED);
+            return;
+        }
+
+        record_retry(metrics);
+        wait_job(scheduler, job, STATUS_RUNNING);
+        if (job->next_poll_time > limit) job->next_poll_time = limit;
+        return;
+    }
+
+    // Another copy of a hedged job already completed, so this one is only cancelled.
+
+    if (job->superseded && job->state != JOB_CANCELLING) {
+        if (job->state == JOB_SUBMITTING && response_code == CURLE_OK && http_code < 400) job->job_id = parse_job_id(job->rb.data);
+
+        if (job->job_id && job->state != JOB_FETCHING) cancel_scheduled_job(scheduler, job);
+        else finish_job(scheduler, job, JOB_SUPERSEDED);
+        return;
+    }
+
+    // A failed cancellation is only reported, since the job is given up either way.
+    // A superseded copy may well have finished or vanished already, so 404 and 409 are expected for it.
+
+    if (job->state == JOB_CANCELLING) {
+        bool expected = job->superseded && (http_code == 404 || http_code == 409);
+        if ((response_code != CURLE_OK || http_code >= 400) && !expected) {
+            fprintf(stderr, "ERROR - Cancelling job %s failed in handle_transfer()!\n", job->job_id);
+            fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        }
+        fall_back_job(scheduler, job);
+        return;
+    }
+
+    if (response_code != CURLE_OK || http_code >= 400) {
+        fprintf(stderr, "ERROR - Request for job %s failed in handle_transfer()!\n", job->job_id ? job->job_id : "(unsubmitted)");
+        fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+        fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        if (body && body[0]) fprintf(stderr, "ERROR - Response Body: %s\n", body);
+        finish_job(scheduler, job, JOB_FAILED);
+        return;
+    }
+
+    if (job->state == JOB_SUBMITTING) {
+        job->job_id = parse_job_id(job->rb.data);
+        if (!job->job_id) {
+            fprintf(stderr, "ERROR - Parsing the job ID failed in handle_transfer()!\n");
+            finish_job(scheduler, job, JOB_FAILED);
+            return;
+        }
+
+        job->submitted_time = get_monotonic_time();
+        job->pending_time = 0.0;
+        initialize_poll_state(&job->poll_state);
+        initialize_queue_estimate(&job->estimate);
+        wait_job(scheduler, job, STATUS_QUEUED);
+        return;
+    }
+
+    if (job->state == JOB_POLLING) {
+        JOB_STATUS status = parse_job_status(job->rb.data);
+        if (status == STATUS_QUEUED || status == STATUS_RUNNING) {
+            int queue_position = status == STATUS_QUEUED ? parse_queue_position(job->rb.data) : -1;
+            if (misses_deadline(&job->estimate, status, queue_position, scheduler->deadline)) {
+                fprintf(stderr, "ERROR - The job %s cannot finish before the deadline in handle_transfer()!\n", job->job_id);
+                cancel_scheduled_job(scheduler, job);
+            } else {
+                wait_job(scheduler, job, status);
+            }
+            return;
+        }
+
+        job->queue_time = get_monotonic_time() - job->submitted_time;
+        record_phase(metrics, PHASE_QUEUE, job->queue_time);
+        if (status != STATUS_COMPLETED) {
+            fprintf(stderr, "ERROR - The job %s did not complete in handle_transfer()!\n", job->job_id);
+            finish_job(scheduler, job, JOB_FAILED);
+            return;
+        }
+
+        if (!job->decoder) job->decoder = create_job_decoder(job->circuits, job->circuit_count, scheduler->keep_samples);
+        else reset_result_decoder(job->decoder);
+
+        if (!job->decoder) {
+            fprintf(stderr, "ERROR - Creating the result decoder failed in handle_transfer()!\n");
+            finish_job(scheduler, job, JOB_FAILED);
+            return;
+        }
+
+        char url[BUFFER_NMEMB];
+        snprintf(url, BUFFER_NMEMB, "%s/jobs/%s/results", scheduler->pool->api_url, job->job_id);
+        if (start_request(scheduler, job, url, NULL, 0, job->decoder) < 0) {
+            finish_job(scheduler, job, JOB_FAILED);
+            return;
+        }
+
+        job->state = JOB_FETCHING;
+        return;
+    }
+
+    record_phase(metrics, PHASE_DOWNLOAD, transfer_time - job->decoder->parse_time);
+
+    double start_time = get_monotonic_time();
+    int finish_status = finish_result_decoder(job->decoder);
+    record_phase(metrics, PHASE_PARSE, job->decoder->parse_time + get_monotonic_time() - start_time);
+    if (finish_status < 0) {
+        fprintf(stderr, "ERROR - Decoding the result of job %s failed in handle_transfer()!\n", job->job_id);
+        finish_job(scheduler, job, JOB_FAILED);
+        return;
+    }
+
+    if (job->result_key) store_cached_result(job->result_key, job->backend, job->job_id, job->decoder);
+
+    finish_job(scheduler, job, JOB_COMPLETED);
+
+    return;
+}
+
+/**
+ * @brief Start submissions and polls that are due
+ *
+ * Submits pending jobs while the in-flight limit allows it, polls the
+ * status of waiting jobs whose next poll time has passed, and sends the
+ * requests held back by the rate limit or a retry backoff once their time
+ * has come.
+ *
+ * @param scheduler Pointer to SCHEDULER to advance
+ * @param now Current monotonic time in seconds
+ * @return Milliseconds until the next poll is due, capped at MULTI_WAIT_MS
+ */
+static int start_due_requests(SCHEDULER* scheduler, double now) {
+    double next_event = now + MULTI_WAIT_MS / 1000.0;
+
+    for (int i = 0; i < scheduler->job_count; i++) {
+        SCHEDULED_JOB* job = scheduler->jobs[i];
+
+        // Requests held back by the rate limit or a retry backoff keep the job in its current state.
+
+        if (job->retry_time > 0.0 && !is_finished(job)) {
+            if (job->retry_time > now) {
+                if (job->retry_time < next_event) next_event = job->retry_time;
+                continue;
+            }
+
+            // A copy superseded while held back is never submitted.
+
+            if (job->superseded && !job->job_id) {
+                finish_job(scheduler, job, JOB_SUPERSEDED);
+                continue;
+            }
+
+            if (send_request(scheduler, job) < 0) {
+                if (job->state == JOB_CANCELLING) fall_back_job(scheduler, job);
+                else finish_job(scheduler, job, JOB_FAILED);
+            } else if (job->retry_time > 0.0 && job->retry_time < next_event) {
+                next_event = job->retry_time;
+            }
+            continue;
+        }
+
+        if (job->state == JOB_PENDING) {
+            if (scheduler->max_in_flight > 0 && scheduler->in_flight >= scheduler->max_in_flight) continue;
+
+            if (scheduler->deadline > 0.0 && now >= scheduler->deadline) {
+                fprintf(stderr, "ERROR - The job for %s was not submitted before the deadline in start_due_requests()!\n", job->circuits[0].name);
+                finish_job(scheduler, job, JOB_FAILED);
+                continue;
+            }
+
+            char url[BUFFER_NMEMB];
+            snprintf(url, BUFFER_NMEMB, "%s/jobs", scheduler->pool->api_url);
+            if (start_request(scheduler, job, url, job->payload, job->payload_size, NULL) < 0) {
+                finish_job(scheduler, job, JOB_FAILED);
+                continue;
+            }
+
+            job->state = JOB_SUBMITTING;
+            scheduler->in_flight++;
+        } else if (job->state == JOB_WAITING) {
+            if (job->superseded) {
+                cancel_scheduled_job(scheduler, job);
+                continue;
+            }
+
+            if (job->next_poll_time > now) {
+                if (job->next_poll_time < next_event) next_event = job->next_poll_time;
+                continue;
+            }
+
+            char url[BUFFER_NMEMB];
+            snprintf(url, BUFFER_NMEMB, "%s/jobs/%s", scheduler->pool->api_url, job->job_id);
+            if (start_request(scheduler, job, url, NULL, 0, NULL) < 0) {
+                finish_job(scheduler, job, JOB_FAILED);
+                continue;
+            }
+
+            job->state = JOB_POLLING;
+        }
+    }
+
+    return (int)((next_event - now) * 1000.0);
+}
+
+/**
+ * @brief Run every queued job to completion on a single event loop
+ *
+ * Fetches the backend list once, selects a backend and builds the payload
+ * for each job, completing jobs whose result is cached right away. With
+ * hedging, every job also gets copies on the next best backends, up to
+ * hedge_count backends in all and hedge_budget copies per run (-1 for no
+ * limit); the first copy to complete wins and the others are cancelled.
+ * With a session, every job instead runs in it on the session backend.
+ * All job submissions and result polls are then driven concurrently with
+ * curl_multi. Each job reports through the completion callback as soon as
+ * it finishes, independently of the others.
+ *
+ * @param scheduler Pointer to SCHEDULER holding the jobs
+ * @return Number of failed jobs, or -1 if the run could not start
+ */
+int run_scheduler(SCHEDULER* scheduler) {
+    int failed_count = -1;
+
+    char* backends_data = get_backends(scheduler->backend_cache);
+    if (!backends_data) {
+        fprintf(stderr, "ERROR - Fetching backends data failed in run_scheduler()!\n");
+        goto terminate;
+    }
+
+    int max_backend_count = scheduler->hedge_count > scheduler->shard_count ? scheduler->hedge_count : scheduler->shard_count;
+    char** backends = (char**)calloc(max_backend_count, sizeof(char*));
+    if (!backends) {
+        fprintf(stderr, "ERROR - Allocating memory for backend names failed in run_scheduler()!\n");
+        goto cleanup_backends_data;
+    }
+
+    if (scheduler->session && scheduler->job_count > 0) {
+        scheduler->session_id = enter_session(scheduler->session, scheduler->jobs[0]->circuits, scheduler->jobs[0]->circuit_count, &scheduler->session_backend);
+        if (!scheduler->session_id) {
+            fprintf(stderr, "ERROR - Entering the session failed in run_scheduler()!\n");
+            free(backends);
+            goto cleanup_backends_data;
+        }
+    }
+
+    // Jobs may need different devices, so each job selects its own backends.
+
+    int job_count = scheduler->job_count;
+    for (int i = 0; i < job_count; i++) {
+        SCHEDULED_JOB* job = scheduler->jobs[i];
+
+        int shard_count = count_shards(scheduler, job);
+        int backend_count = -1;
+        if (scheduler->session_backend) {
+            backends[0] = strdup(scheduler->session_backend);
+            if (backends[0]) backend_count = 1;
+        } else {
+            backend_count = select_backends(backends_data, job->circuits, job->circuit_count, backends, shard_count > 1 ? shard_count : scheduler->hedge_count);
+        }
+        if (backend_count < 0) {
+            fprintf(stderr, "ERROR - Selecting the backend device for job %d failed in run_scheduler()!\n", i);
+            finish_job(scheduler, job, JOB_FAILED);
+            continue;
+        }
+        job->backend = backends[0];
+
+        // Shards run on as many of the backends as were found, each one planned on its own.
+
+        if (shard_count > 1 && backend_count > 1) {
+            if (split_job(scheduler, job, backends, backend_count) < 0) {
+                finish_job(scheduler, job, JOB_FAILED);
+                continue;
+            }
+
+            for (int k = i; k < scheduler->job_count; k++) {
+                SCHEDULED_JOB* shard = scheduler->jobs[k];
+                if (shard->group == job->group && !is_finished(shard)) plan_job(scheduler, shard);
+            }
+            continue;
+        }
+
+        if (plan_job(scheduler, job) != 0) {
+            for (int k = 1; k < backend_count; k++) free(backends[k]);
+            continue;
+        }
+
+        // Hedged copies go to the next best backends while the budget for duplicates lasts.
+
+        for (int k = 1; k < backend_count; k++) {
+            if (scheduler->hedge_budget == 0 || add_hedge(scheduler, job, backends[k]) < 0) {
+                free(backends[k]);
+                continue;
+            }
+            if (scheduler->hedge_budget > 0) scheduler->hedge_budget--;
+        }
+    }
+    free(backends);
+
+    if (wait_for_token(scheduler->pool->token_data) < 0) {
+        fprintf(stderr, "ERROR - No bearer token is available in run_scheduler()!\n");
+        goto cleanup_session;
+    }
+
+    while (true) {
+        int timeout_ms = start_due_requests(scheduler, get_monotonic_time());
+
+        int running = 0;
+        if (curl_multi_perform(scheduler->multi, &running) != CURLM_OK) {
+            fprintf(stderr, "ERROR - Driving the transfers failed in run_scheduler()!\n");
+            goto cleanup_session;
+        }
+
+        CURLMsg* message = NULL;
+        int queued_messages = 0;
+        while ((message = curl_multi_info_read(scheduler->multi, &queued_messages))) {
+            if (message->msg != CURLMSG_DONE) continue;
+
+            SCHEDULED_JOB* job = NULL;
+            curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, (char**)&job);
+            handle_transfer(scheduler, job, message->data.result);
+
+            // The transfer may have made other jobs due, such as copies to cancel.
+
+            timeout_ms = 0;
+        }
+
+        bool finished = true;
+        for (int i = 0; i < scheduler->job_count; i++) {
+            if (!is_finished(scheduler->jobs[i])) {
+                finished = false;
+                break;
+            }
+        }
+        if (finished) break;
+
+        if (timeout_ms < 0) timeout_ms = 0;
+        curl_multi_poll(scheduler->multi, NULL, 0, timeout_ms, NULL);
+    }
+
+    failed_count = 0;
+    for (int i = 0; i < scheduler->job_count; i++) {
+        if (scheduler->jobs[i]->state == JOB_FAILED) failed_count++;
+    }
+
+cleanup_session:
+    if (scheduler->session_id) {
+        leave_session(scheduler->session);
+        free(scheduler->session_id);
+        free(scheduler->session_backend);
+        scheduler->session_id = NULL;
+        scheduler->session_backend = NULL;
+    }
+
+cleanup_backends_data:
+    free(backends_data);
+
+terminate:
+    return failed_count;
+}
@@ -0,0 +1,86 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#define MULTI_WAIT_MS 1000
+
+typedef enum JobState {
+    JOB_PENDING,
+    JOB_SUBMITTING,
+    JOB_WAITING,
+    JOB_POLLING,
+    JOB_FETCHING,
+    JOB_CANCELLING,
+    JOB_COMPLETED,
+    JOB_FAILED,
+    JOB_SUPERSEDED
+} JOB_STATE;
+
+typedef struct ScheduledJob {
+    CIRCUIT* circuits;
+    int circuit_count;
+    int group;
+    int shard;
+    int shard_count;
+    bool owns_circuits;
+
+    JOB_STATE state;
+    char* backend;
+    char* result_key;
+    char* payload;
+    size_t payload_size;
+    char* job_id;
+
+    CURL* curl;
+    RESPONSE_BUFFER rb;
+    RESULT_DECODER* decoder;
+    char* url;
+    char* request_payload;
+    size_t request_payload_size;
+    RESULT_DECODER* request_decoder;
+    struct curl_slist* headers;
+    char idempotency_key[IDEMPOTENCY_KEY_NMEMB];
+    int attempts;
+    double retry_time;
+    double pending_time;
+    POLL_STATE poll_state;
+    QUEUE_ESTIMATE estimate;
+    double submitted_time;
+    double queue_time;
+    double next_poll_time;
+    bool fell_back;
+    bool superseded;
+} SCHEDULED_JOB;
+
+typedef void (*JOB_CALLBACK)(SCHEDULED_JOB* job, void* userp);
+
+typedef struct Scheduler {
+    CONNECTION_POOL* pool;
+    BACKEND_CACHE* backend_cache;
+    CURLM* multi;
+
+    SCHEDULED_JOB** jobs;
+    int job_count;
+    int max_in_flight;
+    int in_flight;
+    bool keep_samples;
+    RESULT_CACHE_POLICY result_policy;
+    double deadline;
+    bool fallback;
+    int hedge_count;
+    int hedge_budget;
+    int shard_count;
+    SESSION* session;
+    char* session_id;
+    char* session_backend;
+
+    JOB_CALLBACK on_complete;
+    void* userp;
+} SCHEDULER;
+
+SCHEDULER* create_scheduler(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, int max_in_flight, JOB_CALLBACK on_complete, void* userp);
+void destroy_scheduler(SCHEDULER* scheduler);
+
+int add_job(SCHEDULER* scheduler, CIRCUIT* circuits, int circuit_count);
+int run_scheduler(SCHEDULER* scheduler);
+
+#endif
@@ -3,38 +3,35 @@
 #include <stdbool.h>
 #include <string.h>
 #include <limits.h>
+#include <math.h>
 
 #include <curl/curl.h>
 #include <cjson/cJSON.h>
 #include <pthread.h>
 
+#include "metrics.h"
 #include "comm.h"
+#include "reader.h"
+#include "backends.h"
 #include "sender.h"
 
 
 /**
  * @brief Fetch available backends data from IBM Quantum API
  *
- * Uses the bearer token in token_data and the provided CRN to request the
- * list of backends. The returned string must be freed by the caller.
+ * Uses a pooled connection and the cached authorization headers to request
+ * the list of backends. The returned string must be freed by the caller.
  *
- * @param token_data Pointer to TOKEN_DATA with authentication token
- * @param crn Service CRN string to include in headers
+ * @param pool Pointer to CONNECTION_POOL used for the request
  * @return JSON response string on success (CALLER MUST FREE), or NULL on error
  */
-char* get_backends_data(TOKEN_DATA* token_data, char* crn) {
+char* get_backends_data(CONNECTION_POOL* pool) {
     char* backends_data = NULL;
 
-    char* token = copy_bearer_token(token_data);
-    if (!token) {
-        fprintf(stderr, "ERROR - Copying bearer token failed in get_backends_data()!\n");
-        goto terminate;
-    }
-
-    CURL* curl = curl_easy_init();
+    CURL* curl = acquire_handle(pool);
     if (!curl) {
-        fprintf(stderr, "ERROR - cURL initialization failed in get_backends_data()!\n");
-        goto cleanup_token;
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in get_backends_data()!\n");
+        goto terminate;
     }
 
     RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
@@ -43,127 +40,340 @@ char* get_backends_data(TOKEN_DATA* token_data, char* crn) {
         goto cleanup_curl;
     }
 
-    char* token_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!token_header) {
-        fprintf(stderr, "ERROR - Allocating memory for token header failed in get_backends_data()!\n");
-        goto cleanup_rb;
-    }
-
-    char* crn_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!crn_header) {
-        fprintf(stderr, "ERROR - Allocating memory for CRN header failed in get_backends_data()!\n");
-        goto cleanup_token_header;
-    }
-
-    snprintf(token_header, BUFFER_NMEMB, "Authorization: Bearer %s", token);
-    snprintf(crn_header, BUFFER_NMEMB, "Service-CRN: %s", crn);
-
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Accept: application/json");
-    headers = curl_slist_append(headers, token_header);
-    headers = curl_slist_append(headers, crn_header);
-    headers = curl_slist_append(headers, "IBM-API-Version: 2026-02-01");
+    struct curl_slist* headers = get_api_headers(pool, false);
     if (!headers) {
         fprintf(stderr, "ERROR - Header construction failed in get_backends_data()!\n");
-        goto cleanup_crn_header;
+        goto cleanup_rb;
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, "https://quantum.cloud.ibm.com/api/v1/backends");
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/backends", pool->api_url);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT_NAME);
 
-    CURLcode response_code = curl_easy_perform(curl);
     long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    CURLcode response_code = perform_request(pool, curl, PHASE_BACKENDS, false, &rb, &http_code);
     if (response_code != CURLE_OK || http_code >= 400) {
         fprintf(stderr, "ERROR - Getting backend information failed in get_backends_data()!\n");
         fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
         fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
-        goto cleanup_headers;
+        goto cleanup_rb;
     }
 
     backends_data = strdup(rb.data);
 
-cleanup_headers:
-    curl_slist_free_all(headers);
+cleanup_rb:
+    free(rb.data);
+
+cleanup_curl:
+    release_handle(pool, curl);
+
+terminate:
+    return backends_data;
+}
 
-cleanup_crn_header:
-    free(crn_header);
+/**
+ * @brief Fetch the calibration properties of one backend
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the request
+ * @param backend Backend name
+ * @return JSON response string on success (CALLER MUST FREE), or NULL on error
+ */
+char* get_backend_properties_data(CONNECTION_POOL* pool, char* backend) {
+    char* properties_data = NULL;
+
+    CURL* curl = acquire_handle(pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in get_backend_properties_data()!\n");
+        goto terminate;
+    }
 
-cleanup_token_header:
-    free(token_header);
+    RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
+    if (!rb.data) {
+        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in get_backend_properties_data()!\n");
+        goto cleanup_curl;
+    }
+
+    struct curl_slist* headers = get_api_headers(pool, false);
+    if (!headers) {
+        fprintf(stderr, "ERROR - Header construction failed in get_backend_properties_data()!\n");
+        goto cleanup_rb;
+    }
+
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/backends/%s/properties", pool->api_url, backend);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
+
+    long http_code = 0;
+    CURLcode response_code = perform_request(pool, curl, PHASE_BACKENDS, false, &rb, &http_code);
+    if (response_code != CURLE_OK || http_code >= 400) {
+        fprintf(stderr, "ERROR - Getting properties of %s failed in get_backend_properties_data()!\n", backend);
+        fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+        fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        goto cleanup_rb;
+    }
+
+    properties_data = strdup(rb.data);
 
 cleanup_rb:
     free(rb.data);
 
 cleanup_curl:
-    curl_easy_cleanup(curl);
-
-cleanup_token:
-    free(token);
+    release_handle(pool, curl);
 
 terminate:
-    return backends_data;
+    return properties_data;
+}
+
+/**
+ * @brief Read a number from a device entry, with a fallback
+ *
+ * @param device_cjson Device entry of the backends JSON
+ * @param key Name of the field
+ * @param fallback Value returned when the field is missing
+ * @return Value of the field, or fallback
+ */
+static double get_device_number(cJSON* device_cjson, const char* key, double fallback) {
+    cJSON* number_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, key);
+
+    return cJSON_IsNumber(number_cjson) ? number_cjson->valuedouble : fallback;
+}
+
+/**
+ * @brief Expected number of queue slots until a usable result
+ *
+ * The job waits for queue_length jobs ahead of it and then runs. Its result
+ * is only usable with the probability that no two-qubit gate and no readout
+ * of the largest circuit fails, so a noisier device needs proportionally
+ * more runs. Error rates missing from the backend data are replaced by
+ * typical values.
+ *
+ * @param device_cjson Device entry of the backends JSON
+ * @param queue_length Number of jobs waiting on the device
+ * @param two_qubit_gates Largest two-qubit gate count of the circuits
+ * @param measured_bits Largest number of measured bits of the circuits
+ * @return Score of the device, lower being better
+ */
+static double score_backend(cJSON* device_cjson, int queue_length, int two_qubit_gates, int measured_bits) {
+    double two_q_error = get_device_number(device_cjson, "two_q_error", BACKEND_DEFAULT_TWO_Q_ERROR);
+    double readout_error = get_device_number(device_cjson, "readout_error", BACKEND_DEFAULT_READOUT_ERROR);
+
+    double success = pow(1 - two_q_error, two_qubit_gates) * pow(1 - readout_error, measured_bits);
+    if (!(success > BACKEND_MIN_SUCCESS)) success = BACKEND_MIN_SUCCESS;
+
+    return (queue_length + 1) / success;
 }
 
 /**
- * @brief Select the least-busy backend from backends JSON
+ * @brief Check whether a device can run circuits of the given width
  *
- * Parses the provided JSON and returns a duplicated backend name chosen by
- * queue length heuristics.
+ * Devices that are not online or have fewer qubits than the widest circuit
+ * would reject the job after it waited in the queue.
+ *
+ * @param device_cjson Device entry of the backends JSON
+ * @param queue_length Number of jobs waiting on the device
+ * @param qubit_count Number of qubits of the widest circuit
+ * @return true if the device is usable, false otherwise
+ */
+static bool is_usable_device(cJSON* device_cjson, int queue_length, int qubit_count) {
+    if (queue_length < 0) return false;
+
+    cJSON* device_status_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "status");
+    if (cJSON_IsString(device_status_cjson) && strcmp(device_status_cjson->valuestring, "online") != 0) return false;
+
+    return get_device_number(device_cjson, "num_qubits", INT_MAX) >= qubit_count;
+}
+
+/**
+ * @brief Select the backends expected to return a usable result first
+ *
+ * Devices rejected by is_usable_device() are skipped, and the remaining
+ * devices are ranked by score_backend(). The best max_count of them are
+ * returned in order, the best first.
  *
  * @param backends_data JSON string describing available backends
- * @return Duplicated backend name (CALLER MUST FREE) or NULL on failure
+ * @param circuits Array of circuits the job will run
+ * @param circuit_count Number of circuits
+ * @param backends Output array of max_count entries receiving the
+ *        duplicated backend names (CALLER MUST FREE each)
+ * @param max_count Largest number of backends to select
+ * @return Number of selected backends, or -1 on failure
  */
-char* select_backend(char* backends_data) {
-    char* backend = NULL;
+int select_backends(char* backends_data, CIRCUIT* circuits, int circuit_count, char** backends, int max_count) {
+    int backend_count = -1;
+
+    int qubit_count = 0;
+    int two_qubit_gates = 0;
+    int measured_bits = 0;
+    for (int i = 0; i < circuit_count; i++) {
+        if (circuits[i].qubit_count > qubit_count) qubit_count = circuits[i].qubit_count;
+        if (circuits[i].two_qubit_gate_count > two_qubit_gates) two_qubit_gates = circuits[i].two_qubit_gate_count;
+        if (circuits[i].measured_bits > measured_bits) measured_bits = circuits[i].measured_bits;
+    }
+
+    double* best_device_scores = (double*)calloc(max_count, sizeof(double));
+    char** best_device_names = (char**)calloc(max_count, sizeof(char*));
+    if (!best_device_scores || !best_device_names) {
+        fprintf(stderr, "ERROR - Allocating memory for the ranking failed in select_backends()!\n");
+        goto cleanup_ranking;
+    }
 
     cJSON* backends_data_cjson = cJSON_Parse(backends_data);
     if (!backends_data_cjson) {
-        fprintf(stderr, "ERROR - Parsing backends data JSON failed in select_backend()!\n");
+        fprintf(stderr, "ERROR - Parsing backends data JSON failed in select_backends()!\n");
         const char* error = cJSON_GetErrorPtr();
         if (error) fprintf(stderr, "ERROR - %s\n", error);
-        goto terminate;
+        goto cleanup_ranking;
     }
 
     cJSON* devices_cjson = cJSON_GetObjectItemCaseSensitive(backends_data_cjson, "devices");
     if (!devices_cjson || !devices_cjson->child) {
-        fprintf(stderr, "ERROR - Parsing devices list failed in select_backend()!\n");
+        fprintf(stderr, "ERROR - Parsing devices list failed in select_backends()!\n");
         goto cleanup_backends_data_cjson;
     }
 
-    int least_busy_device_queue = INT_MAX;
-    char* least_busy_device_name = NULL;
+    int ranked_count = 0;
 
     for (cJSON* device_cjson = devices_cjson->child; device_cjson; device_cjson = device_cjson->next) {
-        int device_jobs = 0;
-
         cJSON* device_jobs_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "queue_length");
-        if (cJSON_IsNumber(device_jobs_cjson)) {
-            device_jobs = device_jobs_cjson->valueint;
-        } else {
-            fprintf(stderr, "ERROR - Parsing the queue length failed in select_backend()!\n");
+        if (!cJSON_IsNumber(device_jobs_cjson)) {
+            fprintf(stderr, "ERROR - Parsing the queue length failed in select_backends()!\n");
             goto cleanup_backends_data_cjson;
         }
-        
-        if (0 <= device_jobs && device_jobs < least_busy_device_queue) {
-            least_busy_device_queue = device_jobs;
-
-            cJSON* device_name_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "name");
-            if (cJSON_IsString(device_name_cjson) && device_name_cjson->valuestring) {
-                least_busy_device_name = device_name_cjson->valuestring;
-            } else {
-                fprintf(stderr, "ERROR - Parsing the device name failed in select_backend()!\n");
-                goto cleanup_backends_data_cjson;
-            }
+
+        int device_jobs = device_jobs_cjson->valueint;
+        if (!is_usable_device(device_cjson, device_jobs, qubit_count)) continue;
+
+        double device_score = score_backend(device_cjson, device_jobs, two_qubit_gates, measured_bits);
+        if (ranked_count == max_count && device_score >= best_device_scores[max_count-1]) continue;
+
+        cJSON* device_name_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "name");
+        if (!cJSON_IsString(device_name_cjson) || !device_name_cjson->valuestring) {
+            fprintf(stderr, "ERROR - Parsing the device name failed in select_backends()!\n");
+            goto cleanup_backends_data_cjson;
+        }
+
+        // Insert the device into the ranking, dropping the worst one when it is full.
+
+        int position = ranked_count < max_count ? ranked_count++ : max_count-1;
+        while (position > 0 && best_device_scores[position-1] > device_score) {
+            best_device_scores[position] = best_device_scores[position-1];
+            best_device_names[position] = best_device_names[position-1];
+            position--;
         }
+        best_device_scores[position] = device_score;
+        best_device_names[position] = device_name_cjson->valuestring;
+    }
+
+    if (ranked_count == 0) {
+        fprintf(stderr, "ERROR - No online backend has the %d qubits the circuits need in select_backends()!\n", qubit_count);
+        goto cleanup_backends_data_cjson;
     }
 
-    backend = strdup(least_busy_device_name);
+    for (int i = 0; i < ranked_count; i++) {
+        backends[i] = strdup(best_device_names[i]);
+        if (!backends[i]) {
+            fprintf(stderr, "ERROR - Copying the backend name failed in select_backends()!\n");
+            while (i > 0) free(backends[--i]);
+            goto cleanup_backends_data_cjson;
+        }
+    }
+    backend_count = ranked_count;
+
+cleanup_backends_data_cjson:
+    cJSON_Delete(backends_data_cjson);
+
+cleanup_ranking:
+    free(best_device_scores);
+    free(best_device_names);
+
+    return backend_count;
+}
+
+/**
+ * @brief Select the backend expected to return a usable result first
+ *
+ * @param backends_data JSON string describing available backends
+ * @param circuits Array of circuits the job will run
+ * @param circuit_count Number of circuits
+ * @return Duplicated backend name (CALLER MUST FREE) or NULL on failure
+ */
+char* select_backend(char* backends_data, CIRCUIT* circuits, int circuit_count) {
+    char* backend = NULL;
+
+    if (select_backends(backends_data, circuits, circuit_count, &backend, 1) < 0) return NULL;
+
+    return backend;
+}
+
+/**
+ * @brief Select the least loaded backend other than the one given
+ *
+ * Used to resubmit a job that could not finish in time on its first
+ * backend, so only the queue length counts: the device with the fewest
+ * jobs waiting that still fits within max_queue_length is chosen.
+ *
+ * @param backends_data JSON string describing available backends
+ * @param circuits Array of circuits the job will run
+ * @param circuit_count Number of circuits
+ * @param excluded Name of the backend the job is moved away from
+ * @param max_queue_length Longest queue the job can still wait through
+ * @return Duplicated backend name (CALLER MUST FREE) or NULL if no backend
+ *         qualifies
+ */
+char* select_fallback_backend(char* backends_data, CIRCUIT* circuits, int circuit_count, char* excluded, int max_queue_length) {
+    char* backend = NULL;
+
+    int qubit_count = 0;
+    for (int i = 0; i < circuit_count; i++) {
+        if (circuits[i].qubit_count > qubit_count) qubit_count = circuits[i].qubit_count;
+    }
+
+    cJSON* backends_data_cjson = cJSON_Parse(backends_data);
+    if (!backends_data_cjson) {
+        fprintf(stderr, "ERROR - Parsing backends data JSON failed in select_fallback_backend()!\n");
+        goto terminate;
+    }
+
+    cJSON* devices_cjson = cJSON_GetObjectItemCaseSensitive(backends_data_cjson, "devices");
+    if (!devices_cjson || !devices_cjson->child) {
+        fprintf(stderr, "ERROR - Parsing devices list failed in select_fallback_backend()!\n");
+        goto cleanup_backends_data_cjson;
+    }
+
+    int best_device_jobs = max_queue_length + 1;
+    char* best_device_name = NULL;
+
+    for (cJSON* device_cjson = devices_cjson->child; device_cjson; device_cjson = device_cjson->next) {
+        cJSON* device_name_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "name");
+        cJSON* device_jobs_cjson = cJSON_GetObjectItemCaseSensitive(device_cjson, "queue_length");
+        if (!cJSON_IsString(device_name_cjson) || !device_name_cjson->valuestring || !cJSON_IsNumber(device_jobs_cjson)) continue;
+        if (excluded && strcmp(device_name_cjson->valuestring, excluded) == 0) continue;
+
+        int device_jobs = device_jobs_cjson->valueint;
+        if (!is_usable_device(device_cjson, device_jobs, qubit_count)) continue;
+
+        if (device_jobs < best_device_jobs) {
+            best_device_jobs = device_jobs;
+            best_device_name = device_name_cjson->valuestring;
+        }
+    }
+
+    if (!best_device_name) {
+        fprintf(stderr, "ERROR - No other backend has a queue of at most %d jobs in select_fallback_backend()!\n", max_queue_length);
+        goto cleanup_backends_data_cjson;
+    }
+
+    backend = strdup(best_device_name);
 
 cleanup_backends_data_cjson:
     cJSON_Delete(backends_data_cjson);
@@ -176,24 +386,49 @@ terminate:
  * @brief Build job submission payload
  *
  * Constructs the JSON payload to submit a sampling job for the provided
- * backend and OpenQASM program.
+ * backend with one pub per OpenQASM program, so that a whole batch of
+ * circuits shares a single job and queue slot. Circuits with bindings are
+ * sent with their parameter values, so that a whole sweep is one pub, and
+ * circuits with a shot count carry it in their pub. A job submitted into a
+ * session names it, and its backend must be the one of the session.
  *
  * @param backend Backend name to target
- * @param qasm OpenQASM program string
+ * @param session_id Session to run the job in, or NULL for a standalone job
+ * @param circuits Array of circuits to submit
+ * @param circuit_count Number of circuits (and pubs)
  * @return JSON payload string (CALLER MUST FREE) or NULL
  */
-char* build_payload(char* backend, char* qasm) {
+char* build_payload(char* backend, char* session_id, CIRCUIT* circuits, int circuit_count) {
     char* payload = NULL;
 
     cJSON* root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "program_id", "sampler");
     cJSON_AddStringToObject(root, "backend", backend);
+    if (session_id) cJSON_AddStringToObject(root, "session_id", session_id);
 
     cJSON* params = cJSON_AddObjectToObject(root, "params");
     cJSON* pubs = cJSON_AddArrayToObject(params, "pubs");
-    cJSON* single_pub = cJSON_CreateArray();
-    cJSON_AddItemToArray(single_pub, cJSON_CreateString(qasm));
-    cJSON_AddItemToArray(pubs, single_pub);
+    for (int i = 0; i < circuit_count; i++) {
+        cJSON* pub = cJSON_CreateArray();
+        cJSON_AddItemToArray(pub, cJSON_CreateString(circuits[i].qasm));
+
+        // A swept circuit carries one row of parameter values per binding.
+
+        if (circuits[i].binding_count > 0) {
+            cJSON* bindings = cJSON_CreateArray();
+            for (int j = 0; j < circuits[i].binding_count; j++) {
+                double* values = &circuits[i].parameter_values[(size_t)j*circuits[i].parameter_count];
+                cJSON_AddItemToArray(bindings, cJSON_CreateDoubleArray(values, circuits[i].parameter_count));
+            }
+            cJSON_AddItemToArray(pub, bindings);
+        } else if (circuits[i].shots > 0) {
+            cJSON_AddItemToArray(pub, cJSON_CreateNull());
+        }
+
+        if (circuits[i].shots > 0) cJSON_AddItemToArray(pub, cJSON_CreateNumber(circuits[i].shots));
+
+        cJSON_AddItemToArray(pubs, pub);
+    }
 
     cJSON* options = cJSON_AddObjectToObject(params, "options");
     cJSON* dd = cJSON_AddObjectToObject(options, "dynamical_decoupling");
@@ -211,26 +446,20 @@ char* build_payload(char* backend, char* qasm) {
  * @brief Submit a job to the IBM Quantum jobs endpoint
  *
  * Posts the provided JSON payload to the jobs endpoint and returns the raw
- * response body when successful.
+ * response body when successful. Only failures that left the submission
+ * unsent are retried, so the job is created at most once.
  *
- * @param token_data Pointer to TOKEN_DATA with authentication token
- * @param crn Service CRN string
+ * @param pool Pointer to CONNECTION_POOL used for the request
  * @param payload JSON payload to submit
  * @return Response body string on success (CALLER MUST FREE) or NULL on error
  */
-char* submit_job(TOKEN_DATA* token_data, char* crn, char* payload) {
+char* submit_job(CONNECTION_POOL* pool, char* payload) {
     char* response = NULL;
 
-    char* token = copy_bearer_token(token_data);
-    if (!token) {
-        fprintf(stderr, "ERROR - Copying bearer token failed in submit_job()!\n");
-        goto terminate;
-    }
-
-    CURL* curl = curl_easy_init();
+    CURL* curl = acquire_handle(pool);
     if (!curl) {
-        fprintf(stderr, "ERROR - cURL initialization failed in submit_job()!\n");
-        goto cleanup_token;
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in submit_job()!\n");
+        goto terminate;
     }
 
     RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
@@ -239,71 +468,65 @@ char* submit_job(TOKEN_DATA* token_data, char* crn, char* payload) {
         goto cleanup_curl;
     }
 
-    char* token_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!token_header) {
-        fprintf(stderr, "ERROR - Allocating memory for token header failed in submit_job()!\n");
-        goto cleanup_rb;
-    }
+    // Every attempt carries the same idempotency key, for a service that deduplicates submissions.
 
-    char* crn_header = (char*)calloc(BUFFER_NMEMB, sizeof(char));
-    if (!crn_header) {
-        fprintf(stderr, "ERROR - Allocating memory for CRN header failed in submit_job()!\n");
-        goto cleanup_token_header;
-    }
+    char key[IDEMPOTENCY_KEY_NMEMB];
+    generate_idempotency_key(pool, key);
 
-    snprintf(token_header, BUFFER_NMEMB, "Authorization: Bearer %s", token);
-    snprintf(crn_header, BUFFER_NMEMB, "Service-CRN: %s", crn);
-
-    struct curl_slist* headers = NULL;
-    headers = curl_slist_append(headers, "Accept: application/json");
-    headers = curl_slist_append(headers, token_header);
-    headers = curl_slist_append(headers, crn_header);
-    headers = curl_slist_append(headers, "IBM-API-Version: 2026-02-01");
-    headers = curl_slist_append(headers, "Content-Type: application/json");
+    struct curl_slist* headers = build_idempotent_headers(get_api_headers(pool, true), key);
     if (!headers) {
         fprintf(stderr, "ERROR - Header construction failed in submit_job()!\n");
-        goto cleanup_crn_header;
+        goto cleanup_rb;
+    }
+
+    // The headers announce a compressed body when the pool compresses requests.
+
+    char* body = payload;
+    size_t body_size = strlen(payload);
+    char* compressed = NULL;
+    if (pool->compress_requests) {
+        compressed = compress_request_body(payload, body_size, &body_size);
+        if (!compressed) {
+            fprintf(stderr, "ERROR - Compressing the payload failed in submit_job()!\n");
+            goto cleanup_headers;
+        }
+        body = compressed;
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, "https://quantum.cloud.ibm.com/api/v1/jobs");
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/jobs", pool->api_url);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
     curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, payload);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body_size);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
     curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
     curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT_NAME);
 
-    CURLcode response_code = curl_easy_perform(curl);
     long http_code = 0;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+    CURLcode response_code = perform_request(pool, curl, PHASE_SUBMIT, true, &rb, &http_code);
     if (response_code != CURLE_OK || http_code >= 400) {
         fprintf(stderr, "ERROR - Job submission failed in submit_job()!\n");
         fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
         fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
         if (rb.data && rb.size > 0) fprintf(stderr, "ERROR - Response Body: %s\n", rb.data);
-        goto cleanup_headers;
+        goto cleanup_compressed;
     }
 
     response = strdup(rb.data);
 
+cleanup_compressed:
+    free(compressed);
+
 cleanup_headers:
     curl_slist_free_all(headers);
 
-cleanup_crn_header:
-    free(crn_header);
-
-cleanup_token_header:
-    free(token_header);
-
 cleanup_rb:
     free(rb.data);
 
 cleanup_curl:
-    curl_easy_cleanup(curl);
-
-cleanup_token:
-    free(token);
+    release_handle(pool, curl);
 
 terminate:
     return response;
@@ -345,44 +568,35 @@ terminate:
 
 
 /**
- * @brief High-level sender: select backend, submit job, return job id
+ * @brief High-level sender: submit job, return job id
  *
- * Waits for the authenticator to provide a token, selects a backend,
- * constructs the payload, submits the job and returns the job id.
+ * Constructs the payload for all circuits, waits for the authenticator to
+ * provide a token, submits the job and returns the job id.
  *
- * @param token_data Pointer to TOKEN_DATA used for authentication
- * @param crn Service CRN string
- * @param qasm OpenQASM program string to submit
+ * @param pool Pointer to CONNECTION_POOL used for the requests
+ * @param backend Backend to submit the job to
+ * @param session_id Session to submit the job into, or NULL
+ * @param circuits Array of circuits to submit as one job
+ * @param circuit_count Number of circuits
  * @return Duplicated job id string (CALLER MUST FREE) or NULL on failure
  */
-char* sender(TOKEN_DATA* token_data, char* crn, char* qasm) {
-    pthread_mutex_lock(&token_data->lock);
-    while (!token_data->token_received_bool) {
-        pthread_cond_wait(&token_data->token_received_cond, &token_data->lock);
-    }
-    pthread_mutex_unlock(&token_data->lock);
-
+char* sender(CONNECTION_POOL* pool, char* backend, char* session_id, CIRCUIT* circuits, int circuit_count) {
     char* job_id = NULL;
 
-    char* backends_data = get_backends_data(token_data, crn);
-    if (!backends_data) {
-        fprintf(stderr, "ERROR - Fetching backends data failed in sender()!\n");
+    double start_time = get_monotonic_time();
+    char* payload = build_payload(backend, session_id, circuits, circuit_count);
+    record_phase(pool->metrics, PHASE_PAYLOAD, get_monotonic_time() - start_time);
+    if (!payload) {
+        fprintf(stderr, "ERROR - Building payload for job submission failed in sender()!\n");
         goto terminate;
     }
 
-    char* backend = select_backend(backends_data);
-    if (!backend) {
-        fprintf(stderr, "ERROR - Selecting the backend device failed in sender()!\n");
-        goto cleanup_backends_data;
-    }
-
-    char* payload = build_payload(backend, qasm);
-    if (!payload) {
-        fprintf(stderr, "ERROR - Building payload for job submission failed in sender()!\n");
-        goto cleanup_backend;
+    if (wait_for_token(pool->token_data) < 0) {
+        fprintf(stderr, "ERROR - No bearer token is available in sender()!\n");
+        goto cleanup_payload;
     }
 
-    char* response = submit_job(token_data, crn, payload);
+    char* response = submit_job(pool, payload);
     if (!response) {
         fprintf(stderr, "ERROR - Getting a response from job submission failed in sender()!\n");
         goto cleanup_payload;
@@ -400,12 +614,6 @@ cleanup_response:
 cleanup_payload:
     free(payload);
 
-cleanup_backend:
-    free(backend);
-
-cleanup_backends_data:
-    free(backends_data);
-
 terminate:
     return job_id;
 }
@@ -1,12 +1,19 @@
 #ifndef _SENDER_H_
 #define _SENDER_H_
 
-char* get_backends_data(TOKEN_DATA* token_data, char* crn);
-char* select_backend(char* backends_data);
-char* build_payload(char* backend, char* qasm);
-char* submit_job(TOKEN_DATA* token_data, char* crn, char* payload);
+#define BACKEND_DEFAULT_TWO_Q_ERROR 0.01
+#define BACKEND_DEFAULT_READOUT_ERROR 0.02
+#define BACKEND_MIN_SUCCESS 1e-6
+
+char* get_backends_data(CONNECTION_POOL* pool);
+char* get_backend_properties_data(CONNECTION_POOL* pool, char* backend);
+int select_backends(char* backends_data, CIRCUIT* circuits, int circuit_count, char** backends, int max_count);
+char* select_backend(char* backends_data, CIRCUIT* circuits, int circuit_count);
+char* select_fallback_backend(char* backends_data, CIRCUIT* circuits, int circuit_count, char* excluded, int max_queue_length);
+char* build_payload(char* backend, char* session_id, CIRCUIT* circuits, int circuit_count);
+char* submit_job(CONNECTION_POOL* pool, char* payload);
 char* parse_job_id(char* response);
 
-char* sender(TOKEN_DATA* token_data, char* crn, char* qasm);
+char* sender(CONNECTION_POOL* pool, char* backend, char* session_id, CIRCUIT* circuits, int circuit_count);
 
 #endif
@@ -0,0 +1,366 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <curl/curl.h>
+#include <cjson/cJSON.h>
+#include <pthread.h>
+
+#include "metrics.h"
+#include "comm.h"
+#include "reader.h"
+#include "backends.h"
+#include "session.h"
+
+
+/**
+ * @brief Parse the name of a session execution mode
+ *
+ * @param name Mode name: dedicated, batch or off
+ * @param mode Output pointer receiving the mode
+ * @return 0 on success, or -1 for an unknown name
+ */
+int parse_session_mode(char* name, SESSION_MODE* mode) {
+    if (strcmp(name, "dedicated") == 0) *mode = SESSION_DEDICATED;
+    else if (strcmp(name, "batch") == 0) *mode = SESSION_BATCH;
+    else if (strcmp(name, "off") == 0) *mode = SESSION_OFF;
+    else return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Create the session shared by the jobs of a run
+ *
+ * No session is opened on the service until the first job enters it.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the session requests
+ * @param backend_cache Pointer to BACKEND_CACHE the session backend is
+ *        chosen from
+ * @param mode Execution mode of the session, not SESSION_OFF
+ * @param idle_timeout Seconds without jobs after which the session is
+ *        closed, or a negative value for SESSION_IDLE_TIMEOUT
+ * @return Pointer to newly allocated SESSION (CALLER MUST DESTROY), or NULL
+ *         on failure
+ */
+SESSION* create_session(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION_MODE mode, int idle_timeout) {
+    SESSION* session = (SESSION*)calloc(1, sizeof(SESSION));
+    if (!session) {
+        fprintf(stderr, "ERROR - Allocating memory for session failed in create_session()!\n");
+        return NULL;
+    }
+
+    session->pool = pool;
+    session->backend_cache = backend_cache;
+    session->mode = mode;
+    session->idle_timeout = idle_timeout < 0 ? SESSION_IDLE_TIMEOUT : idle_timeout;
+    pthread_mutex_init(&session->lock, NULL);
+
+    return session;
+}
+
+/**
+ * @brief Close the session on the service, if one is open
+ *
+ * The caller must hold the session lock.
+ *
+ * @param session Pointer to SESSION to close
+ */
+static void end_session(SESSION* session) {
+    if (!session->id) return;
+
+    if (close_session(session->pool, session->id) < 0) {
+        fprintf(stderr, "ERROR - Closing session %s failed in end_session()!\n", session->id);
+    }
+
+    free(session->id);
+    free(session->backend);
+    session->id = NULL;
+    session->backend = NULL;
+
+    return;
+}
+
+/**
+ * @brief Close the session on the service and destroy it
+ *
+ * @param session Pointer to SESSION to destroy, or NULL
+ */
+void destroy_session(SESSION* session) {
+    if (!session) return;
+
+    end_session(session);
+    pthread_mutex_destroy(&session->lock);
+    free(session);
+
+    return;
+}
+
+/**
+ * @brief Open a session on a backend of the service
+ *
+ * The service reserves the backend for the jobs of a dedicated session
+ * one after the other, and schedules the jobs of a batch session together,
+ * so that only the first job waits in the public queue.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the request
+ * @param backend Backend the session runs on
+ * @param mode Execution mode of the session
+ * @return Duplicated session id (CALLER MUST FREE), or NULL on failure
+ */
+char* open_session(CONNECTION_POOL* pool, char* backend, SESSION_MODE mode) {
+    char* session_id = NULL;
+
+    cJSON* request_cjson = cJSON_CreateObject();
+    cJSON_AddStringToObject(request_cjson, "backend", backend);
+    cJSON_AddStringToObject(request_cjson, "mode", mode == SESSION_BATCH ? "batch" : "dedicated");
+    cJSON_AddNumberToObject(request_cjson, "max_ttl", SESSION_MAX_TTL);
+    char* body = cJSON_PrintUnformatted(request_cjson);
+    cJSON_Delete(request_cjson);
+    if (!body) {
+        fprintf(stderr, "ERROR - Building the session request failed in open_session()!\n");
+        goto terminate;
+    }
+
+    CURL* curl = acquire_handle(pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in open_session()!\n");
+        goto cleanup_body;
+    }
+
+    RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
+    if (!rb.data) {
+        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in open_session()!\n");
+        goto cleanup_curl;
+    }
+
+    struct curl_slist* headers = get_api_headers(pool, true);
+    if (!headers) {
+        fprintf(stderr, "ERROR - Header construction failed in open_session()!\n");
+        goto cleanup_rb;
+    }
+
+    // The headers announce a compressed body when the pool compresses requests.
+
+    size_t body_size = strlen(body);
+    if (pool->compress_requests) {
+        char* compressed = compress_request_body(body, body_size, &body_size);
+        if (!compressed) {
+            fprintf(stderr, "ERROR - Compressing the session request failed in open_session()!\n");
+            goto cleanup_rb;
+        }
+        free(body);
+        body = compressed;
+    }
+
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/sessions", pool->api_url);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)body_size);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
+
+    long http_code = 0;
+    CURLcode response_code = perform_request(pool, curl, PHASE_SESSION, false, &rb, &http_code);
+    if (response_code != CURLE_OK || http_code >= 400) {
+        fprintf(stderr, "ERROR - Opening a session on %s failed in open_session()!\n", backend);
+        fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+        fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        if (rb.data && rb.size > 0) fprintf(stderr, "ERROR - Response Body: %s\n", rb.data);
+        goto cleanup_rb;
+    }
+
+    cJSON* response_cjson = cJSON_Parse(rb.data);
+    cJSON* id_cjson = cJSON_GetObjectItemCaseSensitive(response_cjson, "id");
+    if (cJSON_IsString(id_cjson) && id_cjson->valuestring) session_id = strdup(id_cjson->valuestring);
+    else fprintf(stderr, "ERROR - Parsing the session ID failed in open_session()!\n");
+    cJSON_Delete(response_cjson);
+
+cleanup_rb:
+    free(rb.data);
+
+cleanup_curl:
+    release_handle(pool, curl);
+
+cleanup_body:
+    free(body);
+
+terminate:
+    return session_id;
+}
+
+/**
+ * @brief Close a session so that it accepts no more jobs
+ *
+ * Jobs already submitted to the session still run.
+ *
+ * @param pool Pointer to CONNECTION_POOL used for the request
+ * @param session_id Id of the session to close
+ * @return 0 on success, or -1 on failure
+ */
+int close_session(CONNECTION_POOL* pool, char* session_id) {
+    int status = -1;
+
+    CURL* curl = acquire_handle(pool);
+    if (!curl) {
+        fprintf(stderr, "ERROR - Acquiring a cURL handle failed in close_session()!\n");
+        goto terminate;
+    }
+
+    RESPONSE_BUFFER rb = {(char*)calloc(1, sizeof(char)), 0};
+    if (!rb.data) {
+        fprintf(stderr, "ERROR - Allocating memory for response buffer failed in close_session()!\n");
+        goto cleanup_curl;
+    }
+
+    struct curl_slist* headers = get_api_headers(pool, false);
+    if (!headers) {
+        fprintf(stderr, "ERROR - Header construction failed in close_session()!\n");
+        goto cleanup_rb;
+    }
+
+    char url[BUFFER_NMEMB];
+    snprintf(url, BUFFER_NMEMB, "%s/sessions/%s/close", pool->api_url, session_id);
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &rb);
+
+    long http_code = 0;
+    CURLcode response_code = perform_request(pool, curl, PHASE_SESSION, false, &rb, &http_code);
+    if (response_code != CURLE_OK || http_code >= 400) {
+        fprintf(stderr, "ERROR - cURL Error: %s\n", curl_easy_strerror(response_code));
+        fprintf(stderr, "ERROR - HTTP Code: %ld\n", http_code);
+        goto cleanup_rb;
+    }
+
+    status = 0;
+
+cleanup_rb:
+    free(rb.data);
+
+cleanup_curl:
+    release_handle(pool, curl);
+
+terminate:
+    return status;
+}
+
+/**
+ * @brief Check whether the open session has been idle for too long
+ *
+ * The caller must hold the session lock.
+ *
+ * @param session Pointer to SESSION to check
+ * @return true if an open session with no users exceeded its idle timeout
+ */
+static bool is_session_idle(SESSION* session) {
+    if (!session->id || session->user_count > 0) return false;
+
+    return get_monotonic_time() - session->last_used_time > session->idle_timeout;
+}
+
+/**
+ * @brief Enter the session to submit jobs into it
+ *
+ * Reuses the open session unless it has been idle for longer than the
+ * idle timeout, in which case it is closed and a new one is opened. A new
+ * session runs on the backend chosen for the given circuits; later jobs
+ * run on that backend too. Every call must be paired with
+ * leave_session().
+ *
+ * @param session Pointer to SESSION to enter
+ * @param circuits Array of circuits of the first job
+ * @param circuit_count Number of circuits
+ * @param backend Output pointer receiving the duplicated session backend
+ *        (CALLER MUST FREE)
+ * @return Duplicated session id (CALLER MUST FREE), or NULL on failure
+ */
+char* enter_session(SESSION* session, CIRCUIT* circuits, int circuit_count, char** backend) {
+    char* session_id = NULL;
+
+    pthread_mutex_lock(&session->lock);
+
+    if (is_session_idle(session)) end_session(session);
+
+    if (!session->id) {
+        session->backend = choose_backend(session->backend_cache, circuits, circuit_count);
+        if (!session->backend) {
+            fprintf(stderr, "ERROR - Choosing the session backend failed in enter_session()!\n");
+            goto unlock;
+        }
+
+        if (wait_for_token(session->pool->token_data) < 0) {
+            fprintf(stderr, "ERROR - No bearer token is available in enter_session()!\n");
+            free(session->backend);
+            session->backend = NULL;
+            goto unlock;
+        }
+
+        session->id = open_session(session->pool, session->backend, session->mode);
+        if (!session->id) {
+            fprintf(stderr, "ERROR - Opening the session failed in enter_session()!\n");
+            free(session->backend);
+            session->backend = NULL;
+            goto unlock;
+        }
+    }
+
+    session_id = strdup(session->id);
+    *backend = strdup(session->backend);
+    if (!session_id || !*backend) {
+        fprintf(stderr, "ERROR - Copying the session failed in enter_session()!\n");
+        free(session_id);
+        free(*backend);
+        session_id = NULL;
+        *backend = NULL;
+        goto unlock;
+    }
+    session->user_count++;
+
+unlock:
+    pthread_mutex_unlock(&session->lock);
+
+    return session_id;
+}
+
+/**
+ * @brief Leave a session entered with enter_session()
+ *
+ * The idle timeout of the session counts from the last call.
+ *
+ * @param session Pointer to SESSION to leave
+ */
+void leave_session(SESSION* session) {
+    pthread_mutex_lock(&session->lock);
+    session->user_count--;
+    session->last_used_time = get_monotonic_time();
+    pthread_mutex_unlock(&session->lock);
+
+    return;
+}
+
+/**
+ * @brief Close the session if it has been idle for too long
+ *
+ * Lets a long-running process give up a backend reservation it no longer
+ * uses.
+ *
+ * @param session Pointer to SESSION to check, or NULL
+ */
+void expire_session(SESSION* session) {
+    if (!session) return;
+
+    pthread_mutex_lock(&session->lock);
+    if (is_session_idle(session)) end_session(session);
+    pthread_mutex_unlock(&session->lock);
+
+    return;
+}
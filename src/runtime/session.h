@@ -0,0 +1,39 @@
+#ifndef _SESSION_H_
+#define _SESSION_H_
+
+#define SESSION_IDLE_TIMEOUT 60
+#define SESSION_MAX_TTL 28800
+
+typedef enum SessionMode {
+    SESSION_OFF,
+    SESSION_DEDICATED,
+    SESSION_BATCH
+} SESSION_MODE;
+
+typedef struct Session {
+    CONNECTION_POOL* pool;
+    BACKEND_CACHE* backend_cache;
+    SESSION_MODE mode;
+    int idle_timeout;
+
+    char* id;
+    char* backend;
+    int user_count;
+    double last_used_time;
+
+    pthread_mutex_t lock;
+} SESSION;
+
+int parse_session_mode(char* name, SESSION_MODE* mode);
+
+SESSION* create_session(CONNECTION_POOL* pool, BACKEND_CACHE* backend_cache, SESSION_MODE mode, int idle_timeout);
+void destroy_session(SESSION* session);
+
+char* open_session(CONNECTION_POOL* pool, char* backend, SESSION_MODE mode);
+int close_session(CONNECTION_POOL* pool, char* session_id);
+
+char* enter_session(SESSION* session, CIRCUIT* circuits, int circuit_count, char** backend);
+void leave_session(SESSION* session);
+void expire_session(SESSION* session);
+
+#endif